@@ -0,0 +1,85 @@
+#include "bench.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../rlc/rlc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * global_rlc_dl_entity - Downlink RLC entity used by the loopback path
+ *
+ * Defined here because the benchmark binary replaces main.c.
+ */
+rlc_entity_t *global_rlc_dl_entity = NULL;
+
+uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t bench_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return bench_now_ns();
+#endif
+}
+
+double bench_cycles_per_ns(void) {
+    static double ratio = 0.0;
+    if (ratio == 0.0) {
+        uint64_t t0 = bench_now_ns(), c0 = bench_cycles();
+        while (bench_now_ns() - t0 < 50000000ull)
+            ;
+        ratio = (double)(bench_cycles() - c0) / (double)(bench_now_ns() - t0);
+    }
+    return ratio;
+}
+
+static const struct {
+    const char *name;
+    void (*run)(void);
+} benchmarks[] = {
+    { "cipher", bench_cipher },
+    { "rohc", bench_rohc },
+    { "burst", bench_pdcp_burst },
+    { "offload", bench_offload },
+    { "rlc_am", bench_rlc_am },
+    { "grant", bench_rlc_grant },
+    { "spsc", bench_rlc_spsc },
+    { "timer", bench_timer },
+    { "lcp", bench_lcp },
+    { "bsr", bench_mac_bsr },
+    { "encode", bench_mac_encode },
+    { "demux", bench_mac_demux },
+    { "sched", bench_mac_sched },
+    { "harq", bench_harq },
+    { "combine", bench_harq_combine },
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+int main(int argc, char **argv) {
+    int ran = 0;
+    for (size_t i = 0; i < NUM_BENCHMARKS; i++) {
+        int selected = (argc < 2);
+        for (int a = 1; a < argc; a++)
+            if (strcmp(argv[a], benchmarks[i].name) == 0) selected = 1;
+        if (!selected) continue;
+        printf("=== Benchmark: %s ===\n", benchmarks[i].name);
+        benchmarks[i].run();
+        ran++;
+    }
+    if (ran == 0) {
+        printf("Usage: %s [benchmark...]\nAvailable:", argv[0]);
+        for (size_t i = 0; i < NUM_BENCHMARKS; i++)
+            printf(" %s", benchmarks[i].name);
+        printf("\n");
+        return 1;
+    }
+    return 0;
+}
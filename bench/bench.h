@@ -0,0 +1,106 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * bench_now_ns - Monotonic wall-clock time
+ *
+ * Return: Current CLOCK_MONOTONIC time in nanoseconds
+ */
+uint64_t bench_now_ns(void);
+
+/**
+ * bench_cycles - CPU timestamp counter
+ *
+ * Return: Current TSC value (reference cycles), or nanoseconds on
+ * targets without a TSC
+ */
+uint64_t bench_cycles(void);
+
+/**
+ * bench_cycles_per_ns - Calibrate the timestamp counter
+ *
+ * Return: TSC ticks per nanosecond, measured once and cached
+ */
+double bench_cycles_per_ns(void);
+
+/* Individual benchmarks, each printing its own report */
+
+/**
+ * bench_cipher - NEA2 cycles per byte for the available AES engines
+ */
+void bench_cipher(void);
+
+/**
+ * bench_rohc - Header bytes saved per flow and ROHC ns per packet
+ */
+void bench_rohc(void);
+
+/**
+ * bench_pdcp_burst - PDCP TX/RX throughput for burst sizes 1/8/32/128
+ */
+void bench_pdcp_burst(void);
+
+/**
+ * bench_offload - PDCP throughput with 1..8 crypto workers against the inline path
+ */
+void bench_offload(void);
+
+/**
+ * bench_rlc_am - RLC AM goodput and delivery latency over a lossy loopback
+ */
+void bench_rlc_am(void);
+
+/**
+ * bench_rlc_grant - Grant fill ratio and padding of the RLC PDU builder per SDU mix
+ */
+void bench_rlc_grant(void);
+
+/**
+ * bench_rlc_spsc - RLC SDU queue throughput and cache misses across two threads
+ */
+void bench_rlc_spsc(void);
+
+/**
+ * bench_timer - Timer wheel arm/cancel and per-tick expiry cost for 1k..100k bearers
+ */
+void bench_timer(void);
+
+/**
+ * bench_lcp - Logical channel prioritization decisions per second for 1k/10k UEs
+ */
+void bench_lcp(void);
+
+/**
+ * bench_mac_bsr - BSR and SR from the LCG counters, ns per TB and formats sent for 4/8/32 channels
+ */
+void bench_mac_bsr(void);
+
+/**
+ * bench_mac_encode - MAC PDU encoding ns per TB for 10 to 200 subPDUs
+ */
+void bench_mac_encode(void);
+
+/**
+ * bench_mac_demux - DL MAC PDU parse and dispatch throughput for 10 to 1000 subPDUs
+ */
+void bench_mac_demux(void);
+
+/**
+ * bench_mac_sched - Slot scheduling time for 100/1k/10k UEs against a 500 us slot
+ */
+void bench_mac_sched(void);
+
+/**
+ * bench_harq - UL throughput against HARQ RTT with 1, 8 and 16 processes over the loopback channel
+ */
+void bench_harq(void);
+
+/**
+ * bench_harq_combine - Soft-buffer LLR combining GB/s, scalar against SSE2 and AVX2
+ */
+void bench_harq_combine(void);
+
+#endif /* BENCH_H */
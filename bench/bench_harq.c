@@ -0,0 +1,116 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../harq/harq.h"
+#include "../loopback/loopback.h"
+#include "../timer/timer.h"
+
+#define HARQ_BENCH_SLOTS  20000     /* 1 ms slots per point */
+#define HARQ_BENCH_TBS    12000     /* Bytes per UL grant, one grant per slot */
+#define HARQ_FB_RING      64        /* Feedback in flight, at most one per process */
+
+static const uint32_t harq_rtts[] = { 1, 2, 4, 8, 16, 32 };
+static const int harq_procs[] = { 1, 8, 16 };
+
+static const struct {
+    const char *name;
+    uint32_t loss_ppm;
+} harq_blers[] = {
+    { "0%", 0 },
+    { "10%", 100000 },
+};
+
+static loopback_channel_t channel;
+static harq_fb_queue_t feedback;
+
+/* Decode outcome of each TB on the channel: the feedback to return when it is due */
+static void channel_tx(harq_process_t *proc) {
+    uint64_t lost = channel.stats.lost;
+    loopback_channel_send(&channel, pktbuf_ref(proc->tb), proc->tx_slot);
+    harq_fb_push(&feedback, proc, channel.stats.lost == lost);
+}
+
+typedef struct {
+    uint64_t acked;
+    uint64_t lost;
+    uint64_t retx;
+    uint64_t stalls;
+    uint64_t ns;
+} harq_result_t;
+
+/*
+ * One UL grant per slot. The channel delays every TB by the HARQ RTT,
+ * and the feedback queue returns its outcome as it is delivered (or
+ * would have been), just when the process's HARQ RTT timer runs out.
+ */
+static void run_point(pktbuf_t *tb, int num_processes, uint32_t rtt, uint32_t loss_ppm, harq_result_t *res) {
+    timer_wheel_t *wheel = timer_get_wheel();
+    harq_entity_t ent;
+    memset(res, 0, sizeof(*res));
+    if (harq_entity_init(&ent, num_processes, rtt) < 0) return;
+    if (loopback_channel_init(&channel, HARQ_FB_RING, rtt, loss_ppm, 1, 0x4a11 + rtt) < 0) return;
+    if (harq_fb_queue_init(&feedback, HARQ_FB_RING, rtt) < 0) {
+        loopback_channel_free(&channel);
+        return;
+    }
+
+    uint64_t t0 = bench_now_ns();
+    for (int t = 0; t < HARQ_BENCH_SLOTS; t++) {
+        timer_wheel_tick(wheel);
+        loopback_channel_deliver(&channel, timer_now(wheel), NULL);
+        harq_fb_drain(&feedback, timer_now(wheel));
+
+        harq_process_t *proc = harq_select(&ent);
+        if (!proc) {
+            res->stalls++;
+        } else if (proc->state == HARQ_IDLE) {
+            harq_ul_start_tx(proc, pktbuf_ref(tb));
+        } else {
+            harq_ul_retransmit(proc);
+            res->retx++;
+        }
+    }
+    res->ns = bench_now_ns() - t0;
+    res->acked = feedback.stats.acks;
+    res->lost = feedback.stats.failures;
+
+    harq_entity_release(&ent);
+    harq_fb_queue_free(&feedback);
+    loopback_channel_free(&channel);
+}
+
+void bench_harq(void) {
+    pktbuf_t *tb = pktbuf_alloc(HARQ_BENCH_TBS);
+    if (!tb) return;
+    memset(pktbuf_append(tb, HARQ_BENCH_TBS), 0x5a, HARQ_BENCH_TBS);
+    harq_set_ul_tx_callback(channel_tx);
+
+    printf("UL HARQ over the loopback channel: one %d-byte TB per 1 ms slot, %d slots per point\n",
+           HARQ_BENCH_TBS, HARQ_BENCH_SLOTS);
+    for (size_t b = 0; b < sizeof(harq_blers) / sizeof(harq_blers[0]); b++) {
+        printf("BLER %s\n", harq_blers[b].name);
+        printf("%5s", "RTT");
+        for (size_t p = 0; p < sizeof(harq_procs) / sizeof(harq_procs[0]); p++)
+            printf("  %2d proc Mbps", harq_procs[p]);
+        printf(" %8s %8s %8s %8s\n", "stall%", "retx%", "lost", "ns/slot");
+        for (size_t r = 0; r < sizeof(harq_rtts) / sizeof(harq_rtts[0]); r++) {
+            harq_result_t res;
+            printf("%5u", harq_rtts[r]);
+            for (size_t p = 0; p < sizeof(harq_procs) / sizeof(harq_procs[0]); p++) {
+                run_point(tb, harq_procs[p], harq_rtts[r], harq_blers[b].loss_ppm, &res);
+                printf(" %13.1f", (double)res.acked * HARQ_BENCH_TBS * 8 / (HARQ_BENCH_SLOTS * 1e-3) / 1e6);
+            }
+            /* The last point is the largest pool */
+            printf(" %7.1f%% %7.1f%% %8llu %8.1f\n", 100.0 * (double)res.stalls / HARQ_BENCH_SLOTS,
+                   100.0 * (double)res.retx / HARQ_BENCH_SLOTS, (unsigned long long)res.lost,
+                   (double)res.ns / HARQ_BENCH_SLOTS);
+        }
+    }
+    printf("RTT is in slots; a process is busy from its transmission to the feedback. stall%% and retx%% are the"
+           " slots\nwith every process waiting and the grants spent on retransmissions, lost the TBs NACKed after"
+           " %d\nretransmissions, for the largest pool.\n", HARQ_MAX_RETX);
+
+    harq_set_ul_tx_callback(NULL);
+    pktbuf_free(tb);
+}
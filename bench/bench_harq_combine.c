@@ -0,0 +1,102 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "../harq/harq.h"
+
+#define COMBINE_BYTES  (1u << 30)   /* LLRs combined per point */
+
+/* One code block, a 100 PRB TB, the largest TB's soft buffer, and a pool of them out of cache */
+static const struct {
+    const char *name;
+    size_t llrs;
+} combine_sizes[] = {
+    { "1 CB", 25344 },
+    { "small TB", 202752 },
+    { "max TB", 1277952 },
+    { "16 TBs", 16 * 1277952 },
+};
+
+static const struct {
+    const char *name;
+    harq_llr_engine_t engine;
+} combine_engines[] = {
+    { "scalar", HARQ_LLR_SCALAR },
+    { "SSE2", HARQ_LLR_SSE2 },
+    { "AVX2", HARQ_LLR_AVX2 },
+};
+
+#define NUM_ENGINES (sizeof(combine_engines) / sizeof(combine_engines[0]))
+
+/* Every engine must saturate like the scalar one, tails included */
+static int check_engine(harq_llr_engine_t engine, const int8_t *llrs) {
+    int8_t ref[1000], out[1000];
+    for (size_t i = 0; i < sizeof(ref); i++)
+        ref[i] = out[i] = llrs[sizeof(ref) + i];
+    harq_llr_select_engine(HARQ_LLR_SCALAR);
+    harq_soft_combine(ref, sizeof(ref), 331, llrs, 999);
+    harq_llr_select_engine(engine);
+    harq_soft_combine(out, sizeof(out), 331, llrs, 999);
+    for (size_t i = 0; i < sizeof(ref); i++)
+        if (ref[i] != out[i]) return -1;
+    return 0;
+}
+
+/* GB/s of LLRs combined, rv 0 (Chase) or rv 2 (IR, wrapping past the buffer end) */
+static double run_point(int8_t *soft, const int8_t *llrs, size_t n, int rv) {
+    size_t k = harq_rv_start(n, rv);
+    size_t iters = COMBINE_BYTES / n ? COMBINE_BYTES / n : 1;
+    harq_soft_combine(soft, n, k, llrs, n);
+    uint64_t t0 = bench_now_ns();
+    for (size_t i = 0; i < iters; i++)
+        harq_soft_combine(soft, n, k, llrs, n);
+    uint64_t ns = bench_now_ns() - t0;
+    return (double)(iters * n) / (double)(ns ? ns : 1);
+}
+
+void bench_harq_combine(void) {
+    size_t max = combine_sizes[sizeof(combine_sizes) / sizeof(combine_sizes[0]) - 1].llrs;
+    int8_t *soft = malloc(max);
+    int8_t *llrs = malloc(max);
+    if (!soft || !llrs) {
+        free(soft);
+        free(llrs);
+        return;
+    }
+    uint32_t rng = 0x11a2b3c4;
+    for (size_t i = 0; i < max; i++) {
+        rng = rng * 1664525u + 1013904223u;
+        llrs[i] = (int8_t)(rng >> 24);
+        soft[i] = 0;
+    }
+
+    const char *automatic = harq_llr_engine_name();
+    printf("HARQ soft combining: saturating int8 LLR add, one LLR per coded bit (GB/s of LLRs)\n");
+    printf("%-9s %10s %4s", "buffer", "LLRs", "rv");
+    for (size_t e = 0; e < NUM_ENGINES; e++)
+        printf(" %9s", combine_engines[e].name);
+    printf("\n");
+    for (size_t s = 0; s < sizeof(combine_sizes) / sizeof(combine_sizes[0]); s++) {
+        for (int rv = 0; rv <= 2; rv += 2) {
+            printf("%-9s %10zu %4d", combine_sizes[s].name, combine_sizes[s].llrs, rv);
+            for (size_t e = 0; e < NUM_ENGINES; e++) {
+                if (harq_llr_select_engine(combine_engines[e].engine) < 0) {
+                    printf(" %9s", "n/a");
+                    continue;
+                }
+                if (check_engine(combine_engines[e].engine, llrs) < 0) {
+                    printf(" %9s", "MISMATCH");
+                    continue;
+                }
+                printf(" %9.2f", run_point(soft, llrs, combine_sizes[s].llrs, rv));
+            }
+            printf("\n");
+        }
+    }
+    printf("rv 2 starts at k0 = 33 Zc and wraps past the buffer end, so it combines as two runs.\n"
+           "The engine picked automatically on this CPU is %s.\n", automatic);
+    for (size_t e = NUM_ENGINES; e-- > 0;)
+        if (harq_llr_select_engine(combine_engines[e].engine) == 0) break;
+
+    free(soft);
+    free(llrs);
+}
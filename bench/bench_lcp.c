@@ -0,0 +1,87 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "../mac/mac.h"
+#include "../timer/timer.h"
+
+#define LCP_SLOTS      200          /* 1 ms slots per row, one grant per UE each */
+#define LCP_BACKLOG    20000        /* Bytes queued per DRB; the decisions leave the buffers alone */
+#define LCP_SRB_BYTES  200          /* Signalling queued per SRB */
+
+static const int lcp_ues[] = { 1000, 10000 };
+static const int lcp_channels[] = { 4, 8, 32 };
+
+/*
+ * Channel j of a UE: two SRBs first, with the highest priorities and
+ * unlimited PBR, then DRBs with 8 to 256 kB/s over 50 to 1000 ms. DRB
+ * priorities run opposite to the array so mac_lcp_init() has to
+ * reorder them.
+ */
+static void setup_ue(logical_channel_t *lc, int n) {
+    static const uint32_t pbr[] = { 8, 16, 32, 64, 128, 256 };
+    static const uint32_t bsd[] = { 50, 100, 300, 1000 };
+    for (int j = 0; j < n; j++) {
+        lc[j].channel_id = j + 1;
+        lc[j].type = j < 2 ? LC_TYPE_DCCH : LC_TYPE_DTCH;
+        lc[j].priority = j < 2 ? j + 1 : n - j + 2;
+        lc[j].rlc = NULL;
+        /* One DRB in four idle, as bearers without traffic are */
+        lc[j].buffer_size = j < 2 ? LCP_SRB_BYTES : (j & 3) == 2 ? 0 : LCP_BACKLOG;
+        lc[j].pbr = j < 2 ? MAC_PBR_INFINITY : pbr[j % 6];
+        lc[j].bsd = bsd[j % 4];
+    }
+}
+
+static void run_row(int num_ues, int num_channels) {
+    timer_wheel_t *wheel = timer_get_wheel();
+    logical_channel_t *lcs = calloc((size_t)num_ues * num_channels, sizeof(logical_channel_t));
+    mac_lcp_t *ues = calloc((size_t)num_ues, sizeof(mac_lcp_t));
+    if (!lcs || !ues) goto out;
+    for (int u = 0; u < num_ues; u++) {
+        setup_ue(&lcs[(size_t)u * num_channels], num_channels);
+        mac_lcp_init(&ues[u], &lcs[(size_t)u * num_channels], num_channels);
+    }
+
+    size_t alloc[MAC_MAX_LCH];
+    uint32_t rng = 0x9e3779b9u;
+    uint64_t ns = 0, decisions = 0, granted = 0, used = 0, over = 0, srb = 0, top = 0;
+    for (int t = 0; t < LCP_SLOTS; t++) {
+        timer_wheel_tick(wheel);
+        uint64_t t0 = bench_now_ns();
+        for (int u = 0; u < num_ues; u++) {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            size_t grant = 64 + (rng & 8191);
+            size_t n = mac_lcp_allocate(&ues[u], grant, alloc);
+            decisions++;
+            granted += grant;
+            used += n;
+            over += n > grant;
+            srb += alloc[0] + alloc[1];
+            /* Highest priority DRB, the last in the array */
+            top += alloc[num_channels - 1];
+        }
+        ns += bench_now_ns() - t0;
+    }
+    printf("%6d %4d %10.1f %10.2f %7.1f%% %7.1f%% %7.1f%% %6llu\n", num_ues, num_channels,
+           (double)ns / (double)decisions, (double)decisions * 1e3 / (double)ns,
+           100.0 * (double)used / (double)granted, 100.0 * (double)srb / (double)used,
+           100.0 * (double)top / (double)used, (unsigned long long)over);
+
+out:
+    free(lcs);
+    free(ues);
+}
+
+void bench_lcp(void) {
+    printf("LCP decisions: one grant of 64-8255 bytes per UE per 1 ms slot, %d slots,"
+           " 2 SRBs and 3 of 4 DRBs backlogged\n", LCP_SLOTS);
+    printf("%6s %4s %10s %10s %8s %8s %8s %6s\n", "UEs", "LCHs", "ns/dec", "Mdec/s", "fill", "SRBs", "top DRB",
+           "over");
+    for (size_t u = 0; u < sizeof(lcp_ues) / sizeof(lcp_ues[0]); u++)
+        for (size_t c = 0; c < sizeof(lcp_channels) / sizeof(lcp_channels[0]); c++)
+            run_row(lcp_ues[u], lcp_channels[c]);
+    printf("fill is grant bytes used; SRBs and top DRB are shares of the bytes sent; over counts grants"
+           " exceeded.\n");
+}
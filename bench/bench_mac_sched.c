@@ -0,0 +1,119 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "../mac/mac.h"
+
+#define SCHED_SLOTS      4000       /* 2 s of 0.5 ms slots per row */
+#define SCHED_BUDGET_NS  500000     /* 30 kHz SCS slot */
+#define SCHED_PRBS       273        /* 100 MHz carrier */
+#define SCHED_GRANTS     16         /* PDCCH capacity per slot */
+#define SCHED_LOAD_PCT   95         /* Offered load against the cell capacity */
+
+static const int sched_ues[] = { 100, 1000, 10000 };
+
+static uint32_t xorshift(uint32_t *rng) {
+    *rng ^= *rng << 13;
+    *rng ^= *rng >> 17;
+    *rng ^= *rng << 5;
+    return *rng;
+}
+
+/* MCS spread from cell edge to cell centre: 16 to 160 bytes per PRB */
+static uint32_t random_mcs(uint32_t *rng) {
+    return 16 + xorshift(rng) % 145;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int cmp_key_desc(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x < y) - (x > y);
+}
+
+/* What incremental maintenance avoids: re-deriving every key and sorting each slot. */
+static uint64_t full_sort_ns(const mac_sched_t *sched, double *keys) {
+    uint64_t t0 = bench_now_ns();
+    int n = 0;
+    for (int i = 0; i < sched->num_ues; i++) {
+        const mac_sched_ue_t *ue = &sched->ues[i];
+        if (ue->buffered == 0) continue;
+        keys[n++] = sched->policy == MAC_SCHED_PF ? (double)ue->bytes_per_prb / ue->avg : -(double)ue->last_slot;
+    }
+    qsort(keys, (size_t)n, sizeof(double), cmp_key_desc);
+    return bench_now_ns() - t0;
+}
+
+static void run_row(int num_ues, mac_sched_policy_t policy) {
+    mac_sched_t sched;
+    mac_grant_t grants[SCHED_GRANTS];
+    uint64_t *slot_ns = calloc(SCHED_SLOTS, sizeof(uint64_t));
+    double *keys = calloc((size_t)num_ues, sizeof(double));
+    uint32_t rng = 0x9e3779b9u ^ (uint32_t)num_ues;
+    if (!slot_ns || !keys || mac_sched_init(&sched, DIRECTION_DOWNLINK, policy, num_ues, SCHED_PRBS,
+                                            SCHED_GRANTS) < 0) {
+        free(slot_ns);
+        free(keys);
+        return;
+    }
+    for (int i = 0; i < num_ues; i++)
+        mac_sched_add_ue(&sched, random_mcs(&rng));
+
+    /* 5% of the UEs get data each slot, together SCHED_LOAD_PCT of an average UE's full carrier */
+    int arrivals = num_ues / 20 ? num_ues / 20 : 1;
+    size_t burst = (size_t)SCHED_PRBS * 88 * SCHED_LOAD_PCT / 100 / (size_t)arrivals + 1;
+    uint64_t sort_ns = 0, granted = 0, over = 0;
+    for (int t = 0; t < SCHED_SLOTS; t++) {
+        uint64_t t0 = bench_now_ns();
+        for (int a = 0; a < arrivals; a++) {
+            int id = (int)(xorshift(&rng) % (uint32_t)num_ues);
+            mac_sched_ue_t *ue = &sched.ues[id];
+            /* One UE in eight also reports a new CQI */
+            uint32_t mcs = (rng & 0x700) ? ue->bytes_per_prb : random_mcs(&rng);
+            mac_sched_update(&sched, id, ue->buffered + burst, mcs);
+        }
+        int n = mac_sched_run(&sched, grants);
+        slot_ns[t] = bench_now_ns() - t0;
+        over += slot_ns[t] > SCHED_BUDGET_NS;
+        for (int g = 0; g < n; g++)
+            granted += grants[g].tbs;
+        sort_ns += full_sort_ns(&sched, keys);
+    }
+
+    /* Jain's index of the bytes served per UE */
+    double sum = 0, sq = 0;
+    for (int i = 0; i < num_ues; i++) {
+        double x = (double)sched.ues[i].served;
+        sum += x;
+        sq += x * x;
+    }
+    uint64_t total = 0;
+    for (int t = 0; t < SCHED_SLOTS; t++)
+        total += slot_ns[t];
+    qsort(slot_ns, SCHED_SLOTS, sizeof(uint64_t), cmp_u64);
+    printf("%6d %3s %9.2f %9.2f %9.2f %8.3f%% %11.2f %9.0f %6.3f %5llu\n", num_ues,
+           policy == MAC_SCHED_PF ? "PF" : "RR", (double)total / SCHED_SLOTS / 1e3,
+           (double)slot_ns[SCHED_SLOTS * 99 / 100] / 1e3, (double)slot_ns[SCHED_SLOTS - 1] / 1e3,
+           100.0 * (double)total / SCHED_SLOTS / SCHED_BUDGET_NS, (double)sort_ns / SCHED_SLOTS / 1e3,
+           (double)granted * 8 / (SCHED_SLOTS * 0.5e-3) / 1e6, sq > 0 ? sum * sum / (num_ues * sq) : 0.0,
+           (unsigned long long)over);
+
+    mac_sched_free(&sched);
+    free(slot_ns);
+    free(keys);
+}
+
+void bench_mac_sched(void) {
+    printf("DL slot scheduler: %d PRBs, %d grants per slot, %d%% offered load, %d slots of %d us\n",
+           SCHED_PRBS, SCHED_GRANTS, SCHED_LOAD_PCT, SCHED_SLOTS, SCHED_BUDGET_NS / 1000);
+    printf("%6s %3s %9s %9s %9s %9s %11s %9s %6s %5s\n", "UEs", "", "mean us", "p99 us", "max us", "budget",
+           "full sort us", "Mbps", "Jain", "over");
+    for (size_t i = 0; i < sizeof(sched_ues) / sizeof(sched_ues[0]); i++) {
+        run_row(sched_ues[i], MAC_SCHED_RR);
+        run_row(sched_ues[i], MAC_SCHED_PF);
+    }
+    printf("Slot times include the buffer and CQI updates; budget is the mean share of a slot, over the slots"
+           " past it.\nfull sort us is the cost of re-deriving and sorting every UE's priority each slot instead.\n");
+}
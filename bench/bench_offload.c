@@ -0,0 +1,149 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "../ipgen/ipgen.h"
+#include "../pdcp/pdcp.h"
+
+#define OFFLOAD_POOL     8192   /* SDUs generated per round, outside the timed region */
+#define OFFLOAD_ROUNDS   4
+#define OFFLOAD_BURST    32
+#define OFFLOAD_PAYLOAD  1400   /* UDP payload: 1428-byte IPv4 SDUs */
+
+static const unsigned worker_counts[] = { 1, 2, 4, 8 };
+
+/* Demo NIA2 key (TS 33.401 C.2 test set 2). */
+static const uint8_t offload_ik[SEC_KEY_LEN] = {
+    0xd3, 0xc5, 0xd5, 0x92, 0x32, 0x7f, 0xb1, 0x1c,
+    0x40, 0x35, 0xc6, 0x68, 0x0a, 0xf8, 0xc6, 0xd1
+};
+
+static pktbuf_t **tx_out;       /* PDUs in the order they reached "RLC" */
+static size_t tx_out_n;
+static uint32_t expected_count;
+static size_t delivered;
+static size_t out_of_order;
+
+static void collect_pdu(pdcp_entity_t *entity, pktbuf_t *pdu) {
+    (void)entity;
+    /* 12-bit SN: PDUs must reach RLC with consecutive SNs. */
+    uint32_t sn = ((uint32_t)(pdu->data[0] & 0x0F) << 8) | pdu->data[1];
+    if (sn != (expected_count++ & 0xFFF))
+        out_of_order++;
+    tx_out[tx_out_n++] = pdu;
+}
+
+static void count_sdus(const pdcp_sdu_t *sdus, size_t num_sdus) {
+    (void)sdus;
+    delivered += num_sdus;
+}
+
+static void fill_pool(pktbuf_t **pkts) {
+    static uint8_t payload[OFFLOAD_PAYLOAD];
+    memset(payload, 0x5a, sizeof(payload));
+    for (size_t i = 0; i < OFFLOAD_POOL; i++)
+        pkts[i] = generate_udp_packet(inet_addr("192.168.1.100"), inet_addr("192.168.1.200"),
+                                      5000, 6000, payload, sizeof(payload));
+}
+
+/* One round trip of the pool through TX and RX; workers < 0 runs the inline path. */
+static void run_round(pdcp_entity_t *entity, pktbuf_t **pkts, int workers, uint64_t *tx_ns, uint64_t *rx_ns) {
+    static uint8_t *data[OFFLOAD_POOL];
+    static size_t sizes[OFFLOAD_POOL];
+    fill_pool(pkts);
+    tx_out_n = 0;
+
+    uint64_t t0 = bench_now_ns();
+    if (workers < 0) {
+        for (size_t i = 0; i < OFFLOAD_POOL; i += OFFLOAD_BURST)
+            tx_out_n += pdcp_prepare_tx_pdu_burst(entity, pkts + i, tx_out + tx_out_n, OFFLOAD_BURST);
+    } else {
+        for (size_t i = 0; i < OFFLOAD_POOL; i += OFFLOAD_BURST) {
+            pdcp_offload_tx_burst(entity, pkts + i, OFFLOAD_BURST);
+            pdcp_offload_poll();
+        }
+        pdcp_offload_flush();
+    }
+    uint64_t t1 = bench_now_ns();
+
+    uint64_t t2 = bench_now_ns();
+    if (workers < 0) {
+        for (size_t i = 0; i < tx_out_n; i++) {
+            data[i] = tx_out[i]->data;
+            sizes[i] = tx_out[i]->len;
+        }
+        for (size_t i = 0; i < tx_out_n; i += OFFLOAD_BURST)
+            pdcp_rx_pdu_burst(entity, data + i, sizes + i,
+                              tx_out_n - i < OFFLOAD_BURST ? tx_out_n - i : OFFLOAD_BURST);
+        for (size_t i = 0; i < tx_out_n; i++)
+            pktbuf_free(tx_out[i]);
+    } else {
+        for (size_t i = 0; i < tx_out_n; i += OFFLOAD_BURST) {
+            pdcp_offload_rx_burst(entity, tx_out + i,
+                                  tx_out_n - i < OFFLOAD_BURST ? tx_out_n - i : OFFLOAD_BURST);
+            pdcp_offload_poll();
+        }
+        pdcp_offload_flush();
+    }
+    uint64_t t3 = bench_now_ns();
+
+    *tx_ns += t1 - t0;
+    *rx_ns += t3 - t2;
+}
+
+static void report(const char *name, pdcp_entity_t *entity, pktbuf_t **pkts, int workers, double *base) {
+    uint64_t tx_ns = 0, rx_ns = 0;
+    pdcp_entity_reestablish(entity);
+    delivered = 0;
+    out_of_order = 0;
+    expected_count = 0;
+    for (int r = 0; r < OFFLOAD_ROUNDS; r++)
+        run_round(entity, pkts, workers, &tx_ns, &rx_ns);
+
+    double bits = (double)OFFLOAD_POOL * OFFLOAD_ROUNDS * (OFFLOAD_PAYLOAD + 28) * 8.0;
+    double tx_gbps = bits / (double)tx_ns, rx_gbps = bits / (double)rx_ns;
+    if (workers < 0) {
+        base[0] = tx_gbps;
+        base[1] = rx_gbps;
+    }
+    printf("%-8s %10.2f %10.2f %10.2f %10.2f %10zu %10zu\n", name, tx_gbps, tx_gbps / base[0], rx_gbps,
+           rx_gbps / base[1], out_of_order, (size_t)OFFLOAD_POOL * OFFLOAD_ROUNDS - delivered);
+}
+
+void bench_offload(void) {
+    pdcp_table_t table;
+    if (pdcp_table_init(&table, 4) < 0) return;
+    pdcp_entity_t *entity = pdcp_table_add(&table, 1, 1);
+    pktbuf_t **pkts = calloc(OFFLOAD_POOL, sizeof(pktbuf_t *));
+    tx_out = calloc(OFFLOAD_POOL, sizeof(pktbuf_t *));
+    if (!entity || !pkts || !tx_out) goto out;
+    pdcp_set_integrity_key(entity, offload_ik);
+    pdcp_set_deliver_callback(count_sdus);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("PDCP crypto offload, %d-byte IPv4/UDP SDUs, ROHC + NIA2 + NEA2, bursts of %d\n",
+           OFFLOAD_PAYLOAD + 28, OFFLOAD_BURST);
+    printf("%ld online CPU(s); the PDCP thread shares them with the workers.\n", cpus);
+    printf("%-8s %10s %10s %10s %10s %10s %10s\n", "workers", "TX Gbps", "vs inline", "RX Gbps",
+           "vs inline", "misorder", "lost");
+
+    double base[2] = { 1.0, 1.0 };
+    report("inline", entity, pkts, -1, base);
+    for (size_t w = 0; w < sizeof(worker_counts) / sizeof(worker_counts[0]); w++) {
+        char name[16];
+        if (pdcp_offload_start(worker_counts[w], collect_pdu) < 0) break;
+        snprintf(name, sizeof(name), "%u%s", worker_counts[w], (long)worker_counts[w] >= cpus ? "*" : "");
+        report(name, entity, pkts, (int)worker_counts[w], base);
+        pdcp_offload_stop();
+    }
+    printf("* no core left for the PDCP thread: workers and PDCP time-share.\n");
+
+out:
+    pdcp_set_deliver_callback(NULL);
+    free(pkts);
+    free(tx_out);
+    tx_out = NULL;
+    pdcp_table_free(&table);
+}
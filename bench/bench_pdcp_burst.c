@@ -0,0 +1,77 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../ipgen/ipgen.h"
+#include "../pdcp/pdcp.h"
+
+#define BURST_POOL   16384  /* SDUs generated per round, outside the timed region */
+#define BURST_ROUNDS 8
+
+static const size_t burst_sizes[] = { 1, 8, 32, 128 };
+
+static size_t delivered;
+
+static void count_sdus(const pdcp_sdu_t *sdus, size_t num_sdus) {
+    (void)sdus;
+    delivered += num_sdus;
+}
+
+void bench_pdcp_burst(void) {
+    pdcp_table_t table;
+    if (pdcp_table_init(&table, 4) < 0) return;
+    pdcp_entity_t *entity = pdcp_table_add(&table, 1, 1);
+    pktbuf_t **pkts = calloc(BURST_POOL, sizeof(pktbuf_t *));
+    uint8_t **data = calloc(BURST_POOL, sizeof(uint8_t *));
+    size_t *sizes = calloc(BURST_POOL, sizeof(size_t));
+    if (!entity || !pkts || !data || !sizes) goto out;
+    pdcp_set_deliver_callback(count_sdus);
+
+    printf("PDCP burst API, 74-byte IPv4/UDP SDUs, ROHC + NEA2, %d SDUs per size\n",
+           BURST_POOL * BURST_ROUNDS);
+    printf("%6s %10s %10s %10s %10s %10s\n", "burst", "TX Mpps", "TX ns", "RX Mpps", "RX ns", "speedup");
+    double base_ns = 0.0;
+    for (size_t b = 0; b < sizeof(burst_sizes) / sizeof(burst_sizes[0]); b++) {
+        size_t burst = burst_sizes[b];
+        uint64_t tx_ns = 0, rx_ns = 0;
+        size_t sent = 0;
+        pdcp_entity_reestablish(entity);
+        delivered = 0;
+        for (int r = 0; r < BURST_ROUNDS; r++) {
+            for (size_t i = 0; i < BURST_POOL; i++)
+                pkts[i] = generate_dummy_ip_packet();
+
+            uint64_t t0 = bench_now_ns();
+            size_t n = 0;
+            for (size_t i = 0; i < BURST_POOL; i += burst)
+                n += pdcp_prepare_tx_pdu_burst(entity, pkts + i, pkts + n, burst);
+            uint64_t t1 = bench_now_ns();
+
+            for (size_t i = 0; i < n; i++) {
+                data[i] = pkts[i]->data;
+                sizes[i] = pkts[i]->len;
+            }
+            uint64_t t2 = bench_now_ns();
+            for (size_t i = 0; i < n; i += burst)
+                pdcp_rx_pdu_burst(entity, data + i, sizes + i, n - i < burst ? n - i : burst);
+            uint64_t t3 = bench_now_ns();
+
+            for (size_t i = 0; i < n; i++)
+                pktbuf_free(pkts[i]);
+            tx_ns += t1 - t0;
+            rx_ns += t3 - t2;
+            sent += n;
+        }
+        double tx = (double)tx_ns / (double)sent, rx = (double)rx_ns / (double)sent;
+        if (b == 0) base_ns = tx + rx;
+        printf("%6zu %10.2f %10.1f %10.2f %10.1f %9.2fx%s\n", burst, 1e3 / tx, tx, 1e3 / rx, rx,
+               base_ns / (tx + rx), delivered == sent ? "" : "  (SDUs lost)");
+    }
+
+out:
+    pdcp_set_deliver_callback(NULL);
+    free(pkts);
+    free(data);
+    free(sizes);
+    pdcp_table_free(&table);
+}
@@ -0,0 +1,183 @@
+#include "bench.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "../ipgen/ipgen.h"
+#include "../loopback/loopback.h"
+#include "../pdcp/pdcp.h"
+#include "../rlc/rlc.h"
+#include "../timer/timer.h"
+
+#define AM_SDUS_PER_MS   256    /* ~2.9 Gbps of 1428-byte SDUs */
+#define AM_TRAFFIC_MS    1000
+#define AM_DRAIN_MS      2000   /* Virtual time allowed for the last retransmissions */
+#define AM_DELAY_MS      5      /* One-way delay: >2048 SNs in flight at full rate */
+#define AM_PAYLOAD       1400   /* UDP payload: 1428-byte IPv4 SDUs */
+#define AM_LAT_BUCKETS   1024   /* 1 ms latency histogram buckets */
+#define AM_CHANNEL_SIZE  16384
+#define AM_TB_SIZE       16384  /* Grant per TB: SDUs are cut at every TB edge */
+#define AM_TBS_PER_MS    32     /* ~4.2 Gbps of grants, room for retransmissions */
+#define AM_MAX_PDUS      64
+#define AM_NUM_SDUS      (AM_SDUS_PER_MS * AM_TRAFFIC_MS)
+
+static const struct {
+    const char *name;
+    uint32_t loss_ppm;
+    uint32_t burst;
+} am_scenarios[] = {
+    { "none", 0, 1 },
+    { "1%", 10000, 1 },
+    { "5%", 50000, 1 },
+    { "1% x8", 10000, 8 },
+};
+
+static loopback_channel_t channel;
+static uint32_t now_ms;
+static uint32_t *sent_ms;          /* Virtual send time of each SDU index */
+static uint32_t latency_hist[AM_LAT_BUCKETS];
+static size_t delivered;
+static size_t misordered;
+static uint32_t next_index;
+static uint32_t last_delivery_ms;
+
+static void record_sdus(const pdcp_sdu_t *sdus, size_t num_sdus) {
+    for (size_t i = 0; i < num_sdus; i++) {
+        uint32_t index;
+        if (sdus[i].data_len < sizeof(index)) continue;
+        memcpy(&index, sdus[i].data + sdus[i].data_len - sizeof(index), sizeof(index));
+        if (index >= AM_NUM_SDUS) continue;
+        if (index != next_index)
+            misordered++;
+        next_index = index + 1;
+        uint32_t latency = now_ms - sent_ms[index];
+        latency_hist[latency < AM_LAT_BUCKETS ? latency : AM_LAT_BUCKETS - 1]++;
+        delivered++;
+    }
+    last_delivery_ms = now_ms;
+}
+
+static uint32_t latency_percentile(double p) {
+    uint64_t target = (uint64_t)((double)delivered * p), seen = 0;
+    for (uint32_t ms = 0; ms < AM_LAT_BUCKETS; ms++) {
+        seen += latency_hist[ms];
+        if (seen > target) return ms;
+    }
+    return AM_LAT_BUCKETS - 1;
+}
+
+static void run_scenario(pdcp_table_t *table, uint8_t drb, size_t s) {
+    static uint8_t payload[AM_PAYLOAD];
+    pktbuf_t *sdus[AM_SDUS_PER_MS];
+    pktbuf_t *tb_pdus[AM_MAX_PDUS];
+    rlc_entity_t rlc;
+    rlc_am_config_t cfg = {
+        .sn_bits = RLC_AM_SN_BITS_LONG,
+        .poll_pdu = 64,
+        .poll_byte = 100000,
+        .max_retx = 16,
+        .t_poll_retransmit = 4 * AM_DELAY_MS,
+        .t_reassembly = 5,
+        .t_status_prohibit = 2 * AM_DELAY_MS,   /* One round trip: no duplicate NACKs */
+    };
+
+    pdcp_entity_t *pdcp = pdcp_table_add(table, 1, drb);
+    if (!pdcp || pdcp_set_sn_length(pdcp, PDCP_SN_BITS_LONG) < 0) return;
+    if (loopback_channel_init(&channel, AM_CHANNEL_SIZE, AM_DELAY_MS, am_scenarios[s].loss_ppm,
+                              am_scenarios[s].burst, 0x5eed + (uint32_t)s) < 0)
+        return;
+    rlc_entity_establish(&rlc, RLC_MODE_AM);
+    rlc_entity_bind_pdcp(&rlc, pdcp);
+    if (rlc_am_configure(&rlc, &cfg) < 0) goto out;
+
+    memset(latency_hist, 0, sizeof(latency_hist));
+    delivered = misordered = 0;
+    next_index = 0;
+    last_delivery_ms = 0;
+    uint32_t generated = 0, max_in_flight = 0;
+    uint64_t wall_ns = 0;
+
+    for (now_ms = 0; now_ms < AM_TRAFFIC_MS + AM_DRAIN_MS; now_ms++) {
+        size_t n = 0;
+        if (now_ms < AM_TRAFFIC_MS) {
+            /* SDU generation and PDCP TX stay outside the timed region */
+            for (; n < AM_SDUS_PER_MS; n++, generated++) {
+                memcpy(payload + AM_PAYLOAD - sizeof(generated), &generated, sizeof(generated));
+                sdus[n] = generate_udp_packet(inet_addr("192.168.1.100"), inet_addr("192.168.1.200"),
+                                              5000, 6000, payload, sizeof(payload));
+                sent_ms[generated] = now_ms;
+            }
+            n = pdcp_prepare_tx_pdu_burst(pdcp, sdus, sdus, n);
+        } else if (delivered >= generated) {
+            break;
+        }
+
+        uint64_t t0 = bench_now_ns();
+        loopback_channel_deliver(&channel, now_ms, &rlc);
+        timer_wheel_tick(timer_get_wheel());
+        for (size_t i = 0; i < n; i++)
+            rlc_tx_enqueue(&rlc, sdus[i]);
+        /* Both directions of the bearer share the channel: the entity talks to itself */
+        for (int tb = 0; tb < AM_TBS_PER_MS; tb++) {
+            size_t num_pdus = rlc_build_pdus(&rlc, AM_TB_SIZE, tb_pdus, AM_MAX_PDUS);
+            if (num_pdus == 0) break;
+            for (size_t i = 0; i < num_pdus; i++)
+                loopback_channel_send(&channel, tb_pdus[i], now_ms);
+        }
+        wall_ns += bench_now_ns() - t0;
+
+        uint32_t in_flight = rlc.am->tx_next - rlc.am->tx_next_ack;
+        if (in_flight > max_in_flight)
+            max_in_flight = in_flight;
+    }
+
+    const rlc_am_stats_t *st = &rlc.am->stats;
+    uint64_t pdus = channel.stats.sent;
+    double mbps = last_delivery_ms ? (double)delivered * (AM_PAYLOAD + 28) * 8.0 / last_delivery_ms / 1e3 : 0.0;
+    double mean = 0.0;
+    for (uint32_t ms = 0; ms < AM_LAT_BUCKETS; ms++)
+        mean += (double)ms * latency_hist[ms];
+    mean = delivered ? mean / (double)delivered : 0.0;
+    uint32_t max_latency = 0;
+    for (uint32_t ms = 0; ms < AM_LAT_BUCKETS; ms++)
+        if (latency_hist[ms]) max_latency = ms;
+
+    printf("%-7s %8.0f %8.2f %7.2f %7.2f %7" PRIu64 " %6.1f %6.1f %5u %5u %8u %7zu\n",
+           am_scenarios[s].name, mbps, (double)pdus / ((double)wall_ns / 1e3),
+           100.0 * (double)channel.stats.lost / (double)(pdus ? pdus : 1),
+           100.0 * (double)st->retx_pdus / (double)(st->tx_pdus ? st->tx_pdus : 1), st->status_tx,
+           st->status_tx ? (double)st->status_tx_bytes / (double)st->status_tx : 0.0, mean,
+           latency_percentile(0.99), max_latency, max_in_flight, generated - delivered);
+    if (misordered)
+        printf("        %zu SDUs delivered out of order\n", misordered);
+
+out:
+    rlc_entity_release(&rlc);
+    loopback_channel_free(&channel);
+}
+
+void bench_rlc_am(void) {
+    pdcp_table_t table;
+    if (pdcp_table_init(&table, 8) < 0) return;
+    sent_ms = calloc(AM_NUM_SDUS, sizeof(uint32_t));
+    if (!sent_ms) goto out;
+    pdcp_set_deliver_callback(record_sdus);
+
+    printf("RLC AM over a lossy loopback, %d-byte SDUs, %d SDUs/ms for %d ms, %d ms one-way delay\n",
+           AM_PAYLOAD + 28, AM_SDUS_PER_MS, AM_TRAFFIC_MS, AM_DELAY_MS);
+    printf("PDUs built for %d grants of %d bytes per ms, segmenting SDUs at the grant edges.\n",
+           AM_TBS_PER_MS, AM_TB_SIZE);
+    printf("Virtual time: Mbps and latency are simulated, Mpps is wall-clock RLC + PDCP RX + channel cost.\n");
+    printf("%-7s %8s %8s %7s %7s %7s %6s %6s %5s %5s %8s %7s\n", "loss", "Mbps", "Mpps", "lost%", "retx%",
+           "STATUS", "B/STA", "lat ms", "p99", "max", "inflight", "missing");
+    for (size_t s = 0; s < sizeof(am_scenarios) / sizeof(am_scenarios[0]); s++)
+        run_scenario(&table, (uint8_t)(s + 1), s);
+    printf("18-bit RLC and PDCP SNs; lost%% counts data and STATUS PDUs, latency is SDU in to PDCP delivery.\n");
+
+out:
+    pdcp_set_deliver_callback(NULL);
+    free(sent_ms);
+    sent_ms = NULL;
+    pdcp_table_free(&table);
+}
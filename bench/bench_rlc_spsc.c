@@ -0,0 +1,203 @@
+#include "bench.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include "../rlc/rlc.h"
+
+#define SPSC_SDUS      (1u << 21)   /* SDUs passed from producer to consumer per row */
+#define SPSC_POOL      8192         /* Preallocated SDUs, reused round robin */
+#define SPSC_SDU_SIZE  1428
+
+static const uint32_t spsc_bursts[] = { 1, 32, 256 };
+
+/* Per-thread counters of one side of the queue */
+typedef struct {
+    uint64_t cpu_ns;
+    uint64_t misses;            /* UINT64_MAX when no hardware counter is available */
+    uint64_t switches;
+    uint64_t waits;             /* Queue found full (producer) or empty (consumer) */
+} spsc_side_t;
+
+typedef struct {
+    rlc_entity_t *rlc;
+    pktbuf_t **pool;
+    uint32_t burst;
+    spsc_side_t producer;
+    spsc_side_t consumer;
+} spsc_run_t;
+
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Counts @config for the calling thread only; -1 if the kernel or the CPU cannot. */
+static int perf_open(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = type == PERF_TYPE_HARDWARE;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t perf_read(int fd) {
+    uint64_t value = 0;
+    if (fd < 0 || read(fd, &value, sizeof(value)) != (ssize_t)sizeof(value))
+        return UINT64_MAX;
+    return value;
+}
+
+/* Wraps one side of the queue in its thread's CPU time and perf counters. */
+static void side_begin(int *fds, uint64_t *t0) {
+    fds[0] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    fds[1] = perf_open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+    *t0 = thread_cpu_ns();
+}
+
+static void side_end(const int *fds, uint64_t t0, spsc_side_t *side) {
+    side->cpu_ns = thread_cpu_ns() - t0;
+    side->misses = perf_read(fds[0]);
+    side->switches = perf_read(fds[1]);
+    for (int i = 0; i < 2; i++)
+        if (fds[i] >= 0) close(fds[i]);
+}
+
+/*
+ * PDCP side: queues bursts and backs off on the queued-byte count, the
+ * same figure BSR reads. The pool is twice the queue, so an SDU is
+ * never queued again before the consumer has taken it.
+ */
+static void *spsc_producer(void *arg) {
+    spsc_run_t *run = arg;
+    size_t limit = (size_t)(RLC_TX_QUEUE_SIZE - run->burst) * SPSC_SDU_SIZE;
+    int fds[2];
+    uint64_t t0;
+    side_begin(fds, &t0);
+    for (uint32_t i = 0; i < SPSC_SDUS; ) {
+        if (rlc_tx_queued_bytes(run->rlc) > limit) {
+            run->producer.waits++;
+            sched_yield();
+            continue;
+        }
+        for (uint32_t b = 0; b < run->burst && i < SPSC_SDUS; b++, i++)
+            rlc_tx_enqueue(run->rlc, run->pool[i & (SPSC_POOL - 1)]);
+    }
+    side_end(fds, t0, &run->producer);
+    return NULL;
+}
+
+/* MAC side: drains the queue; the SDUs go back to the pool, not to free(). */
+static void *spsc_consumer(void *arg) {
+    spsc_run_t *run = arg;
+    int fds[2];
+    uint64_t t0;
+    side_begin(fds, &t0);
+    for (uint32_t i = 0; i < SPSC_SDUS; ) {
+        if (rlc_tx_dequeue(run->rlc)) {
+            i++;
+            continue;
+        }
+        run->consumer.waits++;
+        sched_yield();
+    }
+    side_end(fds, t0, &run->consumer);
+    return NULL;
+}
+
+static void print_misses(const spsc_side_t *side) {
+    if (side->misses == UINT64_MAX)
+        printf(" %9s", "n/a");
+    else
+        printf(" %9.3f", (double)side->misses / SPSC_SDUS);
+}
+
+static void report(const char *name, uint32_t burst, uint64_t wall_ns, const spsc_run_t *run) {
+    printf("%-9s %5u %8.1f %8.1f %8.1f", name, burst, (double)SPSC_SDUS * 1e3 / (double)wall_ns,
+           (double)run->producer.cpu_ns / SPSC_SDUS, (double)run->consumer.cpu_ns / SPSC_SDUS);
+    print_misses(&run->producer);
+    print_misses(&run->consumer);
+    if (run->producer.switches == UINT64_MAX || run->consumer.switches == UINT64_MAX)
+        printf(" %8s", "n/a");
+    else
+        printf(" %8" PRIu64, run->producer.switches + run->consumer.switches);
+    printf(" %8" PRIu64 " %8" PRIu64 "\n", run->producer.waits, run->consumer.waits);
+}
+
+/* Both sides on one thread: the uncontended cost of the queue operations. */
+static void run_inline(rlc_entity_t *rlc, pktbuf_t **pool, uint32_t burst) {
+    spsc_run_t run = { .rlc = rlc, .pool = pool, .burst = burst };
+    int fds[2];
+    uint64_t t0, wall = bench_now_ns();
+    side_begin(fds, &t0);
+    for (uint32_t i = 0; i < SPSC_SDUS; i += burst) {
+        for (uint32_t b = 0; b < burst; b++)
+            rlc_tx_enqueue(rlc, pool[(i + b) & (SPSC_POOL - 1)]);
+        for (uint32_t b = 0; b < burst; b++)
+            rlc_tx_dequeue(rlc);
+    }
+    side_end(fds, t0, &run.producer);
+    wall = bench_now_ns() - wall;
+    /* One thread did both halves: split its time evenly for the table */
+    run.producer.cpu_ns /= 2;
+    if (run.producer.misses != UINT64_MAX)
+        run.producer.misses /= 2;
+    run.consumer = run.producer;
+    run.consumer.switches = 0;
+    report("1 thread", burst, wall, &run);
+}
+
+static void run_threads(rlc_entity_t *rlc, pktbuf_t **pool, uint32_t burst) {
+    spsc_run_t run = { .rlc = rlc, .pool = pool, .burst = burst };
+    pthread_t producer, consumer;
+    uint64_t wall = bench_now_ns();
+    if (pthread_create(&consumer, NULL, spsc_consumer, &run) != 0) return;
+    if (pthread_create(&producer, NULL, spsc_producer, &run) != 0)
+        spsc_producer(&run);        /* The consumer still needs its SDUs */
+    else
+        pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    wall = bench_now_ns() - wall;
+    report("2 threads", burst, wall, &run);
+}
+
+void bench_rlc_spsc(void) {
+    static pktbuf_t *pool[SPSC_POOL];
+    rlc_entity_t rlc;
+    size_t n = 0;
+
+    rlc_entity_establish(&rlc, RLC_MODE_UM);
+    if (!rlc.txq) goto out;
+    for (; n < SPSC_POOL; n++) {
+        pool[n] = pktbuf_alloc(SPSC_SDU_SIZE);
+        if (!pool[n]) goto out;
+        memset(pktbuf_append(pool[n], SPSC_SDU_SIZE), 0x5a, SPSC_SDU_SIZE);
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("RLC SDU queue, PDCP producer thread -> MAC consumer thread, %u SDUs of %d bytes per row\n",
+           SPSC_SDUS, SPSC_SDU_SIZE);
+    printf("%ld online CPU(s)%s\n", cpus, cpus < 2 ? ": the threads time-share one core, so no cache "
+           "line crosses cores" : "");
+    printf("%-9s %5s %8s %8s %8s %9s %9s %8s %8s %8s\n", "mode", "burst", "Mops/s", "enq ns", "deq ns",
+           "enq miss", "deq miss", "ctxsw", "full", "empty");
+    for (size_t b = 0; b < sizeof(spsc_bursts) / sizeof(spsc_bursts[0]); b++)
+        run_inline(&rlc, pool, spsc_bursts[b]);
+    for (size_t b = 0; b < sizeof(spsc_bursts) / sizeof(spsc_bursts[0]); b++)
+        run_threads(&rlc, pool, spsc_bursts[b]);
+    printf("ns are thread CPU time per SDU; misses are cache misses per SDU (n/a: no hardware counters).\n");
+
+out:
+    rlc_entity_release(&rlc);
+    for (size_t i = 0; i < n; i++)
+        pktbuf_free(pool[i]);
+}
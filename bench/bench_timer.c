@@ -0,0 +1,94 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "../timer/timer.h"
+
+#define TIMER_TICKS        1000     /* 1 ms slots per row */
+#define TIMER_ACTIVE_PCT   10       /* Bearers seeing traffic in each slot */
+
+static const uint32_t timer_bearers[] = { 1000, 10000, 100000 };
+
+/* The three timers of an RLC AM bearer, embedded as in rlc_entity_t */
+typedef struct {
+    timer_node_t t_reassembly;
+    timer_node_t t_poll_retransmit;
+    timer_node_t t_status_prohibit;
+} bench_bearer_t;
+
+static uint64_t fired_reassembly;
+
+static void reassembly_expired(timer_node_t *node) {
+    (void)node;
+    fired_reassembly++;
+}
+
+/* An unanswered poll goes out again with the timer restarted. */
+static void poll_retransmit_expired(timer_node_t *node) {
+    timer_arm(timer_get_wheel(), node, 45);
+}
+
+static void status_prohibit_expired(timer_node_t *node) {
+    (void)node;
+}
+
+static void run_row(uint32_t num_bearers) {
+    timer_wheel_t *wheel = timer_get_wheel();
+    bench_bearer_t *bearers = calloc(num_bearers, sizeof(bench_bearer_t));
+    if (!bearers) return;
+    for (uint32_t i = 0; i < num_bearers; i++) {
+        timer_init(&bearers[i].t_reassembly, reassembly_expired);
+        timer_init(&bearers[i].t_poll_retransmit, poll_retransmit_expired);
+        timer_init(&bearers[i].t_status_prohibit, status_prohibit_expired);
+    }
+
+    uint32_t rng = 0x9e3779b9u, active = num_bearers / 100 * TIMER_ACTIVE_PCT;
+    uint64_t ops = 0, op_ns = 0, tick_ns = 0, fired = 0, fired_before = wheel->expired;
+    fired_reassembly = 0;
+    for (uint32_t t = 0; t < TIMER_TICKS; t++) {
+        uint64_t t0 = bench_now_ns();
+        for (uint32_t k = 0; k < active; k++) {
+            /* Bearers with traffic are spread over the table, as in a real cell */
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            bench_bearer_t *b = &bearers[rng % num_bearers];
+            /* A poll restarts t-PollRetransmit, a gap starts or ends t-Reassembly */
+            timer_arm(wheel, &b->t_poll_retransmit, 45);
+            if (rng & 0x100)
+                timer_cancel(&b->t_reassembly);
+            else if (!timer_armed(&b->t_reassembly))
+                timer_arm(wheel, &b->t_reassembly, 35);
+            if (!timer_armed(&b->t_status_prohibit))
+                timer_arm(wheel, &b->t_status_prohibit, 10);
+            ops += 3;
+        }
+        uint64_t t1 = bench_now_ns();
+        fired += timer_wheel_tick(wheel);
+        tick_ns += bench_now_ns() - t1;
+        op_ns += t1 - t0;
+    }
+
+    printf("%8u %10u %10.1f %10.1f %10.1f %12.1f\n", num_bearers, num_bearers * 3, (double)op_ns / (double)ops,
+           (double)tick_ns / TIMER_TICKS / 1e3, (double)fired / TIMER_TICKS,
+           fired ? (double)tick_ns / (double)fired : 0.0);
+    if (wheel->expired - fired_before != fired)
+        printf("         expiry count mismatch\n");
+
+    for (uint32_t i = 0; i < num_bearers; i++) {
+        timer_cancel(&bearers[i].t_reassembly);
+        timer_cancel(&bearers[i].t_poll_retransmit);
+        timer_cancel(&bearers[i].t_status_prohibit);
+    }
+    free(bearers);
+}
+
+void bench_timer(void) {
+    printf("Timer wheel with the three RLC AM timers per bearer, %d%% of bearers active per 1 ms slot, %d slots\n",
+           TIMER_ACTIVE_PCT, TIMER_TICKS);
+    printf("%zu-byte timer nodes, %zu-byte wheel\n", sizeof(timer_node_t), sizeof(timer_wheel_t));
+    printf("%8s %10s %10s %10s %10s %12s\n", "bearers", "timers", "ns/op", "us/tick", "fired/tick",
+           "ns/expiry");
+    for (size_t i = 0; i < sizeof(timer_bearers) / sizeof(timer_bearers[0]); i++)
+        run_row(timer_bearers[i]);
+    printf("ns/op covers arm, restart and cancel; us/tick includes cascading and the expiry handlers.\n");
+}
@@ -2,6 +2,37 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include "../mac/mac.h"
+
+static void harq_rtt_expired(timer_node_t *node);
+
+/* Uplink PHY handler, NULL for the trace */
+static harq_ul_tx_cb_t harq_ul_tx_cb;
+
+/* RLC handler for given-up uplink TBs, NULL for the trace */
+static harq_ul_fail_cb_t harq_ul_fail_cb;
+
+/* The per-TB trace is left to the stub PHY */
+#define harq_trace(...) do { if (!harq_ul_tx_cb) printf(__VA_ARGS__); } while (0)
+
+static uint32_t harq_rtt(const harq_process_t *proc) {
+    return proc->entity ? proc->entity->rtt : HARQ_RTT_SLOTS;
+}
+
+static int harq_max_retx(const harq_process_t *proc) {
+    return proc->entity ? proc->entity->max_retx : HARQ_MAX_RETX;
+}
+
+static void harq_mark_free(harq_process_t *proc) {
+    if (!proc->entity) return;
+    proc->entity->free_mask |= 1u << proc->process_id;
+    proc->entity->retx_mask &= ~(1u << proc->process_id);
+}
+
+static void harq_mark_busy(harq_process_t *proc) {
+    if (proc->entity)
+        proc->entity->free_mask &= ~(1u << proc->process_id);
+}
 
 /**
  * harq_init_process - Set up a new HARQ process with default values
@@ -19,8 +50,84 @@ void harq_init_process(harq_process_t *proc, int process_id) {
     proc->rv = 0;
     proc->tb_data = NULL;
     proc->tb_size = 0;
+    proc->tb = NULL;
+    proc->sdu_bytes = 0;
     proc->num_retx = 0;
     proc->soft_buffer = NULL;
+    proc->soft_size = 0;
+    proc->soft_slot = -1;
+    timer_init(&proc->rtt_timer, harq_rtt_expired);
+    proc->retx_pending = 0;
+    proc->tx_slot = 0;
+    proc->entity = NULL;
+}
+
+/**
+ * harq_entity_init - Set up a HARQ process pool
+ * @ent: Entity to initialize
+ * @num_processes: Processes to use
+ * @rtt: HARQ RTT in slots
+ *
+ * Every process starts idle, so all bits of the free bitmap below
+ * @num_processes are set.
+ */
+int harq_entity_init(harq_entity_t *ent, int num_processes, uint32_t rtt) {
+    if (!ent || num_processes < 1 || num_processes > HARQ_MAX_PROCESSES || rtt == 0) return -1;
+    for (int i = 0; i < HARQ_MAX_PROCESSES; i++) {
+        harq_init_process(&ent->procs[i], i);
+        ent->procs[i].entity = ent;
+    }
+    ent->num_processes = num_processes;
+    ent->rtt = rtt;
+    ent->free_mask = num_processes == 32 ? UINT32_MAX : (1u << num_processes) - 1;
+    ent->retx_mask = 0;
+    ent->max_retx = HARQ_MAX_RETX;
+    ent->arena = NULL;
+    ent->soft_mask = 0;
+    ent->soft_limit = num_processes;
+    return 0;
+}
+
+/**
+ * harq_entity_release - Return every process to idle
+ * @ent: Entity to release
+ *
+ * Cancels the HARQ RTT timers and drops the TBs still held. Soft
+ * buffers go back to the arena, which stays attached.
+ */
+void harq_entity_release(harq_entity_t *ent) {
+    for (int i = 0; i < ent->num_processes; i++) {
+        harq_process_t *proc = &ent->procs[i];
+        timer_cancel(&proc->rtt_timer);
+        pktbuf_free(proc->tb);
+        harq_soft_release(proc);
+        harq_init_process(proc, i);
+        proc->entity = ent;
+    }
+    ent->free_mask = ent->num_processes == 32 ? UINT32_MAX : (1u << ent->num_processes) - 1;
+    ent->retx_mask = 0;
+}
+
+/**
+ * harq_next_free - Lowest idle process
+ * @ent: Entity
+ */
+harq_process_t *harq_next_free(harq_entity_t *ent) {
+    if (!ent || !ent->free_mask) return NULL;
+    return &ent->procs[__builtin_ctz(ent->free_mask)];
+}
+
+/**
+ * harq_select - Process for the next grant
+ * @ent: Entity
+ *
+ * A due retransmission wins over new data, lowest process first.
+ */
+harq_process_t *harq_select(harq_entity_t *ent) {
+    if (!ent) return NULL;
+    if (ent->retx_mask)
+        return &ent->procs[__builtin_ctz(ent->retx_mask)];
+    return harq_next_free(ent);
 }
 
 /**
@@ -28,44 +135,63 @@ void harq_init_process(harq_process_t *proc, int process_id) {
  * @proc: Target HARQ process
  * @received_ndi: New Data Indicator from physical layer
  * @received_rv: Redundancy Version for this transmission
- * @tb_data: Transport block data received
+ * @tb_data: Coded bits received, read out of the circular buffer from k0(rv)
  * @tb_size: Size of the transport block
  *
  * Handles incoming downlink data by either:
  * 1. Setting up a new transmission if NDI has changed
  * 2. Combining with previous transmission if it's a retransmission
- * Manages memory for transport block and soft buffer storage.
+ * A new transmission clears the soft buffer, so both cases combine the
+ * received bits into it. The buffers come from the entity's arena if
+ * it has one. The code here is rate 1: the circular buffer
+ * holds the TB bits themselves, 8 * @tb_size of them.
  */
 void harq_handle_dl_assignment(harq_process_t *proc, int received_ndi, int received_rv,
                              uint8_t *tb_data, size_t tb_size) {
     /* Check if this is a new transmission */
     if (proc->state == HARQ_IDLE || proc->ndi != received_ndi) {
         printf("HARQ process %d: New downlink transmission\n", proc->process_id);
-        /* Clean up previous transmission data if any */
-        if (proc->tb_data) {
-            free(proc->tb_data);
+        /* Reuses the buffers of the previous TB, if any */
+        if (harq_soft_acquire(proc, tb_size) < 0) {
+            printf("HARQ process %d: No soft buffer for a %zu-byte TB, dropped\n", proc->process_id, tb_size);
+            return;
         }
-        /* Store new transmission data */
-        proc->tb_data = (uint8_t *)malloc(tb_size);
-        memcpy(proc->tb_data, tb_data, tb_size);
         proc->tb_size = tb_size;
         proc->ndi = received_ndi;
-        proc->rv = received_rv;
         proc->num_retx = 0;
-        
-        /* Initialize soft buffer for potential retransmissions */
-        if (proc->soft_buffer) {
-            free(proc->soft_buffer);
-        }
-        proc->soft_buffer = (uint8_t *)malloc(tb_size);
-        memcpy(proc->soft_buffer, tb_data, tb_size);
         proc->state = HARQ_WAIT_ACK;
+        harq_mark_busy(proc);
     } else {
         /* Handle retransmission by combining with previous data */
         printf("HARQ process %d: Downlink retransmission, combining data\n", proc->process_id);
-        phy_combine_dl(proc, tb_data, tb_size);
-        proc->rv = received_rv;
         proc->num_retx++;
+        /* Flushed for another TB of the UE: combining starts over */
+        if (!proc->soft_buffer && harq_soft_acquire(proc, proc->tb_size) < 0) return;
+    }
+    proc->rv = received_rv;
+    phy_combine_dl(proc, received_rv, tb_data, tb_size);
+}
+
+/**
+ * harq_dl_combine_llrs - Combine the LLRs of one downlink transmission
+ * @proc: Process holding the soft buffer
+ * @rv: Redundancy version of the transmission
+ * @llrs: LLR of each received coded bit, in transmission order
+ * @num_llrs: Coded bits received (E)
+ */
+void harq_dl_combine_llrs(harq_process_t *proc, int rv, const int8_t *llrs, size_t num_llrs) {
+    if (!proc || !proc->soft_buffer) return;
+    harq_soft_combine(proc->soft_buffer, proc->soft_size, harq_rv_start(proc->soft_size, rv), llrs, num_llrs);
+}
+
+/* Hard decision on the combined LLRs: a negative sum decodes as 1 */
+static void harq_decide(harq_process_t *proc) {
+    for (size_t i = 0; i < proc->tb_size; i++) {
+        const int8_t *llr = proc->soft_buffer + 8 * i;
+        uint8_t byte = 0;
+        for (int b = 0; b < 8; b++)
+            byte = (uint8_t)(byte << 1 | (llr[b] < 0));
+        proc->tb_data[i] = byte;
     }
 }
 
@@ -80,15 +206,18 @@ void harq_handle_dl_assignment(harq_process_t *proc, int received_ndi, int recei
  */
 void harq_dl_process_feedback(harq_process_t *proc, int ack) {
     if (ack) {
-        printf("HARQ process %d: Downlink ACK received, delivering MAC PDU to RLC\n", proc->process_id);
-        /* Successful transmission - forward to RLC */
-        rlc_deliver_mac_pdu(proc->tb_data, proc->tb_size);
+        /* Successful transmission - forward to RLC, unless its soft bits were flushed */
+        if (proc->soft_buffer) {
+            printf("HARQ process %d: Downlink ACK received, delivering MAC PDU to RLC\n", proc->process_id);
+            harq_decide(proc);
+            rlc_deliver_mac_pdu(proc->tb_data, proc->tb_size);
+        } else {
+            printf("HARQ process %d: Downlink ACK received for a flushed soft buffer, TB lost\n", proc->process_id);
+        }
         proc->state = HARQ_IDLE;
         /* Clean up resources */
-        free(proc->tb_data);
-        proc->tb_data = NULL;
-        free(proc->soft_buffer);
-        proc->soft_buffer = NULL;
+        harq_soft_release(proc);
+        harq_mark_free(proc);
     } else {
         printf("HARQ process %d: Downlink NACK received, scheduling retransmission\n", proc->process_id);
         /* Failed transmission - request retransmission */
@@ -100,28 +229,76 @@ void harq_dl_process_feedback(harq_process_t *proc, int ack) {
  * harq_ul_start_tx - Begin a new uplink transmission
  * @proc: Target HARQ process
  * @mac_pdu: MAC PDU to transmit
- * @pdu_size: Size of the MAC PDU
  *
  * Prepares and initiates a new uplink transmission:
- * 1. Stores the MAC PDU for potential retransmissions
+ * 1. Holds the MAC PDU buffer for potential retransmissions
  * 2. Initializes transmission parameters
  * 3. Triggers the physical layer transmission
+ *
+ * The PDU is kept by reference, so retransmissions share the
+ * bytes built by the upper layers instead of a private copy.
+ * A process still waiting for feedback keeps its TB.
  */
-void harq_ul_start_tx(harq_process_t *proc, uint8_t *mac_pdu, size_t pdu_size) {
-    /* Store MAC PDU for potential retransmissions */
-    if (proc->tb_data) {
-        free(proc->tb_data);
+int harq_ul_start_tx(harq_process_t *proc, pktbuf_t *mac_pdu) {
+    if (!proc || proc->state != HARQ_IDLE) {
+        printf("HARQ: No idle process for a new uplink TB, MAC PDU dropped\n");
+        pktbuf_free(mac_pdu);
+        return -1;
     }
-    proc->tb_data = (uint8_t *)malloc(pdu_size);
-    memcpy(proc->tb_data, mac_pdu, pdu_size);
-    proc->tb_size = pdu_size;
-    proc->ndi = 1;  /* Indicate new transmission */
+    /* Keep MAC PDU for potential retransmissions */
+    proc->tb = mac_pdu;
+    proc->tb_size = pktbuf_pkt_len(mac_pdu);
+    proc->ndi ^= 1;  /* Toggled for every new transmission */
     proc->rv = 0;
     proc->num_retx = 0;
     proc->state = HARQ_WAIT_ACK;
-    
+    proc->retx_pending = 0;
+    harq_mark_busy(proc);
+
     /* Start transmission */
+    proc->tx_slot = timer_now(timer_get_wheel());
+    phy_transmit_ul(proc);
+    timer_arm(timer_get_wheel(), &proc->rtt_timer, harq_rtt(proc));
+    return 0;
+}
+
+/**
+ * harq_ul_retransmit - Resend the TB of a NACKed process
+ * @proc: Process with a retransmission due
+ *
+ * Same NDI, next attempt; the HARQ RTT timer restarts.
+ */
+void harq_ul_retransmit(harq_process_t *proc) {
+    if (!proc || proc->state != HARQ_WAIT_ACK) return;
+    if (proc->entity)
+        proc->entity->retx_mask &= ~(1u << proc->process_id);
+    proc->num_retx++;
+    proc->tx_slot = timer_now(timer_get_wheel());
     phy_transmit_ul(proc);
+    timer_arm(timer_get_wheel(), &proc->rtt_timer, harq_rtt(proc));
+}
+
+/*
+ * A NACKed TB whose HARQ RTT has run out: a pooled process waits for
+ * harq_select(), ahead of new data; a standalone one resends at once.
+ */
+static void harq_retx_due(harq_process_t *proc) {
+    if (proc->entity) {
+        proc->entity->retx_mask |= 1u << proc->process_id;
+        return;
+    }
+    harq_ul_retransmit(proc);
+}
+
+/* The TB is done with, decoded or given up: the process goes idle */
+static void harq_ul_finish(harq_process_t *proc) {
+    timer_cancel(&proc->rtt_timer);
+    proc->retx_pending = 0;
+    proc->state = HARQ_IDLE;
+    pktbuf_free(proc->tb);
+    proc->tb = NULL;
+    proc->sdu_bytes = 0;
+    harq_mark_free(proc);
 }
 
 /**
@@ -130,22 +307,46 @@ void harq_ul_start_tx(harq_process_t *proc, uint8_t *mac_pdu, size_t pdu_size) {
  * @ack: Boolean indicating successful (1) or failed (0) transmission
  *
  * Processes feedback for uplink transmissions:
- * - On ACK: Cleans up resources
- * - On NACK: Initiates retransmission
+ * - On ACK: Cleans up resources and returns the process to its pool
+ * - On NACK: Makes the retransmission due, or leaves it to the HARQ
+ *   RTT timer if that is still running; after the last retransmission
+ *   allowed, gives the TB up and tells RLC
  */
 void harq_ul_process_feedback(harq_process_t *proc, int ack) {
+    if (proc->state != HARQ_WAIT_ACK) return;
     if (ack) {
-        printf("HARQ process %d: Uplink ACK received, transmission successful\n", proc->process_id);
-        proc->state = HARQ_IDLE;
-        free(proc->tb_data);
-        proc->tb_data = NULL;
+        harq_trace("HARQ process %d: Uplink ACK received, transmission successful\n", proc->process_id);
+        harq_ul_finish(proc);
+    } else if (proc->num_retx >= harq_max_retx(proc)) {
+        harq_trace("HARQ process %d: Uplink NACK after %d retransmissions, TB given up to RLC\n",
+                   proc->process_id, proc->num_retx);
+        if (harq_ul_fail_cb)
+            harq_ul_fail_cb(proc);
+        harq_ul_finish(proc);
     } else {
-        printf("HARQ process %d: Uplink NACK received, scheduling retransmission\n", proc->process_id);
-        proc->num_retx++;
-        phy_transmit_ul(proc);
+        harq_trace("HARQ process %d: Uplink NACK received, scheduling retransmission\n", proc->process_id);
+        if (timer_armed(&proc->rtt_timer)) {
+            proc->retx_pending = 1;
+            return;
+        }
+        harq_retx_due(proc);
     }
 }
 
+/**
+ * harq_rtt_expired - Handle HARQ RTT timer expiry
+ * @node: The process's HARQ RTT timer
+ *
+ * Makes due the retransmission that a NACK asked for while the
+ * timer was running.
+ */
+static void harq_rtt_expired(timer_node_t *node) {
+    harq_process_t *proc = timer_entry(node, harq_process_t, rtt_timer);
+    if (!proc->retx_pending || proc->state != HARQ_WAIT_ACK) return;
+    proc->retx_pending = 0;
+    harq_retx_due(proc);
+}
+
 /**
  * phy_transmit_dl - Physical layer interface for downlink transmission
  * @proc: HARQ process containing data to transmit
@@ -158,30 +359,61 @@ void phy_transmit_dl(harq_process_t *proc) {
            proc->process_id, proc->rv, proc->num_retx);
 }
 
+/* Hard bits converted per call, bounding the stack used */
+#define HARQ_LLR_CHUNK 1024
+
 /**
  * phy_combine_dl - Combine new data with stored soft bits
  * @proc: HARQ process for combining
- * @new_data: New transport block data
- * @new_data_size: Size of new transport block
+ * @rv: Redundancy version the data was sent with
+ * @new_data: Hard-decided coded bits of the transmission, MSB first
+ * @new_data_size: Size of @new_data in bytes
  *
- * Simulates soft combining of retransmissions.
- * In practice, would implement proper Chase combining or incremental redundancy.
+ * Stands in for the demodulator, which would hand over real LLRs to
+ * harq_dl_combine_llrs(): every bit becomes +/-HARQ_LLR_HARD.
  */
-void phy_combine_dl(harq_process_t *proc, uint8_t *new_data, size_t new_data_size) {
-    /* Simple averaging for demonstration - real implementation would use proper soft combining */
-    for (size_t i = 0; i < new_data_size && i < proc->tb_size; i++) {
-        proc->soft_buffer[i] = (proc->soft_buffer[i] + new_data[i]) / 2;
+void phy_combine_dl(harq_process_t *proc, int rv, const uint8_t *new_data, size_t new_data_size) {
+    int8_t llrs[HARQ_LLR_CHUNK];
+    if (!proc || !proc->soft_buffer) return;
+    size_t k = harq_rv_start(proc->soft_size, rv);
+    for (size_t off = 0; off < new_data_size; off += HARQ_LLR_CHUNK / 8) {
+        size_t bytes = new_data_size - off < HARQ_LLR_CHUNK / 8 ? new_data_size - off : HARQ_LLR_CHUNK / 8;
+        for (size_t i = 0; i < bytes * 8; i++)
+            llrs[i] = (new_data[off + i / 8] >> (7 - i % 8) & 1) ? -HARQ_LLR_HARD : HARQ_LLR_HARD;
+        harq_soft_combine(proc->soft_buffer, proc->soft_size, k + off * 8, llrs, bytes * 8);
     }
 }
 
+/**
+ * harq_set_ul_tx_callback - Install the uplink PHY handler
+ * @cb: Handler, NULL to restore the trace
+ */
+void harq_set_ul_tx_callback(harq_ul_tx_cb_t cb) {
+    harq_ul_tx_cb = cb;
+}
+
+/**
+ * harq_set_ul_fail_callback - Install the handler for given-up TBs
+ * @cb: Handler, NULL to only trace the loss
+ */
+void harq_set_ul_fail_callback(harq_ul_fail_cb_t cb) {
+    harq_ul_fail_cb = cb;
+}
+
 /**
  * phy_transmit_ul - Physical layer interface for uplink transmission
  * @proc: HARQ process containing data to transmit
  *
- * Stub function simulating physical layer transmission.
+ * Stub function simulating physical layer transmission, unless a
+ * handler took over the link.
  * In a real implementation, this would interface with the actual PHY layer.
  */
+
 void phy_transmit_ul(harq_process_t *proc) {
+    if (harq_ul_tx_cb) {
+        harq_ul_tx_cb(proc);
+        return;
+    }
     printf("PHY: Transmitting uplink MAC PDU for HARQ process %d (NDI=%d, retx=%d)\n",
            proc->process_id, proc->ndi, proc->num_retx);
 }
@@ -191,9 +423,11 @@ void phy_transmit_ul(harq_process_t *proc) {
  * @mac_pdu: Successfully decoded MAC PDU
  * @pdu_size: Size of the MAC PDU
  *
- * Stub function simulating delivery to RLC layer.
- * In a real implementation, this would pass data to the actual RLC entity.
+ * Demultiplexes the PDU through the UE's dispatch table, so each MAC
+ * SDU reaches the RLC entity registered for its LCID without a copy.
  */
 void rlc_deliver_mac_pdu(uint8_t *mac_pdu, size_t pdu_size) {
-    printf("RLC: Delivered MAC PDU of size %zu bytes\n", pdu_size);
+    int n = mac_demultiplex(mac_get_rx_table(), mac_pdu, pdu_size);
+    if (n >= 0)
+        printf("RLC: Delivered %d MAC subPDUs from a MAC PDU of %zu bytes\n", n, pdu_size);
 }
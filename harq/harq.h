@@ -3,6 +3,58 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "../pktbuf/pktbuf.h"
+#include "../timer/timer.h"
+
+/**
+ * HARQ_RTT_SLOTS - Slots from a transmission to the earliest retransmission
+ *
+ * Covers the PUSCH-to-feedback delay and the receiver's decoding time.
+ */
+#define HARQ_RTT_SLOTS 8
+
+/**
+ * HARQ_MAX_RETX - Default retransmissions of a TB before HARQ gives up
+ *
+ * maxHARQ-Tx of 4 transmissions in total.
+ */
+#define HARQ_MAX_RETX 3
+
+/**
+ * HARQ_MAX_PROCESSES - HARQ processes per UE and direction
+ *
+ * 16 in NR up to Rel-16. Rel-17 allows 32, the most a process bitmap
+ * holds. Override at build time with -DHARQ_MAX_PROCESSES=n.
+ */
+#ifndef HARQ_MAX_PROCESSES
+#define HARQ_MAX_PROCESSES 16
+#endif
+#if HARQ_MAX_PROCESSES < 1 || HARQ_MAX_PROCESSES > 32
+#error "HARQ_MAX_PROCESSES must be within 1..32"
+#endif
+
+/**
+ * HARQ_LLR_HARD - LLR magnitude of a bit received as a hard decision
+ *
+ * LLRs are int8, positive for a 0 bit. Four hard copies of a bit
+ * combine to full confidence before saturating at 127.
+ */
+#define HARQ_LLR_HARD 32
+
+/**
+ * enum harq_llr_engine_t - LLR combining implementations
+ * @HARQ_LLR_SCALAR: Portable C, one LLR at a time
+ * @HARQ_LLR_SSE2: x86 SSE2, 16 LLRs per saturating add
+ * @HARQ_LLR_AVX2: x86 AVX2, 32 LLRs per saturating add
+ */
+typedef enum {
+    HARQ_LLR_SCALAR,
+    HARQ_LLR_SSE2,
+    HARQ_LLR_AVX2
+} harq_llr_engine_t;
+
+typedef struct harq_entity harq_entity_t;
+typedef struct harq_arena harq_arena_t;
 
 /**
  * enum harq_state_t - Possible states of a HARQ process
@@ -22,10 +74,20 @@ typedef enum {
  * @state: Current operational state of the process
  * @ndi: New Data Indicator - toggles for fresh transmissions
  * @rv: Redundancy Version - indicates which version of data is being transmitted
- * @tb_data: Pointer to the current transport block data
+ * @tb_data: Downlink transport block, decided from @soft_buffer on ACK
  * @tb_size: Size of the transport block in bytes
+ * @tb: Uplink transport block held by reference for retransmissions
+ * @sdu_bytes: MAC SDU bytes in @tb, set by the MAC building it before
+ *  harq_ul_start_tx() (0 if not told); subheaders, MAC CEs and padding
+ *  excluded
  * @num_retx: Counter for number of retransmission attempts
- * @soft_buffer: Storage for combining multiple transmissions of same data
+ * @soft_buffer: Downlink circular buffer: one int8 LLR per coded bit
+ * @soft_size: Coded bits in @soft_buffer (Ncb)
+ * @soft_slot: Arena slot holding @tb_data and @soft_buffer, -1 if none
+ * @rtt_timer: HARQ RTT timer, running for HARQ_RTT_SLOTS after each transmission
+ * @retx_pending: A NACK arrived before @rtt_timer expired
+ * @tx_slot: Slot of the latest transmission, matched by its feedback
+ * @entity: Pool holding the process, NULL for a standalone process
  *
  * This structure maintains all necessary state information for
  * handling hybrid ARQ operations in 5G NR.
@@ -37,10 +99,167 @@ typedef struct {
     int rv;
     uint8_t *tb_data;
     size_t tb_size;
+    pktbuf_t *tb;
+    size_t sdu_bytes;
     int num_retx;
-    uint8_t *soft_buffer;
+    int8_t *soft_buffer;
+    size_t soft_size;
+    int soft_slot;
+    timer_node_t rtt_timer;
+    int retx_pending;
+    uint32_t tx_slot;
+    harq_entity_t *entity;
 } harq_process_t;
 
+/**
+ * struct harq_entity - HARQ processes of one UE in one direction
+ * @procs: Processes, @procs[i] has process ID i
+ * @num_processes: Processes in use, at most HARQ_MAX_PROCESSES
+ * @rtt: HARQ RTT in slots
+ * @free_mask: Bit i set while process i holds no TB
+ * @retx_mask: Bit i set while process i has a retransmission due
+ * @max_retx: Retransmissions after which a NACK gives the TB up,
+ *  HARQ_MAX_RETX unless changed after harq_entity_init()
+ * @arena: Soft-buffer arena of the DL processes, NULL to malloc per TB
+ * @soft_mask: Bit i set while process i holds an arena slot
+ * @soft_limit: Arena slots the UE may hold at once
+ *
+ * Up to @num_processes TBs are in flight at once, each waiting for
+ * its own feedback. Both bitmaps turn process selection into a find
+ * first set: a NACKed TB whose HARQ RTT has run out goes before any
+ * new data, and new data takes the lowest free process.
+ */
+struct harq_entity {
+    harq_process_t procs[HARQ_MAX_PROCESSES];
+    int num_processes;
+    uint32_t rtt;
+    uint32_t free_mask;
+    uint32_t retx_mask;
+    int max_retx;
+    harq_arena_t *arena;
+    uint32_t soft_mask;
+    int soft_limit;
+};
+
+/**
+ * struct harq_arena_stats_t - Soft-buffer arena counters
+ * @in_use: Slots held now
+ * @peak: Most slots ever held at once
+ * @allocs: Slots handed out
+ * @failures: TBs refused: larger than a slot, or no slot left
+ * @flushes: Soft buffers dropped to make room for another TB of the UE
+ */
+typedef struct {
+    uint32_t in_use;
+    uint32_t peak;
+    uint64_t allocs;
+    uint64_t failures;
+    uint64_t flushes;
+} harq_arena_stats_t;
+
+/**
+ * struct harq_arena - Preallocated DL soft buffers shared by many UEs
+ * @mem: @num_slots slots of @slot_size bytes
+ * @max_tbs: Largest TB a slot holds, in bytes
+ * @slot_size: 8 * @max_tbs LLRs followed by @max_tbs TB bytes, rounded up
+ *  to a cache line
+ * @num_slots: Slots in @mem
+ * @free_slots: Stack of free slot indices
+ * @num_free: Entries on @free_slots
+ * @ue_limit: Slots per UE in limited-buffer mode, 0 for one per process
+ * @stats: Counters
+ *
+ * Sized once for every UE attached: max TBS x processes x UEs, or
+ * max TBS x @ue_limit x UEs in limited-buffer mode. A slot is taken
+ * by a new DL TB and returned on ACK, both by a stack push or pop,
+ * so the slot path never calls the allocator.
+ */
+struct harq_arena {
+    uint8_t *mem;
+    size_t max_tbs;
+    size_t slot_size;
+    uint32_t num_slots;
+    uint32_t *free_slots;
+    uint32_t num_free;
+    int ue_limit;
+    harq_arena_stats_t stats;
+};
+
+/**
+ * harq_ul_tx_cb_t - Uplink PHY handler
+ * @proc: Process whose TB (@proc->tb) goes on air, new or retransmitted
+ *
+ * The handler does not own @proc->tb: it takes a reference with
+ * pktbuf_ref() to keep the bytes past the process's feedback.
+ */
+typedef void (*harq_ul_tx_cb_t)(harq_process_t *proc);
+
+/**
+ * harq_ul_fail_cb_t - Handler telling RLC that HARQ gave up on a TB
+ * @proc: Process NACKed past its maximum retransmissions, still holding
+ *  @proc->tb; it goes idle once the handler returns
+ *
+ * The bytes are left to RLC: AM recovers them by ARQ, UM loses them.
+ */
+typedef void (*harq_ul_fail_cb_t)(harq_process_t *proc);
+
+/**
+ * struct harq_feedback_t - ACK/NACK on its way to the transmitter
+ * @entity: HARQ entity of the UE
+ * @slot: Slot of the transmission it answers
+ * @due: Slot at which it arrives
+ * @pid: HARQ process ID
+ * @ack: Whether the TB was decoded
+ */
+typedef struct {
+    harq_entity_t *entity;
+    uint32_t slot;
+    uint32_t due;
+    uint8_t pid;
+    uint8_t ack;
+} harq_feedback_t;
+
+/**
+ * struct harq_fb_stats_t - Feedback queue counters
+ * @acks: ACKs applied
+ * @nacks: NACKs applied
+ * @acked_bytes: MAC SDU bytes of the TBs ACKed (their @sdu_bytes)
+ * @failures: TBs given up on after their last retransmission
+ * @stale: Feedback for a transmission the process no longer waits on
+ * @overflows: Feedback refused with the queue full
+ */
+typedef struct {
+    uint64_t acks;
+    uint64_t nacks;
+    uint64_t acked_bytes;
+    uint64_t failures;
+    uint64_t stale;
+    uint64_t overflows;
+} harq_fb_stats_t;
+
+/**
+ * struct harq_fb_queue_t - HARQ feedback in flight, in arrival order
+ * @ring: Entries, a power of two of them
+ * @mask: Entries in @ring minus one
+ * @head: Oldest feedback
+ * @tail: Next free entry
+ * @delay: Slots from a transmission to its feedback (K1/K2 and decoding)
+ * @stats: Counters
+ *
+ * Feedback is pushed when the receiver decides it and applied when
+ * harq_fb_drain() reaches its slot, once per slot, rather than by
+ * whoever produced it. With one @delay for every entry, pushing in
+ * transmission order keeps the ring in arrival order.
+ */
+typedef struct {
+    harq_feedback_t *ring;
+    uint32_t mask;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t delay;
+    harq_fb_stats_t stats;
+} harq_fb_queue_t;
+
 /**
  * harq_init_process - Initialize a new HARQ process
  * @proc: Pointer to the HARQ process structure
@@ -51,6 +270,95 @@ typedef struct {
  */
 void harq_init_process(harq_process_t *proc, int process_id);
 
+/**
+ * harq_entity_init - Set up a pool of idle HARQ processes
+ * @ent: Entity to initialize
+ * @num_processes: Processes to use, 1 to HARQ_MAX_PROCESSES
+ * @rtt: HARQ RTT in slots, at least 1
+ *
+ * Return: 0 on success, -1 for bad parameters
+ */
+int harq_entity_init(harq_entity_t *ent, int num_processes, uint32_t rtt);
+
+/**
+ * harq_entity_release - Stop every process and drop its TB
+ * @ent: Entity to release
+ */
+void harq_entity_release(harq_entity_t *ent);
+
+/**
+ * harq_arena_init - Preallocate the soft buffers of a set of UEs
+ * @arena: Arena to initialize
+ * @max_tbs: Largest DL TB in bytes
+ * @num_processes: DL HARQ processes per UE
+ * @num_ues: UEs to attach
+ * @ue_limit: Slots per UE for limited-buffer mode, 0 for one per process
+ *
+ * In limited-buffer mode a UE that already holds @ue_limit slots
+ * frees one of its own, the lowest process's, for a new TB: memory
+ * per UE is capped at the price of that process's combined bits.
+ *
+ * Return: 0 on success, -1 for bad sizes or on allocation failure
+ */
+int harq_arena_init(harq_arena_t *arena, size_t max_tbs, int num_processes, int num_ues, int ue_limit);
+
+/**
+ * harq_arena_free - Release the memory of an arena
+ * @arena: Arena, with no slot still held
+ */
+void harq_arena_free(harq_arena_t *arena);
+
+/**
+ * harq_entity_attach_arena - Take the DL soft buffers of a UE from an arena
+ * @ent: Entity with no DL TB in flight
+ * @arena: Arena sized for it
+ *
+ * Return: 0 on success, -1 if @ent still holds soft buffers
+ */
+int harq_entity_attach_arena(harq_entity_t *ent, harq_arena_t *arena);
+
+/**
+ * harq_soft_acquire - Get the TB and soft buffers of a new DL TB
+ * @proc: Process receiving the TB
+ * @tb_size: TB size in bytes
+ *
+ * Takes an arena slot when @proc's entity has an arena, flushing
+ * another process of the UE first if it is at its limit; otherwise
+ * the buffers are allocated. A slot @proc already holds is reused.
+ * The soft buffer comes back zeroed.
+ *
+ * Return: 0 on success, -1 if no buffer could be had
+ */
+int harq_soft_acquire(harq_process_t *proc, size_t tb_size);
+
+/**
+ * harq_soft_release - Give back the TB and soft buffers of a process
+ * @proc: Process, possibly holding none
+ */
+void harq_soft_release(harq_process_t *proc);
+
+/**
+ * harq_next_free - Find the lowest idle process
+ * @ent: Entity
+ *
+ * The process stays free until a transmission is started on it.
+ *
+ * Return: Idle process, or NULL if every process holds a TB
+ */
+harq_process_t *harq_next_free(harq_entity_t *ent);
+
+/**
+ * harq_select - Pick the process to serve with the next grant
+ * @ent: Entity
+ *
+ * Retransmissions come first: the lowest process with one due is
+ * returned in HARQ_WAIT_ACK state, for harq_ul_retransmit().
+ * Otherwise the lowest idle process is returned, for new data.
+ *
+ * Return: Selected process, or NULL if all wait for feedback
+ */
+harq_process_t *harq_select(harq_entity_t *ent);
+
 /* Downlink HARQ Functions */
 
 /**
@@ -67,6 +375,19 @@ void harq_init_process(harq_process_t *proc, int process_id);
 void harq_handle_dl_assignment(harq_process_t *proc, int received_ndi, int received_rv,
                              uint8_t *tb_data, size_t tb_size);
 
+/**
+ * harq_dl_combine_llrs - Combine the LLRs of one downlink transmission
+ * @proc: Process holding the soft buffer
+ * @rv: Redundancy version of the transmission
+ * @llrs: LLR of each received coded bit, in transmission order
+ * @num_llrs: Coded bits received (E)
+ *
+ * Incremental redundancy: the bits of each RV start at its k0 in the
+ * circular buffer (harq_rv_start()) and wrap around its end. Chase
+ * combining is the case of every transmission using the same RV.
+ */
+void harq_dl_combine_llrs(harq_process_t *proc, int rv, const int8_t *llrs, size_t num_llrs);
+
 /**
  * harq_dl_process_feedback - Handle downlink acknowledgment
  * @proc: Target HARQ process
@@ -82,13 +403,22 @@ void harq_dl_process_feedback(harq_process_t *proc, int ack);
 /**
  * harq_ul_start_tx - Initiate an uplink transmission
  * @proc: Target HARQ process
- * @mac_pdu: MAC PDU data to transmit
- * @pdu_size: Size of the MAC PDU
+ * @mac_pdu: MAC PDU to transmit (consumed)
  *
- * Prepares and starts a new uplink transmission by storing the
- * PDU and triggering physical layer transmission.
+ * Prepares and starts a new uplink transmission by keeping a
+ * reference to the PDU and triggering physical layer transmission.
+ * A process still holding a TB is left alone: its TB may yet be
+ * NACKed.
+ *
+ * Return: 0 on success, -1 if @proc is NULL or busy (@mac_pdu is dropped)
  */
-void harq_ul_start_tx(harq_process_t *proc, uint8_t *mac_pdu, size_t pdu_size);
+int harq_ul_start_tx(harq_process_t *proc, pktbuf_t *mac_pdu);
+
+/**
+ * harq_ul_retransmit - Send a due retransmission
+ * @proc: Process returned by harq_select() with a retransmission due
+ */
+void harq_ul_retransmit(harq_process_t *proc);
 
 /**
  * harq_ul_process_feedback - Handle uplink acknowledgment
@@ -96,12 +426,74 @@ void harq_ul_start_tx(harq_process_t *proc, uint8_t *mac_pdu, size_t pdu_size);
  * @ack: 1 for successful transmission, 0 for failed transmission
  *
  * Processes feedback for uplink transmissions and schedules
- * retransmission if necessary.
+ * retransmission if necessary. A retransmission never goes out
+ * before the HARQ RTT timer of the previous one has expired. A
+ * pooled process then waits for harq_select() to pick it; a
+ * standalone one retransmits at once. A NACK after the process's
+ * maximum retransmissions gives the TB up instead and tells RLC
+ * (harq_set_ul_fail_callback()).
  */
 void harq_ul_process_feedback(harq_process_t *proc, int ack);
 
+/**
+ * harq_fb_queue_init - Set up a feedback queue
+ * @q: Queue to initialize
+ * @size: Feedback in flight at most, rounded up to a power of two;
+ *  one per HARQ process of every UE is always enough
+ * @delay: Slots from a transmission to its feedback, at least 1
+ *
+ * Return: 0 on success, -1 for bad sizes or on allocation failure
+ */
+int harq_fb_queue_init(harq_fb_queue_t *q, uint32_t size, uint32_t delay);
+
+/**
+ * harq_fb_queue_free - Release the storage of a feedback queue
+ * @q: Queue; undelivered feedback is dropped
+ */
+void harq_fb_queue_free(harq_fb_queue_t *q);
+
+/**
+ * harq_fb_push - Queue the feedback of a process's latest transmission
+ * @q: Queue
+ * @proc: Pooled process that transmitted
+ * @ack: Whether the TB was decoded
+ *
+ * The feedback arrives @q->delay slots after @proc->tx_slot.
+ *
+ * Return: 0 on success, -1 for a standalone process or a full queue
+ */
+int harq_fb_push(harq_fb_queue_t *q, const harq_process_t *proc, int ack);
+
+/**
+ * harq_fb_drain - Apply the feedback that has arrived
+ * @q: Queue
+ * @now: Current slot
+ *
+ * Each entry is matched to its process by process ID and transmission
+ * slot, then applied with harq_ul_process_feedback(); feedback for a
+ * transmission the process no longer waits on is dropped as stale.
+ *
+ * Return: Feedback entries applied
+ */
+int harq_fb_drain(harq_fb_queue_t *q, uint32_t now);
+
 /* Physical Layer Interface Functions */
 
+/**
+ * harq_set_ul_tx_callback - Redirect uplink transmissions
+ * @cb: Handler, or NULL for the phy_transmit_ul() trace
+ *
+ * With a handler installed the per-TB trace lines are left out too,
+ * so links carrying thousands of TBs per second stay quiet.
+ */
+void harq_set_ul_tx_callback(harq_ul_tx_cb_t cb);
+
+/**
+ * harq_set_ul_fail_callback - Install the handler for given-up TBs
+ * @cb: Handler, or NULL to only trace the loss
+ */
+void harq_set_ul_fail_callback(harq_ul_fail_cb_t cb);
+
 /**
  * phy_transmit_dl - Send data to physical layer for downlink
  * @proc: HARQ process containing data to transmit
@@ -114,20 +506,22 @@ void phy_transmit_dl(harq_process_t *proc);
 /**
  * phy_combine_dl - Combine new data with stored soft bits
  * @proc: HARQ process for combining
- * @new_data: Recently received transport block
- * @new_data_size: Size of the new transport block
+ * @rv: Redundancy version the data was sent with
+ * @new_data: Hard-decided coded bits of the transmission, MSB first
+ * @new_data_size: Size of @new_data in bytes
  *
- * Combines newly received data with previously stored soft bits
- * for improved decoding probability.
+ * Turns each bit into an LLR of magnitude HARQ_LLR_HARD and combines
+ * it with the soft buffer, for improved decoding probability.
  */
-void phy_combine_dl(harq_process_t *proc, uint8_t *new_data, size_t new_data_size);
+void phy_combine_dl(harq_process_t *proc, int rv, const uint8_t *new_data, size_t new_data_size);
 
 /**
  * phy_transmit_ul - Send data to physical layer for uplink
  * @proc: HARQ process containing data to transmit
  *
  * Interface function for triggering physical layer transmission
- * of uplink transport blocks.
+ * of uplink transport blocks. Goes to the handler set with
+ * harq_set_ul_tx_callback() if there is one.
  */
 void phy_transmit_ul(harq_process_t *proc);
 
@@ -137,8 +531,64 @@ void phy_transmit_ul(harq_process_t *proc);
  * @pdu_size: Size of the MAC PDU
  *
  * Delivers successfully decoded MAC PDUs to the RLC sublayer
- * for further processing.
+ * through the MAC demultiplexer.
  */
 void rlc_deliver_mac_pdu(uint8_t *mac_pdu, size_t pdu_size);
 
+/* Soft Combining */
+
+/**
+ * harq_llr_select_engine - Choose the LLR combining implementation
+ * @engine: Requested implementation
+ *
+ * The fastest engine the CPU supports is picked on first use; this
+ * call overrides that choice, e.g. for benchmarking the fallback.
+ *
+ * Return: 0 on success, -1 if @engine is not supported by this CPU
+ */
+int harq_llr_select_engine(harq_llr_engine_t engine);
+
+/**
+ * harq_llr_engine_name - Name of the LLR combining implementation in use
+ *
+ * Return: Human-readable engine name
+ */
+const char *harq_llr_engine_name(void);
+
+/**
+ * harq_llr_combine - Saturating add of LLRs into a soft buffer
+ * @soft: Accumulated LLRs, updated in place
+ * @llrs: LLRs to add
+ * @n: Number of LLRs
+ *
+ * Each sum saturates to -128..127 rather than wrapping, so a run of
+ * confident copies can never flip a bit's sign.
+ */
+void harq_llr_combine(int8_t *soft, const int8_t *llrs, size_t n);
+
+/**
+ * harq_rv_start - Start of a redundancy version in the circular buffer
+ * @ncb: Circular buffer size in coded bits
+ * @rv: Redundancy version, 0 to 3
+ *
+ * k0 of TS 38.212 Table 5.4.2.1-2 for LDPC base graph 1, with the
+ * buffer taken as 66 lifting sizes: 0, 17, 33 and 56 Zc.
+ *
+ * Return: k0, or 0 for an invalid @rv
+ */
+size_t harq_rv_start(size_t ncb, int rv);
+
+/**
+ * harq_soft_combine - Combine LLRs into a circular buffer
+ * @soft: Circular buffer of @ncb LLRs
+ * @ncb: Circular buffer size
+ * @k: Buffer position of the first LLR
+ * @llrs: LLRs to combine
+ * @n: Number of LLRs, possibly more than @ncb (repetition)
+ *
+ * Splits the range at the buffer end into contiguous runs for
+ * harq_llr_combine().
+ */
+void harq_soft_combine(int8_t *soft, size_t ncb, size_t k, const int8_t *llrs, size_t n);
+
 #endif /* HARQ_H */
@@ -0,0 +1,155 @@
+#include "harq.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * harq_arena_init - Preallocate the soft buffers of a set of UEs
+ * @arena: Arena to initialize
+ * @max_tbs: Largest DL TB in bytes
+ * @num_processes: DL HARQ processes per UE
+ * @num_ues: UEs to attach
+ * @ue_limit: Slots per UE for limited-buffer mode, 0 for one per process
+ *
+ * Slots are 64-byte aligned and start with their LLRs, so every soft
+ * buffer starts on a cache line for the combining kernels.
+ */
+int harq_arena_init(harq_arena_t *arena, size_t max_tbs, int num_processes, int num_ues, int ue_limit) {
+    if (!arena || max_tbs == 0 || num_processes < 1 || num_processes > HARQ_MAX_PROCESSES || num_ues < 1 ||
+        ue_limit < 0 || ue_limit > num_processes)
+        return -1;
+    memset(arena, 0, sizeof(*arena));
+    uint64_t slots = (uint64_t)num_ues * (uint64_t)(ue_limit ? ue_limit : num_processes);
+    if (slots > UINT32_MAX) return -1;
+    arena->max_tbs = max_tbs;
+    arena->slot_size = (max_tbs * 9 + 63) & ~(size_t)63;
+    arena->num_slots = (uint32_t)slots;
+    arena->ue_limit = ue_limit;
+    arena->free_slots = malloc(slots * sizeof(uint32_t));
+    if (!arena->free_slots || posix_memalign((void **)&arena->mem, 64, slots * arena->slot_size) != 0) {
+        free(arena->free_slots);
+        arena->free_slots = NULL;
+        arena->mem = NULL;
+        return -1;
+    }
+    /* Popped lowest first, so a lightly loaded arena stays in few pages */
+    for (uint32_t i = 0; i < arena->num_slots; i++)
+        arena->free_slots[i] = arena->num_slots - 1 - i;
+    arena->num_free = arena->num_slots;
+    printf("HARQ arena: %u soft buffers of %zu bytes, %.1f MB\n", arena->num_slots, arena->slot_size,
+           (double)slots * (double)arena->slot_size / 1e6);
+    return 0;
+}
+
+/**
+ * harq_arena_free - Release the memory of an arena
+ * @arena: Arena, with no slot still held
+ */
+void harq_arena_free(harq_arena_t *arena) {
+    if (!arena) return;
+    free(arena->mem);
+    free(arena->free_slots);
+    arena->mem = NULL;
+    arena->free_slots = NULL;
+    arena->num_slots = arena->num_free = 0;
+}
+
+/**
+ * harq_entity_attach_arena - Take the DL soft buffers of a UE from an arena
+ * @ent: Entity with no DL TB in flight
+ * @arena: Arena sized for it
+ */
+int harq_entity_attach_arena(harq_entity_t *ent, harq_arena_t *arena) {
+    if (!ent || !arena || ent->soft_mask) return -1;
+    for (int i = 0; i < ent->num_processes; i++)
+        if (ent->procs[i].soft_buffer) return -1;
+    ent->arena = arena;
+    ent->soft_limit = arena->ue_limit ? arena->ue_limit : ent->num_processes;
+    return 0;
+}
+
+static void harq_arena_put(harq_process_t *proc) {
+    harq_entity_t *ent = proc->entity;
+    harq_arena_t *arena = ent->arena;
+    arena->free_slots[arena->num_free++] = (uint32_t)proc->soft_slot;
+    arena->stats.in_use--;
+    ent->soft_mask &= ~(1u << proc->process_id);
+    proc->soft_slot = -1;
+    proc->tb_data = NULL;
+    proc->soft_buffer = NULL;
+    proc->soft_size = 0;
+}
+
+/*
+ * Slot for a new TB of @proc, taken from the UE's own slots when it
+ * is at its limit. The victim stays WAIT_ACK; its next retransmission
+ * starts combining afresh.
+ */
+static int harq_arena_get(harq_process_t *proc) {
+    harq_entity_t *ent = proc->entity;
+    harq_arena_t *arena = ent->arena;
+    uint32_t others = ent->soft_mask & ~(1u << proc->process_id);
+    if (others && (__builtin_popcount(ent->soft_mask) >= ent->soft_limit || arena->num_free == 0)) {
+        harq_process_t *victim = &ent->procs[__builtin_ctz(others)];
+        printf("HARQ process %d: Soft buffer flushed for process %d\n", victim->process_id, proc->process_id);
+        harq_arena_put(victim);
+        arena->stats.flushes++;
+    }
+    if (arena->num_free == 0) return -1;
+    proc->soft_slot = (int)arena->free_slots[--arena->num_free];
+    ent->soft_mask |= 1u << proc->process_id;
+    arena->stats.allocs++;
+    if (++arena->stats.in_use > arena->stats.peak)
+        arena->stats.peak = arena->stats.in_use;
+    return 0;
+}
+
+/**
+ * harq_soft_acquire - Get the TB and soft buffers of a new DL TB
+ * @proc: Process receiving the TB
+ * @tb_size: TB size in bytes
+ */
+int harq_soft_acquire(harq_process_t *proc, size_t tb_size) {
+    harq_arena_t *arena = proc->entity ? proc->entity->arena : NULL;
+    if (!arena) {
+        free(proc->tb_data);
+        free(proc->soft_buffer);
+        proc->tb_data = (uint8_t *)malloc(tb_size);
+        proc->soft_buffer = (int8_t *)calloc(tb_size, 8);
+        if (!proc->tb_data || !proc->soft_buffer) {
+            harq_soft_release(proc);
+            return -1;
+        }
+        proc->soft_size = tb_size * 8;
+        return 0;
+    }
+
+    if (tb_size > arena->max_tbs || (proc->soft_slot < 0 && harq_arena_get(proc) < 0)) {
+        arena->stats.failures++;
+        if (proc->soft_slot >= 0)
+            harq_arena_put(proc);
+        return -1;
+    }
+    uint8_t *slot = arena->mem + (size_t)proc->soft_slot * arena->slot_size;
+    proc->soft_buffer = (int8_t *)slot;
+    proc->tb_data = slot + 8 * arena->max_tbs;
+    proc->soft_size = tb_size * 8;
+    memset(proc->soft_buffer, 0, proc->soft_size);
+    return 0;
+}
+
+/**
+ * harq_soft_release - Give back the TB and soft buffers of a process
+ * @proc: Process, possibly holding none
+ */
+void harq_soft_release(harq_process_t *proc) {
+    if (proc->soft_slot >= 0) {
+        harq_arena_put(proc);
+        return;
+    }
+    free(proc->tb_data);
+    free(proc->soft_buffer);
+    proc->tb_data = NULL;
+    proc->soft_buffer = NULL;
+    proc->soft_size = 0;
+}
@@ -0,0 +1,93 @@
+#include "harq.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * harq_fb_queue_init - Set up a feedback queue
+ * @q: Queue to initialize
+ * @size: Feedback in flight at most
+ * @delay: Slots from a transmission to its feedback
+ */
+int harq_fb_queue_init(harq_fb_queue_t *q, uint32_t size, uint32_t delay) {
+    if (!q || size == 0 || size > (1u << 31) || delay == 0) return -1;
+    uint32_t entries = 1;
+    while (entries < size)
+        entries <<= 1;
+    memset(q, 0, sizeof(*q));
+    q->ring = calloc(entries, sizeof(harq_feedback_t));
+    if (!q->ring) return -1;
+    q->mask = entries - 1;
+    q->delay = delay;
+    return 0;
+}
+
+/**
+ * harq_fb_queue_free - Release the storage of a feedback queue
+ * @q: Queue
+ */
+void harq_fb_queue_free(harq_fb_queue_t *q) {
+    if (!q) return;
+    free(q->ring);
+    q->ring = NULL;
+    q->head = q->tail = 0;
+}
+
+/**
+ * harq_fb_push - Queue the feedback of a process's latest transmission
+ * @q: Queue
+ * @proc: Pooled process that transmitted
+ * @ack: Whether the TB was decoded
+ */
+int harq_fb_push(harq_fb_queue_t *q, const harq_process_t *proc, int ack) {
+    if (!q || !proc || !proc->entity) return -1;
+    if (q->tail - q->head > q->mask) {
+        q->stats.overflows++;
+        return -1;
+    }
+    harq_feedback_t *fb = &q->ring[q->tail++ & q->mask];
+    fb->entity = proc->entity;
+    fb->slot = proc->tx_slot;
+    fb->due = proc->tx_slot + q->delay;
+    fb->pid = (uint8_t)proc->process_id;
+    fb->ack = ack ? 1 : 0;
+    return 0;
+}
+
+/**
+ * harq_fb_drain - Apply the feedback that has arrived
+ * @q: Queue
+ * @now: Current slot
+ *
+ * A process that was retransmitted, or went idle, since the
+ * transmission the feedback answers has a different @tx_slot or
+ * state, and one already NACKed has its retransmission pending, so
+ * late or duplicate feedback cannot touch a newer TB.
+ */
+int harq_fb_drain(harq_fb_queue_t *q, uint32_t now) {
+    int applied = 0;
+    while (q->head != q->tail) {
+        /* Copied out: applying it may push new feedback into the entry */
+        harq_feedback_t fb = q->ring[q->head & q->mask];
+        if ((int32_t)(now - fb.due) < 0) break;
+        q->head++;
+        harq_process_t *proc = &fb.entity->procs[fb.pid];
+        /* A NACK already taken leaves the retransmission pending or due */
+        int answered = proc->retx_pending || (fb.entity->retx_mask & (1u << fb.pid));
+        if (proc->state != HARQ_WAIT_ACK || proc->tx_slot != fb.slot || answered) {
+            q->stats.stale++;
+            continue;
+        }
+        if (fb.ack) {
+            q->stats.acks++;
+            q->stats.acked_bytes += proc->sdu_bytes;
+        } else {
+            q->stats.nacks++;
+        }
+        harq_ul_process_feedback(proc, fb.ack);
+        /* Only giving up turns a NACKed process idle */
+        if (!fb.ack && proc->state == HARQ_IDLE)
+            q->stats.failures++;
+        applied++;
+    }
+    return applied;
+}
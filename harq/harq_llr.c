@@ -0,0 +1,167 @@
+#include "harq.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HARQ_HAVE_SIMD 1
+#endif
+
+/* --------------------------------------------------------------------------
+   Portable Implementation
+   -------------------------------------------------------------------------- */
+
+/*
+ * Kept scalar so it stays the reference the benchmark compares against:
+ * at -O2 gcc would otherwise turn the clamp into the same SSE2 adds.
+ */
+__attribute__((optimize("no-tree-vectorize")))
+static void llr_combine_scalar(int8_t *soft, const int8_t *llrs, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        int sum = soft[i] + llrs[i];
+        /* Two independent clamps, so both become cmov rather than branches */
+        sum = sum < INT8_MIN ? INT8_MIN : sum;
+        soft[i] = (int8_t)(sum > INT8_MAX ? INT8_MAX : sum);
+    }
+}
+
+/* --------------------------------------------------------------------------
+   SSE2 / AVX2 Implementations
+   -------------------------------------------------------------------------- */
+#ifdef HARQ_HAVE_SIMD
+__attribute__((target("sse2")))
+static void llr_combine_sse2(int8_t *soft, const int8_t *llrs, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(soft + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(llrs + i));
+        _mm_storeu_si128((__m128i *)(soft + i), _mm_adds_epi8(a, b));
+    }
+    llr_combine_scalar(soft + i, llrs + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void llr_combine_avx2(int8_t *soft, const int8_t *llrs, size_t n) {
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(soft + i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(soft + i + 32));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(llrs + i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(llrs + i + 32));
+        _mm256_storeu_si256((__m256i *)(soft + i), _mm256_adds_epi8(a0, b0));
+        _mm256_storeu_si256((__m256i *)(soft + i + 32), _mm256_adds_epi8(a1, b1));
+    }
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(soft + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(llrs + i));
+        _mm256_storeu_si256((__m256i *)(soft + i), _mm256_adds_epi8(a, b));
+    }
+    llr_combine_sse2(soft + i, llrs + i, n - i);
+}
+#endif /* HARQ_HAVE_SIMD */
+
+/* --------------------------------------------------------------------------
+   Runtime Engine Selection
+   -------------------------------------------------------------------------- */
+typedef void (*llr_combine_fn)(int8_t *, const int8_t *, size_t);
+
+static struct {
+    int selected;
+    harq_llr_engine_t engine;
+    llr_combine_fn combine;
+} llr_ops;
+
+/**
+ * harq_llr_select_engine - Choose the LLR combining implementation
+ * @engine: Requested implementation
+ *
+ * Return: 0 on success, -1 if @engine is not supported by this CPU
+ */
+int harq_llr_select_engine(harq_llr_engine_t engine) {
+    switch (engine) {
+    case HARQ_LLR_SCALAR:
+        llr_ops.combine = llr_combine_scalar;
+        break;
+#ifdef HARQ_HAVE_SIMD
+    case HARQ_LLR_SSE2:
+        if (!__builtin_cpu_supports("sse2")) return -1;
+        llr_ops.combine = llr_combine_sse2;
+        break;
+    case HARQ_LLR_AVX2:
+        if (!__builtin_cpu_supports("avx2")) return -1;
+        llr_ops.combine = llr_combine_avx2;
+        break;
+#endif
+    default:
+        return -1;
+    }
+    llr_ops.engine = engine;
+    llr_ops.selected = 1;
+    return 0;
+}
+
+static inline void llr_ensure_selected(void) {
+    if (!llr_ops.selected) {
+        if (harq_llr_select_engine(HARQ_LLR_AVX2) < 0 && harq_llr_select_engine(HARQ_LLR_SSE2) < 0)
+            harq_llr_select_engine(HARQ_LLR_SCALAR);
+    }
+}
+
+/**
+ * harq_llr_engine_name - Name of the LLR combining implementation in use
+ */
+const char *harq_llr_engine_name(void) {
+    llr_ensure_selected();
+    switch (llr_ops.engine) {
+    case HARQ_LLR_AVX2: return "AVX2";
+    case HARQ_LLR_SSE2: return "SSE2";
+    default: return "scalar";
+    }
+}
+
+/**
+ * harq_llr_combine - Saturating add of LLRs into a soft buffer
+ * @soft: Accumulated LLRs, updated in place
+ * @llrs: LLRs to add
+ * @n: Number of LLRs
+ */
+void harq_llr_combine(int8_t *soft, const int8_t *llrs, size_t n) {
+    llr_ensure_selected();
+    llr_ops.combine(soft, llrs, n);
+}
+
+/* --------------------------------------------------------------------------
+   Circular Buffer
+   -------------------------------------------------------------------------- */
+
+/**
+ * harq_rv_start - Start of a redundancy version in the circular buffer
+ * @ncb: Circular buffer size in coded bits
+ * @rv: Redundancy version, 0 to 3
+ *
+ * k0 = floor(x * Ncb / (66 Zc)) * Zc reduces to x * (Ncb / 66) when
+ * the buffer is taken as 66 lifting sizes.
+ */
+size_t harq_rv_start(size_t ncb, int rv) {
+    static const size_t k0_zc[4] = { 0, 17, 33, 56 };
+    if (rv < 0 || rv > 3) return 0;
+    return k0_zc[rv] * (ncb / 66);
+}
+
+/**
+ * harq_soft_combine - Combine LLRs into a circular buffer
+ * @soft: Circular buffer of @ncb LLRs
+ * @ncb: Circular buffer size
+ * @k: Buffer position of the first LLR
+ * @llrs: LLRs to combine
+ * @n: Number of LLRs
+ */
+void harq_soft_combine(int8_t *soft, size_t ncb, size_t k, const int8_t *llrs, size_t n) {
+    if (!soft || !llrs || ncb == 0) return;
+    k %= ncb;
+    while (n > 0) {
+        size_t run = ncb - k < n ? ncb - k : n;
+        harq_llr_combine(soft + k, llrs, run);
+        llrs += run;
+        n -= run;
+        k = 0;
+    }
+}
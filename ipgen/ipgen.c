@@ -1,4 +1,5 @@
 #include "ipgen.h"
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -41,54 +42,119 @@ static uint16_t ip_checksum(void *vdata, size_t length) {
 }
 
 /**
- * generate_dummy_ip_packet - Create a test IPv4 packet
- * @packet_size: Pointer to store total packet size
+ * udp_checksum - Calculate UDP checksum over pseudo-header and datagram
+ * @iph: IPv4 header providing addresses and protocol
+ * @udp: UDP header and payload (checksum field must be zero)
+ * @udp_len: Length of UDP header and payload
  *
- * Generates an IPv4 packet with:
- * - Source IP: 192.168.1.100
- * - Destination IP: 192.168.1.200
+ * Return: 16-bit checksum in network byte order (0xffff if the
+ * computed value is zero, as required by RFC 768)
+ */
+static uint16_t udp_checksum(const struct ip_header *iph, const uint8_t *udp, size_t udp_len) {
+    uint32_t acc = 0;
+    const uint8_t *addrs = (const uint8_t *)&iph->src_addr;
+
+    /* Pseudo-header: source, destination, zero, protocol, UDP length */
+    for (size_t i = 0; i < 8; i += 2)
+        acc += ((uint32_t)addrs[i] << 8) | addrs[i + 1];
+    acc += iph->protocol;
+    acc += (uint32_t)udp_len;
+
+    /* UDP header and payload, odd byte padded with zero */
+    for (size_t i = 0; i + 1 < udp_len; i += 2)
+        acc += ((uint32_t)udp[i] << 8) | udp[i + 1];
+    if (udp_len & 1)
+        acc += (uint32_t)udp[udp_len - 1] << 8;
+
+    while (acc > 0xffff)
+        acc = (acc & 0xffff) + (acc >> 16);
+    uint16_t sum = (uint16_t)~acc;
+    return htons(sum ? sum : 0xffff);
+}
+
+/**
+ * generate_udp_packet - Create an IPv4/UDP packet
+ * @src_addr: Source IPv4 address (network byte order)
+ * @dest_addr: Destination IPv4 address (network byte order)
+ * @src_port: UDP source port (host byte order)
+ * @dest_port: UDP destination port (host byte order)
+ * @payload: UDP payload
+ * @payload_len: Length of @payload in bytes
+ *
+ * Generates an IPv4/UDP packet with:
  * - Protocol: UDP (17)
  * - TTL: 64
  * - Don't Fragment flag set
- * - Test payload message
+ * - Identification increasing by one per packet
+ * - Valid IPv4 header and UDP checksums
  *
- * Return: Pointer to complete packet (caller must free) or NULL on error
+ * Return: Packet buffer holding the complete packet or NULL on error
  */
-uint8_t* generate_dummy_ip_packet(size_t *packet_size) {
-    /* Create test payload */
-    const char *payload = "Dummy IP Packet: Hello from the Network Layer!";
-    size_t payload_len = strlen(payload);
+pktbuf_t *generate_udp_packet(uint32_t src_addr, uint32_t dest_addr, uint16_t src_port,
+                              uint16_t dest_port, const uint8_t *payload, size_t payload_len) {
+    static uint16_t next_identification = 0x1234;
 
     /* Calculate total packet size */
     size_t header_len = sizeof(struct ip_header);
-    *packet_size = header_len + payload_len;
+    size_t udp_len = sizeof(struct udp_header) + payload_len;
+    size_t packet_size = header_len + udp_len;
 
-    /* Allocate packet buffer */
-    uint8_t *packet = malloc(*packet_size);
-    if (!packet) {
+    /* Allocate packet buffer with headroom for the lower layer headers */
+    pktbuf_t *buf = pktbuf_alloc(packet_size);
+    if (!buf) {
         perror("malloc");
         return NULL;
     }
+    uint8_t *packet = pktbuf_append(buf, packet_size);
 
     /* Initialize IPv4 header */
     struct ip_header iph;
     iph.ver_ihl = (4 << 4) | (header_len / 4);  /* IPv4 with 5 32-bit words */
     iph.tos = 0;
-    iph.total_length = htons(*packet_size);
-    iph.identification = htons(0x1234);          /* Example packet ID */
+    iph.total_length = htons(packet_size);
+    iph.identification = htons(next_identification++);
     iph.flags_fragment = htons(0x4000);          /* Set Don't Fragment flag */
     iph.ttl = 64;
     iph.protocol = 17;                           /* UDP protocol */
     iph.checksum = 0;                            /* Zero before checksum calculation */
-    iph.src_addr = inet_addr("192.168.1.100");
-    iph.dest_addr = inet_addr("192.168.1.200");
+    iph.src_addr = src_addr;
+    iph.dest_addr = dest_addr;
 
     /* Calculate header checksum */
     iph.checksum = ip_checksum(&iph, header_len);
 
-    /* Assemble complete packet */
+    /* Initialize UDP header */
+    struct udp_header udph;
+    udph.src_port = htons(src_port);
+    udph.dest_port = htons(dest_port);
+    udph.length = htons(udp_len);
+    udph.checksum = 0;
+
+    /* Assemble complete packet, then checksum the datagram in place */
+    uint8_t *udp = packet + header_len;
     memcpy(packet, &iph, header_len);
-    memcpy(packet + header_len, payload, payload_len);
+    memcpy(udp, &udph, sizeof(udph));
+    memcpy(udp + sizeof(udph), payload, payload_len);
+    udph.checksum = udp_checksum(&iph, udp, udp_len);
+    memcpy(udp + offsetof(struct udp_header, checksum), &udph.checksum, 2);
+
+    return buf;
+}
+
+/**
+ * generate_dummy_ip_packet - Create a test IPv4 packet
+ *
+ * Generates an IPv4/UDP packet with:
+ * - Source: 192.168.1.100, port 5000
+ * - Destination: 192.168.1.200, port 6000
+ * - Test payload message
+ *
+ * Return: Packet buffer holding the complete packet or NULL on error
+ */
+pktbuf_t *generate_dummy_ip_packet(void) {
+    /* Create test payload */
+    const char *payload = "Dummy IP Packet: Hello from the Network Layer!";
 
-    return packet;
+    return generate_udp_packet(inet_addr("192.168.1.100"), inet_addr("192.168.1.200"),
+                               5000, 6000, (const uint8_t *)payload, strlen(payload));
 }
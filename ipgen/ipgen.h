@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "../pktbuf/pktbuf.h"
 
 /**
  * struct ip_header - IPv4 header structure (20 bytes)
@@ -34,16 +35,52 @@ struct ip_header {
     uint32_t dest_addr;    // Destination IP address
 } __attribute__((packed));
 
+/**
+ * struct udp_header - UDP header structure (8 bytes)
+ * @src_port: Source port
+ * @dest_port: Destination port
+ * @length: Length of UDP header and payload
+ * @checksum: Checksum over pseudo-header, header and payload (0 = none)
+ *
+ * Defines the UDP header as specified in RFC 768, all fields
+ * in network byte order.
+ */
+struct udp_header {
+    uint16_t src_port;
+    uint16_t dest_port;
+    uint16_t length;
+    uint16_t checksum;
+} __attribute__((packed));
+
+/**
+ * generate_udp_packet - Create an IPv4/UDP packet
+ * @src_addr: Source IPv4 address (network byte order)
+ * @dest_addr: Destination IPv4 address (network byte order)
+ * @src_port: UDP source port (host byte order)
+ * @dest_port: UDP destination port (host byte order)
+ * @payload: UDP payload
+ * @payload_len: Length of @payload in bytes
+ *
+ * Builds a packet with valid IPv4 header checksum and UDP checksum
+ * in a packet buffer with headroom for the lower layer headers.
+ * The IP identification field increases by one per generated packet.
+ *
+ * Return: Packet buffer holding the packet or NULL on error
+ */
+pktbuf_t *generate_udp_packet(uint32_t src_addr, uint32_t dest_addr, uint16_t src_port,
+                              uint16_t dest_port, const uint8_t *payload, size_t payload_len);
+
 /**
  * generate_dummy_ip_packet - Create a test IPv4 packet
- * @packet_size: Pointer to store the total packet size
  *
- * Generates an IPv4 packet with static source (192.168.1.100)
- * and destination (192.168.1.200) addresses. The packet includes
- * a valid header and dummy payload data.
+ * Generates an IPv4/UDP packet with static source (192.168.1.100:5000)
+ * and destination (192.168.1.200:6000) addresses. The packet includes
+ * valid headers and dummy payload data. It is built directly in a
+ * packet buffer with headroom so lower layers can prepend their
+ * headers without copying.
  *
- * Return: Pointer to the generated packet (caller must free)
+ * Return: Packet buffer holding the packet (release with pktbuf_free)
  */
-uint8_t* generate_dummy_ip_packet(size_t *packet_size);
+pktbuf_t *generate_dummy_ip_packet(void);
 
 #endif // IPGEN_H
@@ -1,6 +1,7 @@
 #include "loopback.h"
-#include "../rlc/rlc.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 /**
  * global_rlc_dl_entity - Global downlink RLC entity pointer
@@ -14,24 +15,117 @@ extern rlc_entity_t *global_rlc_dl_entity;
 /**
  * mac_loopback_pdu - Process loopback of MAC PDU
  * @harq: HARQ process associated with original transmission
- * @pdu: MAC PDU data to loopback
- * @pdu_size: Size of MAC PDU in bytes
+ * @pdu: MAC PDU to loopback
  *
  * Simulates physical layer loopback by:
  * 1. Verifying downlink RLC entity is available
- * 2. Forwarding PDU to RLC layer in transparent mode
- * 3. Allowing RLC to process and forward to PDCP
+ * 2. Gathering the PDU chain into a receive buffer
+ * 3. Forwarding PDU to the RLC entity in its configured mode
+ * 4. Allowing RLC to process and forward to PDCP
  *
  * Uses existing downlink RLC entity rather than creating
  * a new one for each loopback operation.
  */
-void mac_loopback_pdu(harq_process_t *harq, uint8_t *pdu, size_t pdu_size) {
+void mac_loopback_pdu(harq_process_t *harq, const pktbuf_t *pdu) {
+    size_t pdu_size = pktbuf_pkt_len(pdu);
     printf("MAC Loopback: Received MAC PDU from PHY (size: %zu bytes).\n", pdu_size);
     if (global_rlc_dl_entity == NULL) {
         printf("MAC Loopback: Error – no downlink RLC entity available.\n");
         return;
     }
 
-    /* Forward PDU to RLC layer for transparent mode processing */
-    rlc_tm_rx_data(global_rlc_dl_entity, pdu, pdu_size);
+    /* The receive buffer stands in for the PHY's decoded transport block */
+    pktbuf_t *rx = pktbuf_alloc(pdu_size);
+    if (!rx) return;
+    pktbuf_copy_out(pdu, pktbuf_append(rx, pdu_size), pdu_size);
+
+    /* Forward PDU to RLC layer */
+    rlc_rx_pdu(global_rlc_dl_entity, rx->data, rx->len);
+    pktbuf_free(rx);
+}
+
+/* --------------------------------------------------------------------------
+   Lossy Loopback Channel
+   -------------------------------------------------------------------------- */
+
+int loopback_channel_init(loopback_channel_t *ch, uint32_t size, uint32_t delay, uint32_t loss_ppm,
+                          uint32_t burst, uint32_t seed) {
+    if (!ch || size == 0 || (size & (size - 1)) || burst == 0 || loss_ppm > 1000000) return -1;
+    memset(ch, 0, sizeof(*ch));
+    ch->pdus = calloc(size, sizeof(pktbuf_t *));
+    ch->due = calloc(size, sizeof(uint32_t));
+    if (!ch->pdus || !ch->due) {
+        loopback_channel_free(ch);
+        return -1;
+    }
+    ch->size = size;
+    ch->delay = delay;
+    ch->loss_ppm = loss_ppm;
+    ch->burst = burst;
+    ch->rng = seed ? seed : 1;
+    return 0;
+}
+
+void loopback_channel_free(loopback_channel_t *ch) {
+    if (!ch) return;
+    while (ch->pdus && ch->head != ch->tail)
+        pktbuf_free(ch->pdus[ch->head++ & (ch->size - 1)]);
+    free(ch->pdus);
+    free(ch->due);
+    ch->pdus = NULL;
+    ch->due = NULL;
+}
+
+/* xorshift32: cheap and repeatable, plenty for a loss model */
+static uint32_t loopback_channel_rand(loopback_channel_t *ch) {
+    uint32_t x = ch->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    ch->rng = x;
+    return x;
+}
+
+void loopback_channel_send(loopback_channel_t *ch, pktbuf_t *pdu, uint32_t now) {
+    ch->stats.sent++;
+    if (ch->burst_left == 0 && ch->loss_ppm &&
+        loopback_channel_rand(ch) * (1e6 / 4294967296.0) * ch->burst < ch->loss_ppm)
+        ch->burst_left = ch->burst;
+    if (ch->burst_left > 0) {
+        ch->burst_left--;
+        ch->stats.lost++;
+        pktbuf_free(pdu);
+        return;
+    }
+    if (ch->tail - ch->head == ch->size) {
+        ch->stats.overflow++;
+        pktbuf_free(pdu);
+        return;
+    }
+    ch->pdus[ch->tail & (ch->size - 1)] = pdu;
+    ch->due[ch->tail & (ch->size - 1)] = now + ch->delay;
+    ch->tail++;
+}
+
+size_t loopback_channel_deliver(loopback_channel_t *ch, uint32_t now, rlc_entity_t *rx) {
+    size_t delivered = 0;
+    while (ch->head != ch->tail && (int32_t)(now - ch->due[ch->head & (ch->size - 1)]) >= 0) {
+        pktbuf_t *pdu = ch->pdus[ch->head++ & (ch->size - 1)];
+        if (!rx) {
+            pktbuf_free(pdu);
+            delivered++;
+            continue;
+        }
+        size_t pdu_size = pktbuf_pkt_len(pdu);
+        pktbuf_t *buf = pktbuf_alloc(pdu_size);
+        if (buf) {
+            pktbuf_copy_out(pdu, pktbuf_append(buf, pdu_size), pdu_size);
+            rlc_rx_pdu(rx, buf->data, buf->len);
+            pktbuf_free(buf);
+            delivered++;
+        }
+        pktbuf_free(pdu);
+    }
+    ch->stats.delivered += delivered;
+    return delivered;
 }
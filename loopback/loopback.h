@@ -4,18 +4,113 @@
 #include <stddef.h>
 #include <stdint.h>
 #include "../harq/harq.h"
+#include "../pktbuf/pktbuf.h"
+#include "../rlc/rlc.h"
 
 /**
  * mac_loopback_pdu - Simulate physical layer loopback
  * @harq: HARQ process used for uplink transmission
- * @pdu: MAC PDU to loopback
- * @pdu_size: Size of MAC PDU in bytes
+ * @pdu: MAC PDU to loopback (not consumed)
  *
  * Simulates physical layer loopback by taking an uplink MAC PDU
  * and feeding it back through the downlink processing chain.
+ * The transmitted buffer is copied into a separate receive buffer,
+ * as the radio would, so in-place processing on the receive side
+ * never touches bytes HARQ may still retransmit.
  * Uses a pre-configured global downlink RLC entity rather than
  * creating a new one for each loopback operation.
  */
-void mac_loopback_pdu(harq_process_t *harq, uint8_t *pdu, size_t pdu_size);
+void mac_loopback_pdu(harq_process_t *harq, const pktbuf_t *pdu);
+
+/**
+ * struct loopback_channel_stats_t - Lossy channel counters
+ * @sent: PDUs handed to the channel
+ * @lost: PDUs dropped by the loss model
+ * @overflow: PDUs dropped because the channel was full
+ * @delivered: PDUs handed to the receiving RLC entity
+ */
+typedef struct {
+    uint64_t sent;
+    uint64_t lost;
+    uint64_t overflow;
+    uint64_t delivered;
+} loopback_channel_stats_t;
+
+/**
+ * struct loopback_channel_t - Delaying, lossy loopback link
+ * @pdus: PDUs in flight, in send order
+ * @due: Delivery time of each PDU in @pdus
+ * @size: Number of slots (power of two)
+ * @head: Oldest PDU in flight
+ * @tail: Next free slot
+ * @delay: One-way delay in ms
+ * @loss_ppm: Average loss rate in PDUs per million
+ * @burst: Consecutive PDUs dropped by each loss event
+ * @burst_left: PDUs still to drop in the current loss event
+ * @rng: xorshift32 state of the loss model
+ * @stats: Counters
+ *
+ * Stands in for HARQ residual errors when driving RLC AM: every PDU
+ * arrives @delay ms after it was sent, in order, unless the loss
+ * model drops it. Loss events start with probability
+ * @loss_ppm / @burst per PDU, so the average loss rate does not
+ * depend on the burst length.
+ */
+typedef struct {
+    pktbuf_t **pdus;
+    uint32_t *due;
+    uint32_t size;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t delay;
+    uint32_t loss_ppm;
+    uint32_t burst;
+    uint32_t burst_left;
+    uint32_t rng;
+    loopback_channel_stats_t stats;
+} loopback_channel_t;
+
+/**
+ * loopback_channel_init - Set up a lossy loopback channel
+ * @ch: Channel to initialize
+ * @size: Most PDUs in flight, a power of two
+ * @delay: One-way delay in ms
+ * @loss_ppm: Average loss rate in PDUs per million
+ * @burst: PDUs lost per loss event (at least 1)
+ * @seed: Seed of the loss model, for repeatable runs
+ *
+ * Return: 0 on success, -1 for bad parameters or on allocation failure
+ */
+int loopback_channel_init(loopback_channel_t *ch, uint32_t size, uint32_t delay, uint32_t loss_ppm,
+                          uint32_t burst, uint32_t seed);
+
+/**
+ * loopback_channel_free - Release a channel and the PDUs still in flight
+ * @ch: Channel to free
+ */
+void loopback_channel_free(loopback_channel_t *ch);
+
+/**
+ * loopback_channel_send - Transmit a PDU over the channel
+ * @ch: Channel
+ * @pdu: PDU to transmit (consumed)
+ * @now: Current time in ms
+ */
+void loopback_channel_send(loopback_channel_t *ch, pktbuf_t *pdu, uint32_t now);
+
+/**
+ * loopback_channel_deliver - Hand the PDUs due by now to an RLC entity
+ * @ch: Channel
+ * @now: Current time in ms
+ * @rx: Receiving RLC entity, or NULL to only count the PDUs
+ *
+ * Each PDU is gathered into its own receive buffer, as in
+ * mac_loopback_pdu(), and passed to rlc_rx_pdu(). PDUs the receiver
+ * sends back meanwhile are queued behind them. Without a receiver
+ * the PDUs are dropped once due, for runs measuring the link itself.
+ *
+ * Return: Number of PDUs delivered
+ */
+size_t loopback_channel_deliver(loopback_channel_t *ch, uint32_t now, rlc_entity_t *rx);
 
 #endif /* LOOPBACK_H */
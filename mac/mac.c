@@ -3,17 +3,43 @@
 #include <stdlib.h>
 #include <string.h>
 #include "../harq/harq.h"
+#include "../rlc/rlc.h"
+#include "../timer/timer.h"
+
+// RLC PDUs one logical channel may put in a TB
+#define MAC_MUX_MAX_PDUS 512
 
 /* --- HARQ Process Pool --- */
-/* For simplicity we use a single static HARQ process.
-   In a full system, you may allocate a pool and select one based on criteria.
-*/
-static harq_process_t global_harq_process;
+/* HARQ entities of the simulated UE, indexed by direction_t */
+static harq_entity_t global_harq[2];
+
+/* Soft buffers of the DL processes, allocated once */
+static harq_arena_t global_harq_arena;
+
+/* DL dispatch table of the simulated UE */
+static mac_rx_table_t global_rx_table;
+
+harq_entity_t *mac_get_harq_entity(direction_t dir) {
+    // Initialized on first use: the HARQ RTT timers need an expiry handler
+    static int initialized;
+    if (!initialized) {
+        harq_entity_init(&global_harq[DIRECTION_DOWNLINK], HARQ_MAX_PROCESSES, HARQ_RTT_SLOTS);
+        harq_entity_init(&global_harq[DIRECTION_UPLINK], HARQ_MAX_PROCESSES, HARQ_RTT_SLOTS);
+        // Without the arena the DL processes fall back to malloc per TB
+        if (harq_arena_init(&global_harq_arena, MAC_DL_MAX_TBS, HARQ_MAX_PROCESSES, 1, 0) == 0)
+            harq_entity_attach_arena(&global_harq[DIRECTION_DOWNLINK], &global_harq_arena);
+        initialized = 1;
+    }
+    return &global_harq[dir];
+}
+
+harq_arena_t *mac_get_harq_arena(void) {
+    mac_get_harq_entity(DIRECTION_DOWNLINK);
+    return &global_harq_arena;
+}
 
 harq_process_t* mac_get_harq_process(void) {
-    // Ensure the global HARQ process is initialized (could be done once during system init)
-    // Here we assume it is already initialized or we could call harq_init_process(&global_harq_process, <id>);
-    return &global_harq_process;
+    return harq_next_free(mac_get_harq_entity(DIRECTION_UPLINK));
 }
 
 /* --------------------------------------------------------------------------
@@ -25,88 +51,576 @@ void mac_dl_sch_data_transfer(harq_process_t *proc, int received_ndi, int receiv
     harq_handle_dl_assignment(proc, received_ndi, received_rv, tb_data, tb_size);
 }
 
-void mac_ul_sch_data_transfer(harq_process_t *proc, uint8_t *mac_pdu, size_t pdu_size) {
+void mac_ul_sch_data_transfer(harq_process_t *proc, pktbuf_t *mac_pdu) {
     printf("MAC: Processing UL-SCH data transfer\n");
-    harq_ul_start_tx(proc, mac_pdu, pdu_size);
+    harq_ul_start_tx(proc, mac_pdu);
 }
 
 /* --------------------------------------------------------------------------
-   Logical Channel Multiplexing/Demultiplexing
+   Logical Channel Prioritization
    -------------------------------------------------------------------------- */
-uint8_t *mac_multiplex(logical_channel_t *channels, int num_channels, size_t *pdu_size) {
-    size_t total_size = 0;
+
+/* Longest MAC SDU a 16-bit L field describes */
+#define MAC_SDU_MAX_LEN 0xFFFF
+
+/* Bytes a channel can send in one PDU */
+static size_t mac_lcp_pending(const logical_channel_t *lc) {
+    return lc->buffer_size < MAC_SDU_MAX_LEN ? lc->buffer_size : MAC_SDU_MAX_LEN;
+}
+
+/*
+ * Largest MAC SDU that fits @budget with its subheader. The L field
+ * grows to 16 bits past 255 bytes, so a budget of 258 still only
+ * takes 255.
+ */
+static size_t mac_sdu_fit(size_t budget) {
+    if (budget <= 2) return 0;
+    if (budget - 2 <= 255) return budget - 2;
+    if (budget - 3 >= 256) return budget - 3;
+    return 255;
+}
+
+int mac_lcp_init(mac_lcp_t *lcp, logical_channel_t *channels, int num_channels) {
+    if (!lcp || !channels || num_channels <= 0 || num_channels > MAC_MAX_LCH) return -1;
+    lcp->channels = channels;
+    lcp->num_channels = num_channels;
+    lcp->last_tick = timer_now(timer_get_wheel());
+    lcp->bsr = NULL;
+    // Insertion sort, once per configuration: stable, and n is at most 32
     for (int i = 0; i < num_channels; i++) {
-        if (channels[i].buffer_size > 0) {
-            total_size += 3 + channels[i].buffer_size;
+        int j = i;
+        while (j > 0 && channels[lcp->order[j - 1]].priority > channels[i].priority) {
+            lcp->order[j] = lcp->order[j - 1];
+            j--;
         }
+        lcp->order[j] = (uint8_t)i;
+        channels[i].bucket = 0;
     }
-    if (total_size == 0) {
-        *pdu_size = 0;
-        return NULL;
-    }
-    uint8_t *pdu = (uint8_t *)malloc(total_size);
-    if (!pdu) {
-        *pdu_size = 0;
-        return NULL;
+    return 0;
+}
+
+/* Adds PBR for every whole ms since the last fill, up to PBR * BSD. */
+static void mac_lcp_fill_buckets(mac_lcp_t *lcp) {
+    const timer_wheel_t *wheel = timer_get_wheel();
+    uint32_t ms = (timer_now(wheel) - lcp->last_tick) / wheel->ticks_per_ms;
+    if (ms == 0) return;
+    lcp->last_tick += ms * wheel->ticks_per_ms;
+    for (int i = 0; i < lcp->num_channels; i++) {
+        logical_channel_t *lc = &lcp->channels[i];
+        if (lc->pbr == MAC_PBR_INFINITY) continue;
+        int64_t size = (int64_t)lc->pbr * lc->bsd;
+        lc->bucket += (int64_t)lc->pbr * ms;
+        if (lc->bucket > size)
+            lc->bucket = size;
     }
-    size_t offset = 0;
-    for (int i = 0; i < num_channels; i++) {
-        if (channels[i].buffer_size > 0) {
-            pdu[offset++] = (uint8_t)channels[i].channel_id;
-            pdu[offset++] = (uint8_t)(channels[i].buffer_size & 0xFF);
-            pdu[offset++] = (uint8_t)((channels[i].buffer_size >> 8) & 0xFF);
-            memcpy(&pdu[offset], channels[i].buffer, channels[i].buffer_size);
-            offset += channels[i].buffer_size;
+}
+
+size_t mac_lcp_allocate(mac_lcp_t *lcp, size_t grant, size_t *alloc) {
+    if (!lcp || !alloc) return 0;
+    size_t left = grant;
+    mac_lcp_fill_buckets(lcp);
+    memset(alloc, 0, (size_t)lcp->num_channels * sizeof(*alloc));
+
+    // Step 1: channels with Bj > 0, in priority order, up to Bj
+    for (int k = 0; k < lcp->num_channels && left > 2; k++) {
+        int i = lcp->order[k];
+        logical_channel_t *lc = &lcp->channels[i];
+        size_t n = mac_lcp_pending(lc);
+        if (n == 0) continue;
+        if (lc->pbr != MAC_PBR_INFINITY) {
+            if (lc->bucket <= 0) continue;
+            if ((uint64_t)lc->bucket < n)
+                n = (size_t)lc->bucket;
         }
+        size_t fit = mac_sdu_fit(left);
+        if (n > fit)
+            n = fit;
+        alloc[i] = n;
+        left -= n + mac_subheader_size(n);
+        // Step 2: Bj is charged only for what step 1 gave
+        if (lc->pbr != MAC_PBR_INFINITY)
+            lc->bucket -= (int64_t)n;
+    }
+
+    // Step 3: the rest in strict priority order, whatever the buckets hold
+    for (int k = 0; k < lcp->num_channels && left > 0; k++) {
+        int i = lcp->order[k];
+        logical_channel_t *lc = &lcp->channels[i];
+        size_t n = mac_lcp_pending(lc);
+        if (n <= alloc[i]) continue;
+        // A channel served in step 1 grows its subPDU, subheader included
+        size_t budget = left + (alloc[i] ? alloc[i] + mac_subheader_size(alloc[i]) : 0);
+        size_t fit = mac_sdu_fit(budget);
+        if (n > fit)
+            n = fit;
+        if (n <= alloc[i]) continue;
+        alloc[i] = n;
+        left = budget - n - mac_subheader_size(n);
     }
-    *pdu_size = total_size;
-    printf("MAC Multiplex: Created MAC PDU of size %zu bytes\n", total_size);
-    return pdu;
+    return grant - left;
 }
 
-void mac_demultiplex(uint8_t *mac_pdu, size_t pdu_size) {
+/* --------------------------------------------------------------------------
+   Logical Channel Multiplexing/Demultiplexing
+   -------------------------------------------------------------------------- */
+/*
+ * Payload size fixed by each LCID (TS 38.321 tables 6.2.1-1 and 6.2.1-2):
+ * MAC_CE_L when the subheader carries L, MAC_CE_RESERVED for reserved
+ * values. Indexed by direction_t.
+ */
+#define MAC_CE_L        -1
+#define MAC_CE_RESERVED -2
+
+static const int8_t mac_lcid_size[2][64] = {
+    [DIRECTION_DOWNLINK] = {
+        [0 ... 32] = MAC_CE_L,
+        [33 ... 46] = MAC_CE_RESERVED,
+        [47] = 2,               // Recommended bit rate
+        [48] = 2,               // SP ZP CSI-RS resource set (de)activation
+        [49] = 3,               // PUCCH spatial relation (de)activation
+        [50] = MAC_CE_L,        // SP SRS (de)activation
+        [51] = 2,               // SP CSI reporting on PUCCH (de)activation
+        [52] = 2,               // TCI state indication for UE-specific PDCCH
+        [53] = MAC_CE_L,        // TCI states (de)activation for UE-specific PDSCH
+        [54] = MAC_CE_L,        // Aperiodic CSI trigger state subselection
+        [55] = MAC_CE_L,        // SP CSI-RS/CSI-IM resource set (de)activation
+        [56] = 1,               // Duplication (de)activation
+        [57] = 4,               // SCell (de)activation, four octets
+        [58] = 1,               // SCell (de)activation, one octet
+        [59] = 0,               // Long DRX command
+        [MAC_DL_LCID_DRX] = 0,
+        [MAC_DL_LCID_TA_COMMAND] = 1,
+        [MAC_DL_LCID_CONTENTION_RES] = 6,
+        [MAC_LCID_PADDING] = 0,
+    },
+    [DIRECTION_UPLINK] = {
+        [MAC_LCID_CCCH_64] = 8,
+        [1 ... 32] = MAC_CE_L,
+        [33 ... 51] = MAC_CE_RESERVED,
+        [MAC_LCID_CCCH_48] = 6,
+        [MAC_LCID_BIT_RATE_QUERY] = 2,
+        [MAC_LCID_MULTI_PHR_4] = MAC_CE_L,
+        [MAC_LCID_CG_CONFIRM] = 0,
+        [MAC_LCID_MULTI_PHR_1] = MAC_CE_L,
+        [MAC_LCID_SINGLE_PHR] = 2,
+        [MAC_LCID_C_RNTI] = 2,
+        [MAC_LCID_SHORT_TRUNC_BSR] = 1,
+        [MAC_LCID_LONG_TRUNC_BSR] = MAC_CE_L,
+        [MAC_LCID_SHORT_BSR] = 1,
+        [MAC_LCID_LONG_BSR] = MAC_CE_L,
+        [MAC_LCID_PADDING] = 0,
+    },
+};
+
+int mac_ce_fixed_size(direction_t dir, uint8_t lcid) {
+    if (lcid > MAC_LCID_PADDING) return -1;
+    int size = mac_lcid_size[dir == DIRECTION_UPLINK][lcid];
+    return size >= 0 ? size : -1;
+}
+
+uint8_t *mac_tb_reserve(mac_tb_t *tb, uint8_t lcid, size_t len) {
+    int fixed = mac_ce_fixed_size(tb->dir, lcid);
+    size_t header;
+    if (lcid > MAC_LCID_PADDING || len > MAC_SDU_MAX_LEN) return NULL;
+    if (fixed >= 0 && (size_t)fixed != len) return NULL;
+    header = fixed >= 0 ? 1 : mac_subheader_size(len);
+    if (tb->size - tb->len < header + len) return NULL;
+
+    uint8_t *p = tb->buf + tb->len;
+    if (fixed >= 0) {
+        p[0] = lcid;
+    } else if (header == 2) {
+        p[0] = lcid;
+        p[1] = (uint8_t)len;
+    } else {
+        // F = 1: 16-bit L
+        p[0] = 0x40 | lcid;
+        p[1] = (uint8_t)(len >> 8);
+        p[2] = (uint8_t)len;
+    }
+    tb->len += header + len;
+    return p + header;
+}
+
+int mac_tb_put(mac_tb_t *tb, uint8_t lcid, const void *data, size_t len) {
+    uint8_t *p = mac_tb_reserve(tb, lcid, len);
+    if (!p) return -1;
+    memcpy(p, data, len);
+    return 0;
+}
+
+int mac_tb_put_sdu(mac_tb_t *tb, uint8_t lcid, const pktbuf_t *sdu) {
+    size_t len = pktbuf_pkt_len(sdu);
+    uint8_t *p = mac_tb_reserve(tb, lcid, len);
+    if (!p) return -1;
+    pktbuf_copy_out(sdu, p, len);
+    return 0;
+}
+
+size_t mac_tb_pad(mac_tb_t *tb) {
+    if (tb->len < tb->size) {
+        tb->buf[tb->len] = MAC_LCID_PADDING;
+        memset(tb->buf + tb->len + 1, 0, tb->size - tb->len - 1);
+        tb->len = tb->size;
+    }
+    return tb->size;
+}
+
+// Puts the PDUs a channel's RLC entity builds for @grant; returns their bytes
+static size_t mac_multiplex_rlc(mac_tb_t *enc, logical_channel_t *lc, size_t grant, pktbuf_t **pdus) {
+    size_t bytes = 0;
+    size_t n = rlc_build_pdus(lc->rlc, grant, pdus, MAC_MUX_MAX_PDUS);
+    for (size_t p = 0; p < n; p++) {
+        if (mac_tb_put_sdu(enc, (uint8_t)lc->channel_id, pdus[p]) == 0)
+            bytes += pktbuf_pkt_len(pdus[p]);
+        pktbuf_free(pdus[p]);
+    }
+    return bytes;
+}
+
+int mac_multiplex(mac_lcp_t *lcp, const mac_ce_t *ces, int num_ces, uint8_t *tb, size_t tb_size,
+                  size_t *sdu_bytes) {
+    size_t alloc[MAC_MAX_LCH];
+    pktbuf_t *pdus[MAC_MUX_MAX_PDUS];
+    size_t ce_bytes = 0, data = 0;
+    mac_bsr_t *bsr = lcp->bsr;
+    mac_tb_t enc;
+    for (int c = 0; c < num_ces; c++) {
+        int fixed = mac_ce_fixed_size(DIRECTION_UPLINK, ces[c].lcid);
+        ce_bytes += (fixed >= 0 ? 1 : mac_subheader_size(ces[c].len)) + ces[c].len;
+    }
+    if (ce_bytes > tb_size) return -1;
+    size_t bsr_bytes = mac_bsr_room(bsr);
+    if (bsr_bytes > tb_size - ce_bytes)
+        bsr_bytes = tb_size - ce_bytes;
+
+    mac_lcp_allocate(lcp, tb_size - ce_bytes - bsr_bytes, alloc);
+    mac_tb_init(&enc, tb, tb_size, DIRECTION_UPLINK);
+    for (int k = 0; k < lcp->num_channels; k++) {
+        int i = lcp->order[k];
+        logical_channel_t *lc = &lcp->channels[i];
+        if (alloc[i] == 0 || !lc->rlc) continue;
+        // RLC charges each of its PDUs a subheader, so it gets the whole subPDU
+        data += mac_multiplex_rlc(&enc, lc, alloc[i] + mac_subheader_size(alloc[i]), pdus);
+    }
+    // The buffer sizes leave out RLC headers and the subheaders of all
+    // but one PDU per channel: what they took is offered again, in
+    // strict priority order as in step 3 of LCP
+    for (int k = 0; k < lcp->num_channels; k++) {
+        logical_channel_t *lc = &lcp->channels[lcp->order[k]];
+        size_t left = tb_size - ce_bytes - bsr_bytes - enc.len;
+        if (left <= 2) break;
+        if (lc->buffer_size && lc->rlc)
+            data += mac_multiplex_rlc(&enc, lc, left, pdus);
+    }
+    // UL order: MAC CEs after the MAC SDUs, padding last
+    for (int c = 0; c < num_ces; c++)
+        if (mac_tb_put(&enc, ces[c].lcid, ces[c].data, ces[c].len) < 0) return -1;
+    if (bsr && mac_report_bsr(bsr, &enc, 0) == 0)
+        mac_report_bsr(bsr, &enc, 1);
+    size_t used = enc.len;
+    mac_tb_pad(&enc);
+    if (sdu_bytes)
+        *sdu_bytes = data;
+    return (int)used;
+}
+
+int mac_parse_pdu(uint8_t *mac_pdu, size_t pdu_size, direction_t dir, mac_subpdu_t *views, int max) {
+    // R bits are ignored on reception
+    const int8_t *ce_size = mac_lcid_size[dir == DIRECTION_UPLINK];
     size_t offset = 0;
-    printf("MAC Demultiplex: Processing MAC PDU of size %zu bytes\n", pdu_size);
-    while (offset + 3 <= pdu_size) {
-        uint8_t channel_id = mac_pdu[offset++];
-        size_t length = mac_pdu[offset++];
-        length |= ((size_t)mac_pdu[offset++]) << 8;
-        if (offset + length > pdu_size) {
-            printf("MAC Demultiplex: Error - invalid length\n");
-            return;
+    int n = 0;
+    while (offset < pdu_size) {
+        uint8_t b = mac_pdu[offset++];
+        uint8_t lcid = b & 0x3F;
+        int fixed = ce_size[lcid];
+        size_t length;
+        if (lcid == MAC_LCID_PADDING) break;
+        if (fixed >= 0) {
+            length = (size_t)fixed;
+        } else if (fixed == MAC_CE_RESERVED) {
+            return -1;
+        } else if (b & 0x40) {
+            if (pdu_size - offset < 2) return -1;
+            length = ((size_t)mac_pdu[offset] << 8) | mac_pdu[offset + 1];
+            offset += 2;
+        } else {
+            if (pdu_size - offset < 1) return -1;
+            length = mac_pdu[offset++];
         }
-        printf("  Channel ID: %d, Data Length: %zu, Data: ", channel_id, length);
-        for (size_t i = 0; i < length; i++) {
-            printf("%c", mac_pdu[offset + i]);
-        }
-        printf("\n");
+        if (pdu_size - offset < length || n == max) return -1;
+        views[n].lcid = lcid;
+        views[n].len = (uint32_t)length;
+        views[n].data = mac_pdu + offset;
+        n++;
         offset += length;
     }
+    return n;
+}
+
+void mac_rx_table_init(mac_rx_table_t *table, direction_t dir) {
+    memset(table, 0, sizeof(*table));
+    table->dir = dir;
+}
+
+int mac_rx_register(mac_rx_table_t *table, uint8_t lcid, mac_rx_handler_t handler, void *ctx) {
+    if (!table || lcid >= MAC_LCID_PADDING) return -1;
+    table->handler[lcid] = handler;
+    table->ctx[lcid] = ctx;
+    return 0;
+}
+
+void mac_rx_rlc(void *entity, uint8_t lcid, uint8_t *data, size_t len) {
+    (void)lcid;
+    rlc_rx_pdu((rlc_entity_t *)entity, data, len);
+}
+
+int mac_demultiplex(mac_rx_table_t *table, uint8_t *mac_pdu, size_t pdu_size) {
+    mac_subpdu_t views[MAC_MAX_SUBPDUS];
+    int n = mac_parse_pdu(mac_pdu, pdu_size, table->dir, views, MAC_MAX_SUBPDUS);
+    if (n < 0) {
+        printf("MAC Demultiplex: Discarded malformed MAC PDU of %zu bytes\n", pdu_size);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        mac_rx_handler_t handler = table->handler[views[i].lcid];
+        if (handler)
+            handler(table->ctx[views[i].lcid], views[i].lcid, views[i].data, views[i].len);
+        else
+            table->unrouted++;
+    }
+    return n;
+}
+
+mac_rx_table_t *mac_get_rx_table(void) {
+    return &global_rx_table;
 }
 
 /* --------------------------------------------------------------------------
    Scheduling Request (SR) and Buffer Status Reporting (BSR)
    -------------------------------------------------------------------------- */
-void mac_handle_sr(logical_channel_t *channels, int num_channels) {
-    int sr_triggered = 0;
-    for (int i = 0; i < num_channels; i++) {
-        if (channels[i].buffer_size > SR_THRESHOLD) {
-            printf("MAC SR: Scheduling Request triggered for Logical Channel %d (buffer size: %zu bytes)\n",
-                   channels[i].channel_id, channels[i].buffer_size);
-            sr_triggered = 1;
+/* Upper bounds of the 5-bit Buffer Size field (TS 38.321 table 6.1.3.1-1); 31 is beyond */
+static const uint32_t mac_bs_short[31] = {
+    0, 10, 14, 20, 28, 38, 53, 74, 102, 142, 198, 276, 384, 535, 745, 1038,
+    1446, 2014, 2806, 3909, 5446, 7587, 10570, 14726, 20516, 28581, 39818, 55474, 77284, 107669, 150000,
+};
+
+/* Upper bounds of the 8-bit Buffer Size field (table 6.1.3.1-2); 254 is beyond, 255 reserved */
+static const uint32_t mac_bs_long[254] = {
+    0, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+    19, 20, 22, 23, 25, 26, 28, 30, 32, 34,
+    36, 38, 40, 43, 46, 49, 52, 55, 59, 62,
+    66, 71, 75, 80, 85, 91, 97, 103, 110, 117,
+    124, 132, 141, 150, 160, 170, 181, 193, 205, 218,
+    233, 248, 264, 281, 299, 318, 339, 361, 384, 409,
+    436, 464, 494, 526, 560, 597, 635, 677, 720, 767,
+    817, 870, 926, 987, 1051, 1119, 1191, 1269, 1351, 1439,
+    1532, 1631, 1737, 1850, 1970, 2098, 2234, 2379, 2533, 2698,
+    2873, 3059, 3258, 3469, 3694, 3934, 4189, 4461, 4751, 5059,
+    5387, 5737, 6109, 6506, 6928, 7378, 7857, 8367, 8910, 9488,
+    10104, 10760, 11458, 12202, 12994, 13838, 14736, 15692, 16711, 17795,
+    18951, 20181, 21491, 22885, 24371, 25953, 27638, 29431, 31342, 33376,
+    35543, 37850, 40307, 42923, 45709, 48676, 51836, 55200, 58784, 62599,
+    66663, 70990, 75598, 80505, 85730, 91295, 97221, 103532, 110252, 117409,
+    125030, 133146, 141789, 150992, 160793, 171231, 182345, 194182, 206786, 220209,
+    234503, 249725, 265935, 283197, 301579, 321155, 342002, 364202, 387842, 413018,
+    439827, 468377, 498780, 531156, 565634, 602350, 641449, 683087, 727427, 774645,
+    824928, 878475, 935498, 996222, 1060888, 1129752, 1203085, 1281179, 1364342, 1452903,
+    1547213, 1647644, 1754595, 1868488, 1989774, 2118933, 2256475, 2402946, 2558924, 2725027,
+    2901912, 3090279, 3290873, 3504487, 3731968, 3974215, 4232186, 4506902, 4799451, 5110989,
+    5442750, 5796046, 6172275, 6572925, 6999582, 7453933, 7937777, 8453028, 9001725, 9586039,
+    10208280, 10870913, 11576557, 12328006, 13128233, 13980403, 14887889, 15854280, 16883401, 17979324,
+    19146385, 20389201, 21712690, 23122088, 24622972, 26221280, 27923336, 29735875, 31666069, 33721553,
+    35910462, 38241455, 40723756, 43367187, 46182206, 49179951, 52372284, 55771835, 59392055, 63247269,
+    67352729, 71724679, 76380419, 81338368,
+};
+
+uint8_t mac_bsr_buffer_size_index(size_t bytes, int long_format) {
+    const uint32_t *bounds = long_format ? mac_bs_long : mac_bs_short;
+    unsigned lo = 0, hi = long_format ? 254 : 31;
+    // First index whose bound covers @bytes; hi itself means "more than the last bound"
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (bytes <= bounds[mid])
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return (uint8_t)lo;
+}
+
+static void mac_bsr_periodic_expired(timer_node_t *node) {
+    mac_bsr_t *bsr = timer_entry(node, mac_bsr_t, t_periodic);
+    bsr->periodic = 1;
+}
+
+static void mac_bsr_retx_expired(timer_node_t *node) {
+    mac_bsr_t *bsr = timer_entry(node, mac_bsr_t, t_retx);
+    if (bsr->lcg_data)
+        bsr->regular = 1;
+}
+
+int mac_bsr_init(mac_bsr_t *bsr, mac_lcp_t *lcp, uint32_t periodic_ms, uint32_t retx_ms) {
+    uint8_t seen = 0;
+    int n = 0;
+    if (!bsr || !lcp || !lcp->channels) return -1;
+    memset(bsr, 0, sizeof(*bsr));
+    bsr->lcp = lcp;
+    bsr->periodic_ms = periodic_ms;
+    bsr->retx_ms = retx_ms;
+    timer_init(&bsr->t_periodic, mac_bsr_periodic_expired);
+    timer_init(&bsr->t_retx, mac_bsr_retx_expired);
+
+    for (int k = 0; k < lcp->num_channels; k++) {
+        int ch = lcp->order[k];
+        logical_channel_t *lc = &lcp->channels[ch];
+        lc->lcg &= MAC_MAX_LCG - 1;
+        bsr->rank[ch] = (uint8_t)k;
+        if (!(seen & (1u << lc->lcg))) {
+            seen |= (uint8_t)(1u << lc->lcg);
+            bsr->lcg_order[n++] = lc->lcg;
+        }
+        if (lc->buffer_size) {
+            bsr->lcg_bytes[lc->lcg] += lc->buffer_size;
+            bsr->lcg_data |= (uint8_t)(1u << lc->lcg);
+            bsr->lch_data |= 1u << k;
         }
     }
-    if (!sr_triggered) {
-        printf("MAC SR: No Scheduling Request needed (all channel buffers below threshold)\n");
+    // LCGs without channels come last, in LCG order
+    for (int g = 0; g < MAC_MAX_LCG; g++)
+        if (!(seen & (1u << g)))
+            bsr->lcg_order[n++] = (uint8_t)g;
+
+    bsr->regular = bsr->lcg_data != 0;
+    if (periodic_ms)
+        timer_arm(timer_get_wheel(), &bsr->t_periodic, timer_ms(timer_get_wheel(), periodic_ms));
+    lcp->bsr = bsr;
+    return 0;
+}
+
+void mac_bsr_release(mac_bsr_t *bsr) {
+    if (!bsr) return;
+    timer_cancel(&bsr->t_periodic);
+    timer_cancel(&bsr->t_retx);
+    if (bsr->lcp && bsr->lcp->bsr == bsr)
+        bsr->lcp->bsr = NULL;
+    bsr->lcp = NULL;
+}
+
+void mac_lch_enqueue(mac_lcp_t *lcp, int ch, size_t bytes) {
+    if (!lcp || ch < 0 || ch >= lcp->num_channels || bytes == 0) return;
+    logical_channel_t *lc = &lcp->channels[ch];
+    mac_bsr_t *bsr = lcp->bsr;
+    lc->buffer_size += bytes;
+    if (!bsr) return;
+
+    // Regular BSR: no channel had data, or this one outranks all that do
+    if (!bsr->lch_data ||
+        lc->priority < lcp->channels[lcp->order[__builtin_ctz(bsr->lch_data)]].priority)
+        bsr->regular = 1;
+    bsr->lcg_bytes[lc->lcg] += bytes;
+    bsr->lcg_data |= (uint8_t)(1u << lc->lcg);
+    bsr->lch_data |= 1u << bsr->rank[ch];
+}
+
+void mac_lch_dequeue(mac_lcp_t *lcp, int ch, size_t bytes) {
+    if (!lcp || ch < 0 || ch >= lcp->num_channels) return;
+    logical_channel_t *lc = &lcp->channels[ch];
+    mac_bsr_t *bsr = lcp->bsr;
+    if (bytes > lc->buffer_size)
+        bytes = lc->buffer_size;
+    lc->buffer_size -= bytes;
+    if (!bsr) return;
+
+    bsr->lcg_bytes[lc->lcg] -= bytes;
+    if (lc->buffer_size == 0)
+        bsr->lch_data &= ~(1u << bsr->rank[ch]);
+    if (bsr->lcg_bytes[lc->lcg] == 0)
+        bsr->lcg_data &= (uint8_t)~(1u << lc->lcg);
+}
+
+int mac_handle_sr(const mac_bsr_t *bsr) {
+    return bsr && bsr->regular;
+}
+
+size_t mac_bsr_room(const mac_bsr_t *bsr) {
+    if (!bsr || (!bsr->regular && !bsr->periodic)) return 0;
+    // LCGs only empty while the TB is built
+    int lcgs = __builtin_popcount(bsr->lcg_data);
+    return lcgs <= 1 ? 2 : 3 + (size_t)lcgs;
+}
+
+/* Short (Truncated) BSR: LCG ID in the top 3 bits, 5-bit Buffer Size below */
+static size_t mac_bsr_put_short(mac_bsr_t *bsr, mac_tb_t *tb, uint8_t lcid, uint8_t lcg) {
+    uint8_t *p = mac_tb_reserve(tb, lcid, 1);
+    if (!p) return 0;
+    p[0] = (uint8_t)(lcg << 5) | mac_bsr_buffer_size_index(bsr->lcg_bytes[lcg], 0);
+    return 2;
+}
+
+/* Long (Truncated) BSR: LCG bitmap, then @fields 8-bit Buffer Sizes */
+static size_t mac_bsr_put_long(mac_bsr_t *bsr, mac_tb_t *tb, uint8_t lcid, int fields) {
+    size_t len = 1 + (size_t)fields;
+    uint8_t *p = mac_tb_reserve(tb, lcid, len);
+    if (!p) return 0;
+    *p++ = bsr->lcg_data;
+    if (lcid == MAC_LCID_LONG_BSR) {
+        for (int g = 0; g < MAC_MAX_LCG; g++)
+            if (bsr->lcg_data & (1u << g))
+                *p++ = mac_bsr_buffer_size_index(bsr->lcg_bytes[g], 1);
+    } else {
+        // Truncated: the LCGs holding the highest priority channels first
+        for (int k = 0; k < MAC_MAX_LCG && fields > 0; k++) {
+            uint8_t g = bsr->lcg_order[k];
+            if (!(bsr->lcg_data & (1u << g))) continue;
+            *p++ = mac_bsr_buffer_size_index(bsr->lcg_bytes[g], 1);
+            fields--;
+        }
     }
+    return mac_subheader_size(len) + len;
 }
 
-void mac_report_bsr(logical_channel_t *channels, int num_channels) {
-    printf("MAC BSR: Buffer Status Report\n");
-    for (int i = 0; i < num_channels; i++) {
-        printf("  Logical Channel %d: Buffer Size = %zu bytes\n",
-               channels[i].channel_id, channels[i].buffer_size);
+size_t mac_report_bsr(mac_bsr_t *bsr, mac_tb_t *tb, int padding) {
+    if (!bsr || !tb || (!padding && !bsr->regular && !bsr->periodic)) return 0;
+    size_t room = tb->size - tb->len;
+    int lcgs = __builtin_popcount(bsr->lcg_data);
+    size_t long_size = 3 + (size_t)lcgs;
+    size_t sent = 0;
+    int truncated = 0;
+    if (room < 2) return 0;
+
+    if (padding ? room >= long_size : lcgs > 1 && room >= long_size) {
+        sent = mac_bsr_put_long(bsr, tb, MAC_LCID_LONG_BSR, lcgs);
+    } else if (lcgs <= 1) {
+        uint8_t lcg = lcgs ? (uint8_t)__builtin_ctz(bsr->lcg_data) : 0;
+        sent = mac_bsr_put_short(bsr, tb, MAC_LCID_SHORT_BSR, lcg);
+    } else if (room == 2) {
+        // The LCG of the highest priority channel with data
+        const mac_lcp_t *lcp = bsr->lcp;
+        uint8_t lcg = lcp->channels[lcp->order[__builtin_ctz(bsr->lch_data)]].lcg;
+        sent = mac_bsr_put_short(bsr, tb, MAC_LCID_SHORT_TRUNC_BSR, lcg);
+        truncated = 1;
+    } else {
+        sent = mac_bsr_put_long(bsr, tb, MAC_LCID_LONG_TRUNC_BSR, (int)(room - 3));
+        truncated = 1;
+    }
+    if (!sent) return 0;
+    if (padding)
+        bsr->padding_reports++;
+    else
+        bsr->reports++;
+
+    // A full report covers every trigger so far
+    timer_wheel_t *wheel = timer_get_wheel();
+    if (!truncated) {
+        bsr->regular = 0;
+        bsr->periodic = 0;
+        if (bsr->periodic_ms)
+            timer_arm(wheel, &bsr->t_periodic, timer_ms(wheel, bsr->periodic_ms));
     }
+    if (bsr->retx_ms)
+        timer_arm(wheel, &bsr->t_retx, timer_ms(wheel, bsr->retx_ms));
+    return sent;
 }
 
 /* --------------------------------------------------------------------------
@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include "../harq/harq.h"
+#include "../timer/timer.h"
 
 /**
  * mac_dl_sch_data_transfer - Handle downlink shared channel data transfer
@@ -22,13 +23,12 @@ void mac_dl_sch_data_transfer(harq_process_t *proc, int received_ndi, int receiv
 /**
  * mac_ul_sch_data_transfer - Handle uplink shared channel data transfer
  * @proc: HARQ process handling the transfer
- * @mac_pdu: MAC PDU to transmit
- * @pdu_size: Size of MAC PDU in bytes
+ * @mac_pdu: MAC PDU to transmit (consumed)
  *
  * Manages transmission of data on the UL-SCH including HARQ
  * operations and interaction with the physical layer.
  */
-void mac_ul_sch_data_transfer(harq_process_t *proc, uint8_t *mac_pdu, size_t pdu_size);
+void mac_ul_sch_data_transfer(harq_process_t *proc, pktbuf_t *mac_pdu);
 
 /* ============================================================================
    Logical Channel Mapping and Multiplexing/Demultiplexing
@@ -55,23 +55,58 @@ typedef enum {
 
 /**
  * struct logical_channel_t - Logical channel configuration
- * @channel_id: Unique identifier for this channel
+ * @channel_id: Unique identifier for this channel, its LCID (1 to 32)
  * @type: Type of logical channel (BCCH, PCCH, etc.)
  * @priority: Channel priority (lower number = higher priority)
- * @buffer: Pending data for transmission
+ * @rlc: RLC entity (an rlc_entity_t) queueing the channel's data, set by
+ *  rlc_entity_bind_mac(); NULL if none
  * @buffer_size: Amount of pending data in bytes
+ * @pbr: prioritisedBitRate in kB/s, i.e. bytes per ms (MAC_PBR_INFINITY: no limit)
+ * @bsd: bucketSizeDuration in ms
+ * @bucket: Bj, the PBR token bucket in bytes (negative once overdrawn)
+ * @lcg: logicalChannelGroup reported in BSRs (0 to 7)
  *
  * Contains configuration and state information for a logical
- * channel, including its transmission buffer.
+ * channel, including the RLC entity that fills its grants.
  */
 typedef struct {
     int channel_id;
     logical_channel_type_t type;
     int priority; // Lower number indicates higher priority
-    uint8_t *buffer;  // Data waiting to be transmitted
+    void *rlc;  // RLC entity holding the data waiting to be transmitted
     size_t buffer_size;
+    uint32_t pbr;
+    uint32_t bsd;
+    int64_t bucket;
+    uint8_t lcg;
 } logical_channel_t;
 
+/**
+ * MAC_MAX_LCH - Logical channels per UE taken by the LCP procedure
+ * MAC_PBR_INFINITY - prioritisedBitRate of a channel served without limit
+ */
+#define MAC_MAX_LCH      32
+#define MAC_PBR_INFINITY UINT32_MAX
+
+/**
+ * struct mac_lcp_t - Logical channel prioritization state of one UE
+ * @channels: Logical channels of the UE
+ * @num_channels: Number of channels, at most MAC_MAX_LCH
+ * @order: Indices into @channels, highest priority first
+ * @last_tick: Wheel tick up to which the buckets have been filled
+ * @bsr: Buffer status tracking of the UE, NULL if none
+ *
+ * The priority order is computed once by mac_lcp_init(), so each grant
+ * costs one or two walks over the channels and no sorting.
+ */
+typedef struct {
+    logical_channel_t *channels;
+    int num_channels;
+    uint8_t order[MAC_MAX_LCH];
+    uint32_t last_tick;
+    struct mac_bsr *bsr;
+} mac_lcp_t;
+
 /**
  * enum transport_channel_t - Types of transport channels
  * @TRANSPORT_BCH: Broadcast Channel
@@ -128,69 +163,626 @@ transport_channel_t mac_map_logical_channel(const logical_channel_t *lc, directi
  */
 const char* transport_channel_to_string(transport_channel_t tc);
 
+/**
+ * mac_subheader_size - Size of the MAC subheader carrying a MAC SDU
+ * @sdu_len: Length of the MAC SDU (an RLC PDU) in bytes
+ *
+ * R/F/LCID/L subheader of TS 38.321 6.1.2: 8-bit L up to 255
+ * bytes, 16-bit L beyond.
+ *
+ * Return: 2 or 3
+ */
+static inline size_t mac_subheader_size(size_t sdu_len) {
+    return sdu_len <= 255 ? 2 : 3;
+}
+
+/**
+ * MAC_MAX_SDU_SIZE - Largest MAC SDU a 16-bit L field can carry, in bytes
+ */
+#define MAC_MAX_SDU_SIZE 65535
+
+/**
+ * MAC_LCID_* - UL-SCH LCID values (TS 38.321 table 6.2.1-2)
+ *
+ * LCIDs 1 to 32 carry logical channels. The others are CCCH or MAC
+ * CEs; mac_ce_fixed_size() tells which of them have a fixed size and so
+ * a subheader without L.
+ */
+#define MAC_LCID_CCCH_64         0
+#define MAC_LCID_CCCH_48         52
+#define MAC_LCID_BIT_RATE_QUERY  53
+#define MAC_LCID_MULTI_PHR_4     54
+#define MAC_LCID_CG_CONFIRM      55
+#define MAC_LCID_MULTI_PHR_1     56
+#define MAC_LCID_SINGLE_PHR      57
+#define MAC_LCID_C_RNTI          58
+#define MAC_LCID_SHORT_TRUNC_BSR 59
+#define MAC_LCID_LONG_TRUNC_BSR  60
+#define MAC_LCID_SHORT_BSR       61
+#define MAC_LCID_LONG_BSR        62
+#define MAC_LCID_PADDING         63
+
+/**
+ * mac_ce_fixed_size - Payload size fixed by an LCID
+ * @dir: DIRECTION_UPLINK for UL-SCH, DIRECTION_DOWNLINK for DL-SCH LCIDs
+ * @lcid: LCID of the subPDU
+ *
+ * Return: Payload bytes of a fixed-size CE or CCCH, -1 when the
+ * subheader carries an L field
+ */
+int mac_ce_fixed_size(direction_t dir, uint8_t lcid);
+
+/**
+ * struct mac_tb_t - Transport block encoded in place
+ * @buf: TB buffer provided by the caller
+ * @size: TB size in bytes
+ * @len: Bytes written so far
+ * @dir: Direction of the TB, which fixes the LCID meanings
+ *
+ * Each subPDU is written once, subheader and payload together, at the
+ * end of the previous one. In UL, subPDUs with MAC SDUs come first,
+ * then MAC CEs, then padding (mac_tb_pad()).
+ */
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    direction_t dir;
+} mac_tb_t;
+
+/**
+ * mac_tb_init - Start encoding into a transport block buffer
+ * @tb: Encoder state
+ * @buf: TB buffer of at least @size bytes
+ * @size: TB size in bytes
+ * @dir: DIRECTION_UPLINK on the UE, DIRECTION_DOWNLINK on the gNB
+ */
+static inline void mac_tb_init(mac_tb_t *tb, uint8_t *buf, size_t size, direction_t dir) {
+    tb->buf = buf;
+    tb->size = size;
+    tb->len = 0;
+    tb->dir = dir;
+}
+
+/**
+ * mac_tb_reserve - Add a subheader and claim room for its payload
+ * @tb: Encoder state
+ * @lcid: LCID of the subPDU
+ * @len: Payload length (the fixed size for fixed-size LCIDs, at most 65535)
+ *
+ * Writes R/F/LCID, plus an 8- or 16-bit L unless @lcid has a fixed
+ * size, so the caller can build the payload straight into the TB.
+ *
+ * Return: Where the @len payload bytes go, NULL if the subPDU does
+ * not fit or @len is invalid for @lcid
+ */
+uint8_t *mac_tb_reserve(mac_tb_t *tb, uint8_t lcid, size_t len);
+
+/**
+ * mac_tb_put - Add a subPDU from a flat buffer
+ * @tb: Encoder state
+ * @lcid: LCID of the subPDU
+ * @data: MAC SDU or MAC CE bytes
+ * @len: Number of bytes
+ *
+ * Return: 0 on success, -1 if it does not fit
+ */
+int mac_tb_put(mac_tb_t *tb, uint8_t lcid, const void *data, size_t len);
+
+/**
+ * mac_tb_put_sdu - Add a subPDU gathered from a packet buffer
+ * @tb: Encoder state
+ * @lcid: LCID of the logical channel
+ * @sdu: RLC PDU, possibly a chain of segments and views (not consumed)
+ *
+ * The segments are copied once, straight from their storage into the
+ * TB.
+ *
+ * Return: 0 on success, -1 if it does not fit
+ */
+int mac_tb_put_sdu(mac_tb_t *tb, uint8_t lcid, const pktbuf_t *sdu);
+
+/**
+ * mac_tb_pad - Fill the rest of a transport block with padding
+ * @tb: Encoder state
+ *
+ * Adds the padding subPDU (a bare LCID 63 subheader followed by
+ * padding bytes) when any room is left.
+ *
+ * Return: TB size
+ */
+size_t mac_tb_pad(mac_tb_t *tb);
+
+/**
+ * struct mac_ce_t - MAC CE to place in a transport block
+ * @lcid: LCID of the CE
+ * @len: Payload length in bytes
+ * @data: Payload
+ */
+typedef struct {
+    uint8_t lcid;
+    uint16_t len;
+    const uint8_t *data;
+} mac_ce_t;
+
+/**
+ * mac_lcp_init - Set up logical channel prioritization for a UE
+ * @lcp: LCP state to initialize
+ * @channels: Logical channels of the UE, with priority, pbr and bsd set
+ * @num_channels: Number of channels (1 to MAC_MAX_LCH)
+ *
+ * Sorts the channels by priority (ties keep their array order) and
+ * empties every bucket, as when the channels are established. Call it
+ * again after changing a priority or adding a channel.
+ *
+ * Return: 0 on success, -1 on invalid arguments
+ */
+int mac_lcp_init(mac_lcp_t *lcp, logical_channel_t *channels, int num_channels);
+
+/**
+ * mac_lcp_allocate - Share an uplink grant between logical channels
+ * @lcp: LCP state of the UE
+ * @grant: Grant size in bytes, R/F/LCID/L subheaders included
+ * @alloc: Filled with the bytes given to each channel, by channel index
+ *
+ * TS 38.321 5.4.3.1: the buckets are first filled with PBR for the
+ * time elapsed on the timer wheel, capped at PBR * BSD. Channels with
+ * a positive bucket are then served up to their bucket in priority
+ * order and charged for it, and what is left of the grant goes to the
+ * channels in strict priority order. Channel buffers are not touched.
+ *
+ * Return: Bytes of the grant used, subheaders included
+ */
+size_t mac_lcp_allocate(mac_lcp_t *lcp, size_t grant, size_t *alloc);
+
 /**
  * mac_multiplex - Combine data from multiple logical channels
- * @channels: Array of logical channels with data
- * @num_channels: Number of channels in array
- * @pdu_size: Size of resulting PDU
+ * @lcp: LCP state of the UE whose channels hold the data
+ * @ces: MAC CEs to send, may be NULL
+ * @num_ces: Number of CEs
+ * @tb: Transport block buffer
+ * @tb_size: TB size (the grant) in bytes
+ * @sdu_bytes: Returns the bytes of RLC PDUs put in the TB, may be NULL
  *
- * Multiplexes data from multiple logical channels into a single
- * MAC PDU based on priorities and available data.
+ * Shares the room left by the CEs, and by a triggered BSR, with
+ * mac_lcp_allocate(), then encodes the TB in one pass: MAC SDUs in
+ * priority order, the CEs, the BSR, a Padding BSR if the room left
+ * takes one, and padding. Each channel with an allocation has its RLC
+ * entity build PDUs for it, subheader included, with rlc_build_pdus(),
+ * which also takes the data off the channel. The BSR reflects the
+ * buffers after this TB.
  *
- * Return: Pointer to multiplexed MAC PDU
+ * Return: Bytes of subPDUs before the padding, -1 if the CEs do not
+ * fit
+ */
+int mac_multiplex(mac_lcp_t *lcp, const mac_ce_t *ces, int num_ces, uint8_t *tb, size_t tb_size,
+                  size_t *sdu_bytes);
+
+/**
+ * MAC_DL_LCID_* - DL-SCH LCID values of the MAC CEs used here
+ * (TS 38.321 table 6.2.1-1)
+ */
+#define MAC_DL_LCID_DRX            60
+#define MAC_DL_LCID_TA_COMMAND     61
+#define MAC_DL_LCID_CONTENTION_RES 62
+
+/**
+ * MAC_MAX_SUBPDUS - Most subPDUs taken from one MAC PDU
  */
-uint8_t *mac_multiplex(logical_channel_t *channels, int num_channels, size_t *pdu_size);
+#define MAC_MAX_SUBPDUS 1024
+
+/**
+ * struct mac_subpdu_t - One subPDU of a received MAC PDU
+ * @lcid: LCID from the subheader
+ * @len: Payload length in bytes
+ * @data: Payload, pointing into the MAC PDU buffer
+ */
+typedef struct {
+    uint8_t lcid;
+    uint32_t len;
+    uint8_t *data;
+} mac_subpdu_t;
+
+/**
+ * mac_rx_handler_t - Receiver of the subPDUs of one LCID
+ * @ctx: Context registered with the handler
+ * @lcid: LCID of the subPDU
+ * @data: Payload inside the MAC PDU, valid only during the call
+ * @len: Payload length in bytes
+ */
+typedef void (*mac_rx_handler_t)(void *ctx, uint8_t lcid, uint8_t *data, size_t len);
+
+/**
+ * struct mac_rx_table_t - Per-UE dispatch table indexed by LCID
+ * @dir: Direction of the MAC PDUs received, which fixes the LCID meanings
+ * @handler: Handler of each LCID, NULL when nothing is registered
+ * @ctx: Context passed to each handler
+ * @unrouted: subPDUs dropped for want of a handler
+ */
+typedef struct {
+    direction_t dir;
+    mac_rx_handler_t handler[64];
+    void *ctx[64];
+    uint64_t unrouted;
+} mac_rx_table_t;
+
+/**
+ * mac_rx_table_init - Set up an empty dispatch table
+ * @table: Table to initialize
+ * @dir: DIRECTION_DOWNLINK on the UE, DIRECTION_UPLINK on the gNB
+ */
+void mac_rx_table_init(mac_rx_table_t *table, direction_t dir);
+
+/**
+ * mac_rx_register - Route an LCID to a handler
+ * @table: Dispatch table
+ * @lcid: Logical channel or MAC CE LCID (0 to 62)
+ * @handler: Handler, NULL to unregister
+ * @ctx: Context passed to @handler
+ *
+ * Return: 0 on success, -1 on invalid LCID
+ */
+int mac_rx_register(mac_rx_table_t *table, uint8_t lcid, mac_rx_handler_t handler, void *ctx);
+
+/**
+ * mac_rx_rlc - Handler delivering MAC SDUs to an RLC entity
+ * @entity: RLC entity (an rlc_entity_t) registered as context
+ * @lcid: LCID of the subPDU
+ * @data: RLC PDU inside the MAC PDU
+ * @len: RLC PDU length in bytes
+ */
+void mac_rx_rlc(void *entity, uint8_t lcid, uint8_t *data, size_t len);
+
+/**
+ * mac_parse_pdu - Split a MAC PDU into subPDU views
+ * @mac_pdu: MAC PDU
+ * @pdu_size: Size of PDU in bytes
+ * @dir: Direction, which fixes the LCID meanings
+ * @views: Filled with one entry per subPDU, pointing into @mac_pdu
+ * @max: Capacity of @views
+ *
+ * Parsing stops at the padding subPDU. Only the subheaders are read,
+ * and every length is checked against the end of the PDU.
+ *
+ * Return: Number of subPDUs, -1 if the PDU is malformed (truncated
+ * subheader or payload, reserved LCID) or has more than @max subPDUs
+ */
+int mac_parse_pdu(uint8_t *mac_pdu, size_t pdu_size, direction_t dir, mac_subpdu_t *views, int max);
 
 /**
  * mac_demultiplex - Split MAC PDU into logical channels
+ * @table: Dispatch table of the UE
  * @mac_pdu: PDU to demultiplex
  * @pdu_size: Size of PDU in bytes
  *
- * Separates a MAC PDU into individual logical channel data
- * streams based on embedded multiplexing information.
+ * Parses the whole PDU first, so a malformed PDU is discarded as a
+ * whole (TS 38.321 6.1.1), then hands each subPDU to the handler of
+ * its LCID without copying it.
+ *
+ * Return: Number of subPDUs dispatched, -1 if the PDU was discarded
+ */
+int mac_demultiplex(mac_rx_table_t *table, uint8_t *mac_pdu, size_t pdu_size);
+
+/**
+ * MAC_MAX_LCG - Logical channel groups reported by BSR
+ */
+#define MAC_MAX_LCG 8
+
+/**
+ * struct mac_bsr - Buffer status of one UE's logical channel groups
+ * @lcp: LCP state of the UE, whose channels are tracked
+ * @lcg_bytes: Bytes buffered per LCG
+ * @lcg_data: LCGs with data, one bit per LCG
+ * @lch_data: Channels with data, one bit per priority rank (bit 0 highest)
+ * @rank: Priority rank of each channel, by channel index
+ * @lcg_order: LCGs by the priority of their best channel, for truncated BSRs
+ * @regular: A Regular BSR is triggered and not yet sent
+ * @periodic: A Periodic BSR is triggered and not yet sent
+ * @periodic_ms: periodicBSR-Timer in ms (0: off)
+ * @retx_ms: retxBSR-Timer in ms (0: off)
+ * @t_periodic: periodicBSR-Timer
+ * @t_retx: retxBSR-Timer
+ * @reports: Regular and Periodic BSRs sent
+ * @padding_reports: Padding BSRs sent
+ *
+ * The counters follow every enqueue and dequeue (mac_lch_enqueue(),
+ * mac_lch_dequeue()), so triggers, SR and the BSR contents need no
+ * walk over the channels.
  */
-void mac_demultiplex(uint8_t *mac_pdu, size_t pdu_size);
+typedef struct mac_bsr {
+    mac_lcp_t *lcp;
+    size_t lcg_bytes[MAC_MAX_LCG];
+    uint8_t lcg_data;
+    uint32_t lch_data;
+    uint8_t rank[MAC_MAX_LCH];
+    uint8_t lcg_order[MAC_MAX_LCG];
+    int regular;
+    int periodic;
+    uint32_t periodic_ms;
+    uint32_t retx_ms;
+    timer_node_t t_periodic;
+    timer_node_t t_retx;
+    uint64_t reports;
+    uint64_t padding_reports;
+} mac_bsr_t;
 
 /**
- * SR_THRESHOLD - Buffer threshold for scheduling request
+ * mac_bsr_init - Start buffer status tracking for a UE
+ * @bsr: BSR state to initialize
+ * @lcp: LCP state of the UE, already initialized
+ * @periodic_ms: periodicBSR-Timer in ms (0: off)
+ * @retx_ms: retxBSR-Timer in ms (0: off)
  *
- * When buffer size exceeds this value (in bytes), a
- * scheduling request will be triggered.
+ * Counts what the channels already hold and attaches @bsr to @lcp, so
+ * mac_multiplex() sends BSRs. Call it again after mac_lcp_init().
+ *
+ * Return: 0 on success, -1 on invalid arguments
+ */
+int mac_bsr_init(mac_bsr_t *bsr, mac_lcp_t *lcp, uint32_t periodic_ms, uint32_t retx_ms);
+
+/**
+ * mac_bsr_release - Stop the BSR timers and detach from the UE's LCP state
+ * @bsr: BSR state
+ */
+void mac_bsr_release(mac_bsr_t *bsr);
+
+/**
+ * mac_lch_enqueue - Account for data appended to a channel's buffer
+ * @lcp: LCP state of the UE
+ * @ch: Channel index
+ * @bytes: Bytes appended after the @buffer_size bytes already queued
+ *
+ * Triggers a Regular BSR when the channel outranks every channel with
+ * data, or when no channel had any (TS 38.321 5.4.5). O(1).
  */
-#define SR_THRESHOLD 50
+void mac_lch_enqueue(mac_lcp_t *lcp, int ch, size_t bytes);
 
 /**
- * mac_handle_sr - Process scheduling requests
- * @channels: Array of logical channels
- * @num_channels: Number of channels in array
+ * mac_lch_dequeue - Consume data from the head of a channel's buffer
+ * @lcp: LCP state of the UE
+ * @ch: Channel index
+ * @bytes: Bytes sent, at most @buffer_size
  *
- * Evaluates buffer status of logical channels and triggers
- * scheduling requests when needed.
+ * Shrinks @buffer_size and updates the LCG counters. O(1).
  */
-void mac_handle_sr(logical_channel_t *channels, int num_channels);
+void mac_lch_dequeue(mac_lcp_t *lcp, int ch, size_t bytes);
 
 /**
- * mac_report_bsr - Generate buffer status report
- * @channels: Array of logical channels
- * @num_channels: Number of channels in array
+ * mac_bsr_buffer_size_index - Buffer Size field for a byte count
+ * @bytes: Bytes buffered in the LCG
+ * @long_format: Non-zero for the 8-bit field of Long BSRs, zero for the
+ * 5-bit field of Short BSRs (TS 38.321 tables 6.1.3.1-1 and 6.1.3.1-2)
  *
- * Creates and sends buffer status report to help network
- * schedule appropriate uplink resources.
+ * Return: Smallest index whose upper bound covers @bytes
  */
-void mac_report_bsr(logical_channel_t *channels, int num_channels);
+uint8_t mac_bsr_buffer_size_index(size_t bytes, int long_format);
+
+/**
+ * mac_handle_sr - Check whether a scheduling request is due
+ * @bsr: BSR state of the UE
+ *
+ * An SR follows a Regular BSR that no grant has carried yet, read from
+ * the trigger flag without a walk over the channels.
+ *
+ * Return: 1 if an SR should be sent, 0 otherwise
+ */
+int mac_handle_sr(const mac_bsr_t *bsr);
+
+/**
+ * mac_bsr_room - TB bytes to keep for a triggered BSR
+ * @bsr: BSR state of the UE, may be NULL
+ *
+ * A Short BSR for at most one LCG with data and a Long BSR otherwise,
+ * as the buffers stand. Taken off the grant before LCP, so the report
+ * still fits once the TB's data has been dequeued.
+ *
+ * Return: Bytes, subheader included; 0 if no Regular or Periodic BSR
+ * is due
+ */
+size_t mac_bsr_room(const mac_bsr_t *bsr);
+
+/**
+ * mac_report_bsr - Encode a BSR MAC CE into a transport block
+ * @bsr: BSR state of the UE
+ * @tb: Transport block being encoded
+ * @padding: Non-zero for a Padding BSR, which only uses the room left
+ *
+ * Regular and Periodic BSRs are Short BSRs when at most one LCG has
+ * data and Long BSRs otherwise. A Padding BSR is a Long BSR if the
+ * room allows, else a Short BSR for a single LCG with data, else a
+ * Short or Long Truncated BSR with the highest priority LCGs. Sending
+ * a BSR cancels the triggered ones and restarts the BSR timers.
+ *
+ * Return: Bytes written, subheader included; 0 if nothing was due or
+ * nothing fits
+ */
+size_t mac_report_bsr(mac_bsr_t *bsr, mac_tb_t *tb, int padding);
+
+/* ============================================================================
+   Slot Scheduler
+   ============================================================================ */
+
+/**
+ * MAC_SCHED_PF_WINDOW - Averaging window of the proportional fair metric in slots
+ */
+#define MAC_SCHED_PF_WINDOW 100
+
+/**
+ * enum mac_sched_policy_t - Order in which UEs with data are served
+ * @MAC_SCHED_RR: Round robin, the UE served longest ago first
+ * @MAC_SCHED_PF: Proportional fair, highest rate over average throughput first
+ */
+typedef enum {
+    MAC_SCHED_RR,
+    MAC_SCHED_PF
+} mac_sched_policy_t;
+
+/**
+ * struct mac_sched_ue_t - Scheduler view of one UE
+ * @buffered: Bytes waiting (DL: RLC queues, UL: reported by BSR)
+ * @bytes_per_prb: Bytes one PRB carries at the UE's current MCS
+ * @avg: Average bytes per slot, scaled by the scheduler's @scale
+ * @key: Priority in the heap, larger first
+ * @last_slot: Slot of the last grant
+ * @served: Bytes granted so far
+ * @heap_pos: Position in the heap, -1 while the UE has nothing to send
+ */
+typedef struct {
+    size_t buffered;
+    uint32_t bytes_per_prb;
+    double avg;
+    double key;
+    uint64_t last_slot;
+    uint64_t served;
+    int heap_pos;
+} mac_sched_ue_t;
+
+/**
+ * struct mac_grant_t - Allocation of one slot to one UE
+ * @ue: UE index
+ * @start_prb: First PRB
+ * @num_prbs: Number of contiguous PRBs
+ * @tbs: Transport block size in bytes
+ */
+typedef struct {
+    int ue;
+    uint16_t start_prb;
+    uint16_t num_prbs;
+    uint32_t tbs;
+} mac_grant_t;
+
+/**
+ * struct mac_sched_t - DL or UL scheduler of a cell
+ * @dir: Direction scheduled
+ * @policy: Round robin or proportional fair
+ * @num_prbs: PRBs of the carrier per slot
+ * @max_grants: Grants per slot (PDCCH capacity)
+ * @num_ues: UEs added
+ * @max_ues: Capacity of @ues
+ * @ues: UE states, indexed by UE
+ * @heap: UEs with data, as a binary max-heap on their key
+ * @heap_len: Number of UEs in @heap
+ * @slot: Slots scheduled so far
+ * @scale: Growth of the PF averages since their last renormalization
+ *
+ * Only UEs with data sit in the heap, so a slot costs
+ * O(max_grants * log n) and a buffer or MCS change O(log n). The PF
+ * averages decay every slot by the same factor for all UEs: instead
+ * of touching each UE, new throughput is added scaled by the growing
+ * @scale, which leaves the order of the UEs not served unchanged.
+ */
+typedef struct {
+    direction_t dir;
+    mac_sched_policy_t policy;
+    uint16_t num_prbs;
+    uint16_t max_grants;
+    int num_ues;
+    int max_ues;
+    mac_sched_ue_t *ues;
+    int *heap;
+    int heap_len;
+    uint64_t slot;
+    double scale;
+} mac_sched_t;
+
+/**
+ * mac_sched_init - Set up a scheduler
+ * @sched: Scheduler to initialize
+ * @dir: DIRECTION_DOWNLINK or DIRECTION_UPLINK
+ * @policy: MAC_SCHED_RR or MAC_SCHED_PF
+ * @max_ues: Most UEs the cell serves
+ * @num_prbs: PRBs per slot (273 for 100 MHz at 30 kHz SCS)
+ * @max_grants: Grants per slot, at least 1
+ *
+ * Return: 0 on success, -1 on invalid arguments or allocation failure
+ */
+int mac_sched_init(mac_sched_t *sched, direction_t dir, mac_sched_policy_t policy, int max_ues,
+                   uint16_t num_prbs, uint16_t max_grants);
+
+/**
+ * mac_sched_free - Release the UE table and heap of a scheduler
+ * @sched: Scheduler
+ */
+void mac_sched_free(mac_sched_t *sched);
+
+/**
+ * mac_sched_add_ue - Admit a UE
+ * @sched: Scheduler
+ * @bytes_per_prb: Bytes per PRB at the UE's initial MCS
+ *
+ * Return: UE index, -1 when the scheduler is full
+ */
+int mac_sched_add_ue(mac_sched_t *sched, uint32_t bytes_per_prb);
+
+/**
+ * mac_sched_update - Report a UE's buffer and channel quality
+ * @sched: Scheduler
+ * @ue: UE index
+ * @buffered: Bytes waiting for the UE
+ * @bytes_per_prb: Bytes per PRB at the UE's current MCS
+ *
+ * Moves the UE within the heap, into it when it gets data and out of
+ * it when its buffer empties. O(log n).
+ */
+void mac_sched_update(mac_sched_t *sched, int ue, size_t buffered, uint32_t bytes_per_prb);
+
+/**
+ * mac_sched_run - Schedule one slot
+ * @sched: Scheduler
+ * @grants: Filled with up to @max_grants grants
+ *
+ * Serves the UEs with the highest priority until the PRBs or the
+ * grants run out, each with the PRBs its buffer needs. The bytes
+ * granted are taken off the UE's buffer.
+ *
+ * Return: Number of grants
+ */
+int mac_sched_run(mac_sched_t *sched, mac_grant_t *grants);
 
 /* ============================================================================
    HARQ Process Interface for RLC Transmission
    ============================================================================ */
 
+/**
+ * MAC_DL_MAX_TBS - Largest DL TB the simulated UE's soft buffers hold
+ */
+#define MAC_DL_MAX_TBS 16384
+
+/**
+ * mac_get_harq_entity - Get the HARQ processes of the simulated UE
+ * @dir: Direction
+ *
+ * Return: Pool of HARQ_MAX_PROCESSES processes with a HARQ RTT of
+ * HARQ_RTT_SLOTS, one per direction. The DL processes take their
+ * soft buffers from the arena of mac_get_harq_arena().
+ */
+harq_entity_t *mac_get_harq_entity(direction_t dir);
+
+/**
+ * mac_get_harq_arena - Get the DL soft-buffer arena of the simulated UE
+ *
+ * Return: Arena of one MAC_DL_MAX_TBS slot per DL HARQ process, for
+ * its occupancy and counters
+ */
+harq_arena_t *mac_get_harq_arena(void);
+
 /**
  * mac_get_harq_process - Get available HARQ process
  *
- * Return: Pointer to available HARQ process
+ * Return: Lowest idle UL process of the simulated UE, or NULL while
+ * every process waits for feedback
  *
- * Provides access to a HARQ process for new transmissions.
- * In a full implementation, this would manage a pool of processes.
+ * Provides access to a HARQ process for new transmissions. The
+ * process stays idle until a TB is started on it.
  */
 harq_process_t* mac_get_harq_process(void);
 
+/**
+ * mac_get_rx_table - Get the dispatch table of the simulated UE
+ *
+ * Return: Pointer to the DL dispatch table, empty until handlers are
+ * registered
+ */
+mac_rx_table_t *mac_get_rx_table(void);
+
 #endif // MAC_H
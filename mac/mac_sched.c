@@ -0,0 +1,188 @@
+#include "mac.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* The PF averages are brought back to scale 1 before they lose precision */
+#define MAC_SCHED_SCALE_MAX 1e12
+
+int mac_sched_init(mac_sched_t *sched, direction_t dir, mac_sched_policy_t policy, int max_ues,
+                   uint16_t num_prbs, uint16_t max_grants) {
+    if (!sched || max_ues <= 0 || num_prbs == 0 || max_grants == 0) return -1;
+    memset(sched, 0, sizeof(*sched));
+    sched->ues = calloc((size_t)max_ues, sizeof(mac_sched_ue_t));
+    sched->heap = calloc((size_t)max_ues, sizeof(int));
+    if (!sched->ues || !sched->heap) {
+        mac_sched_free(sched);
+        return -1;
+    }
+    sched->dir = dir;
+    sched->policy = policy;
+    sched->max_ues = max_ues;
+    sched->num_prbs = num_prbs;
+    sched->max_grants = max_grants;
+    sched->scale = 1.0;
+    return 0;
+}
+
+void mac_sched_free(mac_sched_t *sched) {
+    free(sched->ues);
+    free(sched->heap);
+    sched->ues = NULL;
+    sched->heap = NULL;
+    sched->num_ues = sched->max_ues = sched->heap_len = 0;
+}
+
+/* RR: oldest grant first. PF: achievable rate over average throughput. */
+static double mac_sched_key(const mac_sched_t *sched, const mac_sched_ue_t *ue) {
+    if (sched->policy == MAC_SCHED_RR)
+        return -(double)ue->last_slot;
+    return (double)ue->bytes_per_prb / ue->avg;
+}
+
+/* ---- Binary max-heap of UE indices on mac_sched_ue_t.key ---- */
+
+static void heap_set(mac_sched_t *sched, int pos, int ue) {
+    sched->heap[pos] = ue;
+    sched->ues[ue].heap_pos = pos;
+}
+
+static void heap_up(mac_sched_t *sched, int pos) {
+    int ue = sched->heap[pos];
+    double key = sched->ues[ue].key;
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (sched->ues[sched->heap[parent]].key >= key) break;
+        heap_set(sched, pos, sched->heap[parent]);
+        pos = parent;
+    }
+    heap_set(sched, pos, ue);
+}
+
+static void heap_down(mac_sched_t *sched, int pos) {
+    int ue = sched->heap[pos];
+    double key = sched->ues[ue].key;
+    for (;;) {
+        int child = 2 * pos + 1;
+        if (child >= sched->heap_len) break;
+        if (child + 1 < sched->heap_len &&
+            sched->ues[sched->heap[child + 1]].key > sched->ues[sched->heap[child]].key)
+            child++;
+        if (sched->ues[sched->heap[child]].key <= key) break;
+        heap_set(sched, pos, sched->heap[child]);
+        pos = child;
+    }
+    heap_set(sched, pos, ue);
+}
+
+static void heap_push(mac_sched_t *sched, int ue) {
+    heap_set(sched, sched->heap_len++, ue);
+    heap_up(sched, sched->heap_len - 1);
+}
+
+static void heap_remove(mac_sched_t *sched, int ue) {
+    int pos = sched->ues[ue].heap_pos;
+    int last = sched->heap[--sched->heap_len];
+    sched->ues[ue].heap_pos = -1;
+    if (last == ue) return;
+    heap_set(sched, pos, last);
+    heap_up(sched, pos);
+    heap_down(sched, sched->ues[last].heap_pos);
+}
+
+int mac_sched_add_ue(mac_sched_t *sched, uint32_t bytes_per_prb) {
+    if (!sched || sched->num_ues == sched->max_ues) return -1;
+    int id = sched->num_ues++;
+    mac_sched_ue_t *ue = &sched->ues[id];
+    memset(ue, 0, sizeof(*ue));
+    ue->bytes_per_prb = bytes_per_prb;
+    /* A newcomer starts from an average of one byte per slot */
+    ue->avg = sched->scale;
+    ue->last_slot = sched->slot;
+    ue->heap_pos = -1;
+    return id;
+}
+
+void mac_sched_update(mac_sched_t *sched, int id, size_t buffered, uint32_t bytes_per_prb) {
+    if (!sched || id < 0 || id >= sched->num_ues) return;
+    mac_sched_ue_t *ue = &sched->ues[id];
+    ue->buffered = buffered;
+    ue->bytes_per_prb = bytes_per_prb;
+    if (buffered == 0 || bytes_per_prb == 0) {
+        if (ue->heap_pos >= 0)
+            heap_remove(sched, id);
+        return;
+    }
+    double key = mac_sched_key(sched, ue);
+    if (ue->heap_pos < 0) {
+        ue->key = key;
+        heap_push(sched, id);
+    } else if (key > ue->key) {
+        ue->key = key;
+        heap_up(sched, ue->heap_pos);
+    } else if (key < ue->key) {
+        ue->key = key;
+        heap_down(sched, ue->heap_pos);
+    }
+}
+
+/*
+ * Divides the PF averages by the accumulated scale. All keys grow by
+ * the same factor, but rounding may reorder near ties, so the heap is
+ * rebuilt. O(n) once every few thousand slots.
+ */
+static void mac_sched_renormalize(mac_sched_t *sched) {
+    for (int i = 0; i < sched->num_ues; i++)
+        sched->ues[i].avg /= sched->scale;
+    sched->scale = 1.0;
+    for (int i = 0; i < sched->heap_len; i++)
+        sched->ues[sched->heap[i]].key = mac_sched_key(sched, &sched->ues[sched->heap[i]]);
+    for (int i = sched->heap_len / 2 - 1; i >= 0; i--)
+        heap_down(sched, i);
+}
+
+int mac_sched_run(mac_sched_t *sched, mac_grant_t *grants) {
+    if (!sched || !grants) return 0;
+    const double alpha = 1.0 / MAC_SCHED_PF_WINDOW;
+    uint16_t left = sched->num_prbs;
+    int n = 0;
+
+    sched->slot++;
+    if (sched->policy == MAC_SCHED_PF) {
+        /* avg = (1 - alpha) avg + alpha served, for every UE at once */
+        sched->scale /= 1.0 - alpha;
+        if (sched->scale > MAC_SCHED_SCALE_MAX)
+            mac_sched_renormalize(sched);
+    }
+
+    while (n < sched->max_grants && left > 0 && sched->heap_len > 0) {
+        int id = sched->heap[0];
+        mac_sched_ue_t *ue = &sched->ues[id];
+        heap_remove(sched, id);
+
+        size_t need = (ue->buffered + ue->bytes_per_prb - 1) / ue->bytes_per_prb;
+        uint16_t prbs = need < left ? (uint16_t)need : left;
+        uint32_t tbs = (uint32_t)prbs * ue->bytes_per_prb;
+        size_t served = tbs < ue->buffered ? tbs : ue->buffered;
+        grants[n].ue = id;
+        grants[n].start_prb = (uint16_t)(sched->num_prbs - left);
+        grants[n].num_prbs = prbs;
+        grants[n].tbs = tbs;
+        n++;
+        left -= prbs;
+
+        ue->buffered -= served;
+        ue->served += served;
+        ue->last_slot = sched->slot;
+        ue->avg += alpha * (double)served * sched->scale;
+    }
+
+    /* Back into the heap after the slot, so nobody is served twice in it */
+    for (int i = 0; i < n; i++) {
+        mac_sched_ue_t *ue = &sched->ues[grants[i].ue];
+        if (ue->buffered > 0) {
+            ue->key = mac_sched_key(sched, ue);
+            heap_push(sched, grants[i].ue);
+        }
+    }
+    return n;
+}
@@ -8,6 +8,22 @@
 #include "rlc/rlc.h"
 #include "pdcp/pdcp.h"
 #include "ipgen/ipgen.h"
+#include "timer/timer.h"
+#include "sim/sim.h"
+
+/* Trace run: ten 3 s packet cycles of virtual time */
+#define TRACE_SECONDS     30
+
+/* Load run defaults: ./5g [-r] [-p] [-c cpu] <ues> [scs_khz] [seconds] */
+#define LOAD_SCS_KHZ      30
+#define LOAD_SECONDS      10
+#define LOAD_PRBS         273     /* 100 MHz at 30 kHz SCS */
+#define LOAD_GRANTS       16      /* UL grants per slot */
+#define LOAD_SDU_SIZE     1400
+#define LOAD_PCT          70      /* Offered load against the mean cell capacity */
+#define LOAD_HARQ_RTT     8       /* Slots */
+#define LOAD_MAX_RETX     HARQ_MAX_RETX   /* Retransmissions before RLC gets the loss */
+#define LOAD_BLER_PPM     100000  /* 10% first transmission BLER */
 
 /**
  * global_rlc_dl_entity - Pointer to the downlink RLC entity used for loopback
@@ -15,63 +31,237 @@
  */
 rlc_entity_t *global_rlc_dl_entity = NULL;
 
-int main(void) {
+/* Slot pacing: as fast as possible unless -r or -p asked for real time */
+static int realtime;
+static sim_pace_t pace = SIM_PACE_SLEEP;
+
+static int parse_arg(const char *arg, long min, long max, long *val) {
+    char *end;
+    *val = strtol(arg, &end, 10);
+    return (*end || end == arg || *val < min || *val > max) ? -1 : 0;
+}
+
+static void advance(sim_t *sim, uint64_t slots) {
+    if (realtime)
+        sim_run_realtime(sim, slots, pace);
+    else
+        sim_run(sim, slots);
+}
+
+static void print_hist(const char *name, const sim_hist_t *h) {
+    if (h->count == 0) return;
+    printf("%-11s mean %7.1f us, p50 %5llu us, p99 %5llu us, p99.9 %5llu us, max %7.1f us\n", name,
+           (double)h->sum_ns / (double)h->count / 1e3, (unsigned long long)sim_hist_percentile(h, 0.5) / 1000,
+           (unsigned long long)sim_hist_percentile(h, 0.99) / 1000,
+           (unsigned long long)sim_hist_percentile(h, 0.999) / 1000, (double)h->max_ns / 1e3);
+    /* The 1 us buckets folded into powers of two */
+    printf("%-11s", "");
+    for (uint32_t lo = 0, hi = 1; lo < SIM_HIST_BUCKETS; lo = hi, hi *= 2) {
+        uint64_t n = 0;
+        for (uint32_t us = lo; us < hi && us < SIM_HIST_BUCKETS; us++)
+            n += h->buckets[us];
+        if (n)
+            printf(" [%u-%u us) %llu", lo, hi, (unsigned long long)n);
+    }
+    printf("\n");
+}
+
+/**
+ * print_rt_report - Slot pacing summary of a real-time run
+ * @sim: Engine that ran with sim_run_realtime()
+ */
+static void print_rt_report(const sim_t *sim) {
+    if (!realtime) return;
+    printf("Real-time pacing (%s), %u us slots: %llu of %llu slots overran their deadline\n",
+           pace == SIM_PACE_POLL ? "busy-poll" : "absolute-deadline sleep", 1000u >> sim->numerology,
+           (unsigned long long)sim->rt.overruns, (unsigned long long)sim->rt.processing.count);
+    print_hist("wake-up", &sim->rt.wakeup);
+    print_hist("processing", &sim->rt.processing);
+}
+
+/**
+ * run_load - Simulate many UEs, as fast as the CPU allows or in real time
+ * @num_ues: UEs, each with one UL DRB
+ * @scs_khz: Subcarrier spacing
+ * @seconds: Virtual time to simulate
+ *
+ * Packets arrive at LOAD_PCT of the carrier's capacity for UEs of
+ * average spectral efficiency.
+ *
+ * Return: 0 on success, 1 if the engine could not be set up
+ */
+static int run_load(int num_ues, uint32_t scs_khz, uint32_t seconds) {
+    sim_t sim;
+    sim_config_t cfg = {
+        .scs_khz = scs_khz,
+        .num_ues = num_ues,
+        .num_prbs = LOAD_PRBS,
+        .max_grants = LOAD_GRANTS,
+        .sdu_size = LOAD_SDU_SIZE,
+        .harq_processes = HARQ_MAX_PROCESSES,
+        .harq_rtt = LOAD_HARQ_RTT,
+        .harq_max_retx = LOAD_MAX_RETX,
+        .bler_ppm = LOAD_BLER_PPM,
+        .seed = 0x5eed,
+    };
+    /* 88 bytes per PRB is the mean of the UEs' 16 to 160 */
+    uint64_t capacity_ms = (uint64_t)LOAD_PRBS * 88 * (scs_khz / 15) * LOAD_PCT / 100;
+    cfg.arrival_ms = (uint32_t)(((uint64_t)num_ues * LOAD_SDU_SIZE + capacity_ms - 1) / capacity_ms);
+    if (sim_init(&sim, &cfg) < 0) {
+        printf("Error: Failed to set up %d UEs at %u kHz SCS.\n", num_ues, scs_khz);
+        return 1;
+    }
+
+    advance(&sim, (uint64_t)seconds * 1000 * sim_slots_per_ms(&sim));
+
+    const sim_stats_t *st = &sim.stats;
+    double wall = (double)st->wall_ns / 1e9;
+    printf("\n=== Load run: %d UEs, %u kHz SCS, %u PRBs, %d HARQ processes, RTT %d slots, BLER %d%% ===\n",
+           num_ues, scs_khz, LOAD_PRBS, HARQ_MAX_PROCESSES, LOAD_HARQ_RTT, LOAD_BLER_PPM / 10000);
+    if (realtime)
+        printf("Simulated %.3f s (%llu slots of %u us) in real time, L2 busy %.3f s (%.1f%% of the slots)\n",
+               sim_seconds(&sim), (unsigned long long)sim.slots, 1000u >> sim.numerology, wall,
+               100.0 * wall / sim_seconds(&sim));
+    else
+        printf("Simulated %.3f s (%llu slots of %u us) in %.3f s: %.2f simulated s per wall-clock s\n",
+               sim_seconds(&sim), (unsigned long long)sim.slots, 1000u >> sim.numerology, wall,
+               wall > 0 ? sim_seconds(&sim) / wall : 0.0);
+    printf("Packets: %llu of %u bytes every %u ms per UE (%llu dropped), offered %.1f Mbps\n",
+           (unsigned long long)st->arrivals, LOAD_SDU_SIZE, cfg.arrival_ms, (unsigned long long)st->dropped,
+           (double)st->arrivals * LOAD_SDU_SIZE * 8 / sim_seconds(&sim) / 1e6);
+    printf("UL: %llu grants, %llu new TBs, %llu retransmissions, %llu HARQ stalls, %.1f Mbps of RLC PDUs ACKed\n",
+           (unsigned long long)st->grants, (unsigned long long)st->new_tbs, (unsigned long long)st->retx,
+           (unsigned long long)st->stalls, (double)sim.feedback.stats.acked_bytes * 8 / sim_seconds(&sim) / 1e6);
+    printf("MAC: %llu SRs, %llu Regular/Periodic BSRs, %llu Padding BSRs\n", (unsigned long long)st->srs,
+           (unsigned long long)st->bsrs, (unsigned long long)st->padding_bsrs);
+    printf("HARQ feedback: %llu ACKs, %llu NACKs, %llu TBs given up after %d retransmissions, %llu stale\n",
+           (unsigned long long)sim.feedback.stats.acks, (unsigned long long)sim.feedback.stats.nacks,
+           (unsigned long long)sim.feedback.stats.failures, LOAD_MAX_RETX,
+           (unsigned long long)sim.feedback.stats.stale);
+    printf("RLC UM: %llu PDUs (%llu bytes) lost with the TBs given up\n", (unsigned long long)st->lost_pdus,
+           (unsigned long long)st->lost_bytes);
+    print_rt_report(&sim);
+
+    sim_free(&sim);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    long ues = 0, scs = LOAD_SCS_KHZ, seconds = LOAD_SECONDS, cpu = -1;
+    int opt, bad = 0;
+    while ((opt = getopt(argc, argv, "rpc:")) != -1) {
+        switch (opt) {
+        case 'p':
+            pace = SIM_PACE_POLL;
+            /* fall through */
+        case 'r':
+            realtime = 1;
+            break;
+        case 'c':
+            bad |= parse_arg(optarg, 0, 4095, &cpu) < 0;
+            break;
+        default:
+            bad = 1;
+        }
+    }
+    int nargs = argc - optind;
+    char **args = argv + optind;
+    if (bad || nargs > 3 || (nargs > 0 && parse_arg(args[0], 1, 1000000, &ues) < 0) ||
+        (nargs > 1 && (parse_arg(args[1], 15, 120, &scs) < 0 || sim_numerology((uint32_t)scs) < 0)) ||
+        (nargs > 2 && parse_arg(args[2], 1, 86400, &seconds) < 0)) {
+        printf("Usage: %s [-r] [-p] [-c cpu] [ues [scs_khz [seconds]]]\n"
+               "Without arguments, traces one packet every 3 s of virtual time for %d s.\n"
+               "With a UE count, simulates that many UEs (15/30/60/120 kHz SCS, default %d) as fast as possible.\n"
+               "  -r  Run on the real slot cadence, sleeping to each slot's absolute deadline\n"
+               "  -p  Run on the real slot cadence, busy-polling the clock\n"
+               "  -c  Pin the simulation to a CPU\n",
+               argv[0], TRACE_SECONDS, LOAD_SCS_KHZ);
+        return 1;
+    }
+    if (cpu >= 0 && sim_pin_cpu((int)cpu) < 0) {
+        printf("Error: Failed to pin to CPU %ld.\n", cpu);
+        return 1;
+    }
+    if (ues > 0)
+        return run_load((int)ues, (uint32_t)scs, (uint32_t)seconds);
+
     printf("=== 5G NR Layer 2 Loopback Simulation ===\n");
 
-    /* Initialize PDCP layer and get a handle to the PDCP entity */
-    pdcp_entity_t *pdcp_ent = pdcp_get_entity();
+    /* Virtual slot clock at 15 kHz SCS: 1 ms slots drive the protocol timers */
+    sim_t sim;
+    sim_config_t clock_cfg = { .scs_khz = 15 };
+    sim_init(&sim, &clock_cfg);
+
+    /* Initialize PDCP layer and establish the entity of UE 0, DRB 1 */
+    pdcp_entity_t *pdcp_ent = pdcp_table_add(pdcp_get_table(), 0, 1);
+    if (!pdcp_ent) {
+        printf("Error: Failed to establish PDCP entity.\n");
+        return 1;
+    }
 
-    /* Create a HARQ process for handling retransmissions in MAC layer */
-    harq_process_t *harq_ptr = mac_get_harq_process();
+    /* Protect the DRB's integrity with the NIA2 key of TS 33.401 C.2 test set 2 */
+    static const uint8_t integrity_key[16] = {
+        0xd3, 0xc5, 0xd5, 0x92, 0x32, 0x7f, 0xb1, 0x1c,
+        0x40, 0x35, 0xc6, 0x68, 0x0a, 0xf8, 0xc6, 0xd1
+    };
+    pdcp_set_integrity_key(pdcp_ent, integrity_key);
 
     /* Initialize downlink RLC entity in Transparent Mode for data loopback */
     rlc_entity_t rlc_dl;
     rlc_entity_establish(&rlc_dl, RLC_MODE_TM);
+    rlc_entity_bind_pdcp(&rlc_dl, pdcp_ent);
     global_rlc_dl_entity = &rlc_dl;
+    /* DL TBs decoded by HARQ reach the entity through the MAC demultiplexer, on LCID 4 (DRB 1) */
+    mac_rx_register(mac_get_rx_table(), 4, mac_rx_rlc, &rlc_dl);
 
-    /* Main simulation loop - processes packets continuously */
-    while (1) {
+    /* Main simulation loop - one packet every 3 s of virtual time */
+    while (sim_seconds(&sim) < TRACE_SECONDS) {
         printf("\n-------------------------------\n");
         printf("Starting new packet transmission cycle...\n");
 
         /* Step 1: Create a test IP packet to simulate network traffic */
-        size_t ip_packet_size = 0;
-        uint8_t *ip_packet = generate_dummy_ip_packet(&ip_packet_size);
+        pktbuf_t *ip_packet = generate_dummy_ip_packet();
         if (!ip_packet) {
             printf("Error: Failed to generate dummy IP packet.\n");
             break;
         }
-        printf("Network: Generated IP packet of %zu bytes.\n", ip_packet_size);
+        printf("Network: Generated IP packet of %zu bytes.\n", ip_packet->len);
         printf("Network: Source IP = 192.168.1.100, Destination IP = 192.168.1.200\n");
 
-        /* Step 2: Process packet through PDCP layer (header addition, security) */
-        size_t pdcp_pdu_size = 0;
-        uint8_t *pdcp_pdu = pdcp_prepare_tx_pdu(pdcp_ent, ip_packet, ip_packet_size, &pdcp_pdu_size);
-        free(ip_packet);
+        /* Step 2: Process packet through PDCP layer (header addition, security).
+         * Headers are added in the packet's own buffer, no copy is made.
+         */
+        pktbuf_t *pdcp_pdu = pdcp_prepare_tx_pdu(pdcp_ent, ip_packet);
         if (!pdcp_pdu) {
             printf("PDCP: Failed to prepare PDCP PDU.\n");
             break;
         }
-        printf("PDCP: Prepared PDCP PDU of %zu bytes.\n", pdcp_pdu_size);
+        printf("PDCP: Prepared PDCP PDU of %zu bytes.\n", pdcp_pdu->len);
 
-        /* Step 3: Simulate uplink transmission through RLC layer */
+        /* Step 3: Simulate uplink transmission through RLC layer.
+         * The PDU buffer ends up held by the lowest idle HARQ process.
+         */
+        harq_process_t *harq_ptr = mac_get_harq_process();
         rlc_entity_t rlc_tx;
         rlc_entity_establish(&rlc_tx, RLC_MODE_TM);
         printf("RLC (TX): Instantiated Transparent Mode entity for uplink transmission.\n");
-        rlc_tm_tx_data(&rlc_tx, pdcp_pdu, pdcp_pdu_size);
+        rlc_tm_tx_data(&rlc_tx, pdcp_pdu);
         rlc_entity_release(&rlc_tx);
         printf("RLC (TX): Released uplink RLC entity.\n");
 
-        /* Simulate network propagation delay */
-        sleep(1);
+        /* Simulate network propagation delay on the virtual clock; protocol timers follow */
+        advance(&sim, 1000 * sim_slots_per_ms(&sim));
 
         /* Step 4: Simulate MAC layer loopback
          * In a real system, this data would come from the physical layer
-         * Here we simulate receiving the same PDU in downlink
+         * Here we simulate receiving the transport block held by HARQ in downlink
          */
         printf("MAC: Loopback simulation triggered.\n");
-        mac_loopback_pdu(harq_ptr, pdcp_pdu, pdcp_pdu_size);
-        free(pdcp_pdu);
+        if (harq_ptr && harq_ptr->tb) {
+            mac_loopback_pdu(harq_ptr, harq_ptr->tb);
+            /* The looped back TB was decoded: the ACK returns the process to the pool */
+            harq_ul_process_feedback(harq_ptr, 1);
+        }
 
         /* Step 5: The loopback process will:
          * - Pass data to RLC downlink
@@ -80,13 +270,17 @@ int main(void) {
          */
 
         /* Add delay between transmission cycles to control traffic rate */
-        sleep(2);
+        advance(&sim, 2000 * sim_slots_per_ms(&sim));
     }
 
     /* Clean up resources before exiting */
+    mac_rx_register(mac_get_rx_table(), 4, NULL, NULL);
     rlc_entity_release(&rlc_dl);
     global_rlc_dl_entity = NULL;
-    printf("Simulation terminated. Cleaning up entities.\n");
+    printf("Simulation terminated after %.0f s of virtual time in %.3f s. Cleaning up entities.\n",
+           sim_seconds(&sim), (double)sim.stats.wall_ns / 1e9);
+    print_rt_report(&sim);
+    sim_free(&sim);
 
     return 0;
 }
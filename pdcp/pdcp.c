@@ -2,174 +2,810 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "../rlc/rlc.h"
 
-// Global PDCP entity instance.
-static pdcp_entity_t global_pdcp_entity;
+// Example NEA2 key (TS 33.401 Annex C.1 test set 1).
+static const uint8_t default_cipher_key[SEC_KEY_LEN] = {
+    0xd3, 0xc5, 0xd5, 0x92, 0x32, 0x7f, 0xb1, 0x1c,
+    0x40, 0x35, 0xc6, 0x68, 0x0a, 0xf8, 0xc6, 0xd1
+};
 
-void pdcp_entity_establish(pdcp_entity_t *entity) {
-    if (!entity) return;
+// --- SN Length Helpers ---
+static inline uint32_t pdcp_sn_bits(const pdcp_entity_t *entity) {
+    return (entity->flags & PDCP_FLAG_SN18) ? PDCP_SN_BITS_LONG : PDCP_SN_BITS_SHORT;
+}
+
+static inline uint32_t pdcp_window_size(const pdcp_entity_t *entity) {
+    return 1u << (pdcp_sn_bits(entity) - 1);
+}
+
+static inline size_t pdcp_header_size(const pdcp_entity_t *entity) {
+    return (entity->flags & PDCP_FLAG_SN18) ? 3 : 2;
+}
+
+// PDUs whose keystream is generated by one nea2_crypt_burst() call.
+#define PDCP_CIPHER_CHUNK 64
+
+static rohc_state_t *pdcp_rohc_get(pdcp_entity_t *entity);
+static void pdcp_rx_window_free(pdcp_entity_t *entity);
+static void pdcp_tx_buffer_free(pdcp_entity_t *entity);
+static void pdcp_rx_reordering_expired(timer_node_t *node);
+static void pdcp_tx_discard_expired(timer_node_t *node);
+
+void pdcp_entity_establish(pdcp_entity_t *entity, pdcp_config_t *cfg) {
+    if (!entity || !cfg) return;
     entity->tx_next = 0;
     entity->rx_next = 0;
-    entity->header_compression_enabled = 1;  // Enabled by default.
-    entity->ciphering_enabled = 1;           // Enabled by default.
-    entity->cipher_key = 0x5A;               // Example key.
+    entity->rx_deliv = 0;
+    // Compression and ciphering enabled by default, 12-bit SN.
+    entity->flags = PDCP_FLAG_ACTIVE | PDCP_FLAG_HEADER_COMPRESSION | PDCP_FLAG_CIPHERING;
+    entity->cfg = cfg;
+    entity->rxwin = NULL;
+    cfg->rohc = NULL;
+    cfg->integrity_failures = 0;
+    cfg->offload = NULL;
+    cfg->txbuf = NULL;
+    cfg->rlc = NULL;
+    cfg->direction = 0;                      // Uplink.
+    cfg->t_reordering = PDCP_T_REORDERING_DEFAULT;
+    pdcp_set_cipher_key(entity, default_cipher_key);
     printf("PDCP: Entity established. TX_NEXT and RX_NEXT set to 0. Compression and ciphering enabled.\n");
 }
 
 void pdcp_entity_reestablish(pdcp_entity_t *entity) {
     if (!entity) return;
+    // PDUs already in the crypto pool still go out with their old COUNTs.
+    pdcp_offload_detach(entity);
+    pdcp_tx_buffer_t *txbuf = entity->cfg->txbuf;
+    if (txbuf) {
+        // AM bearer: the retained PDUs stay valid for data recovery, so the
+        // COUNTs and ROHC contexts they were built with carry over.
+        printf("PDCP: Entity re-established, %u unconfirmed PDUs kept for data recovery.\n",
+               entity->tx_next - txbuf->tx_low);
+        return;
+    }
     entity->tx_next = 0;
     entity->rx_next = 0;
+    entity->rx_deliv = 0;
+    pdcp_rx_window_free(entity);
+    // Header compression restarts from IR packets (drb-ContinueROHC not configured).
+    rohc_destroy(entity->cfg->rohc);
+    entity->cfg->rohc = NULL;
     printf("PDCP: Entity re-established. TX_NEXT and RX_NEXT reset to 0.\n");
 }
 
+void pdcp_set_cipher_key(pdcp_entity_t *entity, const uint8_t key[SEC_KEY_LEN]) {
+    if (!entity || !entity->cfg || !key) return;
+    memcpy(entity->cfg->cipher_key, key, SEC_KEY_LEN);
+    aes128_expand_key(&entity->cfg->cipher_ks, key);
+}
+
+void pdcp_set_integrity_key(pdcp_entity_t *entity, const uint8_t key[SEC_KEY_LEN]) {
+    if (!entity || !entity->cfg) return;
+    if (!key) {
+        entity->flags &= ~PDCP_FLAG_INTEGRITY;
+        return;
+    }
+    memcpy(entity->cfg->integrity_key, key, SEC_KEY_LEN);
+    nia2_expand_key(&entity->cfg->integ_ks, key);
+    entity->flags |= PDCP_FLAG_INTEGRITY;
+}
+
+int pdcp_set_sn_length(pdcp_entity_t *entity, int sn_bits) {
+    if (!entity) return -1;
+    if (sn_bits == PDCP_SN_BITS_LONG)
+        entity->flags |= PDCP_FLAG_SN18;
+    else if (sn_bits == PDCP_SN_BITS_SHORT)
+        entity->flags &= ~PDCP_FLAG_SN18;
+    else
+        return -1;
+    // The reception buffer is sized by the window, drop any old one.
+    pdcp_rx_window_free(entity);
+    return 0;
+}
+
 void pdcp_entity_release(pdcp_entity_t *entity) {
     if (!entity) return;
+    pdcp_offload_detach(entity);
+    pdcp_rx_window_free(entity);
+    if (entity->cfg) {
+        pdcp_tx_buffer_free(entity);
+        rohc_destroy(entity->cfg->rohc);
+        entity->cfg->rohc = NULL;
+    }
+    entity->flags = 0;
     printf("PDCP: Entity released.\n");
 }
 
-void pdcp_tx_data(pdcp_entity_t *entity, uint8_t *sdu, size_t sdu_size) {
+void pdcp_tx_data(pdcp_entity_t *entity, pktbuf_t *sdu) {
     // For backward compatibility: prepare the PDCP PDU and then "send" it.
-    size_t pdu_size = 0;
-    uint8_t *pdu = pdcp_prepare_tx_pdu(entity, sdu, sdu_size, &pdu_size);
+    pktbuf_t *pdu = pdcp_prepare_tx_pdu(entity, sdu);
     if (!pdu) return;
     printf("PDCP: Sending PDCP Data PDU to lower layer (simulated).\n");
     // In a full implementation, pdu would be forwarded to the RLC layer.
-    free(pdu);
-}
-
-uint8_t *pdcp_prepare_tx_pdu(pdcp_entity_t *entity, uint8_t *sdu, size_t sdu_size, size_t *pdu_size) {
-    if (!entity || !sdu) return NULL;
-    // Create a 2-byte header carrying the PDCP SN.
-    uint16_t sn = (uint16_t)(entity->tx_next & 0x0FFF); // Use lower 12 bits.
-    uint8_t header[2];
-    header[0] = (sn >> 4) & 0xFF;
-    header[1] = ((sn & 0x0F) << 4);  // Lower nibble padded with zeros.
-    size_t raw_size = 2 + sdu_size;
-    uint8_t *raw_pdu = malloc(raw_size);
-    if (!raw_pdu) return NULL;
-    memcpy(raw_pdu, header, 2);
-    memcpy(raw_pdu + 2, sdu, sdu_size);
-    entity->tx_next++;
-
-    // Apply header compression if enabled.
-    uint8_t *comp_pdu = raw_pdu;
-    size_t comp_size = raw_size;
-    if (entity->header_compression_enabled) {
-        pdcp_compress_header(entity, raw_pdu, raw_size, &comp_pdu, &comp_size);
-        free(raw_pdu);
-        printf("PDCP: Header compressed. Size reduced to %zu bytes.\n", comp_size);
-    }
-    
-    // Apply ciphering if enabled.
-    uint8_t *cipher_pdu = comp_pdu;
-    size_t cipher_size = comp_size;
-    if (entity->ciphering_enabled) {
-        pdcp_cipher(entity, comp_pdu, comp_size, &cipher_pdu, &cipher_size);
-        if (comp_pdu != cipher_pdu)
-            free(comp_pdu);
-        printf("PDCP: PDU ciphered. Size is now %zu bytes.\n", cipher_size);
-    }
-    
-    *pdu_size = cipher_size;
-    return cipher_pdu;
+    pktbuf_free(pdu);
 }
 
-void pdcp_rx_pdu(pdcp_entity_t *entity, uint8_t *pdu, size_t pdu_size) {
-    if (!entity || !pdu || pdu_size < 1) {
+pktbuf_t *pdcp_prepare_tx_pdu(pdcp_entity_t *entity, pktbuf_t *sdu) {
+    pktbuf_t *pdu;
+    uint32_t count = entity ? entity->tx_next : 0;
+    if (pdcp_prepare_tx_pdu_burst(entity, &sdu, &pdu, 1) == 0)
+        return NULL;
+    printf("PDCP: PDU built for COUNT %u (compression %s, integrity %s, ciphering %s), %zu bytes.\n",
+           count, (entity->flags & PDCP_FLAG_HEADER_COMPRESSION) ? "on" : "off",
+           (entity->flags & PDCP_FLAG_INTEGRITY) ? "on" : "off",
+           (entity->flags & PDCP_FLAG_CIPHERING) ? "on" : "off", pdu->len);
+    return pdu;
+}
+
+size_t pdcp_prepare_tx_pdu_burst(pdcp_entity_t *entity, pktbuf_t **sdus, pktbuf_t **pdus, size_t num_sdus) {
+    uint32_t count;
+    size_t n = pdcp_tx_assign(entity, sdus, pdus, num_sdus, &count);
+    if (n == 0) return 0;
+    size_t header_size = pdcp_header_size(entity);
+
+    // MAC-I and ciphering in one pass per PDU. The PDCP header itself stays in clear.
+    if (entity->flags & PDCP_FLAG_INTEGRITY) {
+        const pdcp_config_t *cfg = entity->cfg;
+        const aes128_key_t *cks = (entity->flags & PDCP_FLAG_CIPHERING) ? &cfg->cipher_ks : NULL;
+        for (size_t i = 0; i < n; i++) {
+            pktbuf_t *pdu = pdus[i];
+            sec_protect(cks, &cfg->integ_ks, count + (uint32_t)i, cfg->bearer_id, cfg->direction,
+                        pdu->data, header_size, pdu->data + header_size,
+                        pdu->len - header_size - SEC_MAC_LEN);
+        }
+    } else if (entity->flags & PDCP_FLAG_CIPHERING) {
+        // Without a MAC-I to chain, the keystream of the whole burst is generated together.
+        const pdcp_config_t *cfg = entity->cfg;
+        uint32_t counts[PDCP_CIPHER_CHUNK];
+        uint8_t *data[PDCP_CIPHER_CHUNK];
+        size_t lens[PDCP_CIPHER_CHUNK];
+        for (size_t i = 0; i < n; i += PDCP_CIPHER_CHUNK) {
+            size_t m = n - i < PDCP_CIPHER_CHUNK ? n - i : PDCP_CIPHER_CHUNK;
+            for (size_t j = 0; j < m; j++) {
+                counts[j] = count + (uint32_t)(i + j);
+                data[j] = pdus[i + j]->data + header_size;
+                lens[j] = pdus[i + j]->len - header_size;
+            }
+            nea2_crypt_burst(&cfg->cipher_ks, counts, cfg->bearer_id, cfg->direction, data, lens, m);
+        }
+    }
+
+    if (entity->cfg->txbuf) {
+        for (size_t i = 0; i < n; i++)
+            pdcp_tx_retain(entity, count + (uint32_t)i, pdus[i]);
+    }
+
+    return n;
+}
+
+size_t pdcp_tx_assign(pdcp_entity_t *entity, pktbuf_t **sdus, pktbuf_t **pdus, size_t num_sdus,
+                      uint32_t *first_count) {
+    if (!entity) {
+        for (size_t i = 0; i < num_sdus; i++)
+            pktbuf_free(sdus[i]);
+        return 0;
+    }
+    size_t header_size = pdcp_header_size(entity);
+    size_t trailer_size = (entity->flags & PDCP_FLAG_INTEGRITY) ? SEC_MAC_LEN : 0;
+    size_t n = 0;
+
+    // A full transmit buffer takes no more PDUs until lower layers confirm some.
+    pdcp_tx_buffer_t *txbuf = entity->cfg->txbuf;
+    if (txbuf) {
+        size_t room = txbuf->size - (entity->tx_next - txbuf->tx_low);
+        if (num_sdus > room) {
+            for (size_t i = room; i < num_sdus; i++)
+                pktbuf_free(sdus[i]);
+            txbuf->dropped += (uint32_t)(num_sdus - room);
+            num_sdus = room;
+        }
+    }
+
+    // Header compression; SDUs that fail are dropped before they get a COUNT.
+    // ROHC only touches the front, so the MAC-I room is checked first and the PDCP
+    // header's room is left by the compressor, which refuses the SDU untouched.
+    rohc_state_t *rohc = (entity->flags & PDCP_FLAG_HEADER_COMPRESSION) ? pdcp_rohc_get(entity) : NULL;
+    if (rohc) {
+        for (size_t i = 0; i < num_sdus; i++) {
+            pktbuf_t *sdu = sdus[i];
+            if (!sdu || pktbuf_tailroom(sdu) < trailer_size || rohc_compress(rohc, sdu, header_size) < 0) {
+                pktbuf_free(sdu);
+                continue;
+            }
+            pdus[n++] = sdu;
+        }
+    } else {
+        for (size_t i = 0; i < num_sdus; i++) {
+            pktbuf_t *sdu = sdus[i];
+            if (!sdu || pktbuf_headroom(sdu) < header_size || pktbuf_tailroom(sdu) < trailer_size) {
+                pktbuf_free(sdu);
+                continue;
+            }
+            pdus[n++] = sdu;
+        }
+    }
+
+    // COUNTs for the whole burst in one step.
+    uint32_t count = entity->tx_next;
+    entity->tx_next += (uint32_t)n;
+    *first_count = count;
+
+    // Data PDU header (D/C=1, reserved bits, SN) into the headroom checked above.
+    // It goes on first because the MAC-I covers it.
+    uint32_t sn_mask = (1u << pdcp_sn_bits(entity)) - 1;
+    if (header_size == 3) {
+        for (size_t i = 0; i < n; i++) {
+            uint32_t sn = (count + (uint32_t)i) & sn_mask;
+            uint8_t *header = pktbuf_prepend(pdus[i], 3);
+            header[0] = 0x80 | ((sn >> 16) & 0x03);
+            header[1] = (sn >> 8) & 0xFF;
+            header[2] = sn & 0xFF;
+        }
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            uint32_t sn = (count + (uint32_t)i) & sn_mask;
+            uint8_t *header = pktbuf_prepend(pdus[i], 2);
+            header[0] = 0x80 | ((sn >> 8) & 0x0F);
+            header[1] = sn & 0xFF;
+        }
+    }
+
+    // Room for the MAC-I, filled in by the security step.
+    if (trailer_size) {
+        for (size_t i = 0; i < n; i++)
+            pktbuf_append(pdus[i], SEC_MAC_LEN);
+    }
+
+    // discardTimer starts now, when the SDU is taken from the upper layer.
+    if (txbuf && n > 0) {
+        timer_wheel_t *wheel = timer_get_wheel();
+        uint32_t ticks = timer_ms(wheel, txbuf->discard_timer);
+        for (size_t i = 0; i < n; i++)
+            txbuf->expiry[(count + (uint32_t)i) & (txbuf->size - 1)] = timer_now(wheel) + ticks;
+        // Later PDUs never expire first: the running timer already covers them.
+        if (txbuf->discard_timer != PDCP_DISCARD_TIMER_INFINITY && !timer_armed(&txbuf->discard))
+            timer_arm(wheel, &txbuf->discard, ticks);
+    }
+
+    return n;
+}
+
+void pdcp_tx_protect(const pdcp_entity_t *entity, pktbuf_t *pdu, uint32_t count) {
+    const pdcp_config_t *cfg = entity->cfg;
+    size_t header_size = pdcp_header_size(entity);
+    if (entity->flags & PDCP_FLAG_INTEGRITY) {
+        const aes128_key_t *cks = (entity->flags & PDCP_FLAG_CIPHERING) ? &cfg->cipher_ks : NULL;
+        sec_protect(cks, &cfg->integ_ks, count, cfg->bearer_id, cfg->direction, pdu->data, header_size,
+                    pdu->data + header_size, pdu->len - header_size - SEC_MAC_LEN);
+    } else if (entity->flags & PDCP_FLAG_CIPHERING) {
+        nea2_crypt(&cfg->cipher_ks, count, cfg->bearer_id, cfg->direction, pdu->data + header_size,
+                   pdu->len - header_size);
+    }
+}
+
+// --- Transmit Buffer ---
+int pdcp_set_tx_retention(pdcp_entity_t *entity, uint32_t size, uint32_t discard_timer) {
+    if (!entity || !entity->cfg) return -1;
+    if (size == 0) {
+        pdcp_tx_buffer_free(entity);
+        return 0;
+    }
+    uint32_t slots = 1;
+    while (slots < size)
+        slots <<= 1;
+    // Unconfirmed COUNTs must fit in the peer's reordering window.
+    if (slots > pdcp_window_size(entity)) return -1;
+
+    pdcp_tx_buffer_t *txbuf = entity->cfg->txbuf;
+    if (txbuf && txbuf->size == slots) {
+        txbuf->discard_timer = discard_timer;
+        if (discard_timer == PDCP_DISCARD_TIMER_INFINITY)
+            timer_cancel(&txbuf->discard);
+        return 0;
+    }
+    pdcp_tx_buffer_free(entity);
+    txbuf = calloc(1, sizeof(pdcp_tx_buffer_t));
+    if (!txbuf) return -1;
+    txbuf->pdus = calloc(slots, sizeof(pktbuf_t *));
+    txbuf->expiry = calloc(slots, sizeof(uint32_t));
+    if (!txbuf->pdus || !txbuf->expiry) {
+        free(txbuf->pdus);
+        free(txbuf->expiry);
+        free(txbuf);
+        return -1;
+    }
+    txbuf->size = slots;
+    txbuf->tx_low = entity->tx_next;
+    txbuf->discard_timer = discard_timer;
+    txbuf->entity = entity;
+    timer_init(&txbuf->discard, pdcp_tx_discard_expired);
+    entity->cfg->txbuf = txbuf;
+    return 0;
+}
+
+static void pdcp_tx_buffer_free(pdcp_entity_t *entity) {
+    pdcp_tx_buffer_t *txbuf = entity->cfg->txbuf;
+    if (!txbuf) return;
+    timer_cancel(&txbuf->discard);
+    for (uint32_t i = 0; i < txbuf->size; i++)
+        pktbuf_free(txbuf->pdus[i]);
+    free(txbuf->pdus);
+    free(txbuf->expiry);
+    free(txbuf);
+    entity->cfg->txbuf = NULL;
+}
+
+void pdcp_tx_retain(pdcp_entity_t *entity, uint32_t count, pktbuf_t *pdu) {
+    pdcp_tx_buffer_t *txbuf = entity->cfg->txbuf;
+    if (!txbuf || count - txbuf->tx_low >= entity->tx_next - txbuf->tx_low) return;
+    uint32_t idx = count & (txbuf->size - 1);
+    pktbuf_free(txbuf->pdus[idx]);
+    txbuf->pdus[idx] = pktbuf_view(pdu, 0, pdu->len);
+}
+
+// Moves TX_LOW over PDUs already released out of order.
+static void pdcp_tx_buffer_advance(pdcp_entity_t *entity, pdcp_tx_buffer_t *txbuf) {
+    while (txbuf->tx_low != entity->tx_next && !txbuf->pdus[txbuf->tx_low & (txbuf->size - 1)])
+        txbuf->tx_low++;
+}
+
+void pdcp_tx_confirm(pdcp_entity_t *entity, uint32_t count) {
+    pdcp_tx_buffer_t *txbuf = entity ? entity->cfg->txbuf : NULL;
+    if (!txbuf || count - txbuf->tx_low >= entity->tx_next - txbuf->tx_low) return;
+    uint32_t idx = count & (txbuf->size - 1);
+    pktbuf_free(txbuf->pdus[idx]);
+    txbuf->pdus[idx] = NULL;
+    if (count == txbuf->tx_low)
+        pdcp_tx_buffer_advance(entity, txbuf);
+}
+
+void pdcp_tx_confirm_upto(pdcp_entity_t *entity, uint32_t count) {
+    pdcp_tx_buffer_t *txbuf = entity ? entity->cfg->txbuf : NULL;
+    if (!txbuf || count - txbuf->tx_low > entity->tx_next - txbuf->tx_low) return;
+    for (; txbuf->tx_low != count; txbuf->tx_low++) {
+        uint32_t idx = txbuf->tx_low & (txbuf->size - 1);
+        pktbuf_free(txbuf->pdus[idx]);
+        txbuf->pdus[idx] = NULL;
+    }
+    pdcp_tx_buffer_advance(entity, txbuf);
+}
+
+int pdcp_tx_pdu_count(const pdcp_entity_t *entity, const uint8_t *pdu, size_t pdu_size, uint32_t *count) {
+    size_t header_size = pdcp_header_size(entity);
+    if (!pdu || pdu_size < header_size || !(pdu[0] & 0x80)) return -1;
+    uint32_t sn;
+    if (header_size == 3)
+        sn = ((uint32_t)(pdu[0] & 0x03) << 16) | ((uint32_t)pdu[1] << 8) | pdu[2];
+    else
+        sn = ((uint32_t)(pdu[0] & 0x0F) << 8) | pdu[1];
+    // The PDU went out before TX_NEXT, so count back to the latest COUNT with this SN.
+    uint32_t sn_mask = (1u << pdcp_sn_bits(entity)) - 1;
+    uint32_t last = entity->tx_next - 1;
+    *count = last - ((last - sn) & sn_mask);
+    return 0;
+}
+
+// Releases the retained PDUs whose discardTimer expired, all at the head.
+static void pdcp_tx_discard_expired(timer_node_t *node) {
+    pdcp_tx_buffer_t *txbuf = timer_entry(node, pdcp_tx_buffer_t, discard);
+    pdcp_entity_t *entity = txbuf->entity;
+    uint32_t now = timer_now(timer_get_wheel());
+
+    uint32_t first = txbuf->tx_low;
+    while (txbuf->tx_low != entity->tx_next) {
+        uint32_t idx = txbuf->tx_low & (txbuf->size - 1);
+        if ((int32_t)(now - txbuf->expiry[idx]) < 0)
+            break;
+        if (txbuf->pdus[idx]) {
+            pktbuf_free(txbuf->pdus[idx]);
+            txbuf->pdus[idx] = NULL;
+            txbuf->discarded++;
+        }
+        txbuf->tx_low++;
+    }
+    if (txbuf->tx_low != first) {
+        printf("PDCP: discardTimer expired for COUNT %u..%u\n", first, txbuf->tx_low - 1);
+        // TS 38.323 5.2.2: RLC drops the discarded PDUs it has not started sending.
+        if (entity->cfg->rlc)
+            rlc_tx_discard(entity->cfg->rlc, txbuf->tx_low - 1);
+        pdcp_tx_buffer_advance(entity, txbuf);
+    }
+    // Run again for the new oldest PDU.
+    if (txbuf->tx_low != entity->tx_next)
+        timer_arm(timer_get_wheel(), node, txbuf->expiry[txbuf->tx_low & (txbuf->size - 1)] - now);
+}
+
+size_t pdcp_tx_data_recovery(pdcp_entity_t *entity, pktbuf_t **pdus, size_t max) {
+    pdcp_tx_buffer_t *txbuf = entity ? entity->cfg->txbuf : NULL;
+    if (!txbuf) return 0;
+    // Retained bytes are only final once the crypto pool is done with them.
+    pdcp_offload_detach(entity);
+    size_t n = 0;
+    for (uint32_t count = txbuf->tx_low; count != entity->tx_next && n < max; count++) {
+        pktbuf_t *pdu = txbuf->pdus[count & (txbuf->size - 1)];
+        if (pdu)
+            pdus[n++] = pktbuf_ref(pdu);
+    }
+    return n;
+}
+
+// Derives the COUNT of a received PDU from its SN relative to RX_DELIV (TS 38.323 5.2.2.2).
+static uint32_t pdcp_rx_count(const pdcp_entity_t *entity, uint32_t sn) {
+    uint32_t sn_bits = pdcp_sn_bits(entity);
+    uint32_t window = 1u << (sn_bits - 1);
+    uint32_t hfn = entity->rx_deliv >> sn_bits;
+    uint32_t deliv_sn = entity->rx_deliv & ((1u << sn_bits) - 1);
+    if ((int32_t)sn < (int32_t)deliv_sn - (int32_t)window)
+        hfn++;
+    else if (sn >= deliv_sn + window && hfn > 0)
+        hfn--;
+    return (hfn << sn_bits) | sn;
+}
+
+// --- Reception Buffer ---
+static pdcp_rx_window_t *pdcp_rx_window_get(pdcp_entity_t *entity) {
+    if (entity->rxwin) return entity->rxwin;
+    uint32_t size = pdcp_window_size(entity);
+    pdcp_rx_window_t *win = calloc(1, sizeof(pdcp_rx_window_t));
+    if (!win) return NULL;
+    win->slots = calloc(size, sizeof(pktbuf_t *));
+    win->bitmap = calloc(size / 64, sizeof(uint64_t));
+    if (!win->slots || !win->bitmap) {
+        free(win->slots);
+        free(win->bitmap);
+        free(win);
+        return NULL;
+    }
+    win->size = size;
+    win->entity = entity;
+    timer_init(&win->t_reordering, pdcp_rx_reordering_expired);
+    entity->rxwin = win;
+    return win;
+}
+
+static void pdcp_rx_window_free(pdcp_entity_t *entity) {
+    pdcp_rx_window_t *win = entity->rxwin;
+    if (!win) return;
+    timer_cancel(&win->t_reordering);
+    for (uint32_t i = 0; i < win->size; i++)
+        pktbuf_free(win->slots[i]);
+    free(win->slots);
+    free(win->bitmap);
+    free(win);
+    entity->rxwin = NULL;
+}
+
+static inline int pdcp_rx_window_test(const pdcp_rx_window_t *win, uint32_t count) {
+    uint32_t idx = count & (win->size - 1);
+    return (win->bitmap[idx >> 6] >> (idx & 63)) & 1;
+}
+
+// Returns the first stored COUNT in [from, to), or to if there is none.
+static uint32_t pdcp_rx_window_next_stored(const pdcp_rx_window_t *win, uint32_t from, uint32_t to) {
+    while (from < to) {
+        uint32_t idx = from & (win->size - 1);
+        uint64_t word = win->bitmap[idx >> 6] >> (idx & 63);
+        if (word) {
+            uint32_t count = from + (uint32_t)__builtin_ctzll(word);
+            return count < to ? count : to;
+        }
+        from += 64 - (idx & 63);
+    }
+    return to;
+}
+
+static pktbuf_t *pdcp_rx_window_take(pdcp_rx_window_t *win, uint32_t count) {
+    uint32_t idx = count & (win->size - 1);
+    pktbuf_t *buf = win->slots[idx];
+    win->slots[idx] = NULL;
+    win->bitmap[idx >> 6] &= ~(1ull << (idx & 63));
+    return buf;
+}
+
+// Collects consecutive SDUs so the upper layer is called once per run.
+typedef struct {
+    pdcp_entity_t *entity;
+    pdcp_sdu_t sdus[PDCP_DELIVER_BATCH];
+    pktbuf_t *bufs[PDCP_DELIVER_BATCH];
+    uint8_t hdrs[PDCP_DELIVER_BATCH][ROHC_MAX_HEADER_LEN];
+    size_t n;
+} pdcp_delivery_batch_t;
+
+static pdcp_deliver_cb_t pdcp_deliver_cb = pdcp_deliver_sdus_to_upper;
+
+void pdcp_set_deliver_callback(pdcp_deliver_cb_t cb) {
+    pdcp_deliver_cb = cb ? cb : pdcp_deliver_sdus_to_upper;
+}
+
+static void pdcp_batch_flush(pdcp_delivery_batch_t *batch) {
+    if (batch->n == 0) return;
+    pdcp_deliver_cb(batch->sdus, batch->n);
+    for (size_t i = 0; i < batch->n; i++)
+        pktbuf_free(batch->bufs[i]);
+    batch->n = 0;
+}
+
+// Decompression happens here, as SDUs leave the reordering function in COUNT order.
+static void pdcp_batch_add(pdcp_delivery_batch_t *batch, uint8_t *sdu, size_t size, pktbuf_t *buf) {
+    if (batch->n == PDCP_DELIVER_BATCH)
+        pdcp_batch_flush(batch);
+    pdcp_sdu_t *out = &batch->sdus[batch->n];
+    const uint8_t *data = sdu;
+    out->hdr = batch->hdrs[batch->n];
+    out->hdr_len = 0;
+    if (batch->entity->flags & PDCP_FLAG_HEADER_COMPRESSION) {
+        if (pdcp_decompress_header(batch->entity, &data, &size, batch->hdrs[batch->n], &out->hdr_len) < 0) {
+            printf("PDCP: Header decompression failed, SDU discarded\n");
+            pktbuf_free(buf);
+            return;
+        }
+    }
+    out->data = data;
+    out->data_len = size;
+    batch->bufs[batch->n] = buf;
+    batch->n++;
+}
+
+static void pdcp_batch_add_stored(pdcp_delivery_batch_t *batch, pdcp_rx_window_t *win, uint32_t count) {
+    pktbuf_t *buf = pdcp_rx_window_take(win, count);
+    pdcp_batch_add(batch, buf->data, buf->len, buf);
+}
+
+// Delivers stored SDUs from RX_DELIV onward until the first gap.
+static void pdcp_rx_deliver_consecutive(pdcp_entity_t *entity, pdcp_delivery_batch_t *batch) {
+    pdcp_rx_window_t *win = entity->rxwin;
+    if (!win) return;
+    while (entity->rx_deliv < entity->rx_next && pdcp_rx_window_test(win, entity->rx_deliv)) {
+        pdcp_batch_add_stored(batch, win, entity->rx_deliv);
+        entity->rx_deliv++;
+    }
+}
+
+// Stops or starts t-Reordering after RX_DELIV/RX_NEXT moved.
+static void pdcp_rx_update_reordering(pdcp_entity_t *entity) {
+    pdcp_rx_window_t *win = entity->rxwin;
+    if (!win) return;
+    if (timer_armed(&win->t_reordering) && entity->rx_deliv >= win->rx_reord)
+        timer_cancel(&win->t_reordering);
+    if (!timer_armed(&win->t_reordering) && entity->rx_deliv < entity->rx_next) {
+        win->rx_reord = entity->rx_next;
+        timer_arm(timer_get_wheel(), &win->t_reordering, timer_ms(timer_get_wheel(), entity->cfg->t_reordering));
+    }
+}
+
+static inline int pdcp_rx_is_duplicate(const pdcp_entity_t *entity, uint32_t count) {
+    return count < entity->rx_deliv ||
+           (count < entity->rx_next && entity->rxwin && pdcp_rx_window_test(entity->rxwin, count));
+}
+
+int pdcp_rx_pdu_count(pdcp_entity_t *entity, const uint8_t *pdu, size_t pdu_size, uint32_t *count) {
+    size_t header_size = pdcp_header_size(entity);
+    if (!pdu || pdu_size < header_size) {
         printf("PDCP: Invalid PDU received\n");
-        return;
+        return -1;
+    }
+    if (!(pdu[0] & 0x80)) {
+        printf("PDCP: Control PDU received, ignored\n");
+        return -1;
+    }
+
+    uint32_t sn;
+    if (header_size == 3)
+        sn = ((uint32_t)(pdu[0] & 0x03) << 16) | ((uint32_t)pdu[1] << 8) | pdu[2];
+    else
+        sn = ((uint32_t)(pdu[0] & 0x0F) << 8) | pdu[1];
+    *count = pdcp_rx_count(entity, sn);
+
+    // Discard PDUs already delivered or already waiting in the buffer.
+    if (pdcp_rx_is_duplicate(entity, *count)) {
+        printf("PDCP: Duplicate or stale PDU (COUNT = %u) discarded\n", *count);
+        return -1;
+    }
+    return (int)header_size;
+}
+
+int pdcp_rx_unprotect(const pdcp_entity_t *entity, uint32_t count, uint8_t *pdu, size_t *pdu_size) {
+    const pdcp_config_t *cfg = entity->cfg;
+    size_t header_size = pdcp_header_size(entity);
+    size_t data_size = *pdu_size - header_size;
+    // Deciphering and verification work on the received buffer in one pass;
+    // decompression waits for in-order delivery.
+    if (entity->flags & PDCP_FLAG_INTEGRITY) {
+        const aes128_key_t *cks = (entity->flags & PDCP_FLAG_CIPHERING) ? &cfg->cipher_ks : NULL;
+        if (data_size < SEC_MAC_LEN ||
+            sec_verify(cks, &cfg->integ_ks, count, cfg->bearer_id, cfg->direction, pdu, header_size,
+                       pdu + header_size, data_size - SEC_MAC_LEN) < 0)
+            return -1;
+        *pdu_size -= SEC_MAC_LEN;
+    } else if (entity->flags & PDCP_FLAG_CIPHERING) {
+        nea2_crypt(&cfg->cipher_ks, count, cfg->bearer_id, cfg->direction, pdu + header_size, data_size);
+    }
+    return 0;
+}
+
+// Reordering step for a PDU that passed security. In-order SDUs are added to
+// the caller's batch; buf, if given, owns sdu and is kept instead of a copy.
+static void pdcp_rx_reorder(pdcp_entity_t *entity, uint32_t count, uint8_t *sdu, size_t sdu_size,
+                            pktbuf_t *buf, pdcp_delivery_batch_t *batch) {
+    if (count >= entity->rx_next)
+        entity->rx_next = count + 1;
+
+    if (count == entity->rx_deliv) {
+        // In order: deliver from the received buffer, then any run it unblocks.
+        pdcp_batch_add(batch, sdu, sdu_size, buf);
+        entity->rx_deliv++;
+        pdcp_rx_deliver_consecutive(entity, batch);
+    } else {
+        // Out of order: keep the buffer (or a copy of the caller's) until the gap is filled.
+        pdcp_rx_window_t *win = pdcp_rx_window_get(entity);
+        if (win && !buf && (buf = pktbuf_alloc(sdu_size)) != NULL)
+            memcpy(pktbuf_append(buf, sdu_size), sdu, sdu_size);
+        if (!win || !buf) {
+            printf("PDCP: Reception buffer allocation error\n");
+            pktbuf_free(buf);
+            return;
+        }
+        uint32_t idx = count & (win->size - 1);
+        win->slots[idx] = buf;
+        win->bitmap[idx >> 6] |= 1ull << (idx & 63);
     }
-    
-    uint8_t *deciphered = pdu;
-    size_t decipher_size = pdu_size;
-    if (entity->ciphering_enabled) {
-        pdcp_decipher(entity, pdu, pdu_size, &deciphered, &decipher_size);
-    }
-    
-    uint8_t *decomp = deciphered;
-    size_t decomp_size = decipher_size;
-    if (entity->header_compression_enabled && deciphered[0] == 0xAA) {
-        pdcp_decompress_header(entity, deciphered, decipher_size, &decomp, &decomp_size);
-    }
-    
-    if (decomp_size < 2) {
-        printf("PDCP: Invalid decompressed PDU\n");
-        if (decomp != deciphered) free(decomp);
-        if (deciphered != pdu) free(deciphered);
+
+    pdcp_rx_update_reordering(entity);
+}
+
+// Receive operation for one PDU; in-order SDUs are added to the caller's batch.
+static void pdcp_rx_one(pdcp_entity_t *entity, uint8_t *pdu, size_t pdu_size, pdcp_delivery_batch_t *batch) {
+    uint32_t count;
+    int header_size = pdcp_rx_pdu_count(entity, pdu, pdu_size, &count);
+    if (header_size < 0) return;
+    if (pdcp_rx_unprotect(entity, count, pdu, &pdu_size) < 0) {
+        entity->cfg->integrity_failures++;
+        printf("PDCP: Integrity verification failed (COUNT = %u), PDU discarded\n", count);
         return;
     }
-    
-    uint16_t sn = ((uint16_t)decomp[0] << 4) | (decomp[1] >> 4);
-    printf("PDCP: Received PDU with SN = %u\n", sn);
-    
-    size_t sdu_size = decomp_size - 2;
-    uint8_t *sdu = malloc(sdu_size);
-    if (!sdu) {
-        if (decomp != deciphered) free(decomp);
-        if (deciphered != pdu) free(deciphered);
+    pdcp_rx_reorder(entity, count, pdu + header_size, pdu_size - (size_t)header_size, NULL, batch);
+}
+
+void pdcp_rx_accept_burst(pdcp_entity_t *entity, const uint32_t *counts, pktbuf_t **pdus, size_t num_pdus) {
+    if (!entity) {
+        for (size_t i = 0; i < num_pdus; i++)
+            pktbuf_free(pdus[i]);
         return;
     }
-    memcpy(sdu, decomp + 2, sdu_size);
-    
-    entity->rx_next = sn + 1;
-    
-    pdcp_deliver_sdu_to_upper(sdu, sdu_size);
-    free(sdu);
-    if (decomp != deciphered) free(decomp);
-    if (deciphered != pdu) free(deciphered);
+    size_t header_size = pdcp_header_size(entity);
+    pdcp_delivery_batch_t batch;
+    batch.entity = entity;
+    batch.n = 0;
+    for (size_t i = 0; i < num_pdus; i++) {
+        // The state may have moved on while the PDU was away, so check again.
+        if (pdcp_rx_is_duplicate(entity, counts[i])) {
+            printf("PDCP: Duplicate or stale PDU (COUNT = %u) discarded\n", counts[i]);
+            pktbuf_free(pdus[i]);
+            continue;
+        }
+        uint8_t *sdu = pktbuf_pull(pdus[i], header_size);
+        pdcp_rx_reorder(entity, counts[i], sdu, pdus[i]->len, pdus[i], &batch);
+    }
+    pdcp_batch_flush(&batch);
 }
 
-void pdcp_deliver_sdu_to_upper(uint8_t *sdu, size_t sdu_size) {
-    if (!sdu) return;
-    printf("PDCP: Delivered PDCP SDU to upper layer: %s\n", sdu);
+void pdcp_rx_pdu(pdcp_entity_t *entity, uint8_t *pdu, size_t pdu_size) {
+    if (!entity) {
+        printf("PDCP: Invalid PDU received\n");
+        return;
+    }
+    printf("PDCP: Received PDU of %zu bytes\n", pdu_size);
+    pdcp_rx_pdu_burst(entity, &pdu, &pdu_size, 1);
 }
 
-// --- Header Compression/Decompression (Simulated ROHC) ---
-void pdcp_compress_header(pdcp_entity_t *entity, uint8_t *input_pdu, size_t input_size, uint8_t **output_pdu, size_t *output_size) {
-    *output_size = input_size + 1;
-    *output_pdu = malloc(*output_size);
-    if (!*output_pdu) return;
-    (*output_pdu)[0] = 0xAA; // Compression marker.
-    memcpy(*output_pdu + 1, input_pdu, input_size);
+// Ciphering without integrity: COUNTs of a chunk first, then its keystream in one
+// call, then reordering. COUNTs are derived before the chunk moves RX_DELIV, as
+// for offloaded PDUs, which only differs for PDUs a whole window away.
+static void pdcp_rx_cipher_chunk(pdcp_entity_t *entity, uint8_t *const *pdus, const size_t *pdu_sizes,
+                                 size_t num_pdus, pdcp_delivery_batch_t *batch) {
+    const pdcp_config_t *cfg = entity->cfg;
+    uint32_t counts[PDCP_CIPHER_CHUNK];
+    uint8_t *data[PDCP_CIPHER_CHUNK];
+    size_t lens[PDCP_CIPHER_CHUNK];
+    size_t m = 0;
+    for (size_t i = 0; i < num_pdus; i++) {
+        int header_size = pdcp_rx_pdu_count(entity, pdus[i], pdu_sizes[i], &counts[m]);
+        if (header_size < 0) continue;
+        data[m] = pdus[i] + header_size;
+        lens[m] = pdu_sizes[i] - (size_t)header_size;
+        m++;
+    }
+    nea2_crypt_burst(&cfg->cipher_ks, counts, cfg->bearer_id, cfg->direction, data, lens, m);
+    for (size_t i = 0; i < m; i++) {
+        // The same COUNT twice in one chunk: the first copy is already in.
+        if (pdcp_rx_is_duplicate(entity, counts[i])) {
+            printf("PDCP: Duplicate or stale PDU (COUNT = %u) discarded\n", counts[i]);
+            continue;
+        }
+        pdcp_rx_reorder(entity, counts[i], data[i], lens[i], NULL, batch);
+    }
 }
 
-void pdcp_decompress_header(pdcp_entity_t *entity, uint8_t *input_pdu, size_t input_size, uint8_t **output_pdu, size_t *output_size) {
-    if (input_size < 1) return;
-    if (input_pdu[0] == 0xAA) {
-        *output_size = input_size - 1;
-        *output_pdu = malloc(*output_size);
-        if (!*output_pdu) return;
-        memcpy(*output_pdu, input_pdu + 1, *output_size);
+void pdcp_rx_pdu_burst(pdcp_entity_t *entity, uint8_t *const *pdus, const size_t *pdu_sizes, size_t num_pdus) {
+    if (!entity) return;
+    // One batch for the whole burst: caller buffers stay valid until it is flushed.
+    pdcp_delivery_batch_t batch;
+    batch.entity = entity;
+    batch.n = 0;
+    if ((entity->flags & (PDCP_FLAG_CIPHERING | PDCP_FLAG_INTEGRITY)) == PDCP_FLAG_CIPHERING) {
+        for (size_t i = 0; i < num_pdus; i += PDCP_CIPHER_CHUNK)
+            pdcp_rx_cipher_chunk(entity, pdus + i, pdu_sizes + i,
+                                 num_pdus - i < PDCP_CIPHER_CHUNK ? num_pdus - i : PDCP_CIPHER_CHUNK, &batch);
     } else {
-        *output_size = input_size;
-        *output_pdu = malloc(*output_size);
-        if (!*output_pdu) return;
-        memcpy(*output_pdu, input_pdu, *output_size);
+        for (size_t i = 0; i < num_pdus; i++)
+            pdcp_rx_one(entity, pdus[i], pdu_sizes[i], &batch);
     }
+    pdcp_batch_flush(&batch);
 }
 
-// --- Ciphering/Deciphering (Simulated using XOR) ---
-void pdcp_cipher(pdcp_entity_t *entity, uint8_t *data, size_t data_size, uint8_t **output, size_t *output_size) {
-    *output_size = data_size;
-    *output = malloc(data_size);
-    if (!*output) return;
-    for (size_t i = 0; i < data_size; i++) {
-        (*output)[i] = data[i] ^ entity->cipher_key;
+// t-Reordering expiry: deliver below RX_REORD, giving up on the gaps.
+static void pdcp_rx_reordering_expired(timer_node_t *node) {
+    pdcp_rx_window_t *win = timer_entry(node, pdcp_rx_window_t, t_reordering);
+    pdcp_entity_t *entity = win->entity;
+
+    printf("PDCP: t-Reordering expired, delivering up to COUNT %u\n", win->rx_reord);
+
+    // Deliver everything stored below RX_REORD, skipping the gaps.
+    pdcp_delivery_batch_t batch;
+    batch.entity = entity;
+    batch.n = 0;
+    uint32_t count = pdcp_rx_window_next_stored(win, entity->rx_deliv, win->rx_reord);
+    while (count < win->rx_reord) {
+        pdcp_batch_add_stored(&batch, win, count);
+        count = pdcp_rx_window_next_stored(win, count + 1, win->rx_reord);
     }
+    // Then the consecutive run starting at RX_REORD.
+    entity->rx_deliv = win->rx_reord;
+    pdcp_rx_deliver_consecutive(entity, &batch);
+    pdcp_batch_flush(&batch);
+
+    pdcp_rx_update_reordering(entity);
 }
 
-void pdcp_decipher(pdcp_entity_t *entity, uint8_t *data, size_t data_size, uint8_t **output, size_t *output_size) {
-    // XOR deciphering is identical to ciphering.
-    pdcp_cipher(entity, data, data_size, output, output_size);
+void pdcp_deliver_sdu_to_upper(const pdcp_sdu_t *sdu) {
+    if (!sdu) return;
+    printf("PDCP: Delivered PDCP SDU to upper layer: %zu bytes (%zu-byte header restored)\n",
+           sdu->hdr_len + sdu->data_len, sdu->hdr_len);
 }
 
-// --- Return global PDCP entity ---
-pdcp_entity_t* pdcp_get_entity(void) {
-    static int is_initialized = 0;
-    if (!is_initialized) {
-        pdcp_entity_establish(&global_pdcp_entity);
-        is_initialized = 1;
-    }
-    return &global_pdcp_entity;
+void pdcp_deliver_sdus_to_upper(const pdcp_sdu_t *sdus, size_t num_sdus) {
+    for (size_t i = 0; i < num_sdus; i++)
+        pdcp_deliver_sdu_to_upper(&sdus[i]);
+}
+
+// --- Header Compression/Decompression (ROHC, pdcp/rohc.c) ---
+static rohc_state_t *pdcp_rohc_get(pdcp_entity_t *entity) {
+    if (!entity->cfg->rohc)
+        entity->cfg->rohc = rohc_create();
+    return entity->cfg->rohc;
+}
+
+int pdcp_compress_header(pdcp_entity_t *entity, pktbuf_t *pdu) {
+    rohc_state_t *rohc = pdcp_rohc_get(entity);
+    if (!rohc) return -1;
+    return rohc_compress(rohc, pdu, 0);
+}
+
+int pdcp_decompress_header(pdcp_entity_t *entity, const uint8_t **pdu, size_t *pdu_size,
+                           uint8_t *hdr, size_t *hdr_len) {
+    rohc_state_t *rohc = pdcp_rohc_get(entity);
+    if (!rohc) return -1;
+    return rohc_decompress(rohc, pdu, pdu_size, hdr, hdr_len);
+}
+
+// --- Ciphering/Deciphering (128-NEA2, in place) ---
+void pdcp_cipher(pdcp_entity_t *entity, uint32_t count, uint8_t *data, size_t data_size) {
+    const pdcp_config_t *cfg = entity->cfg;
+    nea2_crypt(&cfg->cipher_ks, count, cfg->bearer_id, cfg->direction, data, data_size);
+}
+
+void pdcp_decipher(pdcp_entity_t *entity, uint32_t count, uint8_t *data, size_t data_size) {
+    // AES-CTR deciphering is identical to ciphering.
+    pdcp_cipher(entity, count, data, data_size);
 }
@@ -3,36 +3,218 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "../pktbuf/pktbuf.h"
+#include "../security/security.h"
+#include "../timer/timer.h"
+#include "rohc.h"
 
 /**
- * struct pdcp_entity_t - PDCP protocol entity instance
- * @tx_next: Sequence number for next PDU transmission
- * @rx_next: Expected sequence number for next reception
- * @header_compression_enabled: Flag for header compression (1=on, 0=off)
- * @ciphering_enabled: Flag for data encryption (1=on, 0=off)
- * @cipher_key: Simple XOR encryption key (8-bit)
+ * PDCP_SN_BITS_SHORT - 12-bit PDCP SN (2-byte data PDU header)
+ * PDCP_SN_BITS_LONG - 18-bit PDCP SN (3-byte data PDU header)
+ *
+ * The reordering window is half the SN space: 2^11 or 2^17 COUNTs.
+ */
+#define PDCP_SN_BITS_SHORT 12
+#define PDCP_SN_BITS_LONG  18
+
+/**
+ * PDCP_T_REORDERING_DEFAULT - Default t-Reordering duration in ms
+ */
+#define PDCP_T_REORDERING_DEFAULT 100
+
+/**
+ * PDCP_DELIVER_BATCH - Maximum SDUs handed to the upper layer per call
+ */
+#define PDCP_DELIVER_BATCH 32
+
+/**
+ * PDCP_FLAG_HEADER_COMPRESSION - Header compression enabled
+ * PDCP_FLAG_CIPHERING - Ciphering enabled
+ * PDCP_FLAG_ACTIVE - Entity is established (set for table slots in use)
+ * PDCP_FLAG_SN18 - 18-bit SN configured (12-bit otherwise)
+ * PDCP_FLAG_INTEGRITY - Integrity protection (128-NIA2 MAC-I) enabled
+ */
+#define PDCP_FLAG_HEADER_COMPRESSION 0x01u
+#define PDCP_FLAG_CIPHERING          0x02u
+#define PDCP_FLAG_ACTIVE             0x04u
+#define PDCP_FLAG_SN18               0x08u
+#define PDCP_FLAG_INTEGRITY          0x10u
+
+/**
+ * struct pdcp_config_t - PDCP bearer configuration (cold data)
+ * @ue_id: UE the bearer belongs to
+ * @drb_id: Data radio bearer identity within the UE
+ * @bearer_id: Radio bearer identity used as NEA2 BEARER input
+ * @direction: Link direction used as NEA2 DIRECTION input (0=UL, 1=DL)
+ * @t_reordering: t-Reordering duration in ms
+ * @cipher_key: 128-bit NEA2 ciphering key
+ * @cipher_ks: Expanded AES key schedule derived from @cipher_key
+ * @rohc: Header compression contexts, allocated on first use
+ * @integrity_key: 128-bit NIA2 integrity key
+ * @integ_ks: Expanded AES-CMAC key derived from @integrity_key
+ * @integrity_failures: Received PDUs discarded for a wrong MAC-I
+ * @offload: Crypto offload jobs in flight, allocated on first use
+ * @txbuf: Transmitted PDUs awaiting confirmation, NULL unless configured
+ * @rlc: RLC entity queueing the bearer's PDUs, set by rlc_entity_bind_pdcp()
+ *
+ * Keys and configuration change only at setup, so they are kept
+ * apart from the per-PDU state to keep the hot array dense.
+ */
+typedef struct {
+    uint32_t ue_id;
+    uint8_t drb_id;
+    uint8_t bearer_id;
+    uint8_t direction;
+    uint16_t t_reordering;
+    uint8_t cipher_key[SEC_KEY_LEN];
+    aes128_key_t cipher_ks;
+    rohc_state_t *rohc;
+    uint8_t integrity_key[SEC_KEY_LEN];
+    nia2_key_t integ_ks;
+    uint32_t integrity_failures;
+    struct pdcp_offload_bearer *offload;
+    struct pdcp_tx_buffer *txbuf;
+    void *rlc;
+} pdcp_config_t;
+
+/**
+ * struct pdcp_rx_window_t - PDCP reception buffer for out-of-order PDUs
+ * @size: Number of ring slots (the reordering window size)
+ * @slots: Stored SDUs, indexed by COUNT modulo @size
+ * @bitmap: One bit per ring slot, set while a SDU is stored there
+ * @rx_reord: RX_REORD, the COUNT that triggered t-Reordering
+ * @entity: Entity owning the buffer
+ * @t_reordering: t-Reordering
+ *
+ * Allocated on the first out-of-order PDU, so bearers that only see
+ * in-order traffic never pay for it. With a ring slot per COUNT in
+ * the window, insert, duplicate check and in-order delivery are O(1)
+ * per PDU for both 12- and 18-bit SNs.
+ */
+typedef struct {
+    uint32_t size;
+    pktbuf_t **slots;
+    uint64_t *bitmap;
+    uint32_t rx_reord;
+    struct pdcp_entity *entity;
+    timer_node_t t_reordering;
+} pdcp_rx_window_t;
+
+/**
+ * struct pdcp_tx_buffer_t - Transmitted PDUs kept until delivery is confirmed
+ * @size: Number of ring slots (power of two), the bound on unconfirmed PDUs
+ * @pdus: Protected PDUs, indexed by COUNT modulo @size (NULL once released)
+ * @expiry: discardTimer expiry of each slot, in wheel ticks
+ * @tx_low: COUNT of the oldest PDU not yet released
+ * @discard_timer: discardTimer in ms, or PDCP_DISCARD_TIMER_INFINITY
+ * @entity: Entity owning the buffer
+ * @discard: discardTimer of the oldest retained PDU
+ * @discarded: PDUs released by discardTimer expiry
+ * @dropped: SDUs dropped because the buffer was full
+ *
+ * Slots in [@tx_low, TX_NEXT) belong to PDUs not yet confirmed.
+ * Each holds a view of the PDU as it left PDCP, so lower layers can
+ * prepend their headers to the buffer they were given without
+ * touching the retained bytes. COUNTs are assigned in time order,
+ * so discardTimer expiries are ordered too and expire from the head:
+ * a single timer, run for the oldest PDU, covers the whole buffer.
+ */
+typedef struct pdcp_tx_buffer {
+    uint32_t size;
+    pktbuf_t **pdus;
+    uint32_t *expiry;
+    uint32_t tx_low;
+    uint32_t discard_timer;
+    struct pdcp_entity *entity;
+    timer_node_t discard;
+    uint32_t discarded;
+    uint32_t dropped;
+} pdcp_tx_buffer_t;
+
+/**
+ * PDCP_DISCARD_TIMER_INFINITY - discardTimer value that never expires
+ */
+#define PDCP_DISCARD_TIMER_INFINITY 0
+
+/**
+ * struct pdcp_entity_t - PDCP protocol entity instance (hot data)
+ * @tx_next: COUNT for next PDU transmission (HFN | SN)
+ * @rx_next: RX_NEXT, COUNT following the highest received PDU
+ * @rx_deliv: RX_DELIV, COUNT of the first SDU not yet delivered
+ * @flags: PDCP_FLAG_* bits (header compression, ciphering, SN length)
+ * @cfg: Bearer configuration and keys
+ * @rxwin: Reception buffer, NULL until a PDU arrives out of order
  *
  * Represents a PDCP entity with state information for
  * sequence numbering, header compression, and security.
+ * Only state touched on every PDU lives here; the timers live in
+ * the buffers they guard, allocated on first use.
  */
-typedef struct {
+typedef struct pdcp_entity {
     uint32_t tx_next;
     uint32_t rx_next;
-    int header_compression_enabled;
-    int ciphering_enabled;
-    uint8_t cipher_key;
+    uint32_t rx_deliv;
+    uint32_t flags;
+    pdcp_config_t *cfg;
+    pdcp_rx_window_t *rxwin;
 } pdcp_entity_t;
 
+/**
+ * struct pdcp_table_t - Table of PDCP entities keyed by (UE id, DRB id)
+ * @entities: Hot per-bearer state, dense and indexed by handle
+ * @configs: Cold per-bearer configuration, same indexing
+ * @slot_keys: Open-addressing hash keys ((UE id << 8) | DRB id)
+ * @slot_handles: Handle stored in each hash slot (PDCP_TABLE_EMPTY if free)
+ * @free_handles: Stack of unused handles
+ * @slot_mask: Number of hash slots minus one
+ * @capacity: Maximum number of bearers
+ * @count: Number of bearers in use
+ *
+ * Storage is sized once at init and never moves, so entity pointers
+ * stay valid for the lifetime of the bearer. Lower layers keep that
+ * pointer and dispatch received PDUs without a hash lookup; the hash
+ * is only used on bearer setup, release and control-plane lookups.
+ *
+ * Memory per bearer is sizeof(pdcp_entity_t) + sizeof(pdcp_config_t)
+ * + 4 bytes of free-handle stack + 2 to 4 hash slots of 12 bytes
+ * (the slot count is the power of two at or above twice the capacity),
+ * i.e. 32 + 480 + 4 + 24..48 = 540..564 bytes on LP64 targets. A
+ * bearer that receives out of order adds its pdcp_rx_window_t (9 bytes
+ * per window COUNT: 18 KB at 12-bit SNs, 1.1 MB at 18-bit SNs), one
+ * that compresses headers adds its rohc_state_t (4 KB), one using
+ * the crypto offload adds its pdcp_offload_bearer_t (12 KB), and one
+ * retaining transmitted PDUs adds its pdcp_tx_buffer_t (12 bytes per
+ * slot plus the PDUs held).
+ */
+typedef struct {
+    pdcp_entity_t *entities;
+    pdcp_config_t *configs;
+    uint64_t *slot_keys;
+    uint32_t *slot_handles;
+    uint32_t *free_handles;
+    uint32_t slot_mask;
+    uint32_t capacity;
+    uint32_t count;
+} pdcp_table_t;
+
+/**
+ * PDCP_TABLE_EMPTY - Marker for an unused hash slot
+ * PDCP_TABLE_DEFAULT_CAPACITY - Size of the table returned by pdcp_get_table()
+ */
+#define PDCP_TABLE_EMPTY 0xFFFFFFFFu
+#define PDCP_TABLE_DEFAULT_CAPACITY 1024
+
 /* PDCP Entity Management Functions */
 
 /**
  * pdcp_entity_establish - Create and initialize a PDCP entity
  * @entity: Pointer to PDCP entity to initialize
+ * @cfg: Configuration storage bound to the entity
  *
  * Sets up a new PDCP entity with default values for sequence
  * numbers and security parameters.
  */
-void pdcp_entity_establish(pdcp_entity_t *entity);
+void pdcp_entity_establish(pdcp_entity_t *entity, pdcp_config_t *cfg);
 
 /**
  * pdcp_entity_reestablish - Reset a PDCP entity
@@ -40,9 +222,46 @@ void pdcp_entity_establish(pdcp_entity_t *entity);
  *
  * Resets sequence numbers and security context while
  * maintaining configuration parameters.
+ *
+ * A bearer retaining transmitted PDUs (pdcp_set_tx_retention()) is
+ * treated as an AM DRB instead: COUNTs, the reception state and the
+ * ROHC contexts carry over, so unconfirmed PDUs can be sent again
+ * with pdcp_tx_data_recovery().
  */
 void pdcp_entity_reestablish(pdcp_entity_t *entity);
 
+/**
+ * pdcp_set_cipher_key - Configure the ciphering key
+ * @entity: PDCP entity to configure
+ * @key: 128-bit NEA2 key
+ *
+ * Stores the key and expands its AES key schedule once, so
+ * per-PDU ciphering only generates keystream.
+ */
+void pdcp_set_cipher_key(pdcp_entity_t *entity, const uint8_t key[SEC_KEY_LEN]);
+
+/**
+ * pdcp_set_sn_length - Configure the PDCP SN length
+ * @entity: PDCP entity to configure
+ * @sn_bits: PDCP_SN_BITS_SHORT or PDCP_SN_BITS_LONG
+ *
+ * Must be called before any PDU is exchanged on the bearer.
+ *
+ * Return: 0 on success, -1 for an unsupported length
+ */
+int pdcp_set_sn_length(pdcp_entity_t *entity, int sn_bits);
+
+/**
+ * pdcp_set_integrity_key - Configure integrity protection
+ * @entity: PDCP entity to configure
+ * @key: 128-bit NIA2 key, or NULL to disable integrity protection
+ *
+ * With a key, every data PDU carries a 4-byte MAC-I computed over
+ * the PDCP header and the (compressed) SDU, and received PDUs whose
+ * MAC-I does not match are counted and discarded.
+ */
+void pdcp_set_integrity_key(pdcp_entity_t *entity, const uint8_t key[SEC_KEY_LEN]);
+
 /**
  * pdcp_entity_release - Clean up a PDCP entity
  * @entity: Pointer to PDCP entity to release
@@ -57,13 +276,12 @@ void pdcp_entity_release(pdcp_entity_t *entity);
 /**
  * pdcp_tx_data - Process data for transmission
  * @entity: PDCP entity handling the transmission
- * @sdu: Data unit from upper layer
- * @sdu_size: Size of data unit in bytes
+ * @sdu: Data unit from upper layer (consumed)
  *
  * Processes outgoing data by adding headers, applying
  * compression and encryption if enabled.
  */
-void pdcp_tx_data(pdcp_entity_t *entity, uint8_t *sdu, size_t sdu_size);
+void pdcp_tx_data(pdcp_entity_t *entity, pktbuf_t *sdu);
 
 /**
  * pdcp_rx_pdu - Process received data
@@ -71,106 +289,541 @@ void pdcp_tx_data(pdcp_entity_t *entity, uint8_t *sdu, size_t sdu_size);
  * @pdu: Received protocol data unit
  * @pdu_size: Size of received data in bytes
  *
- * Processes incoming data by decrypting, decompressing,
- * and handling sequence numbers before delivery.
+ * Processes incoming data by decrypting, reordering and
+ * decompressing it before delivery. The PDU is
+ * deciphered in place, so @pdu must be writable.
+ *
+ * Implements the receive operation of TS 38.323 5.2.2.2: COUNT is
+ * derived relative to RX_DELIV (handling HFN wrap), duplicates and
+ * PDUs below the window are discarded, out-of-order PDUs are stored
+ * until the gap is filled or t-Reordering expires, and runs of
+ * consecutive SDUs are decompressed and delivered to the upper layer
+ * in batches.
+ * In-order PDUs are delivered straight from @pdu without a copy, and
+ * PDUs failing integrity verification are counted and dropped before
+ * they reach the reception buffer.
  */
 void pdcp_rx_pdu(pdcp_entity_t *entity, uint8_t *pdu, size_t pdu_size);
 
+/**
+ * pdcp_rx_pdu_burst - Process a burst of received PDUs
+ * @entity: PDCP entity handling the reception
+ * @pdus: Received PDUs (deciphered in place)
+ * @pdu_sizes: Size of each PDU in bytes
+ * @num_pdus: Number of PDUs
+ *
+ * Same receive operation as pdcp_rx_pdu() without per-PDU logging.
+ * SDUs released by the whole burst share delivery batches, so the
+ * upper layer is called once per PDCP_DELIVER_BATCH SDUs rather than
+ * once per PDU. On bearers with ciphering but no integrity, the
+ * COUNTs of up to 64 PDUs are derived first and their keystream is
+ * generated in one nea2_crypt_burst() call; integrity-protected PDUs
+ * are still verified and deciphered one at a time. @pdus must stay
+ * valid until the call returns.
+ */
+void pdcp_rx_pdu_burst(pdcp_entity_t *entity, uint8_t *const *pdus, const size_t *pdu_sizes, size_t num_pdus);
+
+/**
+ * pdcp_rx_pdu_count - First step of the receive operation
+ * @entity: PDCP entity handling the reception
+ * @pdu: Received PDU
+ * @pdu_size: Size of @pdu in bytes
+ * @count: Set to the COUNT derived from the PDU's SN
+ *
+ * Parses the data PDU header and discards control PDUs, malformed
+ * PDUs and duplicates, as pdcp_rx_pdu() does before security.
+ *
+ * Return: Header size in bytes, or -1 if the PDU is discarded
+ */
+int pdcp_rx_pdu_count(pdcp_entity_t *entity, const uint8_t *pdu, size_t pdu_size, uint32_t *count);
+
+/**
+ * pdcp_rx_unprotect - Security step of the receive operation
+ * @entity: PDCP entity handling the reception
+ * @count: COUNT returned by pdcp_rx_pdu_count()
+ * @pdu: Whole PDU, deciphered in place
+ * @pdu_size: Size of @pdu, reduced by the MAC-I on success
+ *
+ * Verifies the MAC-I and deciphers in one pass. Only reads the
+ * entity's keys and flags, so it may run on any thread.
+ *
+ * Return: 0 on success, -1 if integrity verification failed
+ */
+int pdcp_rx_unprotect(const pdcp_entity_t *entity, uint32_t count, uint8_t *pdu, size_t *pdu_size);
+
+/**
+ * pdcp_rx_accept_burst - Last step of the receive operation
+ * @entity: PDCP entity handling the reception
+ * @counts: COUNT of each PDU
+ * @pdus: PDUs that passed pdcp_rx_unprotect(), header still in front
+ *        and MAC-I already trimmed (all consumed)
+ * @num_pdus: Number of PDUs
+ *
+ * Runs reordering and in-order delivery for PDUs whose security
+ * step ran elsewhere. Duplicates are checked again, since the window
+ * may have moved in the meantime. Out-of-order PDUs are stored
+ * without a copy.
+ */
+void pdcp_rx_accept_burst(pdcp_entity_t *entity, const uint32_t *counts, pktbuf_t **pdus, size_t num_pdus);
+
+/**
+ * struct pdcp_sdu_t - SDU handed to the upper layer
+ * @hdr: Header rebuilt by the decompressor
+ * @hdr_len: Length of @hdr (0 if the SDU was not compressed)
+ * @data: Rest of the SDU, still in the received buffer
+ * @data_len: Length of @data
+ *
+ * The SDU is @hdr followed by @data, so restoring a header never
+ * copies or moves the payload.
+ */
+typedef struct {
+    const uint8_t *hdr;
+    size_t hdr_len;
+    const uint8_t *data;
+    size_t data_len;
+} pdcp_sdu_t;
+
 /**
  * pdcp_deliver_sdu_to_upper - Forward data to upper layer
  * @sdu: Processed data unit
- * @sdu_size: Size of data unit in bytes
  *
  * Delivers processed and verified data to the upper
  * protocol layer (typically IP).
  */
-void pdcp_deliver_sdu_to_upper(uint8_t *sdu, size_t sdu_size);
+void pdcp_deliver_sdu_to_upper(const pdcp_sdu_t *sdu);
+
+/**
+ * pdcp_deliver_sdus_to_upper - Forward a run of in-order SDUs
+ * @sdus: SDUs, in COUNT order
+ * @num_sdus: Number of SDUs (at most PDCP_DELIVER_BATCH)
+ *
+ * Batched form of pdcp_deliver_sdu_to_upper() used by the
+ * reordering function.
+ */
+void pdcp_deliver_sdus_to_upper(const pdcp_sdu_t *sdus, size_t num_sdus);
+
+/**
+ * pdcp_deliver_cb_t - Upper layer receiving runs of in-order SDUs
+ *
+ * SDU memory belongs to PDCP and is only valid during the call.
+ */
+typedef void (*pdcp_deliver_cb_t)(const pdcp_sdu_t *sdus, size_t num_sdus);
+
+/**
+ * pdcp_set_deliver_callback - Route delivered SDUs to an upper layer
+ * @cb: Handler for every entity, or NULL for pdcp_deliver_sdus_to_upper()
+ */
+void pdcp_set_deliver_callback(pdcp_deliver_cb_t cb);
 
 /* Header Compression Functions */
 
 /**
  * pdcp_compress_header - Compress IP headers
  * @entity: PDCP entity handling compression
- * @input_pdu: Data with headers to compress
- * @input_size: Size of input data
- * @output_pdu: Resulting compressed data
- * @output_size: Size of compressed data
+ * @pdu: Packet buffer to compress in place
+ *
+ * Applies ROHC (profiles 0x0001 RTP and 0x0002 UDP over IPv4) to
+ * reduce protocol overhead in the radio interface. The compressed
+ * header replaces the original one inside the buffer.
  *
- * Applies header compression to reduce protocol
- * overhead in the radio interface.
+ * Return: 0 on success, -1 on allocation failure or missing headroom
  */
-void pdcp_compress_header(pdcp_entity_t *entity, uint8_t *input_pdu, size_t input_size,
-                         uint8_t **output_pdu, size_t *output_size);
+int pdcp_compress_header(pdcp_entity_t *entity, pktbuf_t *pdu);
 
 /**
  * pdcp_decompress_header - Decompress headers
  * @entity: PDCP entity handling decompression
- * @input_pdu: Compressed data
- * @input_size: Size of compressed data
- * @output_pdu: Resulting decompressed data
- * @output_size: Size of decompressed data
+ * @pdu: Compressed data, advanced past the compressed header
+ * @pdu_size: Size of compressed data, updated to the payload size
+ * @hdr: Buffer of ROHC_MAX_HEADER_LEN bytes receiving the header
+ * @hdr_len: Length of the restored header
  *
  * Restores original headers from compressed format
- * for upper layer processing.
+ * for upper layer processing without copying the payload.
+ * Must be called in COUNT order, as the reordering function does.
+ *
+ * Return: 0 on success, -1 if the SDU must be discarded
  */
-void pdcp_decompress_header(pdcp_entity_t *entity, uint8_t *input_pdu, size_t input_size,
-                           uint8_t **output_pdu, size_t *output_size);
+int pdcp_decompress_header(pdcp_entity_t *entity, const uint8_t **pdu, size_t *pdu_size,
+                           uint8_t *hdr, size_t *hdr_len);
 
 /* Security Functions */
 
 /**
- * pdcp_cipher - Encrypt data
+ * pdcp_cipher - Encrypt data in place
  * @entity: PDCP entity with security context
+ * @count: COUNT of the PDU being ciphered
  * @data: Data to encrypt
  * @data_size: Size of data to encrypt
- * @output: Resulting encrypted data
- * @output_size: Size of encrypted data
  *
- * Applies encryption to protect data confidentiality
- * using the configured cipher key.
+ * Applies 128-NEA2 using the configured cipher key, the PDU
+ * COUNT and the entity's bearer and direction.
  */
-void pdcp_cipher(pdcp_entity_t *entity, uint8_t *data, size_t data_size,
-                 uint8_t **output, size_t *output_size);
+void pdcp_cipher(pdcp_entity_t *entity, uint32_t count, uint8_t *data, size_t data_size);
 
 /**
- * pdcp_decipher - Decrypt data
+ * pdcp_decipher - Decrypt data in place
  * @entity: PDCP entity with security context
+ * @count: COUNT of the received PDU
  * @data: Encrypted data
  * @data_size: Size of encrypted data
- * @output: Resulting decrypted data
- * @output_size: Size of decrypted data
  *
  * Decrypts received data using the configured
  * cipher key to restore original content.
  */
-void pdcp_decipher(pdcp_entity_t *entity, uint8_t *data, size_t data_size,
-                   uint8_t **output, size_t *output_size);
+void pdcp_decipher(pdcp_entity_t *entity, uint32_t count, uint8_t *data, size_t data_size);
 
 /**
  * pdcp_prepare_tx_pdu - Prepare PDU for transmission
  * @entity: PDCP entity handling the transmission
- * @sdu: Input data from upper layer
- * @sdu_size: Size of input data
- * @pdu_size: Resulting PDU size
+ * @sdu: Input data from upper layer (consumed)
+ *
+ * Creates a complete PDCP PDU in the SDU's own buffer by:
+ * 1. Applying header compression if enabled
+ * 2. Adding 2- or 3-byte data PDU header (never ciphered)
+ * 3. Appending the MAC-I and applying encryption if enabled, in a
+ *    single pass over the data
+ *
+ * Return: Buffer holding the prepared PDU or NULL on failure
+ */
+pktbuf_t *pdcp_prepare_tx_pdu(pdcp_entity_t *entity, pktbuf_t *sdu);
+
+/**
+ * pdcp_prepare_tx_pdu_burst - Prepare a burst of PDUs for transmission
+ * @entity: PDCP entity handling the transmission
+ * @sdus: SDUs from upper layer (all consumed)
+ * @pdus: Array receiving the prepared PDUs (may be @sdus itself)
+ * @num_sdus: Number of SDUs
+ *
+ * Runs the steps of pdcp_prepare_tx_pdu() as one loop per step over
+ * the burst: compression, a single COUNT assignment for all SDUs,
+ * header insertion, then integrity protection and ciphering. The ROHC
+ * state is looked up once per burst, and without integrity protection
+ * the keystream of up to 64 PDUs comes from one nea2_crypt_burst()
+ * call; with it, each PDU still gets its fused MAC-I and cipher
+ * pass. SDUs that cannot be compressed or lack head- or tailroom are freed
+ * before a COUNT is assigned, and the rest keep their order in @pdus.
+ *
+ * Return: Number of PDUs stored in @pdus
+ */
+size_t pdcp_prepare_tx_pdu_burst(pdcp_entity_t *entity, pktbuf_t **sdus, pktbuf_t **pdus, size_t num_sdus);
+
+/**
+ * pdcp_tx_assign - Transmit steps of pdcp_prepare_tx_pdu_burst() before security
+ * @entity: PDCP entity handling the transmission
+ * @sdus: SDUs from upper layer (all consumed)
+ * @pdus: Array receiving the PDUs (may be @sdus itself)
+ * @num_sdus: Number of SDUs
+ * @first_count: Set to the COUNT of @pdus[0]; the others follow in order
+ *
+ * Compresses, assigns COUNTs, writes the data PDU headers and
+ * reserves room for the MAC-I. Each PDU still has to go through
+ * pdcp_tx_protect() before it is sent.
+ *
+ * Return: Number of PDUs stored in @pdus
+ */
+size_t pdcp_tx_assign(pdcp_entity_t *entity, pktbuf_t **sdus, pktbuf_t **pdus, size_t num_sdus,
+                      uint32_t *first_count);
+
+/**
+ * pdcp_tx_protect - Security step for one PDU from pdcp_tx_assign()
+ * @entity: PDCP entity handling the transmission
+ * @pdu: PDU to protect in place
+ * @count: COUNT assigned to @pdu
+ *
+ * Computes the MAC-I and ciphers in one pass. Only reads the
+ * entity's keys and flags, so it may run on any thread.
+ */
+void pdcp_tx_protect(const pdcp_entity_t *entity, pktbuf_t *pdu, uint32_t count);
+
+/* Transmit Buffer Functions */
+
+/**
+ * pdcp_set_tx_retention - Keep transmitted PDUs until delivery is confirmed
+ * @entity: PDCP entity to configure
+ * @size: Maximum unconfirmed PDUs (rounded up to a power of two, at
+ *        most the reordering window), or 0 to stop retaining
+ * @discard_timer: discardTimer in ms, or PDCP_DISCARD_TIMER_INFINITY
+ *
+ * While the buffer is full, new SDUs are dropped before they get a
+ * COUNT. On discardTimer expiry the PDUs still queued in the bound
+ * RLC entity are dropped too (rlc_tx_discard()). Memory per bearer
+ * is bounded by @size slots of 12 bytes plus the PDUs they hold. A
+ * bearer with retention is re-established the AM way: see
+ * pdcp_entity_reestablish().
  *
- * Creates a complete PDCP PDU by:
- * 1. Adding 2-byte sequence number header
- * 2. Applying header compression if enabled
- * 3. Applying encryption if enabled
+ * Return: 0 on success, -1 for a bad size or on allocation failure
+ */
+int pdcp_set_tx_retention(pdcp_entity_t *entity, uint32_t size, uint32_t discard_timer);
+
+/**
+ * pdcp_tx_retain - Record a protected PDU in the transmit buffer
+ * @entity: PDCP entity
+ * @count: COUNT of @pdu
+ * @pdu: PDU about to be handed to lower layers (not consumed)
+ *
+ * Called by the transmit paths once the header is in place; the view
+ * shares the PDU's storage, so security may still run afterwards.
+ * Does nothing if the entity does not retain PDUs or the COUNT was
+ * already released.
+ */
+void pdcp_tx_retain(pdcp_entity_t *entity, uint32_t count, pktbuf_t *pdu);
+
+/**
+ * pdcp_tx_confirm - Lower layers confirmed delivery of one PDU
+ * @entity: PDCP entity
+ * @count: COUNT of the delivered PDU
+ *
+ * Confirmations may arrive in any order; the buffer's low edge only
+ * moves past a run of confirmed PDUs.
+ */
+void pdcp_tx_confirm(pdcp_entity_t *entity, uint32_t count);
+
+/**
+ * pdcp_tx_confirm_upto - Lower layers confirmed delivery of all earlier PDUs
+ * @entity: PDCP entity
+ * @count: First COUNT not confirmed
+ *
+ * Releases every PDU below @count in one sweep.
+ */
+void pdcp_tx_confirm_upto(pdcp_entity_t *entity, uint32_t count);
+
+/**
+ * pdcp_tx_pdu_count - COUNT of a data PDU this entity transmitted
+ * @entity: PDCP entity
+ * @pdu: PDU as handed to lower layers, header first
+ * @pdu_size: Bytes available at @pdu
+ * @count: Set to the COUNT of the PDU
+ *
+ * Lets lower layers that hold PDUs rather than COUNTs confirm them.
+ * The SN is taken as the latest COUNT below TX_NEXT carrying it,
+ * which is exact for every PDU the transmit buffer still retains.
+ *
+ * Return: 0 on success, -1 for a control PDU or a truncated header
+ */
+int pdcp_tx_pdu_count(const pdcp_entity_t *entity, const uint8_t *pdu, size_t pdu_size, uint32_t *count);
+
+/**
+ * pdcp_tx_data_recovery - Collect unconfirmed PDUs for retransmission
+ * @entity: PDCP entity
+ * @pdus: Array receiving one reference per PDU, in COUNT order
+ * @max: Size of @pdus (the retention size covers every PDU)
+ *
+ * Returns the retained PDUs exactly as first transmitted: header,
+ * ciphering and MAC-I are reused, since neither the COUNT nor the
+ * keys changed. The buffers have no headroom, so lower layers add
+ * their headers in a separate buffer. The PDUs stay retained until
+ * confirmed or discarded.
+ *
+ * Return: Number of PDUs stored in @pdus
+ */
+size_t pdcp_tx_data_recovery(pdcp_entity_t *entity, pktbuf_t **pdus, size_t max);
+
+/* Crypto Offload Functions */
+
+/**
+ * PDCP_OFFLOAD_MAX_WORKERS - Upper bound for pdcp_offload_start()
+ * PDCP_OFFLOAD_QUEUE_SIZE - Jobs per worker queue (power of two)
+ * PDCP_OFFLOAD_WINDOW - Jobs in flight per bearer and direction (power of two)
+ */
+#define PDCP_OFFLOAD_MAX_WORKERS 64
+#define PDCP_OFFLOAD_QUEUE_SIZE  1024
+#define PDCP_OFFLOAD_WINDOW      256
+
+/**
+ * struct pdcp_crypto_job_t - Security step of one PDU, run by a worker
+ * @bearer: Offload state the job belongs to
+ * @pdu: PDU buffer, owned by the job while it is in flight
+ * @count: COUNT of the PDU
+ * @rx: Verification/deciphering (1) or protection (0)
+ * @status: Result of pdcp_rx_unprotect() for RX jobs
+ * @done: Set by the PDCP thread once the worker handed the job back
+ */
+typedef struct pdcp_crypto_job {
+    struct pdcp_offload_bearer *bearer;
+    pktbuf_t *pdu;
+    uint32_t count;
+    uint8_t rx;
+    int8_t status;
+    uint8_t done;
+} pdcp_crypto_job_t;
+
+/**
+ * struct pdcp_offload_bearer_t - Resequencing state of one bearer
+ * @entity: Entity the jobs belong to
+ * @tx: TX jobs, in COUNT order
+ * @rx: RX jobs, in arrival order
+ * @tx_head: Oldest TX job not yet released
+ * @tx_tail: Next free TX job
+ * @rx_head: Oldest RX job not yet released
+ * @rx_tail: Next free RX job
+ * @next: Next bearer on the pool's list of bearers with jobs in flight
+ * @busy: Whether the bearer is on that list
+ *
+ * Jobs finish in any order across workers. Each direction is a ring
+ * released strictly from its head, so PDUs reach RLC in COUNT order
+ * and received PDUs reach the reordering function in arrival order.
+ */
+typedef struct pdcp_offload_bearer {
+    pdcp_entity_t *entity;
+    pdcp_crypto_job_t tx[PDCP_OFFLOAD_WINDOW];
+    pdcp_crypto_job_t rx[PDCP_OFFLOAD_WINDOW];
+    uint32_t tx_head;
+    uint32_t tx_tail;
+    uint32_t rx_head;
+    uint32_t rx_tail;
+    struct pdcp_offload_bearer *next;
+    int busy;
+} pdcp_offload_bearer_t;
+
+/**
+ * pdcp_tx_done_cb_t - Lower layer receiving protected PDUs
+ * @entity: Entity the PDU belongs to
+ * @pdu: Protected PDU (ownership passes to the callee)
+ *
+ * Called from pdcp_offload_poll() on the PDCP thread, in COUNT order
+ * per bearer.
+ */
+typedef void (*pdcp_tx_done_cb_t)(pdcp_entity_t *entity, pktbuf_t *pdu);
+
+/**
+ * pdcp_offload_start - Start the crypto worker pool
+ * @num_workers: Worker threads (0 runs the security step inline)
+ * @tx_done: Handler for protected PDUs
+ *
+ * Each worker has a lock-free single-producer queue of jobs from the
+ * PDCP thread and one of completions back to it, so no lock is taken
+ * per PDU. Jobs are spread round-robin over the workers. All other
+ * PDCP state stays on the PDCP thread: workers only run
+ * pdcp_tx_protect() and pdcp_rx_unprotect().
+ *
+ * Return: 0 on success, -1 if already running, for too many workers
+ * or on allocation failure
+ */
+int pdcp_offload_start(unsigned num_workers, pdcp_tx_done_cb_t tx_done);
+
+/**
+ * pdcp_offload_stop - Finish all jobs and stop the worker threads
+ */
+void pdcp_offload_stop(void);
+
+/**
+ * pdcp_offload_tx_burst - Transmit a burst with the security step offloaded
+ * @entity: PDCP entity handling the transmission
+ * @sdus: SDUs from upper layer (all consumed)
+ * @num_sdus: Number of SDUs
+ *
+ * Runs pdcp_tx_assign() on the calling thread and queues one job per
+ * PDU. Protected PDUs are handed to the pool's callback by
+ * pdcp_offload_poll(), in COUNT order. Blocks (polling) while the
+ * bearer already has PDCP_OFFLOAD_WINDOW PDUs in flight.
+ *
+ * Return: Number of PDUs queued, 0 if the pool is not started
+ */
+size_t pdcp_offload_tx_burst(pdcp_entity_t *entity, pktbuf_t **sdus, size_t num_sdus);
+
+/**
+ * pdcp_offload_rx_burst - Receive a burst with the security step offloaded
+ * @entity: PDCP entity handling the reception
+ * @pdus: Received PDUs (all consumed)
+ * @num_pdus: Number of PDUs
+ *
+ * Runs pdcp_rx_pdu_count() on the calling thread and queues one job
+ * per PDU; pdcp_offload_poll() then feeds the results in arrival
+ * order to pdcp_rx_accept_burst(). COUNTs are derived against the
+ * RX_DELIV of submission time, which lags by at most the PDUs in
+ * flight. PDUs are discarded if the pool is not started.
+ */
+void pdcp_offload_rx_burst(pdcp_entity_t *entity, pktbuf_t **pdus, size_t num_pdus);
+
+/**
+ * pdcp_offload_poll - Collect finished jobs
+ *
+ * Must be called regularly on the PDCP thread. Releases, per bearer,
+ * every job at the head of its rings that has completed.
+ *
+ * Return: Number of jobs that completed since the last call
+ */
+size_t pdcp_offload_poll(void);
+
+/**
+ * pdcp_offload_flush - Poll until no job is in flight
+ */
+void pdcp_offload_flush(void);
+
+/**
+ * pdcp_offload_detach - Finish a bearer's jobs and free its offload state
+ * @entity: PDCP entity
+ *
+ * Called on re-establishment and release.
+ */
+void pdcp_offload_detach(pdcp_entity_t *entity);
+
+/* Entity Table Functions */
+
+/**
+ * pdcp_table_init - Allocate an entity table
+ * @table: Table to initialize
+ * @capacity: Maximum number of bearers
+ *
+ * Return: 0 on success, -1 on allocation failure
+ */
+int pdcp_table_init(pdcp_table_t *table, uint32_t capacity);
+
+/**
+ * pdcp_table_free - Release all storage of an entity table
+ * @table: Table to free
+ */
+void pdcp_table_free(pdcp_table_t *table);
+
+/**
+ * pdcp_table_add - Establish a PDCP entity for a bearer
+ * @table: Entity table
+ * @ue_id: UE identity
+ * @drb_id: DRB identity (1..32)
+ *
+ * Return: Established entity, or NULL if the table is full or the
+ * bearer already exists
+ */
+pdcp_entity_t *pdcp_table_add(pdcp_table_t *table, uint32_t ue_id, uint8_t drb_id);
+
+/**
+ * pdcp_table_lookup - Find the PDCP entity of a bearer
+ * @table: Entity table
+ * @ue_id: UE identity
+ * @drb_id: DRB identity
+ *
+ * Return: Entity or NULL if the bearer does not exist
+ */
+pdcp_entity_t *pdcp_table_lookup(const pdcp_table_t *table, uint32_t ue_id, uint8_t drb_id);
+
+/**
+ * pdcp_table_remove - Release the PDCP entity of a bearer
+ * @table: Entity table
+ * @ue_id: UE identity
+ * @drb_id: DRB identity
+ *
+ * Return: 0 on success, -1 if the bearer does not exist
+ */
+int pdcp_table_remove(pdcp_table_t *table, uint32_t ue_id, uint8_t drb_id);
+
+/**
+ * pdcp_table_memory_usage - Bytes allocated by an entity table
+ * @table: Entity table
  *
- * Return: Pointer to prepared PDU or NULL on failure
+ * Return: Total size of all arrays owned by @table
  */
-uint8_t *pdcp_prepare_tx_pdu(pdcp_entity_t *entity, uint8_t *sdu, size_t sdu_size,
-                            size_t *pdu_size);
+size_t pdcp_table_memory_usage(const pdcp_table_t *table);
 
 /**
- * pdcp_get_entity - Get reference to global PDCP entity
+ * pdcp_get_table - Get reference to the global PDCP entity table
  *
- * Return: Pointer to the global PDCP entity instance
+ * Return: Pointer to the global table, created on first use with
+ * PDCP_TABLE_DEFAULT_CAPACITY bearers
  *
- * Provides access to the singleton PDCP entity used
- * for all PDCP layer processing.
+ * Provides access to the table holding every PDCP entity of the
+ * stack, keyed by UE and DRB.
  */
-pdcp_entity_t* pdcp_get_entity(void);
+pdcp_table_t *pdcp_get_table(void);
 
 #endif /* PDCP_H */
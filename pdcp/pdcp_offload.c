@@ -0,0 +1,283 @@
+#include "pdcp.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../ring/ring.h"
+
+// One worker thread with its own job and completion queues, so every
+// queue has exactly one producer and one consumer.
+typedef struct {
+    spsc_ring_t jobs;           // PDCP thread -> worker
+    spsc_ring_t done;           // Worker -> PDCP thread
+    pthread_t thread;
+    int stop;
+} pdcp_offload_worker_t;
+
+typedef struct {
+    pdcp_offload_worker_t *workers;
+    unsigned num_workers;
+    unsigned next_worker;
+    pdcp_tx_done_cb_t tx_done;
+    pdcp_offload_bearer_t *busy;    // Bearers with jobs in flight
+    int running;
+} pdcp_offload_pool_t;
+
+// Global crypto worker pool.
+static pdcp_offload_pool_t pool;
+
+// --- Workers ---
+static void pdcp_offload_run(pdcp_crypto_job_t *job) {
+    pdcp_entity_t *entity = job->bearer->entity;
+    if (job->rx) {
+        size_t len = job->pdu->len;
+        job->status = (int8_t)pdcp_rx_unprotect(entity, job->count, job->pdu->data, &len);
+        pktbuf_trim(job->pdu, job->pdu->len - len);
+    } else {
+        pdcp_tx_protect(entity, job->pdu, job->count);
+    }
+}
+
+static void *pdcp_offload_worker(void *arg) {
+    pdcp_offload_worker_t *w = arg;
+    while (!__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE)) {
+        pdcp_crypto_job_t *job = spsc_ring_pop(&w->jobs);
+        if (!job) {
+            // Workers may share cores with the PDCP thread, so never spin on an empty queue.
+            sched_yield();
+            continue;
+        }
+        pdcp_offload_run(job);
+        while (spsc_ring_push(&w->done, job) < 0)
+            sched_yield();
+    }
+    return NULL;
+}
+
+static void pdcp_offload_free_workers(unsigned started) {
+    for (unsigned i = 0; i < started; i++) {
+        __atomic_store_n(&pool.workers[i].stop, 1, __ATOMIC_RELEASE);
+        pthread_join(pool.workers[i].thread, NULL);
+    }
+    for (unsigned i = 0; pool.workers && i < pool.num_workers; i++) {
+        spsc_ring_free(&pool.workers[i].jobs);
+        spsc_ring_free(&pool.workers[i].done);
+    }
+    free(pool.workers);
+    pool.workers = NULL;
+    pool.num_workers = 0;
+}
+
+int pdcp_offload_start(unsigned num_workers, pdcp_tx_done_cb_t tx_done) {
+    if (pool.running || !tx_done || num_workers > PDCP_OFFLOAD_MAX_WORKERS) return -1;
+    memset(&pool, 0, sizeof(pool));
+    pool.tx_done = tx_done;
+    pool.num_workers = num_workers;
+    if (num_workers > 0) {
+        // Cache-line aligned so the ring indices of different workers never share a line.
+        size_t size = ((num_workers * sizeof(pdcp_offload_worker_t) + RING_CACHE_LINE - 1) /
+                       RING_CACHE_LINE) * RING_CACHE_LINE;
+        pool.workers = aligned_alloc(RING_CACHE_LINE, size);
+        if (!pool.workers) return -1;
+        memset(pool.workers, 0, size);
+    }
+    for (unsigned i = 0; i < num_workers; i++) {
+        if (spsc_ring_init(&pool.workers[i].jobs, PDCP_OFFLOAD_QUEUE_SIZE) < 0 ||
+            spsc_ring_init(&pool.workers[i].done, PDCP_OFFLOAD_QUEUE_SIZE) < 0) {
+            pdcp_offload_free_workers(0);
+            return -1;
+        }
+    }
+    for (unsigned i = 0; i < num_workers; i++) {
+        if (pthread_create(&pool.workers[i].thread, NULL, pdcp_offload_worker, &pool.workers[i]) != 0) {
+            printf("PDCP: Failed to start crypto worker %u\n", i);
+            pdcp_offload_free_workers(i);
+            return -1;
+        }
+    }
+    pool.running = 1;
+    return 0;
+}
+
+void pdcp_offload_stop(void) {
+    if (!pool.running) return;
+    pdcp_offload_flush();
+    pdcp_offload_free_workers(pool.num_workers);
+    pool.running = 0;
+}
+
+// --- Resequencing ---
+static pdcp_offload_bearer_t *pdcp_offload_bearer_get(pdcp_entity_t *entity) {
+    pdcp_config_t *cfg = entity->cfg;
+    if (!cfg->offload) {
+        cfg->offload = calloc(1, sizeof(pdcp_offload_bearer_t));
+        if (!cfg->offload) return NULL;
+        cfg->offload->entity = entity;
+    }
+    return cfg->offload;
+}
+
+static inline int pdcp_offload_idle(const pdcp_offload_bearer_t *b) {
+    return b->tx_head == b->tx_tail && b->rx_head == b->rx_tail;
+}
+
+// Hands completed jobs at the head of each ring back to PDCP, stopping at
+// the first one still in flight.
+static void pdcp_offload_release(pdcp_offload_bearer_t *b) {
+    while (b->tx_head != b->tx_tail) {
+        pdcp_crypto_job_t *job = &b->tx[b->tx_head & (PDCP_OFFLOAD_WINDOW - 1)];
+        if (!job->done) break;
+        job->done = 0;
+        b->tx_head++;
+        pool.tx_done(b->entity, job->pdu);
+    }
+
+    uint32_t counts[PDCP_DELIVER_BATCH];
+    pktbuf_t *pdus[PDCP_DELIVER_BATCH];
+    size_t n = 0;
+    while (b->rx_head != b->rx_tail) {
+        pdcp_crypto_job_t *job = &b->rx[b->rx_head & (PDCP_OFFLOAD_WINDOW - 1)];
+        if (!job->done) break;
+        job->done = 0;
+        b->rx_head++;
+        if (job->status < 0) {
+            b->entity->cfg->integrity_failures++;
+            printf("PDCP: Integrity verification failed (COUNT = %u), PDU discarded\n", job->count);
+            pktbuf_free(job->pdu);
+            continue;
+        }
+        counts[n] = job->count;
+        pdus[n++] = job->pdu;
+        if (n == PDCP_DELIVER_BATCH) {
+            pdcp_rx_accept_burst(b->entity, counts, pdus, n);
+            n = 0;
+        }
+    }
+    if (n > 0)
+        pdcp_rx_accept_burst(b->entity, counts, pdus, n);
+}
+
+size_t pdcp_offload_poll(void) {
+    size_t completed = 0;
+    for (unsigned i = 0; i < pool.num_workers; i++) {
+        pdcp_crypto_job_t *job;
+        while ((job = spsc_ring_pop(&pool.workers[i].done)) != NULL) {
+            job->done = 1;
+            completed++;
+        }
+    }
+    // Without workers, jobs complete as they are submitted.
+    if (completed == 0 && pool.num_workers > 0) return 0;
+
+    pdcp_offload_bearer_t **link = &pool.busy;
+    while (*link) {
+        pdcp_offload_bearer_t *b = *link;
+        pdcp_offload_release(b);
+        if (pdcp_offload_idle(b)) {
+            *link = b->next;
+            b->next = NULL;
+            b->busy = 0;
+        } else {
+            link = &b->next;
+        }
+    }
+    return completed;
+}
+
+void pdcp_offload_flush(void) {
+    while (pool.busy) {
+        if (pdcp_offload_poll() == 0)
+            sched_yield();
+    }
+}
+
+void pdcp_offload_detach(pdcp_entity_t *entity) {
+    if (!entity || !entity->cfg || !entity->cfg->offload) return;
+    pdcp_offload_bearer_t *b = entity->cfg->offload;
+    while (!pdcp_offload_idle(b)) {
+        if (pdcp_offload_poll() == 0)
+            sched_yield();
+    }
+    free(b);
+    entity->cfg->offload = NULL;
+}
+
+// --- Submission ---
+static void pdcp_offload_submit(pdcp_offload_bearer_t *b, pdcp_crypto_job_t *job) {
+    if (!b->busy) {
+        b->busy = 1;
+        b->next = pool.busy;
+        pool.busy = b;
+    }
+    if (pool.num_workers == 0) {
+        pdcp_offload_run(job);
+        job->done = 1;
+        return;
+    }
+    pdcp_offload_worker_t *w = &pool.workers[pool.next_worker];
+    if (++pool.next_worker == pool.num_workers)
+        pool.next_worker = 0;
+    // A full queue means the workers are behind: collect their results meanwhile.
+    while (spsc_ring_push(&w->jobs, job) < 0) {
+        if (pdcp_offload_poll() == 0)
+            sched_yield();
+    }
+}
+
+// Waits until the ring starting at *head has a free job.
+static void pdcp_offload_wait_window(const uint32_t *head, uint32_t tail) {
+    while (tail - *head == PDCP_OFFLOAD_WINDOW) {
+        if (pdcp_offload_poll() == 0)
+            sched_yield();
+    }
+}
+
+size_t pdcp_offload_tx_burst(pdcp_entity_t *entity, pktbuf_t **sdus, size_t num_sdus) {
+    pdcp_offload_bearer_t *b = (pool.running && entity) ? pdcp_offload_bearer_get(entity) : NULL;
+    if (!b) {
+        for (size_t i = 0; i < num_sdus; i++)
+            pktbuf_free(sdus[i]);
+        return 0;
+    }
+    uint32_t count;
+    size_t n = pdcp_tx_assign(entity, sdus, sdus, num_sdus, &count);
+    for (size_t i = 0; i < n; i++) {
+        // The retained view shares the bytes the worker is about to protect.
+        pdcp_tx_retain(entity, count + (uint32_t)i, sdus[i]);
+        pdcp_offload_wait_window(&b->tx_head, b->tx_tail);
+        pdcp_crypto_job_t *job = &b->tx[b->tx_tail & (PDCP_OFFLOAD_WINDOW - 1)];
+        job->bearer = b;
+        job->pdu = sdus[i];
+        job->count = count + (uint32_t)i;
+        job->rx = 0;
+        job->status = 0;
+        b->tx_tail++;
+        pdcp_offload_submit(b, job);
+    }
+    if (pool.num_workers == 0)
+        pdcp_offload_poll();
+    return n;
+}
+
+void pdcp_offload_rx_burst(pdcp_entity_t *entity, pktbuf_t **pdus, size_t num_pdus) {
+    pdcp_offload_bearer_t *b = (pool.running && entity) ? pdcp_offload_bearer_get(entity) : NULL;
+    for (size_t i = 0; i < num_pdus; i++) {
+        uint32_t count;
+        if (!b || pdcp_rx_pdu_count(entity, pdus[i]->data, pdus[i]->len, &count) < 0) {
+            pktbuf_free(pdus[i]);
+            continue;
+        }
+        pdcp_offload_wait_window(&b->rx_head, b->rx_tail);
+        pdcp_crypto_job_t *job = &b->rx[b->rx_tail & (PDCP_OFFLOAD_WINDOW - 1)];
+        job->bearer = b;
+        job->pdu = pdus[i];
+        job->count = count;
+        job->rx = 1;
+        job->status = 0;
+        b->rx_tail++;
+        pdcp_offload_submit(b, job);
+    }
+    if (pool.num_workers == 0)
+        pdcp_offload_poll();
+}
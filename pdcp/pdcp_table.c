@@ -0,0 +1,144 @@
+#include "pdcp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Global PDCP entity table.
+static pdcp_table_t global_pdcp_table;
+
+// --- Hashing ---
+static inline uint64_t pdcp_table_key(uint32_t ue_id, uint8_t drb_id) {
+    return ((uint64_t)ue_id << 8) | drb_id;
+}
+
+static inline uint32_t pdcp_table_hash(const pdcp_table_t *table, uint64_t key) {
+    // Fibonacci hashing spreads consecutive UE ids over the slots.
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & table->slot_mask;
+}
+
+// Returns the hash slot holding key, or the empty slot where it would go.
+static uint32_t pdcp_table_find_slot(const pdcp_table_t *table, uint64_t key) {
+    uint32_t i = pdcp_table_hash(table, key);
+    while (table->slot_handles[i] != PDCP_TABLE_EMPTY && table->slot_keys[i] != key)
+        i = (i + 1) & table->slot_mask;
+    return i;
+}
+
+// --- Table Management ---
+int pdcp_table_init(pdcp_table_t *table, uint32_t capacity) {
+    if (!table || capacity == 0) return -1;
+    memset(table, 0, sizeof(*table));
+
+    // Keep the hash at most half full so probes stay short.
+    uint32_t slots = 1;
+    while (slots < 2 * capacity)
+        slots <<= 1;
+
+    table->entities = calloc(capacity, sizeof(pdcp_entity_t));
+    table->configs = calloc(capacity, sizeof(pdcp_config_t));
+    table->slot_keys = malloc(slots * sizeof(uint64_t));
+    table->slot_handles = malloc(slots * sizeof(uint32_t));
+    table->free_handles = malloc(capacity * sizeof(uint32_t));
+    if (!table->entities || !table->configs || !table->slot_keys ||
+        !table->slot_handles || !table->free_handles) {
+        pdcp_table_free(table);
+        return -1;
+    }
+    memset(table->slot_handles, 0xFF, slots * sizeof(uint32_t));
+    // Hand out low handles first so active bearers stay packed.
+    for (uint32_t i = 0; i < capacity; i++)
+        table->free_handles[i] = capacity - 1 - i;
+    table->slot_mask = slots - 1;
+    table->capacity = capacity;
+    table->count = 0;
+    return 0;
+}
+
+void pdcp_table_free(pdcp_table_t *table) {
+    if (!table) return;
+    // Bearers still in use own a reception buffer and ROHC state.
+    for (uint32_t i = 0; table->entities && i < table->capacity; i++)
+        if (table->entities[i].flags & PDCP_FLAG_ACTIVE)
+            pdcp_entity_release(&table->entities[i]);
+    free(table->entities);
+    free(table->configs);
+    free(table->slot_keys);
+    free(table->slot_handles);
+    free(table->free_handles);
+    memset(table, 0, sizeof(*table));
+}
+
+pdcp_entity_t *pdcp_table_add(pdcp_table_t *table, uint32_t ue_id, uint8_t drb_id) {
+    if (!table || table->count == table->capacity) return NULL;
+    uint64_t key = pdcp_table_key(ue_id, drb_id);
+    uint32_t slot = pdcp_table_find_slot(table, key);
+    if (table->slot_handles[slot] != PDCP_TABLE_EMPTY) {
+        printf("PDCP: Bearer (UE %u, DRB %u) already exists\n", ue_id, drb_id);
+        return NULL;
+    }
+
+    uint32_t handle = table->free_handles[table->capacity - 1 - table->count];
+    table->count++;
+    table->slot_keys[slot] = key;
+    table->slot_handles[slot] = handle;
+
+    pdcp_entity_t *entity = &table->entities[handle];
+    pdcp_config_t *cfg = &table->configs[handle];
+    pdcp_entity_establish(entity, cfg);
+    cfg->ue_id = ue_id;
+    cfg->drb_id = drb_id;
+    cfg->bearer_id = (uint8_t)((drb_id - 1) & 0x1F);  // BEARER = DRB identity - 1
+    return entity;
+}
+
+pdcp_entity_t *pdcp_table_lookup(const pdcp_table_t *table, uint32_t ue_id, uint8_t drb_id) {
+    if (!table || !table->slot_handles) return NULL;
+    uint32_t slot = pdcp_table_find_slot(table, pdcp_table_key(ue_id, drb_id));
+    uint32_t handle = table->slot_handles[slot];
+    return (handle == PDCP_TABLE_EMPTY) ? NULL : &table->entities[handle];
+}
+
+int pdcp_table_remove(pdcp_table_t *table, uint32_t ue_id, uint8_t drb_id) {
+    if (!table || !table->slot_handles) return -1;
+    uint32_t i = pdcp_table_find_slot(table, pdcp_table_key(ue_id, drb_id));
+    uint32_t handle = table->slot_handles[i];
+    if (handle == PDCP_TABLE_EMPTY) return -1;
+
+    pdcp_entity_release(&table->entities[handle]);
+    table->count--;
+    table->free_handles[table->capacity - 1 - table->count] = handle;
+
+    // Backward-shift deletion keeps probe chains intact without tombstones.
+    uint32_t j = i;
+    for (;;) {
+        table->slot_handles[i] = PDCP_TABLE_EMPTY;
+        for (;;) {
+            j = (j + 1) & table->slot_mask;
+            if (table->slot_handles[j] == PDCP_TABLE_EMPTY) return 0;
+            uint32_t home = pdcp_table_hash(table, table->slot_keys[j]);
+            // Move j into the hole only if its home slot is not within (i, j].
+            if (((j - home) & table->slot_mask) >= ((j - i) & table->slot_mask)) break;
+        }
+        table->slot_keys[i] = table->slot_keys[j];
+        table->slot_handles[i] = table->slot_handles[j];
+        i = j;
+    }
+}
+
+size_t pdcp_table_memory_usage(const pdcp_table_t *table) {
+    if (!table || !table->capacity) return 0;
+    size_t slots = (size_t)table->slot_mask + 1;
+    return table->capacity * (sizeof(pdcp_entity_t) + sizeof(pdcp_config_t) + sizeof(uint32_t)) +
+           slots * (sizeof(uint64_t) + sizeof(uint32_t));
+}
+
+// --- Return global PDCP entity table ---
+pdcp_table_t *pdcp_get_table(void) {
+    static int is_initialized = 0;
+    if (!is_initialized) {
+        if (pdcp_table_init(&global_pdcp_table, PDCP_TABLE_DEFAULT_CAPACITY) < 0)
+            return NULL;
+        is_initialized = 1;
+    }
+    return &global_pdcp_table;
+}
@@ -0,0 +1,536 @@
+#include "rohc.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Packet formats (RFC 3095 U-mode, small CIDs):
+ *
+ *   Add-CID     1110 cccc           before the packet when CID != 0
+ *   IR          1111 1101, profile, flags, SN (16), [TS stride (32)], header
+ *   UO-0        0 sssss ccc          SN LSB 4, CRC-3
+ *   UOR-2       110 sssss, F, X ccccccc
+ *                                   SN LSB 5, CRC-7; F is the IP-ID LSB 8
+ *                                   (UDP) or M + TS_SCALED LSB 7 (RTP)
+ *   Uncompressed 1111 1100, original packet
+ *
+ * Compressed packets are followed by the 2-byte IP-ID when the context
+ * marks it random, then by the 2-byte UDP checksum when the flow sends
+ * checksums. Lengths and the IPv4 header checksum are always
+ * inferred. A flow whose static fields change, or whose dynamic fields
+ * can no longer be expressed, is set up again with new IR packets.
+ */
+#define ROHC_PKT_ADD_CID 0xE0
+#define ROHC_PKT_IR      0xFD
+#define ROHC_PKT_UNCOMP  0xFC
+#define ROHC_PKT_UOR2    0xC0
+
+#define ROHC_IR_FLAG_IPID_SEQ 0x01
+#define ROHC_IR_FLAG_CSUM     0x02
+#define ROHC_IR_FLAG_IPID_RND 0x04
+
+#define ROHC_UDP_HDR_LEN 28
+#define ROHC_RTP_HDR_LEN 40
+
+/* Largest compressed header: Add-CID, IR fields, header */
+#define ROHC_MAX_IR_LEN (1 + 5 + 4 + ROHC_MAX_HEADER_LEN)
+
+static uint8_t crc3_table[256];
+static uint8_t crc7_table[256];
+static int crc_tables_ready;
+
+/*
+ * Bytes a compressed packet may change in the reference header (IP total
+ * length, IP-ID, IP checksum, UDP length and checksum, then RTP M bit, SN
+ * and TS). The first ROHC_UDP_DYN_FIELDS belong to both profiles.
+ */
+static const uint8_t rohc_dyn_offsets[] = { 2, 3, 4, 5, 10, 11, 24, 25, 26, 27, 29, 30, 31, 32, 33, 34, 35 };
+#define ROHC_UDP_DYN_FIELDS 10
+#define ROHC_RTP_DYN_FIELDS sizeof(rohc_dyn_offsets)
+
+/* CRC change caused by a nibble changed d bytes before the end, low and high nibble */
+static uint8_t crc3_shift[ROHC_MAX_HEADER_LEN + 1][2][16];
+static uint8_t crc7_shift[ROHC_MAX_HEADER_LEN + 1][2][16];
+
+// --- CRCs over the uncompressed header (RFC 3095 5.9.2) ---
+static void rohc_build_crc_table(uint8_t *table, uint8_t poly) {
+    for (int i = 0; i < 256; i++) {
+        uint8_t crc = (uint8_t)i;
+        for (int b = 0; b < 8; b++)
+            crc = (crc & 1) ? (uint8_t)((crc >> 1) ^ poly) : (uint8_t)(crc >> 1);
+        table[i] = crc;
+    }
+}
+
+static uint8_t rohc_crc(const uint8_t *table, uint8_t init, const uint8_t *data, size_t len) {
+    uint8_t crc = init;
+    for (size_t i = 0; i < len; i++)
+        crc = table[crc ^ data[i]];
+    return crc;
+}
+
+// A table CRC step is linear in the byte fed, so a byte changed by x moves
+// the final CRC by x run through the table once per byte left to the end.
+static void rohc_build_shift_table(uint8_t shift[][2][16], const uint8_t *table) {
+    for (int d = 1; d <= ROHC_MAX_HEADER_LEN; d++) {
+        for (int v = 0; v < 16; v++) {
+            uint8_t lo = (uint8_t)v, hi = (uint8_t)(v << 4);
+            for (int i = 0; i < d; i++) {
+                lo = table[lo];
+                hi = table[hi];
+            }
+            shift[d][0][v] = lo;
+            shift[d][1][v] = hi;
+        }
+    }
+}
+
+// CRC of a header whose static fields match the context's reference header:
+// the reference's CRC, corrected for the dynamic bytes alone. The value is
+// the in-order CRC of RFC 3095 5.9.2; only the work per packet shrinks.
+static uint8_t rohc_crc_delta(const rohc_context_t *c, uint8_t shift[][2][16], uint8_t ref_crc,
+                              const uint8_t *p) {
+    size_t fields = c->profile == ROHC_PROFILE_RTP ? ROHC_RTP_DYN_FIELDS : ROHC_UDP_DYN_FIELDS;
+    uint8_t crc = ref_crc;
+    for (size_t i = 0; i < fields; i++) {
+        size_t off = rohc_dyn_offsets[i];
+        uint8_t x = p[off] ^ c->hdr[off];
+        size_t d = c->hdr_len - off;
+        crc ^= shift[d][0][x & 0x0f] ^ shift[d][1][x >> 4];
+    }
+    return crc;
+}
+
+static inline uint8_t rohc_crc3(const rohc_context_t *c, const uint8_t *p) {
+    return rohc_crc_delta(c, crc3_shift, c->hdr_crc3, p);
+}
+
+static inline uint8_t rohc_crc7(const rohc_context_t *c, const uint8_t *p) {
+    return rohc_crc_delta(c, crc7_shift, c->hdr_crc7, p);
+}
+
+static void rohc_set_reference(rohc_context_t *c, const uint8_t *hdr, size_t hdr_len) {
+    c->hdr_len = (uint8_t)hdr_len;
+    memcpy(c->hdr, hdr, hdr_len);
+    c->hdr_crc3 = rohc_crc(crc3_table, 0x07, hdr, hdr_len);
+    c->hdr_crc7 = rohc_crc(crc7_table, 0x7f, hdr, hdr_len);
+}
+
+// --- Header field access (network byte order) ---
+static inline uint16_t rd16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t rd32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void wr16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static inline void wr32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint16_t rohc_ip_checksum(const uint8_t *iph) {
+    uint32_t acc = 0;
+    for (size_t i = 0; i < 20; i += 2)
+        acc += rd16(iph + i);
+    while (acc > 0xffff)
+        acc = (acc & 0xffff) + (acc >> 16);
+    return (uint16_t)~acc;
+}
+
+// Picks the profile: IPv4 without options or fragments carrying UDP, and RTP v2 on RTP ports.
+static int rohc_classify(const uint8_t *p, size_t len) {
+    if (len < ROHC_UDP_HDR_LEN || p[0] != 0x45 || p[9] != 17)
+        return ROHC_PROFILE_UNCOMPRESSED;
+    if ((rd16(p + 6) & 0x3fff) != 0 || rd16(p + 2) != len || rd16(p + 24) != len - 20)
+        return ROHC_PROFILE_UNCOMPRESSED;
+    // Inferred checksums must reproduce the original bit-exactly.
+    if (rohc_ip_checksum(p) != 0)
+        return ROHC_PROFILE_UNCOMPRESSED;
+    uint16_t dport = rd16(p + 22);
+    if (dport >= ROHC_RTP_PORT_MIN && dport <= ROHC_RTP_PORT_MAX &&
+        len >= ROHC_RTP_HDR_LEN && p[28] == 0x80)
+        return ROHC_PROFILE_RTP;
+    return ROHC_PROFILE_UDP;
+}
+
+// Compares the fields that compressed packets never carry.
+static int rohc_static_match(const rohc_context_t *c, const uint8_t *p) {
+    const uint8_t *r = c->hdr;
+    if (memcmp(r, p, 2) || memcmp(r + 6, p + 6, 4) || memcmp(r + 12, p + 12, 12))
+        return 0;
+    if (c->profile == ROHC_PROFILE_RTP &&
+        (r[28] != p[28] || ((r[29] ^ p[29]) & 0x7f) || memcmp(r + 36, p + 36, 4)))
+        return 0;
+    return 1;
+}
+
+static uint32_t rohc_hash(const rohc_flow_key_t *key) {
+    uint32_t h = key->src_addr ^ key->dest_addr ^ ((uint32_t)key->src_port << 16 | key->dest_port);
+    return (h * 0x9E3779B1u) >> (32 - 5);
+}
+
+static int rohc_key_equal(const rohc_flow_key_t *a, const rohc_flow_key_t *b) {
+    return a->src_addr == b->src_addr && a->dest_addr == b->dest_addr &&
+           a->src_port == b->src_port && a->dest_port == b->dest_port &&
+           a->protocol == b->protocol;
+}
+
+static void rohc_hash_insert(rohc_state_t *state, uint8_t cid) {
+    uint32_t h = rohc_hash(&state->comp[cid].key);
+    while (state->hash[h])
+        h = (h + 1) & (ROHC_HASH_SIZE - 1);
+    state->hash[h] = (uint8_t)(cid + 1);
+}
+
+// Finds the flow's context, or sets one up in a free or the least recently used CID.
+static rohc_context_t *rohc_comp_context(rohc_state_t *state, const uint8_t *p, int profile) {
+    rohc_flow_key_t key;
+    memset(&key, 0, sizeof(key));
+    memcpy(&key.src_addr, p + 12, 4);
+    memcpy(&key.dest_addr, p + 16, 4);
+    memcpy(&key.src_port, p + 20, 2);
+    memcpy(&key.dest_port, p + 22, 2);
+    key.protocol = p[9];
+
+    rohc_context_t *c;
+    for (uint32_t h = rohc_hash(&key); state->hash[h]; h = (h + 1) & (ROHC_HASH_SIZE - 1)) {
+        c = &state->comp[state->hash[h] - 1];
+        if (rohc_key_equal(&c->key, &key)) {
+            c->last_used = ++state->use_clock;
+            if (c->profile != profile) {
+                c->profile = (uint8_t)profile;
+                c->ir_left = ROHC_IR_REPEAT;
+            }
+            return c;
+        }
+    }
+
+    uint8_t cid = 0;
+    for (uint8_t i = 0; i < ROHC_MAX_CONTEXTS; i++) {
+        if (!state->comp[i].in_use) {
+            cid = i;
+            break;
+        }
+        if (state->comp[i].last_used < state->comp[cid].last_used)
+            cid = i;
+    }
+    c = &state->comp[cid];
+    int evict = c->in_use;
+    memset(c, 0, sizeof(*c));
+    c->in_use = 1;
+    c->profile = (uint8_t)profile;
+    c->ir_left = ROHC_IR_REPEAT;
+    c->ipid_seq = 1;
+    c->sn = 0xFFFF;
+    c->key = key;
+    c->last_used = ++state->use_clock;
+
+    // Linear probing has no tombstones, so an eviction rebuilds the 32 buckets.
+    if (evict) {
+        memset(state->hash, 0, sizeof(state->hash));
+        for (uint8_t i = 0; i < ROHC_MAX_CONTEXTS; i++)
+            if (state->comp[i].in_use && i != cid)
+                rohc_hash_insert(state, i);
+    }
+    rohc_hash_insert(state, cid);
+    return c;
+}
+
+// IP-ID behaviour is inferred identically on both sides from each delivered packet.
+static void rohc_update_ipid(rohc_context_t *c, uint16_t ipid, uint16_t dsn) {
+    uint16_t delta = (uint16_t)(ipid - c->ipid);
+    if (delta == dsn)
+        c->ipid_seq = 1;
+    else if (delta == 0)
+        c->ipid_seq = 0;
+    c->ipid = ipid;
+}
+
+rohc_state_t *rohc_create(void) {
+    if (!crc_tables_ready) {
+        rohc_build_crc_table(crc3_table, 0x06);  /* x^3 + x + 1, reflected */
+        rohc_build_crc_table(crc7_table, 0x79);  /* x^7 + x^6 + x^3 + x^2 + x + 1, reflected */
+        rohc_build_shift_table(crc3_shift, crc3_table);
+        rohc_build_shift_table(crc7_shift, crc7_table);
+        crc_tables_ready = 1;
+    }
+    return calloc(1, sizeof(rohc_state_t));
+}
+
+void rohc_destroy(rohc_state_t *state) {
+    free(state);
+}
+
+int rohc_compress(rohc_state_t *state, pktbuf_t *pkt, size_t reserve) {
+    const uint8_t *p = pkt->data;
+    int profile = rohc_classify(p, pkt->len);
+    if (profile == ROHC_PROFILE_UNCOMPRESSED) {
+        if (pktbuf_headroom(pkt) < 1 + reserve) return -1;
+        uint8_t *out = pktbuf_prepend(pkt, 1);
+        if (!out) return -1;
+        *out = ROHC_PKT_UNCOMP;
+        return 0;
+    }
+
+    size_t hdr_len = profile == ROHC_PROFILE_RTP ? ROHC_RTP_HDR_LEN : ROHC_UDP_HDR_LEN;
+    rohc_context_t *c = rohc_comp_context(state, p, profile);
+    uint8_t cid = (uint8_t)(c - state->comp);
+    uint16_t udp_csum = rd16(p + 26);
+    uint16_t ipid = rd16(p + 4);
+    uint16_t sn = profile == ROHC_PROFILE_RTP ? rd16(p + 30) : (uint16_t)(c->sn + 1);
+    uint16_t dsn = (uint16_t)(sn - c->sn);
+    uint32_t ts = profile == ROHC_PROFILE_RTP ? rd32(p + 32) : 0;
+    uint32_t dts = ts - c->ts;
+    int marker = profile == ROHC_PROFILE_RTP ? p[29] >> 7 : 0;
+
+    uint8_t out[ROHC_MAX_IR_LEN];
+    size_t n = 0;
+    if (cid)
+        out[n++] = ROHC_PKT_ADD_CID | cid;
+
+    int compressed = 0;
+    if (c->ir_left == 0 && (udp_csum != 0) == c->csum_present && rohc_static_match(c, p)) {
+        uint16_t ipid_delta = (uint16_t)(ipid - c->ipid);
+        int ipid_inferred = c->ipid_rnd || ipid_delta == (c->ipid_seq ? dsn : 0);
+        if (profile == ROHC_PROFILE_UDP) {
+            if (ipid_inferred) {
+                out[n++] = (uint8_t)((sn & 0x0f) << 3) | rohc_crc3(c, p);
+                compressed = 1;
+            } else if (ipid_delta < 256) {
+                out[n++] = ROHC_PKT_UOR2 | (sn & 0x1f);
+                out[n++] = (uint8_t)ipid;
+                out[n++] = rohc_crc7(c, p);
+                compressed = 1;
+            }
+        } else if (dsn != 0 && ipid_inferred) {
+            // UOR-2 carries LSBs of TS_SCALED = TS / stride, TS_OFFSET staying constant.
+            uint32_t stride = c->ts_stride;
+            uint32_t scaled = stride ? ts / stride : 0;
+            int ts_ok = stride ? ts % stride == c->ts % stride && scaled - c->ts / stride < 128
+                               : dts == 0;
+            if (dsn < 16 && !marker && dts == dsn * c->ts_stride) {
+                out[n++] = (uint8_t)((sn & 0x0f) << 3) | rohc_crc3(c, p);
+                compressed = 1;
+            } else if (dsn < 32 && ts_ok) {
+                out[n++] = ROHC_PKT_UOR2 | (sn & 0x1f);
+                out[n++] = (uint8_t)(marker << 7 | (scaled & 0x7f));
+                out[n++] = rohc_crc7(c, p);
+                compressed = 1;
+            }
+        }
+        if (compressed && c->ipid_rnd) {
+            wr16(out + n, ipid);
+            n += 2;
+        }
+        if (compressed && c->csum_present) {
+            wr16(out + n, udp_csum);
+            n += 2;
+        }
+    }
+
+    // The header must fit before any context state moves, or the decompressor falls out of step.
+    size_t need = compressed ? n : n + 5 + (profile == ROHC_PROFILE_RTP ? 4 : 0) + hdr_len;
+    if (pktbuf_headroom(pkt) + hdr_len < need + reserve) return -1;
+
+    if (compressed) {
+        if (profile == ROHC_PROFILE_RTP)
+            c->ts = ts;
+        rohc_update_ipid(c, ipid, dsn);
+    } else {
+        // Context (re)initialization: every field is sent in full.
+        if (c->ir_left == 0)
+            c->ir_left = ROHC_IR_REPEAT;
+        c->ir_left--;
+        if (profile == ROHC_PROFILE_RTP) {
+            if (dsn != 0 && dsn < 0x8000 && dts != 0 && dts % dsn == 0)
+                c->ts_stride = dts / dsn;
+            c->ts = ts;
+        }
+        if (c->packets) {
+            // IP-IDs that neither follow the SN nor fit UOR-2 are sent in full from now on.
+            uint16_t ipid_delta = (uint16_t)(ipid - c->ipid);
+            c->ipid_rnd = ipid_delta != dsn && ipid_delta != 0 &&
+                          (profile == ROHC_PROFILE_RTP || ipid_delta >= 256);
+            rohc_update_ipid(c, ipid, dsn);
+        } else {
+            c->ipid = ipid;
+        }
+        c->csum_present = udp_csum != 0;
+        rohc_set_reference(c, p, hdr_len);
+
+        out[n++] = ROHC_PKT_IR;
+        out[n++] = (uint8_t)profile;
+        out[n++] = (c->ipid_seq ? ROHC_IR_FLAG_IPID_SEQ : 0) | (c->ipid_rnd ? ROHC_IR_FLAG_IPID_RND : 0) |
+                   (c->csum_present ? ROHC_IR_FLAG_CSUM : 0);
+        wr16(out + n, sn);
+        n += 2;
+        if (profile == ROHC_PROFILE_RTP) {
+            wr32(out + n, c->ts_stride);
+            n += 4;
+        }
+        memcpy(out + n, p, hdr_len);
+        n += hdr_len;
+    }
+    c->sn = sn;
+    c->packets++;
+    c->bytes_in += hdr_len;
+    c->bytes_out += n;
+
+    // Swap the IP/UDP(/RTP) header for the ROHC header in the packet's own buffer.
+    pktbuf_pull(pkt, hdr_len);
+    uint8_t *dst = pktbuf_prepend(pkt, n);
+    if (!dst) {
+        pktbuf_prepend(pkt, hdr_len);
+        return -1;
+    }
+    memcpy(dst, out, n);
+    return 0;
+}
+
+// Rebuilds the full header from the context and the decoded dynamic fields.
+static void rohc_build_header(const rohc_context_t *c, uint8_t *hdr, uint16_t sn, uint16_t ipid,
+                              uint32_t ts, int marker, uint16_t udp_csum, size_t payload_len) {
+    memcpy(hdr, c->hdr, c->hdr_len);
+    wr16(hdr + 2, (uint16_t)(c->hdr_len + payload_len));
+    wr16(hdr + 4, ipid);
+    wr16(hdr + 10, 0);
+    wr16(hdr + 10, rohc_ip_checksum(hdr));
+    wr16(hdr + 24, (uint16_t)(c->hdr_len - 20 + payload_len));
+    wr16(hdr + 26, udp_csum);
+    if (c->profile == ROHC_PROFILE_RTP) {
+        hdr[29] = (uint8_t)((hdr[29] & 0x7f) | marker << 7);
+        wr16(hdr + 30, sn);
+        wr32(hdr + 32, ts);
+    }
+}
+
+int rohc_decompress(rohc_state_t *state, const uint8_t **pkt, size_t *pkt_len,
+                    uint8_t *hdr, size_t *hdr_len) {
+    const uint8_t *p = *pkt;
+    size_t len = *pkt_len;
+    if (len < 1) goto fail;
+
+    if (p[0] == ROHC_PKT_UNCOMP) {
+        *pkt = p + 1;
+        *pkt_len = len - 1;
+        *hdr_len = 0;
+        return 0;
+    }
+
+    uint8_t cid = 0;
+    if ((p[0] & 0xF0) == ROHC_PKT_ADD_CID) {
+        cid = p[0] & 0x0F;
+        p++;
+        len--;
+        if (len < 1) goto fail;
+    }
+    rohc_context_t *c = &state->decomp[cid];
+
+    if (p[0] == ROHC_PKT_IR) {
+        if (len < 5) goto fail;
+        uint8_t profile = p[1];
+        size_t fixed = profile == ROHC_PROFILE_RTP ? 9 : 5;
+        size_t h = profile == ROHC_PROFILE_RTP ? ROHC_RTP_HDR_LEN : ROHC_UDP_HDR_LEN;
+        if ((profile != ROHC_PROFILE_RTP && profile != ROHC_PROFILE_UDP) || len < fixed + h)
+            goto fail;
+        c->in_use = 1;
+        c->profile = profile;
+        c->ipid_seq = (p[2] & ROHC_IR_FLAG_IPID_SEQ) != 0;
+        c->ipid_rnd = (p[2] & ROHC_IR_FLAG_IPID_RND) != 0;
+        c->csum_present = (p[2] & ROHC_IR_FLAG_CSUM) != 0;
+        c->sn = rd16(p + 3);
+        c->ts_stride = profile == ROHC_PROFILE_RTP ? rd32(p + 5) : 0;
+        rohc_set_reference(c, p + fixed, h);
+        c->ipid = rd16(c->hdr + 4);
+        c->ts = profile == ROHC_PROFILE_RTP ? rd32(c->hdr + 32) : 0;
+        memcpy(hdr, c->hdr, h);
+        *hdr_len = h;
+        p += fixed + h;
+        len -= fixed + h;
+    } else {
+        if (!c->in_use) goto fail;
+        uint16_t sn, ipid = c->ipid;
+        uint32_t ts = c->ts;
+        int marker = 0;
+        uint8_t crc;
+        size_t n;
+        int uo0 = (p[0] & 0x80) == 0;
+        if (uo0) {
+            sn = (uint16_t)(c->sn + (((p[0] >> 3) - c->sn) & 0x0f));
+            crc = p[0] & 0x07;
+            n = 1;
+        } else if ((p[0] & 0xE0) == ROHC_PKT_UOR2 && len >= 3) {
+            sn = (uint16_t)(c->sn + ((p[0] - c->sn) & 0x1f));
+            crc = p[2] & 0x7f;
+            n = 3;
+        } else {
+            goto fail;
+        }
+        uint16_t dsn = (uint16_t)(sn - c->sn);
+        if (!uo0 && c->profile == ROHC_PROFILE_UDP) {
+            ipid = (uint16_t)(c->ipid + ((p[1] - c->ipid) & 0xff));
+        } else {
+            if (c->ipid_seq)
+                ipid = (uint16_t)(c->ipid + dsn);
+            if (!uo0) {
+                marker = p[1] >> 7;
+                if (c->ts_stride) {
+                    uint32_t ref = c->ts / c->ts_stride;
+                    uint32_t scaled = ref + ((p[1] - ref) & 0x7f);
+                    ts = scaled * c->ts_stride + c->ts % c->ts_stride;
+                }
+            } else {
+                ts = c->ts + dsn * c->ts_stride;
+            }
+        }
+        if (c->ipid_rnd) {
+            if (len < n + 2) goto fail;
+            ipid = rd16(p + n);
+            n += 2;
+        }
+        uint16_t udp_csum = 0;
+        if (c->csum_present) {
+            if (len < n + 2) goto fail;
+            udp_csum = rd16(p + n);
+            n += 2;
+        }
+        p += n;
+        len -= n;
+
+        rohc_build_header(c, hdr, sn, ipid, ts, marker, udp_csum, len);
+        uint8_t expected = uo0 ? rohc_crc3(c, hdr) : rohc_crc7(c, hdr);
+        if (crc != expected) goto fail;
+
+        rohc_update_ipid(c, ipid, dsn);
+        c->sn = sn;
+        c->ts = ts;
+        *hdr_len = c->hdr_len;
+    }
+
+    c->packets++;
+    c->bytes_in += (size_t)(p - *pkt);
+    c->bytes_out += *hdr_len;
+    *pkt = p;
+    *pkt_len = len;
+    return 0;
+
+fail:
+    state->decomp_failures++;
+    return -1;
+}
+
+size_t rohc_get_flow_stats(const rohc_state_t *state, rohc_context_t *out, size_t max) {
+    size_t n = 0;
+    for (size_t i = 0; i < ROHC_MAX_CONTEXTS && n < max; i++)
+        if (state->comp[i].in_use)
+            out[n++] = state->comp[i];
+    return n;
+}
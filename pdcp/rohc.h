@@ -0,0 +1,174 @@
+#ifndef ROHC_H
+#define ROHC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../pktbuf/pktbuf.h"
+
+/**
+ * ROHC_MAX_CONTEXTS - Contexts per compressor/decompressor (small CIDs 0..15)
+ * ROHC_HASH_SIZE - Buckets of the compressor's 5-tuple hash
+ * ROHC_MAX_HEADER_LEN - Largest compressible header (IPv4 + UDP + RTP)
+ * ROHC_IR_REPEAT - IR packets sent when a context is set up
+ */
+#define ROHC_MAX_CONTEXTS   16
+#define ROHC_HASH_SIZE      32
+#define ROHC_MAX_HEADER_LEN 40
+#define ROHC_IR_REPEAT      3
+
+/**
+ * ROHC_PROFILE_UNCOMPRESSED - Profile 0x0000, packets sent as is
+ * ROHC_PROFILE_RTP - Profile 0x0001, RTP/UDP/IPv4
+ * ROHC_PROFILE_UDP - Profile 0x0002, UDP/IPv4
+ */
+#define ROHC_PROFILE_UNCOMPRESSED 0x00
+#define ROHC_PROFILE_RTP          0x01
+#define ROHC_PROFILE_UDP          0x02
+
+/**
+ * ROHC_RTP_PORT_MIN - Lowest UDP destination port classified as RTP
+ * ROHC_RTP_PORT_MAX - Highest UDP destination port classified as RTP
+ */
+#define ROHC_RTP_PORT_MIN 16384
+#define ROHC_RTP_PORT_MAX 32767
+
+/**
+ * struct rohc_flow_key_t - 5-tuple identifying a compressed flow
+ * @src_addr: IPv4 source address (network byte order)
+ * @dest_addr: IPv4 destination address (network byte order)
+ * @src_port: UDP source port (network byte order)
+ * @dest_port: UDP destination port (network byte order)
+ * @protocol: IP protocol number
+ */
+typedef struct {
+    uint32_t src_addr;
+    uint32_t dest_addr;
+    uint16_t src_port;
+    uint16_t dest_port;
+    uint8_t protocol;
+} rohc_flow_key_t;
+
+/**
+ * struct rohc_context_t - Compression context of one flow
+ * @in_use: Context holds a flow
+ * @profile: ROHC_PROFILE_* of the flow
+ * @ir_left: IR packets still to send before compressing (compressor only)
+ * @ipid_seq: IP-ID grows with the SN (1) or stays constant (0)
+ * @ipid_rnd: IP-ID cannot be inferred and is carried in every packet
+ * @csum_present: UDP checksum is non-zero and carried in every packet
+ * @hdr_len: Length of @hdr (28 for UDP, 40 for RTP)
+ * @hdr_crc3: CRC-3 of @hdr
+ * @hdr_crc7: CRC-7 of @hdr
+ * @sn: ROHC SN of the last packet (RTP SN for profile 1)
+ * @ipid: IP-ID of the last packet
+ * @ts: RTP timestamp of the last packet
+ * @ts_stride: RTP timestamp increment per SN
+ * @last_used: Use stamp for LRU replacement (compressor only)
+ * @key: Flow 5-tuple
+ * @packets: Packets processed with this context
+ * @bytes_in: Header bytes before compression
+ * @bytes_out: Header bytes after compression
+ * @hdr: Reference header holding all static and dynamic fields
+ *
+ * The same structure is used on both sides. The compressor and the
+ * decompressor keep their copies in sync through IR packets and the
+ * fields carried or inferred in compressed packets.
+ */
+typedef struct {
+    uint8_t in_use;
+    uint8_t profile;
+    uint8_t ir_left;
+    uint8_t ipid_seq;
+    uint8_t ipid_rnd;
+    uint8_t csum_present;
+    uint8_t hdr_len;
+    uint8_t hdr_crc3;
+    uint8_t hdr_crc7;
+    uint16_t sn;
+    uint16_t ipid;
+    uint32_t ts;
+    uint32_t ts_stride;
+    uint64_t last_used;
+    rohc_flow_key_t key;
+    uint64_t packets;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint8_t hdr[ROHC_MAX_HEADER_LEN];
+} rohc_context_t;
+
+/**
+ * struct rohc_state_t - ROHC compressor and decompressor of one bearer
+ * @comp: Compressor contexts, indexed by CID
+ * @decomp: Decompressor contexts, indexed by CID
+ * @hash: Compressor 5-tuple hash, holding CID + 1 (0 = empty)
+ * @use_clock: Counter stamping context use for LRU replacement
+ * @decomp_failures: Packets dropped for CRC mismatch or missing context
+ */
+typedef struct {
+    rohc_context_t comp[ROHC_MAX_CONTEXTS];
+    rohc_context_t decomp[ROHC_MAX_CONTEXTS];
+    uint8_t hash[ROHC_HASH_SIZE];
+    uint64_t use_clock;
+    uint64_t decomp_failures;
+} rohc_state_t;
+
+/**
+ * rohc_create - Allocate compressor and decompressor state
+ *
+ * Return: New state or NULL on allocation failure
+ */
+rohc_state_t *rohc_create(void);
+
+/**
+ * rohc_destroy - Free compressor and decompressor state
+ * @state: State to free (may be NULL)
+ */
+void rohc_destroy(rohc_state_t *state);
+
+/**
+ * rohc_compress - Compress the header of a packet in place
+ * @state: Bearer ROHC state
+ * @pkt: Packet whose IP header starts at pkt->data
+ * @reserve: Headroom to leave in front of the ROHC header, for the
+ *           headers lower layers prepend
+ *
+ * IPv4/UDP and IPv4/UDP/RTP packets get their headers replaced by an
+ * IR packet while the context is being set up and by a 1-byte UO-0 or
+ * 3-byte UOR-2 header afterwards (plus 2 bytes each for a random IP-ID
+ * and for a UDP checksum, and 1 Add-CID byte for CIDs other than 0). Other packets are sent with the Uncompressed profile.
+ *
+ * A packet refused for lack of headroom leaves the context as it was,
+ * so the decompressor never misses a change the compressor made.
+ *
+ * Return: 0 on success, -1 if the buffer lacks headroom for the ROHC
+ * header and @reserve
+ */
+int rohc_compress(rohc_state_t *state, pktbuf_t *pkt, size_t reserve);
+
+/**
+ * rohc_decompress - Rebuild the header of a received packet
+ * @state: Bearer ROHC state
+ * @pkt: ROHC packet, advanced past the compressed header on success
+ * @pkt_len: Length of @pkt, updated to the payload length on success
+ * @hdr: Buffer of at least ROHC_MAX_HEADER_LEN bytes for the header
+ * @hdr_len: Length of the rebuilt header
+ *
+ * The payload is not copied: the original packet is @hdr followed by
+ * the bytes at the updated @pkt.
+ *
+ * Return: 0 on success, -1 if the packet must be dropped
+ */
+int rohc_decompress(rohc_state_t *state, const uint8_t **pkt, size_t *pkt_len,
+                    uint8_t *hdr, size_t *hdr_len);
+
+/**
+ * rohc_get_flow_stats - Per-flow compression statistics
+ * @state: Bearer ROHC state
+ * @out: Array receiving copies of the compressor contexts in use
+ * @max: Capacity of @out
+ *
+ * Return: Number of contexts copied
+ */
+size_t rohc_get_flow_stats(const rohc_state_t *state, rohc_context_t *out, size_t max);
+
+#endif /* ROHC_H */
@@ -0,0 +1,120 @@
+#include "pktbuf.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* --------------------------------------------------------------------------
+   Allocation and Reference Counting
+   -------------------------------------------------------------------------- */
+pktbuf_t *pktbuf_alloc(size_t size) {
+    size_t capacity = PKTBUF_HEADROOM + size + PKTBUF_TAILROOM;
+    /* Descriptor and storage share one allocation. */
+    pktbuf_t *buf = malloc(sizeof(pktbuf_t) + capacity);
+    if (!buf) return NULL;
+    buf->start = (uint8_t *)(buf + 1);
+    buf->end = buf->start + capacity;
+    buf->data = buf->start + PKTBUF_HEADROOM;
+    buf->len = 0;
+    buf->next = NULL;
+    buf->parent = NULL;
+    buf->refcnt = 1;
+    return buf;
+}
+
+pktbuf_t *pktbuf_view(pktbuf_t *parent, size_t offset, size_t len) {
+    if (!parent || offset + len > parent->len) return NULL;
+    pktbuf_t *view = malloc(sizeof(pktbuf_t));
+    if (!view) return NULL;
+    /* Always reference the buffer owning the storage, never another view. */
+    pktbuf_t *owner = parent->parent ? parent->parent : parent;
+    view->data = parent->data + offset;
+    view->len = len;
+    view->start = view->data;
+    view->end = view->data + len;
+    view->next = NULL;
+    view->parent = pktbuf_ref(owner);
+    view->refcnt = 1;
+    return view;
+}
+
+pktbuf_t *pktbuf_ref(pktbuf_t *buf) {
+    if (buf) __atomic_add_fetch(&buf->refcnt, 1, __ATOMIC_RELAXED);
+    return buf;
+}
+
+void pktbuf_free(pktbuf_t *buf) {
+    while (buf) {
+        if (__atomic_sub_fetch(&buf->refcnt, 1, __ATOMIC_ACQ_REL) != 0)
+            return;
+        pktbuf_t *next = buf->next;
+        if (buf->parent)
+            pktbuf_free(buf->parent);
+        free(buf);
+        /* Each segment in a chain is owned by its predecessor. */
+        buf = next;
+    }
+}
+
+/* --------------------------------------------------------------------------
+   Head/Tail Manipulation
+   -------------------------------------------------------------------------- */
+uint8_t *pktbuf_prepend(pktbuf_t *buf, size_t len) {
+    if (!buf || pktbuf_headroom(buf) < len) return NULL;
+    buf->data -= len;
+    buf->len += len;
+    return buf->data;
+}
+
+uint8_t *pktbuf_append(pktbuf_t *buf, size_t len) {
+    if (!buf || pktbuf_tailroom(buf) < len) return NULL;
+    uint8_t *tail = buf->data + buf->len;
+    buf->len += len;
+    return tail;
+}
+
+uint8_t *pktbuf_pull(pktbuf_t *buf, size_t len) {
+    if (!buf || len > buf->len) return NULL;
+    buf->data += len;
+    buf->len -= len;
+    return buf->data;
+}
+
+void pktbuf_trim(pktbuf_t *buf, size_t len) {
+    if (!buf) return;
+    buf->len = (len > buf->len) ? 0 : buf->len - len;
+}
+
+size_t pktbuf_headroom(const pktbuf_t *buf) {
+    return (size_t)(buf->data - buf->start);
+}
+
+size_t pktbuf_tailroom(const pktbuf_t *buf) {
+    return (size_t)(buf->end - (buf->data + buf->len));
+}
+
+/* --------------------------------------------------------------------------
+   Chains
+   -------------------------------------------------------------------------- */
+void pktbuf_chain(pktbuf_t *head, pktbuf_t *tail) {
+    if (!head) return;
+    while (head->next)
+        head = head->next;
+    head->next = tail;
+}
+
+size_t pktbuf_pkt_len(const pktbuf_t *buf) {
+    size_t total = 0;
+    for (; buf; buf = buf->next)
+        total += buf->len;
+    return total;
+}
+
+size_t pktbuf_copy_out(const pktbuf_t *buf, uint8_t *dst, size_t max) {
+    size_t copied = 0;
+    for (; buf && copied < max; buf = buf->next) {
+        size_t n = buf->len;
+        if (n > max - copied) n = max - copied;
+        memcpy(dst + copied, buf->data, n);
+        copied += n;
+    }
+    return copied;
+}
@@ -0,0 +1,167 @@
+#ifndef PKTBUF_H
+#define PKTBUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * PKTBUF_HEADROOM - Bytes reserved in front of the payload
+ *
+ * Large enough for the PDCP, RLC and MAC headers to be prepended
+ * in place as the packet travels down the stack.
+ */
+#define PKTBUF_HEADROOM 64
+
+/**
+ * PKTBUF_TAILROOM - Bytes reserved behind the payload
+ *
+ * Room for trailers appended in place (e.g. PDCP MAC-I).
+ */
+#define PKTBUF_TAILROOM 16
+
+/**
+ * struct pktbuf_t - Shared packet buffer descriptor
+ * @data: First valid byte of this segment
+ * @len: Number of valid bytes in this segment
+ * @start: First byte of the underlying storage
+ * @end: One past the last byte of the underlying storage
+ * @next: Next segment of the packet (NULL for the last one)
+ * @parent: Buffer owning the storage when this segment is a view
+ * @refcnt: Number of holders of this segment (and its chain)
+ *
+ * A packet is a chain of segments linked through @next. Direct
+ * buffers own their storage, which is allocated together with the
+ * descriptor. Views (created with pktbuf_view()) point into the
+ * storage of a parent buffer and keep a reference on it, so an RLC
+ * segment can carry part of its SDU without copying it.
+ *
+ * Functions taking a pktbuf_t pointer as input for transmission
+ * consume the caller's reference unless stated otherwise; use
+ * pktbuf_ref() to keep a copy of the pointer.
+ */
+typedef struct pktbuf {
+    uint8_t *data;
+    size_t len;
+    uint8_t *start;
+    uint8_t *end;
+    struct pktbuf *next;
+    struct pktbuf *parent;
+    uint32_t refcnt;
+} pktbuf_t;
+
+/**
+ * pktbuf_alloc - Allocate a packet buffer
+ * @size: Payload capacity in bytes
+ *
+ * Allocates descriptor and storage in a single block with
+ * PKTBUF_HEADROOM bytes in front and PKTBUF_TAILROOM bytes behind
+ * the payload area. The buffer starts empty with a reference count
+ * of one; use pktbuf_append() to claim payload space.
+ *
+ * Return: New buffer or NULL on allocation failure
+ */
+pktbuf_t *pktbuf_alloc(size_t size);
+
+/**
+ * pktbuf_view - Create a view into part of another buffer
+ * @parent: Buffer holding the bytes
+ * @offset: Offset of the first byte in @parent's data
+ * @len: Number of bytes covered by the view
+ *
+ * The view shares @parent's storage and holds a reference on it.
+ * Views have no head- or tailroom of their own.
+ *
+ * Return: New view or NULL on error
+ */
+pktbuf_t *pktbuf_view(pktbuf_t *parent, size_t offset, size_t len);
+
+/**
+ * pktbuf_ref - Take an additional reference on a buffer
+ * @buf: Buffer to reference
+ *
+ * Return: @buf
+ */
+pktbuf_t *pktbuf_ref(pktbuf_t *buf);
+
+/**
+ * pktbuf_free - Drop a reference on a buffer
+ * @buf: Buffer to release (may be NULL)
+ *
+ * When the last reference is dropped, the whole chain is released
+ * along with the references views hold on their parents.
+ */
+void pktbuf_free(pktbuf_t *buf);
+
+/**
+ * pktbuf_prepend - Claim header space in front of the data
+ * @buf: Buffer to grow
+ * @len: Number of bytes to claim
+ *
+ * Return: Pointer to the new first byte, or NULL if the
+ * headroom is too small
+ */
+uint8_t *pktbuf_prepend(pktbuf_t *buf, size_t len);
+
+/**
+ * pktbuf_append - Claim space behind the data
+ * @buf: Buffer to grow
+ * @len: Number of bytes to claim
+ *
+ * Return: Pointer to the first claimed byte, or NULL if the
+ * tailroom is too small
+ */
+uint8_t *pktbuf_append(pktbuf_t *buf, size_t len);
+
+/**
+ * pktbuf_pull - Strip bytes from the front of the data
+ * @buf: Buffer to shrink
+ * @len: Number of bytes to strip
+ *
+ * Return: Pointer to the new first byte, or NULL if @len
+ * exceeds the data length
+ */
+uint8_t *pktbuf_pull(pktbuf_t *buf, size_t len);
+
+/**
+ * pktbuf_trim - Strip bytes from the end of the data
+ * @buf: Buffer to shrink
+ * @len: Number of bytes to strip
+ */
+void pktbuf_trim(pktbuf_t *buf, size_t len);
+
+/**
+ * pktbuf_headroom - Bytes available in front of the data
+ * @buf: Buffer to query
+ */
+size_t pktbuf_headroom(const pktbuf_t *buf);
+
+/**
+ * pktbuf_tailroom - Bytes available behind the data
+ * @buf: Buffer to query
+ */
+size_t pktbuf_tailroom(const pktbuf_t *buf);
+
+/**
+ * pktbuf_chain - Append a buffer chain to the end of another
+ * @head: First segment of the packet
+ * @tail: Chain to append (ownership passes to @head)
+ */
+void pktbuf_chain(pktbuf_t *head, pktbuf_t *tail);
+
+/**
+ * pktbuf_pkt_len - Total data length of a chain
+ * @buf: First segment of the packet
+ */
+size_t pktbuf_pkt_len(const pktbuf_t *buf);
+
+/**
+ * pktbuf_copy_out - Gather a chain into a flat buffer
+ * @buf: First segment of the packet
+ * @dst: Destination buffer
+ * @max: Capacity of @dst in bytes
+ *
+ * Return: Number of bytes copied
+ */
+size_t pktbuf_copy_out(const pktbuf_t *buf, uint8_t *dst, size_t max);
+
+#endif /* PKTBUF_H */
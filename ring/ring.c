@@ -0,0 +1,18 @@
+#include "ring.h"
+#include <stdlib.h>
+#include <string.h>
+
+int spsc_ring_init(spsc_ring_t *ring, size_t size) {
+    if (!ring || size == 0 || (size & (size - 1))) return -1;
+    memset(ring, 0, sizeof(*ring));
+    ring->slots = calloc(size, sizeof(void *));
+    if (!ring->slots) return -1;
+    ring->mask = size - 1;
+    return 0;
+}
+
+void spsc_ring_free(spsc_ring_t *ring) {
+    if (!ring) return;
+    free(ring->slots);
+    ring->slots = NULL;
+}
@@ -0,0 +1,103 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+
+/**
+ * RING_CACHE_LINE - Alignment keeping producer and consumer state apart
+ */
+#define RING_CACHE_LINE 64
+
+/**
+ * struct spsc_ring_t - Bounded single-producer single-consumer pointer queue
+ * @mask: Number of slots minus one (the slot count is a power of two)
+ * @slots: Slot array
+ * @head: Next slot to consume, written by the consumer only
+ * @tail_cache: Consumer's last view of @tail
+ * @tail: Next slot to fill, written by the producer only
+ * @head_cache: Producer's last view of @head
+ *
+ * Lock-free: each index has a single writer and is published with a
+ * release store, which also publishes the slot (and whatever the
+ * pointer refers to) to the other thread. Each side keeps a cached
+ * copy of the other side's index, so the shared cache line is only
+ * read again when the ring looks full or empty.
+ */
+typedef struct {
+    size_t mask;
+    void **slots;
+    _Alignas(RING_CACHE_LINE) size_t head;
+    size_t tail_cache;
+    _Alignas(RING_CACHE_LINE) size_t tail;
+    size_t head_cache;
+} spsc_ring_t;
+
+/**
+ * spsc_ring_init - Allocate the slots of a ring
+ * @ring: Ring to initialize
+ * @size: Number of slots, a power of two
+ *
+ * Return: 0 on success, -1 for a bad size or on allocation failure
+ */
+int spsc_ring_init(spsc_ring_t *ring, size_t size);
+
+/**
+ * spsc_ring_free - Release the slots of a ring
+ * @ring: Ring to free (pointers still queued are not touched)
+ */
+void spsc_ring_free(spsc_ring_t *ring);
+
+/**
+ * spsc_ring_push - Queue a pointer (producer side)
+ * @ring: Ring
+ * @ptr: Pointer to queue
+ *
+ * Return: 0 on success, -1 if the ring is full
+ */
+static inline int spsc_ring_push(spsc_ring_t *ring, void *ptr) {
+    size_t tail = ring->tail;
+    if (tail - ring->head_cache > ring->mask) {
+        ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (tail - ring->head_cache > ring->mask)
+            return -1;
+    }
+    ring->slots[tail & ring->mask] = ptr;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * spsc_ring_peek - Look at the oldest pointer without dequeuing it (consumer side)
+ * @ring: Ring
+ *
+ * Return: Pointer the next spsc_ring_pop() returns, or NULL if the ring is empty
+ */
+static inline void *spsc_ring_peek(spsc_ring_t *ring) {
+    size_t head = ring->head;
+    if (head == ring->tail_cache) {
+        ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (head == ring->tail_cache)
+            return NULL;
+    }
+    return ring->slots[head & ring->mask];
+}
+
+/**
+ * spsc_ring_pop - Dequeue a pointer (consumer side)
+ * @ring: Ring
+ *
+ * Return: Oldest queued pointer, or NULL if the ring is empty
+ */
+static inline void *spsc_ring_pop(spsc_ring_t *ring) {
+    size_t head = ring->head;
+    if (head == ring->tail_cache) {
+        ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (head == ring->tail_cache)
+            return NULL;
+    }
+    void *ptr = ring->slots[head & ring->mask];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return ptr;
+}
+
+#endif /* RING_H */
@@ -5,6 +5,29 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* Lower layer taking transmitted PDUs; NULL sends through MAC UL-SCH. */
+static rlc_tx_cb_t rlc_tx_cb;
+
+static void rlc_um_reassembly_expired(timer_node_t *node);
+
+/* Allocates the reassembly slots once, for the lifetime of the entity. */
+static void rlc_um_rx_alloc(rlc_entity_t *entity, int num_slots) {
+    rlc_um_rx_t *rx = calloc(1, sizeof(rlc_um_rx_t) + (size_t)num_slots * sizeof(rlc_um_slot_t));
+    uint8_t *storage = malloc((size_t)num_slots * RLC_UM_MAX_SDU_SIZE);
+    if (!rx || !storage) {
+        printf("RLC: Failed to allocate reassembly buffers\n");
+        free(rx);
+        free(storage);
+        return;
+    }
+    rx->storage = storage;
+    rx->num_slots = num_slots;
+    for (int i = 0; i < num_slots; i++)
+        rx->slots[i].buf = storage + (size_t)i * RLC_UM_MAX_SDU_SIZE;
+    rx->t_reassembly = RLC_UM_T_REASSEMBLY_DEFAULT;
+    entity->um_rx = rx;
+}
+
 /**
  * rlc_entity_establish - Initialize a new RLC entity
  * @entity: Pointer to RLC entity to initialize
@@ -19,12 +42,78 @@ void rlc_entity_establish(rlc_entity_t *entity, rlc_mode_t mode) {
     entity->mode = mode;
     entity->tx_next = 0;
     entity->rx_next = 0;
-    entity->reassembly_buffer = NULL;
-    entity->reassembly_size = 0;
-    entity->reassembly_sn = 0;
+    entity->um_rx = NULL;
+    entity->pdcp = NULL;
+    entity->am = NULL;
+    entity->txq = NULL;
+    entity->lcp = NULL;
+    entity->lch = 0;
+    timer_init(&entity->t_reassembly, rlc_um_reassembly_expired);
+    timer_init(&entity->t_poll_retransmit, NULL);
+    timer_init(&entity->t_status_prohibit, NULL);
+    if (rlc_tx_queue_init(entity) < 0)
+        printf("RLC: Failed to allocate transmission queue\n");
+    if (mode != RLC_MODE_TM)
+        rlc_um_rx_alloc(entity, mode == RLC_MODE_AM ? RLC_AM_REASSEMBLY_SLOTS : RLC_UM_REASSEMBLY_SLOTS);
+    if (mode == RLC_MODE_AM)
+        rlc_am_establish(entity);
     printf("RLC: Entity established in mode %d\n", mode);
 }
 
+/**
+ * rlc_entity_bind_pdcp - Attach the PDCP entity served by this RLC entity
+ * @entity: Pointer to RLC entity
+ * @pdcp: PDCP entity of the same bearer
+ *
+ * Stores the PDCP entity pointer taken from the PDCP entity table
+ * at bearer setup; the RX path uses it directly. The PDCP entity
+ * points back to the RLC entity for rlc_tx_discard().
+ */
+void rlc_entity_bind_pdcp(rlc_entity_t *entity, pdcp_entity_t *pdcp) {
+    if (!entity) return;
+    if (entity->pdcp && entity->pdcp->cfg->rlc == entity)
+        entity->pdcp->cfg->rlc = NULL;
+    entity->pdcp = pdcp;
+    if (pdcp)
+        pdcp->cfg->rlc = entity;
+}
+
+/**
+ * rlc_entity_bind_mac - Feed the MAC LCG counters from the transmission queue
+ * @entity: RLC entity with a transmission queue
+ * @lcp: LCP state of the UE, or NULL to unbind
+ * @ch: Channel of the entity in @lcp
+ */
+void rlc_entity_bind_mac(rlc_entity_t *entity, mac_lcp_t *lcp, int ch) {
+    if (!entity || !entity->txq) return;
+    if (entity->lcp)
+        entity->lcp->channels[entity->lch].rlc = NULL;
+    entity->lcp = lcp;
+    entity->lch = ch;
+    if (lcp)
+        lcp->channels[ch].rlc = entity;
+    rlc_entity_sync_mac(entity);
+}
+
+/**
+ * rlc_entity_sync_mac - Fold the queue's backlog into the MAC channel
+ * @entity: RLC entity
+ *
+ * The channel's buffer_size is what MAC was last told, so the
+ * difference from the queue's byte counters (and the AM backlog) is
+ * exactly what was queued or sent since.
+ */
+size_t rlc_entity_sync_mac(rlc_entity_t *entity) {
+    if (!entity || !entity->lcp) return 0;
+    logical_channel_t *lc = &entity->lcp->channels[entity->lch];
+    size_t queued = rlc_tx_queued_bytes(entity) + rlc_am_pending_bytes(entity);
+    if (queued > lc->buffer_size)
+        mac_lch_enqueue(entity->lcp, entity->lch, queued - lc->buffer_size);
+    else if (queued < lc->buffer_size)
+        mac_lch_dequeue(entity->lcp, entity->lch, lc->buffer_size - queued);
+    return queued;
+}
+
 /**
  * rlc_entity_reestablish - Reset an existing RLC entity
  * @entity: Pointer to RLC entity to reset
@@ -37,12 +126,13 @@ void rlc_entity_reestablish(rlc_entity_t *entity) {
     if (!entity) return;
     entity->tx_next = 0;
     entity->rx_next = 0;
-    if (entity->reassembly_buffer) {
-        free(entity->reassembly_buffer);
-        entity->reassembly_buffer = NULL;
+    if (entity->um_rx) {
+        timer_cancel(&entity->t_reassembly);
+        for (int i = 0; i < entity->um_rx->num_slots; i++)
+            entity->um_rx->slots[i].in_use = 0;
     }
-    entity->reassembly_size = 0;
-    entity->reassembly_sn = 0;
+    rlc_am_reestablish(entity);
+    rlc_tx_queue_flush(entity);
     printf("RLC: Entity re-established\n");
 }
 
@@ -55,29 +145,80 @@ void rlc_entity_reestablish(rlc_entity_t *entity) {
  */
 void rlc_entity_release(rlc_entity_t *entity) {
     if (!entity) return;
-    if (entity->reassembly_buffer) {
-        free(entity->reassembly_buffer);
-        entity->reassembly_buffer = NULL;
+    rlc_entity_bind_pdcp(entity, NULL);
+    if (entity->um_rx) {
+        timer_cancel(&entity->t_reassembly);
+        free(entity->um_rx->storage);
+        free(entity->um_rx);
+        entity->um_rx = NULL;
     }
+    rlc_tx_queue_free(entity);
+    rlc_am_release(entity);
     printf("RLC: Entity released\n");
 }
 
+/* Lower Layer Interface */
+
+/**
+ * rlc_set_tx_callback - Route transmitted PDUs to a lower layer
+ * @cb: Handler for every entity, or NULL for the MAC UL-SCH path
+ */
+void rlc_set_tx_callback(rlc_tx_cb_t cb) {
+    rlc_tx_cb = cb;
+}
+
+/**
+ * rlc_submit_pdu - Hand a PDU to the lower layer
+ * @entity: RLC entity sending the PDU
+ * @pdu: PDU to transmit (consumed)
+ *
+ * Goes to the handler set with rlc_set_tx_callback(), or to MAC
+ * UL-SCH on the current HARQ process.
+ */
+void rlc_submit_pdu(rlc_entity_t *entity, pktbuf_t *pdu) {
+    if (rlc_tx_cb) {
+        rlc_tx_cb(entity, pdu);
+        return;
+    }
+    harq_process_t *harq_ptr = mac_get_harq_process();
+    mac_ul_sch_data_transfer(harq_ptr, pdu);
+}
+
+/**
+ * rlc_rx_pdu - Dispatch a received PDU by the entity's mode
+ * @entity: RLC entity handling the reception
+ * @pdu: Received PDU data
+ * @pdu_size: Size of received PDU in bytes
+ */
+void rlc_rx_pdu(rlc_entity_t *entity, uint8_t *pdu, size_t pdu_size) {
+    if (!entity) return;
+    switch (entity->mode) {
+    case RLC_MODE_TM:
+        rlc_tm_rx_data(entity, pdu, pdu_size);
+        break;
+    case RLC_MODE_UM:
+        rlc_um_rx_data(entity, pdu, pdu_size);
+        break;
+    case RLC_MODE_AM:
+        rlc_am_rx_data(entity, pdu, pdu_size);
+        break;
+    }
+}
+
 /* Transparent Mode (TM) Operations */
 
 /**
  * rlc_tm_tx_data - Transmit data in Transparent Mode
  * @entity: RLC entity handling the transmission
  * @pdcp_pdu: PDCP PDU to transmit (includes PDCP header)
- * @pdu_size: Size of the PDCP PDU in bytes
  *
  * In TM mode, forwards PDCP PDU directly to MAC layer without
  * any additional processing or headers. The PDCP header remains
  * intact as part of the transmitted data.
  */
-void rlc_tm_tx_data(rlc_entity_t *entity, uint8_t *pdcp_pdu, size_t pdu_size) {
-    printf("RLC TM: Transmitting PDCP PDU of size %zu bytes\n", pdu_size);
-    harq_process_t *harq_ptr = mac_get_harq_process();
-    mac_ul_sch_data_transfer(harq_ptr, pdcp_pdu, pdu_size);
+void rlc_tm_tx_data(rlc_entity_t *entity, pktbuf_t *pdcp_pdu) {
+    printf("RLC TM: Transmitting PDCP PDU of size %zu bytes\n", pktbuf_pkt_len(pdcp_pdu));
+    rlc_submit_pdu(entity, pdcp_pdu);
 }
 
 /**
@@ -92,90 +233,84 @@ void rlc_tm_tx_data(rlc_entity_t *entity, uint8_t *pdcp_pdu, size_t pdu_size) {
  */
 void rlc_tm_rx_data(rlc_entity_t *entity, uint8_t *pdu, size_t pdu_size) {
     printf("RLC TM: Received PDCP PDU of size %zu bytes\n", pdu_size);
-    pdcp_entity_t *pdcp_ent = pdcp_get_entity();
-    pdcp_rx_pdu(pdcp_ent, pdu, pdu_size);
+    if (!entity || !entity->pdcp) {
+        printf("RLC TM: No PDCP entity bound, dropping PDU\n");
+        return;
+    }
+    pdcp_rx_pdu(entity->pdcp, pdu, pdu_size);
 }
 
 /* Unacknowledged Mode (UM) Operations */
 
 /**
- * rlc_um_tx_data - Transmit data in Unacknowledged Mode
- * @entity: RLC entity handling the transmission
- * @pdcp_pdu: PDCP PDU to transmit
- * @pdu_size: Size of the PDCP PDU in bytes
+ * rlc_um_slot_get - Find or claim the reassembly slot of an SN
+ * @rx: UM reassembly state
+ * @sn: SN of the received segment
  *
- * Handles UM mode transmission by:
- * 1. Adding RLC UM header (SN and SI fields)
- * 2. Segmenting large PDUs if needed
- * 3. Managing sequence numbers
- * 4. Forwarding segments to MAC layer
+ * A new SN takes a free slot and sets its t-Reassembly deadline. With
+ * every slot busy, the SDU closest to expiry is given up to make room.
  *
- * For segmented PDUs:
- * - First segment (SI=1): Includes PDCP header
- * - Middle segments (SI=2): Only payload
- * - Last segment (SI=3): Final portion of payload
- * - Single segment (SI=0): Complete PDU with header
+ * Return: Slot holding @sn
  */
-void rlc_um_tx_data(rlc_entity_t *entity, uint8_t *pdcp_pdu, size_t pdu_size) {
-    if (!entity || !pdcp_pdu) return;
-    printf("RLC UM: Transmitting PDCP PDU of size %zu bytes\n", pdu_size);
-    harq_process_t *harq_ptr = mac_get_harq_process();
+static rlc_um_slot_t *rlc_um_slot_get(rlc_um_rx_t *rx, uint32_t sn) {
+    rlc_um_slot_t *victim = NULL;
+    for (int i = 0; i < rx->num_slots; i++) {
+        rlc_um_slot_t *slot = &rx->slots[i];
+        if (!slot->in_use) {
+            if (!victim || victim->in_use)
+                victim = slot;
+        } else if (slot->sn == sn) {
+            return slot;
+        } else if (!victim || (victim->in_use && (int32_t)(slot->expiry - victim->expiry) < 0)) {
+            victim = slot;
+        }
+    }
+    if (victim->in_use) {
+        printf("RLC: No free reassembly slot, SDU (SN=%u) discarded\n", victim->sn);
+        rx->discarded++;
+    }
+    victim->in_use = 1;
+    victim->sn = sn;
+    victim->sdu_size = 0;
+    victim->num_ranges = 0;
+    victim->expiry = timer_now(timer_get_wheel()) + timer_ms(timer_get_wheel(), rx->t_reassembly);
+    return victim;
+}
 
-    /* Handle PDU that fits in single segment */
-    if (pdu_size <= RLC_UM_SEGMENT_SIZE) {
-        uint8_t header[2];
-        header[0] = entity->tx_next;  /* Sequence Number */
-        header[1] = 0;                /* SI=0: Complete PDU */
-        size_t um_pdu_size = 2 + pdu_size;
-        uint8_t *um_pdu = (uint8_t *)malloc(um_pdu_size);
-        if (!um_pdu) return;
-        memcpy(um_pdu, header, 2);
-        memcpy(um_pdu + 2, pdcp_pdu, pdu_size);
-        mac_ul_sch_data_transfer(harq_ptr, um_pdu, um_pdu_size);
-        free(um_pdu);
+/**
+ * rlc_um_add_range - Record received bytes of an SDU
+ * @slot: Reassembly slot of the SDU
+ * @start: Offset of the first byte
+ * @end: Offset one past the last byte
+ *
+ * Keeps the ranges sorted, merging those that overlap or touch the
+ * new one.
+ *
+ * Return: 0 on success, -1 if RLC_UM_MAX_RANGES ranges would be needed
+ */
+static int rlc_um_add_range(rlc_um_slot_t *slot, uint16_t start, uint16_t end) {
+    rlc_byte_range_t *r = slot->ranges;
+    int n = slot->num_ranges, i = 0;
+    while (i < n && r[i].end < start)
+        i++;
+    int j = i;
+    while (j < n && r[j].start <= end) {
+        if (r[j].start < start) start = r[j].start;
+        if (r[j].end > end) end = r[j].end;
+        j++;
+    }
+    if (i == j) {
+        if (n == RLC_UM_MAX_RANGES) return -1;
+        memmove(&r[i + 1], &r[i], (size_t)(n - i) * sizeof(*r));
+        n++;
     } else {
-        /* Handle PDU that requires segmentation */
-        size_t remaining = pdu_size;
-        size_t offset = 0;
-        while (remaining > 0) {
-            size_t seg_size = (remaining > RLC_UM_SEGMENT_SIZE) ? RLC_UM_SEGMENT_SIZE : remaining;
-            uint8_t si;
-            /* Determine Segment Indicator (SI) value */
-            if (offset == 0 && remaining > RLC_UM_SEGMENT_SIZE) {
-                si = 1;  /* First segment */
-            } else if (remaining <= RLC_UM_SEGMENT_SIZE) {
-                si = (offset == 0) ? 0 : 3;  /* Last segment or complete PDU */
-            } else {
-                si = 2;  /* Middle segment */
-            }
-
-            /* Create and send segment with appropriate header */
-            size_t header_size = (offset == 0) ? 2 : 4;
-            size_t um_pdu_size = header_size + seg_size;
-            uint8_t *um_pdu = (uint8_t *)malloc(um_pdu_size);
-            if (!um_pdu) return;
-
-            /* Build segment header */
-            um_pdu[0] = entity->tx_next;  /* Sequence Number */
-            um_pdu[1] = si;
-            if (offset != 0) {
-                um_pdu[2] = (offset >> 8) & 0xFF;  /* Segment Offset (high byte) */
-                um_pdu[3] = offset & 0xFF;         /* Segment Offset (low byte) */
-            }
-
-            /* Add segment payload and send */
-            memcpy(um_pdu + header_size, pdcp_pdu + offset, seg_size);
-            printf("RLC UM: Transmitting segment: SN=%d, SI=%d, offset=%zu, segment size=%zu\n",
-                   entity->tx_next, si, offset, seg_size);
-            mac_ul_sch_data_transfer(harq_ptr, um_pdu, um_pdu_size);
-            free(um_pdu);
-
-            /* Update segment tracking */
-            offset += seg_size;
-            remaining -= seg_size;
-        }
+        memmove(&r[i + 1], &r[j], (size_t)(n - j) * sizeof(*r));
+        n -= j - i - 1;
     }
-    entity->tx_next++;  /* Increment sequence number for next transmission */
+    r[i].start = start;
+    r[i].end = end;
+    slot->num_ranges = (uint8_t)n;
+    return 0;
 }
 
 /**
@@ -192,12 +327,17 @@ void rlc_um_tx_data(rlc_entity_t *entity, uint8_t *pdcp_pdu, size_t pdu_size) {
  *
  * Segmentation handling:
  * - Complete PDU (SI=0): Direct delivery
- * - First segment (SI=1): Start reassembly
- * - Middle segment (SI=2): Continue reassembly
- * - Last segment (SI=3): Complete reassembly and deliver
+ * - Segments (SI=1/2/3): Copied at their SO into the slot of their
+ *   SN; the last segment (SI=3) gives the SDU size
+ * - The SDU is delivered once its byte ranges cover it, whatever
+ *   order the segments came in
  */
 void rlc_um_rx_data(rlc_entity_t *entity, uint8_t *pdu, size_t pdu_size) {
     if (!entity || !pdu) return;
+    if (!entity->pdcp) {
+        printf("RLC UM: No PDCP entity bound, dropping PDU\n");
+        return;
+    }
     if (pdu_size < 2) {
         printf("RLC UM: Invalid PDU size\n");
         return;
@@ -217,41 +357,85 @@ void rlc_um_rx_data(rlc_entity_t *entity, uint8_t *pdu, size_t pdu_size) {
     if (si == 0) {
         /* Handle complete PDU */
         printf("RLC UM: Received complete PDCP PDU (SN=%d) of size %zu bytes\n", sn, data_size);
-        pdcp_rx_pdu(pdcp_get_entity(), pdu, pdu_size);
-    } else {
-        /* Handle segmented PDU */
-        uint16_t so = 0;
-        if (header_size == 4) {
-            so = (pdu[2] << 8) | pdu[3];  /* Extract segment offset */
-        }
-        printf("RLC UM: Received segmented PDU (SN=%d, SI=%d, SO=%d)\n", sn, si, so);
+        pdcp_rx_pdu(entity->pdcp, pdu + header_size, data_size);
+        return;
+    }
 
-        /* Initialize or reset reassembly buffer if needed */
-        if (entity->reassembly_buffer == NULL || entity->reassembly_sn != sn) {
-            if (entity->reassembly_buffer)
-                free(entity->reassembly_buffer);
-            entity->reassembly_buffer = NULL;
-            entity->reassembly_size = 0;
-            entity->reassembly_sn = sn;
-        }
+    /* Handle segmented PDU */
+    uint16_t so = 0;
+    if (header_size == 4) {
+        so = (pdu[2] << 8) | pdu[3];  /* Extract segment offset */
+    }
+    printf("RLC UM: Received segmented PDU (SN=%d, SI=%d, SO=%d)\n", sn, si, so);
+    if (si > 3) {
+        printf("RLC UM: Invalid SI %d, PDU dropped\n", si);
+        return;
+    }
+    rlc_um_slot_t *slot = rlc_rx_segment(entity, sn, so, pdu + header_size, data_size, si == 3);
+    if (slot) {
+        printf("RLC UM: Reassembled PDCP PDU (SN=%d) of size %d bytes\n", sn, slot->sdu_size);
+        slot->in_use = 0;
+        pdcp_rx_pdu(entity->pdcp, slot->buf, slot->sdu_size);
+    }
+}
 
-        /* Add segment to reassembly buffer */
-        uint8_t *new_buf = realloc(entity->reassembly_buffer, entity->reassembly_size + data_size);
-        if (!new_buf) {
-            printf("RLC UM: Reassembly buffer allocation error\n");
-            return;
-        }
-        entity->reassembly_buffer = new_buf;
-        memcpy(entity->reassembly_buffer + entity->reassembly_size, pdu + header_size, data_size);
-        entity->reassembly_size += data_size;
+rlc_um_slot_t *rlc_rx_segment(rlc_entity_t *entity, uint32_t sn, size_t so, const uint8_t *data, size_t len,
+                              int last) {
+    rlc_um_rx_t *rx = entity->um_rx;
+    if (!rx) return NULL;
+    if (len == 0 || so + len > RLC_UM_MAX_SDU_SIZE) {
+        printf("RLC: Segment (SN=%u, SO=%zu) outside the reassembly buffer, dropped\n", sn, so);
+        rx->segments_dropped++;
+        return NULL;
+    }
+
+    rlc_um_slot_t *slot = rlc_um_slot_get(rx, sn);
+    /* A new deadline is never earlier than the ones already running */
+    if (entity->mode == RLC_MODE_UM && !timer_armed(&entity->t_reassembly))
+        timer_arm(timer_get_wheel(), &entity->t_reassembly, slot->expiry - timer_now(timer_get_wheel()));
+    if (rlc_um_add_range(slot, (uint16_t)so, (uint16_t)(so + len)) < 0) {
+        printf("RLC: Too many holes in SDU (SN=%u), segment dropped\n", sn);
+        rx->segments_dropped++;
+        return NULL;
+    }
+    /* Place the segment at its offset; overlapping retransmissions rewrite the same bytes */
+    memcpy(slot->buf + so, data, len);
+    if (last)
+        slot->sdu_size = (uint16_t)(so + len);
 
-        /* If last segment, deliver complete PDU */
-        if (si == 3) {
-            printf("RLC UM: Reassembled PDCP PDU (SN=%d) of size %zu bytes\n", sn, entity->reassembly_size);
-            pdcp_rx_pdu(pdcp_get_entity(), entity->reassembly_buffer, entity->reassembly_size);
-            free(entity->reassembly_buffer);
-            entity->reassembly_buffer = NULL;
-            entity->reassembly_size = 0;
+    /* Complete once the received bytes cover the whole SDU */
+    if (!slot->sdu_size || slot->num_ranges != 1 || slot->ranges[0].start != 0 ||
+        slot->ranges[0].end < slot->sdu_size)
+        return NULL;
+    rx->reassembled++;
+    return slot;
+}
+
+/**
+ * rlc_um_reassembly_expired - Handle UM t-Reassembly expiry
+ * @node: The entity's t-Reassembly timer
+ *
+ * Discards every SDU whose deadline passed before all of its
+ * segments were received, then runs the timer again for the
+ * earliest deadline left.
+ */
+static void rlc_um_reassembly_expired(timer_node_t *node) {
+    rlc_entity_t *entity = timer_entry(node, rlc_entity_t, t_reassembly);
+    rlc_um_rx_t *rx = entity->um_rx;
+    uint32_t now = timer_now(timer_get_wheel());
+    rlc_um_slot_t *next = NULL;
+    for (int i = 0; i < rx->num_slots; i++) {
+        rlc_um_slot_t *slot = &rx->slots[i];
+        if (!slot->in_use) continue;
+        if ((int32_t)(now - slot->expiry) < 0) {
+            if (!next || (int32_t)(slot->expiry - next->expiry) < 0)
+                next = slot;
+            continue;
         }
+        printf("RLC UM: t-Reassembly expired, SDU (SN=%u) discarded\n", slot->sn);
+        slot->in_use = 0;
+        rx->discarded++;
     }
+    if (next)
+        timer_arm(timer_get_wheel(), node, next->expiry - now);
 }
@@ -4,6 +4,10 @@
 #include <stddef.h>
 #include <stdint.h>
 #include "../mac/mac.h"   /* RLC uses MAC interface for data transmission */
+#include "../pktbuf/pktbuf.h"
+#include "../pdcp/pdcp.h"    /* RLC delivers received SDUs to PDCP */
+#include "../ring/ring.h"
+#include "../timer/timer.h"
 
 /**
  * enum rlc_mode_t - Operating modes for RLC entities
@@ -20,25 +24,323 @@ typedef enum {
     RLC_MODE_AM
 } rlc_mode_t;
 
+/**
+ * RLC_TX_QUEUE_SIZE - SDUs an entity can queue for grant-driven transmission
+ */
+#define RLC_TX_QUEUE_SIZE 4096
+
+/**
+ * struct rlc_tx_queue_t - SDUs waiting for a transmission opportunity
+ * @ring: Lock-free ring of RLC_TX_QUEUE_SIZE queued SDUs
+ * @enq_bytes: SDU bytes ever queued, written by the producer only
+ * @oversized: SDUs refused for being too large to send, producer only
+ * @deq_bytes: SDU bytes ever sent, written by the consumer only
+ * @cur: SDU taken off @ring and being segmented (consumer only)
+ * @so: Bytes of @cur already sent in earlier segments
+ * @lost_pdus: PDUs of TBs HARQ gave up on (consumer only)
+ * @lost_bytes: Their size in bytes
+ * @discarded: SDUs dropped by rlc_tx_discard() before being sent (consumer only)
+ *
+ * A single-producer single-consumer queue: the PDCP thread queues
+ * SDUs and the MAC slot thread takes them when a grant arrives,
+ * without locks. Each byte counter has one writer and a cache line
+ * of its own, so buffer status reporting reads the backlog as
+ * @enq_bytes - @deq_bytes without any atomic read-modify-write.
+ * The segment offset survives across grants, so an SDU cut at the
+ * end of one grant continues at the start of the next. Allocated
+ * cache-line aligned at establishment.
+ */
+typedef struct {
+    spsc_ring_t ring;
+    _Alignas(RING_CACHE_LINE) size_t enq_bytes;
+    uint64_t oversized;
+    _Alignas(RING_CACHE_LINE) size_t deq_bytes;
+    pktbuf_t *cur;
+    size_t so;
+    uint64_t lost_pdus;
+    uint64_t lost_bytes;
+    uint64_t discarded;
+} rlc_tx_queue_t;
+
+/**
+ * RLC_UM_REASSEMBLY_SLOTS - SNs an UM entity can reassemble at once
+ */
+#define RLC_UM_REASSEMBLY_SLOTS 8
+
+/**
+ * RLC_AM_REASSEMBLY_SLOTS - SNs an AM entity can reassemble at once
+ *
+ * An AM entity keeps a partly received SDU until its missing bytes
+ * are retransmitted, a round trip or more, so every grant edge cut
+ * during that time may hold a slot.
+ */
+#define RLC_AM_REASSEMBLY_SLOTS 64
+
+/**
+ * RLC_UM_MAX_SDU_SIZE - Largest SDU an UM entity can reassemble, in bytes
+ *
+ * Covers a 9000-byte PDCP SDU with its PDCP header and MAC-I.
+ */
+#define RLC_UM_MAX_SDU_SIZE 9216
+
+/**
+ * RLC_UM_MAX_RANGES - Disjoint byte ranges tracked per SDU in reassembly
+ *
+ * A segment that would need more is dropped; HARQ reordering leaves
+ * only a few holes at a time.
+ */
+#define RLC_UM_MAX_RANGES 16
+
+/**
+ * RLC_UM_T_REASSEMBLY_DEFAULT - Default t-Reassembly duration in ms
+ */
+#define RLC_UM_T_REASSEMBLY_DEFAULT 35
+
+/**
+ * struct rlc_byte_range_t - Received bytes [@start, @end) of an SDU
+ * @start: Offset of the first byte
+ * @end: Offset one past the last byte
+ */
+typedef struct {
+    uint16_t start;
+    uint16_t end;
+} rlc_byte_range_t;
+
+/**
+ * struct rlc_um_slot_t - One SDU being reassembled
+ * @buf: Preallocated storage of RLC_UM_MAX_SDU_SIZE bytes
+ * @expiry: Wheel tick at which t-Reassembly gives up on the SDU (UM);
+ *  AM only uses it to pick the slot to take over
+ * @sn: SN of the SDU, unwrapped in AM
+ * @sdu_size: Size of the SDU, known once its last segment arrived (0 before)
+ * @in_use: Whether the slot holds an SDU
+ * @num_ranges: Number of entries in @ranges
+ * @ranges: Received byte ranges, sorted and merged
+ */
+typedef struct {
+    uint8_t *buf;
+    uint32_t expiry;
+    uint32_t sn;
+    uint16_t sdu_size;
+    uint8_t in_use;
+    uint8_t num_ranges;
+    rlc_byte_range_t ranges[RLC_UM_MAX_RANGES];
+} rlc_um_slot_t;
+
+/**
+ * struct rlc_um_rx_t - Receive-side reassembly state (UM and AM)
+ * @storage: Single allocation backing the buffers of all @slots
+ * @t_reassembly: t-Reassembly duration in ms
+ * @reassembled: SDUs completed from segments
+ * @discarded: Incomplete SDUs given up (t-Reassembly expiry or eviction)
+ * @segments_dropped: Segments outside RLC_UM_MAX_SDU_SIZE or too fragmented
+ * @num_slots: RLC_UM_REASSEMBLY_SLOTS, or RLC_AM_REASSEMBLY_SLOTS in AM
+ * @slots: SDUs in reassembly, in no particular order
+ *
+ * Allocated once at establishment, so reassembly never touches the
+ * heap. Segments are copied straight to their SO in the slot of
+ * their SN, in whatever order they arrive, and the received ranges
+ * tell when the SDU is complete. Each SDU gets its own t-Reassembly
+ * deadline when its first segment arrives; with every slot busy, a
+ * new SN takes over the slot closest to expiry. In UM the entity's
+ * t-Reassembly timer runs for the earliest deadline; AM keeps
+ * incomplete SDUs until their missing bytes are retransmitted.
+ */
+typedef struct {
+    uint8_t *storage;
+    uint32_t t_reassembly;
+    uint32_t reassembled;
+    uint32_t discarded;
+    uint32_t segments_dropped;
+    int num_slots;
+    rlc_um_slot_t slots[];
+} rlc_um_rx_t;
+
+/**
+ * RLC_AM_SN_BITS_SHORT - 12-bit AM SN (2-byte AMD PDU header, 2048-SN window)
+ * RLC_AM_SN_BITS_LONG - 18-bit AM SN (3-byte AMD PDU header, 131072-SN window)
+ */
+#define RLC_AM_SN_BITS_SHORT 12
+#define RLC_AM_SN_BITS_LONG  18
+
+/**
+ * RLC_AM_STATUS_MAX_SIZE - Largest STATUS PDU built, in bytes
+ *
+ * Losses beyond what fits are reported by the next STATUS PDU.
+ */
+#define RLC_AM_STATUS_MAX_SIZE 1500
+
+/**
+ * RLC_AM_NACK_RANGE_MAX - Most SNs covered by one NACK_SN with NACK range
+ */
+#define RLC_AM_NACK_RANGE_MAX 255
+
+/**
+ * RLC_AM_SO_END - SOend of a NACK reaching the end of the SDU
+ */
+#define RLC_AM_SO_END 0xFFFF
+
+/**
+ * struct rlc_am_config_t - AM parameters (TS 38.322 7.3, 7.4)
+ * @sn_bits: RLC_AM_SN_BITS_SHORT or RLC_AM_SN_BITS_LONG
+ * @poll_pdu: pollPDU, new PDUs sent between polls
+ * @poll_byte: pollByte, new SDU bytes sent between polls
+ * @max_retx: maxRetxThreshold
+ * @t_poll_retransmit: t-PollRetransmit in ms
+ * @t_reassembly: t-Reassembly in ms
+ * @t_status_prohibit: t-StatusProhibit in ms
+ */
+typedef struct {
+    int sn_bits;
+    uint32_t poll_pdu;
+    uint32_t poll_byte;
+    uint32_t max_retx;
+    uint32_t t_poll_retransmit;
+    uint32_t t_reassembly;
+    uint32_t t_status_prohibit;
+} rlc_am_config_t;
+
+/**
+ * struct rlc_am_stats_t - AM counters
+ * @tx_pdus: New AMD PDUs and AMD PDU segments sent
+ * @retx_pdus: AMD PDUs and AMD PDU segments retransmitted
+ * @polls: AMD PDUs sent with the poll bit
+ * @status_tx: STATUS PDUs sent
+ * @status_tx_bytes: Bytes of all STATUS PDUs sent
+ * @status_rx: STATUS PDUs received
+ * @nacks_rx: SNs reported missing by received STATUS PDUs
+ * @rx_pdus: SDUs the receiving side completed, whole or from segments
+ * @rx_segments: AMD PDU segments accepted by the receiving side
+ * @rx_discarded: AMD PDUs discarded as duplicates or outside the window
+ * @max_retx_reached: SDUs that reached maxRetxThreshold
+ * @harq_losses: Transport blocks with AMD PDUs that HARQ gave up on
+ */
+typedef struct {
+    uint64_t tx_pdus;
+    uint64_t retx_pdus;
+    uint64_t polls;
+    uint64_t status_tx;
+    uint64_t status_tx_bytes;
+    uint64_t status_rx;
+    uint64_t nacks_rx;
+    uint64_t rx_pdus;
+    uint64_t rx_segments;
+    uint64_t rx_discarded;
+    uint64_t max_retx_reached;
+    uint64_t harq_losses;
+} rlc_am_stats_t;
+
+/**
+ * struct rlc_am_t - Acknowledged Mode state of an RLC entity
+ * @cfg: Configuration
+ * @window: AM_Window_Size (half the SN space)
+ * @sn_mod: Size of the SN space minus one
+ * @tx_next_ack: TX_Next_Ack, oldest SN not positively acknowledged
+ * @tx_next: TX_Next, SN of the next new SDU; the SDU the queue is
+ *  segmenting (rlc_tx_queue_t.cur) is TX_Next - 1
+ * @poll_sn: POLL_SN, highest SN sent when the last poll went out
+ * @pdu_without_poll: PDU_WITHOUT_POLL
+ * @byte_without_poll: BYTE_WITHOUT_POLL
+ * @poll_next: Set the poll bit on the next AMD PDU sent
+ * @tx_sdus: SDUs awaiting acknowledgement, by SN modulo @window
+ * @retx_count: RETX_COUNT + 1 of each SDU, 0 before its first retransmission
+ * @retx_pending: One bit per SDU queued for retransmission
+ * @retx_range: Bytes of each such SDU still to retransmit
+ * @retx_bytes: Sum of the @retx_range sizes, for buffer status
+ * @retx_queue: SNs to retransmit, in the order they were NACKed
+ * @retx_head: Next entry of @retx_queue to send
+ * @retx_tail: Next free entry of @retx_queue
+ * @rx_next: RX_Next, lower edge of the receiving window
+ * @rx_next_highest: RX_Next_Highest, SN after the highest received
+ * @rx_highest_status: RX_Highest_Status, highest SN a STATUS may ACK
+ * @rx_next_status_trigger: RX_Next_Status_Trigger
+ * @rx_bitmap: One bit per window SN, set once all bytes of the SDU are received
+ * @status_triggered: A STATUS report waits to be sent
+ * @poll_pending: A received poll waits for RX_Highest_Status to pass it
+ * @poll_pending_sn: Highest SN of such a poll
+ * @max_retx_hit: An SDU reached maxRetxThreshold, upper layers not told yet
+ * @max_retx_sn: Unwrapped SN of that SDU
+ * @stats: Counters
+ *
+ * SNs are kept unwrapped in 32 bits and reduced to @sn_mod only in
+ * PDU headers, so window arithmetic is plain subtraction. Both sides
+ * are rings of @window slots: the transmitting side holds a
+ * reference on each SDU until it is acknowledged (segments and
+ * retransmissions chain a fresh header to views of the same bytes),
+ * the receiving side keeps a single bit per SN, because RLC AM hands
+ * complete SDUs to PDCP as soon as they arrive and PDCP reorders.
+ * SDUs received in segments are put together in the entity's
+ * reassembly slots (rlc_um_rx_t). New SDUs wait in the entity's
+ * transmission queue. The timers live in the rlc_entity_t.
+ */
+typedef struct {
+    rlc_am_config_t cfg;
+    uint32_t window;
+    uint32_t sn_mod;
+
+    uint32_t tx_next_ack;
+    uint32_t tx_next;
+    uint32_t poll_sn;
+    uint32_t pdu_without_poll;
+    uint32_t byte_without_poll;
+    int poll_next;
+    pktbuf_t **tx_sdus;
+    uint16_t *retx_count;
+    uint64_t *retx_pending;
+    rlc_byte_range_t *retx_range;
+    size_t retx_bytes;
+    uint32_t *retx_queue;
+    uint32_t retx_head;
+    uint32_t retx_tail;
+
+    uint32_t rx_next;
+    uint32_t rx_next_highest;
+    uint32_t rx_highest_status;
+    uint32_t rx_next_status_trigger;
+    uint64_t *rx_bitmap;
+    int status_triggered;
+    int poll_pending;
+    uint32_t poll_pending_sn;
+
+    int max_retx_hit;
+    uint32_t max_retx_sn;
+
+    rlc_am_stats_t stats;
+} rlc_am_t;
+
 /**
  * struct rlc_entity_t - RLC protocol entity instance
  * @mode: Current operational mode (TM/UM/AM)
  * @tx_next: Sequence number for next transmission in UM/AM modes
  * @rx_next: Expected sequence number for next reception in UM/AM modes
- * @reassembly_buffer: Storage for reassembling segmented SDUs
- * @reassembly_size: Current size of data in reassembly buffer
- * @reassembly_sn: Sequence number of SDU being reassembled
+ * @um_rx: Reassembly state, allocated for RLC_MODE_UM and RLC_MODE_AM
+ * @pdcp: PDCP entity receiving this entity's SDUs
+ * @am: Acknowledged Mode state, allocated for RLC_MODE_AM only
+ * @txq: SDUs queued for rlc_build_pdus()
+ * @lcp: LCP state of the UE whose channel @lch carries @txq, NULL if none
+ * @lch: Channel index in @lcp
+ * @t_reassembly: t-Reassembly (UM and AM)
+ * @t_poll_retransmit: t-PollRetransmit (AM)
+ * @t_status_prohibit: t-StatusProhibit (AM)
  *
  * Maintains the state of an RLC entity including buffers and
  * sequence numbers for segmentation/reassembly operations.
+ * The timers run on the wheel of timer_get_wheel(), which holds
+ * pointers into the entity: it must not move while established.
  */
 typedef struct {
     rlc_mode_t mode;
     uint8_t tx_next;
     uint8_t rx_next;
-    uint8_t *reassembly_buffer;
-    size_t reassembly_size;
-    uint8_t reassembly_sn;
+    rlc_um_rx_t *um_rx;
+    pdcp_entity_t *pdcp;
+    rlc_am_t *am;
+    rlc_tx_queue_t *txq;
+    mac_lcp_t *lcp;
+    int lch;
+    timer_node_t t_reassembly;
+    timer_node_t t_poll_retransmit;
+    timer_node_t t_status_prohibit;
 } rlc_entity_t;
 
 /* RLC Entity Management Functions */
@@ -53,6 +355,47 @@ typedef struct {
  */
 void rlc_entity_establish(rlc_entity_t *entity, rlc_mode_t mode);
 
+/**
+ * rlc_entity_bind_pdcp - Attach the PDCP entity served by this RLC entity
+ * @entity: Pointer to RLC entity
+ * @pdcp: PDCP entity of the same bearer
+ *
+ * The binding is resolved once at bearer setup so that received
+ * PDUs are dispatched to PDCP without any table lookup. PDCP keeps
+ * the entity in its configuration to discard queued SDUs.
+ */
+void rlc_entity_bind_pdcp(rlc_entity_t *entity, pdcp_entity_t *pdcp);
+
+/**
+ * rlc_entity_bind_mac - Mirror the transmission queue in a MAC logical channel
+ * @entity: RLC entity
+ * @lcp: LCP state of the UE, or NULL to unbind
+ * @ch: Index of the entity's channel in @lcp
+ *
+ * The LCG counters behind BSR and SR then follow the queue through
+ * rlc_entity_sync_mac(), which the consumer side runs after every
+ * grant and MAC once per slot. The producer keeps to the ring and its
+ * own byte counter, so it may still run on another thread. Bytes
+ * already queued are counted at once, and the channel's @rlc points
+ * at @entity so mac_multiplex() fills its grants. MAC thread only.
+ */
+void rlc_entity_bind_mac(rlc_entity_t *entity, mac_lcp_t *lcp, int ch);
+
+/**
+ * rlc_entity_sync_mac - Bring the bound MAC channel up to date with the queue
+ * @entity: RLC entity bound with rlc_entity_bind_mac()
+ *
+ * Passes the bytes queued or sent since the last call to
+ * mac_lch_enqueue() or mac_lch_dequeue() as one delta, so new data
+ * triggers a Regular BSR (and with it an SR) at the next slot. In AM
+ * the retransmissions and a STATUS report due count as well
+ * (rlc_am_pending_bytes()). O(1), on the MAC thread: the LCG counters
+ * are not atomic.
+ *
+ * Return: Bytes now counted in the channel, 0 if the entity is not bound
+ */
+size_t rlc_entity_sync_mac(rlc_entity_t *entity);
+
 /**
  * rlc_entity_reestablish - Reset an RLC entity
  * @entity: Pointer to RLC entity to reset
@@ -71,18 +414,198 @@ void rlc_entity_reestablish(rlc_entity_t *entity);
  */
 void rlc_entity_release(rlc_entity_t *entity);
 
+/**
+ * rlc_tx_cb_t - Lower layer receiving the PDUs built by RLC
+ * @entity: RLC entity sending the PDU
+ * @pdu: PDU to transmit (consumed)
+ */
+typedef void (*rlc_tx_cb_t)(rlc_entity_t *entity, pktbuf_t *pdu);
+
+/**
+ * rlc_set_tx_callback - Route transmitted PDUs to a lower layer
+ * @cb: Handler for every entity, or NULL for the MAC UL-SCH path
+ *
+ * Lets benchmarks and the loopback channel take PDUs without going
+ * through the HARQ stub.
+ */
+void rlc_set_tx_callback(rlc_tx_cb_t cb);
+
+/**
+ * rlc_submit_pdu - Hand a PDU to the lower layer
+ * @entity: RLC entity sending the PDU
+ * @pdu: PDU to transmit (consumed)
+ */
+void rlc_submit_pdu(rlc_entity_t *entity, pktbuf_t *pdu);
+
+/**
+ * rlc_rx_pdu - Dispatch a received PDU by the entity's mode
+ * @entity: Pointer to RLC entity
+ * @pdu: Received data (processed in place)
+ * @pdu_size: Size of received data in bytes
+ */
+void rlc_rx_pdu(rlc_entity_t *entity, uint8_t *pdu, size_t pdu_size);
+
+/* Grant-Driven Transmission */
+
+/**
+ * rlc_tx_queue_init - Allocate the transmission queue of an entity
+ * @entity: RLC entity being established
+ *
+ * Return: 0 on success, -1 on allocation failure
+ */
+int rlc_tx_queue_init(rlc_entity_t *entity);
+
+/**
+ * rlc_tx_queue_flush - Drop every queued SDU
+ * @entity: RLC entity
+ *
+ * Neither the producer nor the consumer may run meanwhile.
+ */
+void rlc_tx_queue_flush(rlc_entity_t *entity);
+
+/**
+ * rlc_tx_queue_free - Drop every queued SDU and free the queue
+ * @entity: RLC entity
+ */
+void rlc_tx_queue_free(rlc_entity_t *entity);
+
+/**
+ * rlc_tx_enqueue - Queue an SDU until MAC offers a grant (producer side)
+ * @entity: RLC entity
+ * @sdu: Contiguous SDU to queue (consumed)
+ *
+ * Safe to call from one thread while another runs the consumer side.
+ * A bound MAC channel (rlc_entity_bind_mac()) learns of the SDU at the
+ * next rlc_entity_sync_mac().
+ * An SDU over MAC_MAX_SDU_SIZE is refused and counted in the queue:
+ * TM could never fit it in a TB and would block the queue behind it,
+ * and UM and AM could not address its tail with a 16-bit SO.
+ *
+ * Return: 0 on success, -1 if the queue is full, the SDU is too
+ * large or the entity has no queue (the SDU is dropped)
+ */
+int rlc_tx_enqueue(rlc_entity_t *entity, pktbuf_t *sdu);
+
+/**
+ * rlc_tx_dequeue - Take the next SDU off the queue (consumer side)
+ * @entity: RLC entity in RLC_MODE_TM or RLC_MODE_UM
+ *
+ * For lower layers that send whole SDUs. If rlc_build_pdus() left an
+ * SDU partly sent, the rest of it comes first, as a view. AM SDUs
+ * only leave through rlc_build_pdus(), which gives them their SNs.
+ *
+ * Return: SDU (owned by the caller), or NULL if the queue is empty or
+ * the entity is in RLC_MODE_AM
+ */
+pktbuf_t *rlc_tx_dequeue(rlc_entity_t *entity);
+
+/**
+ * rlc_tx_queued_bytes - SDU bytes waiting for transmission
+ * @entity: RLC entity
+ *
+ * Feeds buffer status reporting; any thread may call it. The value
+ * may lag the other side by the SDU it is handling.
+ *
+ * Return: Queued bytes, including the unsent part of a segmented SDU
+ */
+size_t rlc_tx_queued_bytes(const rlc_entity_t *entity);
+
+/**
+ * rlc_tx_discard - Drop queued SDUs that PDCP discarded (TS 38.322 5.4)
+ * @entity: RLC entity bound to the PDCP entity that built the SDUs
+ * @count: PDCP COUNT of the newest SDU discarded
+ *
+ * Drops every queued SDU whose COUNT is @count or older, in any mode;
+ * in AM none of them has an SN yet. An SDU of which a segment was
+ * sent, or already sent whole, stays with RLC. PDCP queues SDUs in
+ * COUNT order and discardTimer expires them in the same order, so the
+ * SDUs to drop are at the head of the queue. Consumer side: call it
+ * from the thread building PDUs, as the timer wheel ticks there.
+ *
+ * Return: SDUs dropped
+ */
+size_t rlc_tx_discard(rlc_entity_t *entity, uint32_t count);
+
+/**
+ * rlc_build_pdus - Fill a MAC grant from the queued SDUs
+ * @entity: RLC entity
+ * @grant: Bytes MAC offers this logical channel
+ * @out: Returns the RLC PDUs built, in transmission order
+ * @max_pdus: Capacity of @out
+ *
+ * Consumer side of the queue. Packs as many queued SDUs as fit, in order, and cuts the SDU that
+ * does not fit into a segment that uses up the rest of the grant.
+ * Each PDU is charged its MAC subheader (mac_subheader_size()) on
+ * top of its RLC header, so PDUs plus subheaders never exceed
+ * @grant and fall short only when the remainder is too small for a
+ * header and one byte of data (or 2-byte L cannot be used at the
+ * 255/256 boundary). TM cannot segment and stops at the first SDU
+ * that does not fit. AM fills the grant with rlc_am_build_pdus().
+ *
+ * Segments are header buffers chained to views of the SDU; an SDU
+ * sent whole gets its header prepended in place when it has headroom.
+ *
+ * Return: Number of PDUs stored in @out
+ */
+size_t rlc_build_pdus(rlc_entity_t *entity, size_t grant, pktbuf_t **out, size_t max_pdus);
+
+/**
+ * rlc_segment_fit - Largest payload whose PDU and subheader fit a budget
+ * @budget: Grant bytes left
+ * @header: RLC header size of the PDU
+ *
+ * The subheader grows from 2 to 3 bytes once the PDU passes 255
+ * bytes, so a budget of 258 fits a 255-byte PDU and wastes a byte.
+ *
+ * Return: Payload bytes, 0 if not even one byte fits
+ */
+size_t rlc_segment_fit(size_t budget, size_t header);
+
+/**
+ * rlc_rx_segment - Place a received segment in the reassembly slot of its SN
+ * @entity: RLC entity in RLC_MODE_UM or RLC_MODE_AM
+ * @sn: SN of the SDU (unwrapped in AM)
+ * @so: Offset of the segment in the SDU
+ * @data: Segment payload
+ * @len: Payload bytes
+ * @last: Non-zero if the segment ends the SDU
+ *
+ * Copies the segment to its SO in the slot of @sn, claiming one for a
+ * new SN. In UM the entity's t-Reassembly runs for the slot's
+ * deadline. Segments outside RLC_UM_MAX_SDU_SIZE or past
+ * RLC_UM_MAX_RANGES holes are counted and dropped.
+ *
+ * Return: Slot holding the now complete SDU, which the caller delivers
+ * and releases by clearing in_use; NULL while bytes are missing or if
+ * the segment was dropped
+ */
+rlc_um_slot_t *rlc_rx_segment(rlc_entity_t *entity, uint32_t sn, size_t so, const uint8_t *data, size_t len,
+                              int last);
+
+/**
+ * rlc_tx_lost - Tell RLC that HARQ gave up on a TB carrying its PDUs
+ * @entity: RLC entity that built the PDUs
+ * @pdus: PDUs of the entity in the TB
+ * @bytes: Their size in bytes
+ *
+ * For the MAC UL fail handler (harq_set_ul_fail_callback()), on the
+ * consumer side of the queue. TM and UM have no ARQ and count the
+ * PDUs as lost; the UM receiver's t-Reassembly discards the SDUs
+ * they belonged to. AM polls at once (rlc_am_tx_lost()).
+ */
+void rlc_tx_lost(rlc_entity_t *entity, size_t pdus, size_t bytes);
+
 /* Transparent Mode (TM) Functions */
 
 /**
  * rlc_tm_tx_data - Transmit data in Transparent Mode
  * @entity: Pointer to RLC entity
- * @sdu: Data to transmit
- * @sdu_size: Size of data in bytes
+ * @sdu: Data to transmit (consumed)
  *
  * Handles transmission in TM mode - directly forwards data
  * without adding headers or performing segmentation.
  */
-void rlc_tm_tx_data(rlc_entity_t *entity, uint8_t *sdu, size_t sdu_size);
+void rlc_tm_tx_data(rlc_entity_t *entity, pktbuf_t *sdu);
 
 /**
  * rlc_tm_rx_data - Receive data in Transparent Mode
@@ -98,33 +621,157 @@ void rlc_tm_rx_data(rlc_entity_t *entity, uint8_t *pdu, size_t pdu_size);
 /* Unacknowledged Mode (UM) Functions */
 
 /**
- * RLC_UM_SEGMENT_SIZE - Maximum size of UM mode segments
+ * rlc_um_rx_data - Receive data in Unacknowledged Mode
+ * @entity: Pointer to RLC entity
+ * @pdu: Received data
+ * @pdu_size: Size of received data in bytes
  *
- * Defines the maximum PDU size for segmentation in UM mode.
- * Larger SDUs will be split into multiple segments of this size.
+ * Processes received data in UM mode including reassembly
+ * of segmented SDUs. Segments of several SNs may be interleaved
+ * and arrive in any order; each SDU is delivered as soon as all of
+ * its bytes are in.
  */
-#define RLC_UM_SEGMENT_SIZE 20
+void rlc_um_rx_data(rlc_entity_t *entity, uint8_t *pdu, size_t pdu_size);
+
+/* Acknowledged Mode (AM) Functions */
 
 /**
- * rlc_um_tx_data - Transmit data in Unacknowledged Mode
- * @entity: Pointer to RLC entity
- * @sdu: Data to transmit
- * @sdu_size: Size of data in bytes
+ * rlc_am_establish - Allocate the AM state of a new entity
+ * @entity: RLC entity being established in RLC_MODE_AM
  *
- * Handles transmission in UM mode including segmentation
- * and header addition for each segment.
+ * Called by rlc_entity_establish() and applies the default
+ * configuration. The state takes about 37 KB with 12-bit SNs and
+ * 2.4 MB with 18-bit SNs, dominated by the per-SN SDU references and
+ * retransmission ranges. The entity's reassembly slots add
+ * RLC_AM_REASSEMBLY_SLOTS buffers of RLC_UM_MAX_SDU_SIZE bytes.
  */
-void rlc_um_tx_data(rlc_entity_t *entity, uint8_t *sdu, size_t sdu_size);
+void rlc_am_establish(rlc_entity_t *entity);
 
 /**
- * rlc_um_rx_data - Receive data in Unacknowledged Mode
- * @entity: Pointer to RLC entity
+ * rlc_am_reestablish - Reset the AM state of an entity
+ * @entity: RLC entity being re-established
+ *
+ * Discards all SDUs held for acknowledgement and restarts both
+ * sides from SN 0, keeping the configuration and the counters.
+ */
+void rlc_am_reestablish(rlc_entity_t *entity);
+
+/**
+ * rlc_am_release - Free the AM state of an entity
+ * @entity: RLC entity being released
+ */
+void rlc_am_release(rlc_entity_t *entity);
+
+/**
+ * rlc_am_configure - Set the AM parameters of an entity
+ * @entity: RLC entity in RLC_MODE_AM
+ * @cfg: Parameters (copied)
+ *
+ * Resizes the windows for the SN length, so it must be called
+ * before any data is exchanged. rlc_entity_establish() applies
+ * 12-bit SNs and the defaults of this file.
+ *
+ * Return: 0 on success, -1 for a bad configuration or on allocation
+ * failure (the entity keeps its previous configuration)
+ */
+int rlc_am_configure(rlc_entity_t *entity, const rlc_am_config_t *cfg);
+
+/**
+ * rlc_am_max_retx_cb_t - Upper layer told an SDU reached maxRetxThreshold
+ * @entity: RLC entity in RLC_MODE_AM
+ * @sn: SN of the SDU, as sent in its AMD PDU header
+ *
+ * The SDU will not be retransmitted again and holds TX_Next_Ack, so
+ * the transmitting window stays stalled until the owner of the
+ * bearer acts: radio link failure, then re-establishment (TS 38.322
+ * 5.3.2). Runs after the entity has finished with the STATUS PDU or
+ * timer that hit the threshold, so the handler may re-establish or
+ * release the entity.
+ */
+typedef void (*rlc_am_max_retx_cb_t)(rlc_entity_t *entity, uint32_t sn);
+
+/**
+ * rlc_am_set_max_retx_callback - Route maxRetxThreshold indications
+ * @cb: Handler for every AM entity, or NULL to have the entity
+ *      re-establish itself
+ */
+void rlc_am_set_max_retx_callback(rlc_am_max_retx_cb_t cb);
+
+/**
+ * rlc_am_tx_lost - Recover AMD PDUs lost with a TB HARQ gave up on
+ * @entity: RLC entity in RLC_MODE_AM
+ *
+ * Acts as if t-PollRetransmit had expired (TS 38.322 5.3.3.4): the
+ * next AMD PDU, a retransmission of an unacknowledged SDU if nothing
+ * else is pending, carries a poll, so the peer's STATUS report NACKs
+ * what the TB carried without waiting for the timer.
+ */
+void rlc_am_tx_lost(rlc_entity_t *entity);
+
+/**
+ * rlc_am_build_pdus - Fill a MAC grant in Acknowledged Mode
+ * @entity: RLC entity in RLC_MODE_AM
+ * @grant: Bytes MAC offers this logical channel, subheaders included
+ * @out: Returns the RLC PDUs built, in transmission order
+ * @max_pdus: Capacity of @out
+ * @sent: Returns the bytes of new SDUs sent, for the queue's counter
+ *
+ * Called by rlc_build_pdus(). A triggered STATUS report goes first,
+ * cut short to fit if need be, unless t-StatusProhibit runs. Then
+ * retransmissions in the order they were NACKed, each covering only
+ * the bytes NACKed, then new SDUs from the queue while the
+ * transmitting window is open; an SDU gets its SN with its first
+ * byte sent. Whatever does not fit is cut into an AMD PDU segment
+ * (SI, SO) using up the grant, and the rest goes out at the next
+ * grant. Every PDU chains a header to a view of the held SDU. The
+ * poll bit follows TS 38.322 5.3.3.2: after pollPDU PDUs or pollByte
+ * bytes, when nothing is left to send or retransmit, and when the
+ * window stalls.
+ *
+ * Return: Number of PDUs stored in @out
+ */
+size_t rlc_am_build_pdus(rlc_entity_t *entity, size_t grant, pktbuf_t **out, size_t max_pdus, size_t *sent);
+
+/**
+ * rlc_am_pending_bytes - AM data volume outside the transmission queue
+ * @entity: RLC entity
+ *
+ * Bytes NACKed and waiting for retransmission, plus the minimum size
+ * of a STATUS PDU when one is due. Consumer side only.
+ *
+ * Return: Bytes, 0 for an entity in another mode
+ */
+size_t rlc_am_pending_bytes(const rlc_entity_t *entity);
+
+/**
+ * rlc_am_rx_data - Receive an AMD or STATUS PDU
+ * @entity: RLC entity in RLC_MODE_AM
  * @pdu: Received data
  * @pdu_size: Size of received data in bytes
  *
- * Processes received data in UM mode including reassembly
- * of segmented SDUs and in-sequence delivery.
+ * AMD PDUs are tracked in the receive bitmap and their SDUs passed
+ * to PDCP straight from @pdu, in the order they arrive. AMD PDU
+ * segments (SI != 0) are placed at their SO in a reassembly slot and
+ * the SDU is passed on once all of its bytes are in. Duplicates and
+ * PDUs outside the window are dropped. STATUS PDUs acknowledge SDUs
+ * in bulk and queue the NACKed bytes for retransmission, which goes
+ * out at the next grant before any new data.
  */
-void rlc_um_rx_data(rlc_entity_t *entity, uint8_t *pdu, size_t pdu_size);
+void rlc_am_rx_data(rlc_entity_t *entity, uint8_t *pdu, size_t pdu_size);
+
+/**
+ * rlc_am_build_status - Build a STATUS PDU for the receiving side
+ * @entity: RLC entity in RLC_MODE_AM
+ *
+ * Reports every SN from RX_Next up to RX_Highest_Status that has not
+ * been received. Runs of missing SNs are found a 64-bit word at a time
+ * and encoded as one NACK_SN with a NACK range (up to
+ * RLC_AM_NACK_RANGE_MAX SNs per entry), so a burst of losses costs a
+ * few bytes. An SDU with segments in reassembly is NACKed by its
+ * missing byte ranges (SOstart, SOend) only.
+ *
+ * Return: STATUS PDU, or NULL on allocation failure
+ */
+pktbuf_t *rlc_am_build_status(rlc_entity_t *entity);
 
 #endif /* RLC_H */
@@ -0,0 +1,1039 @@
+#include "rlc.h"
+#include "../pdcp/pdcp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Defaults applied at establishment (TS 38.331 RLC-Config ranges) */
+#define RLC_AM_DEFAULT_POLL_PDU           64
+#define RLC_AM_DEFAULT_POLL_BYTE          25000
+#define RLC_AM_DEFAULT_MAX_RETX           8
+#define RLC_AM_DEFAULT_T_POLL_RETRANSMIT  45
+#define RLC_AM_DEFAULT_T_REASSEMBLY       35
+#define RLC_AM_DEFAULT_T_STATUS_PROHIBIT  10
+
+/* Segmentation info (SI) of AMD PDU headers; 00 is a complete SDU */
+#define RLC_AM_SI_FIRST  1
+#define RLC_AM_SI_LAST   2
+#define RLC_AM_SI_MIDDLE 3
+
+/* STATUS PDU header: D/C, CPT, ACK_SN and E1 */
+#define RLC_AM_STATUS_MIN_SIZE 3
+
+/* STATUS PDU control PDU type (CPT) */
+#define RLC_AM_CPT_STATUS 0
+
+/* Upper layer told of SDUs reaching maxRetxThreshold; NULL re-establishes in place. */
+static rlc_am_max_retx_cb_t rlc_am_max_retx_cb;
+
+static const rlc_am_config_t rlc_am_default_config = {
+    .sn_bits = RLC_AM_SN_BITS_SHORT,
+    .poll_pdu = RLC_AM_DEFAULT_POLL_PDU,
+    .poll_byte = RLC_AM_DEFAULT_POLL_BYTE,
+    .max_retx = RLC_AM_DEFAULT_MAX_RETX,
+    .t_poll_retransmit = RLC_AM_DEFAULT_T_POLL_RETRANSMIT,
+    .t_reassembly = RLC_AM_DEFAULT_T_REASSEMBLY,
+    .t_status_prohibit = RLC_AM_DEFAULT_T_STATUS_PROHIBIT,
+};
+
+/* --------------------------------------------------------------------------
+   Window Bitmaps
+   -------------------------------------------------------------------------- */
+
+/*
+ * The window sizes are multiples of 64, so a bitmap word never
+ * straddles the point where the ring wraps.
+ */
+static inline int rlc_am_bit_test(const uint64_t *bitmap, uint32_t idx) {
+    return (bitmap[idx >> 6] >> (idx & 63)) & 1;
+}
+
+static inline void rlc_am_bit_set(uint64_t *bitmap, uint32_t idx) {
+    bitmap[idx >> 6] |= 1ULL << (idx & 63);
+}
+
+static inline void rlc_am_bit_clear(uint64_t *bitmap, uint32_t idx) {
+    bitmap[idx >> 6] &= ~(1ULL << (idx & 63));
+}
+
+/**
+ * rlc_am_bitmap_find - Find the first SN whose bit has a given value
+ * @bitmap: Window bitmap
+ * @window: Number of bits in @bitmap
+ * @from: First SN to test
+ * @to: End of the search (exclusive)
+ * @set: Look for a set bit if non-zero, a clear bit otherwise
+ *
+ * Scans a word at a time, so long runs of received (or missing) SNs
+ * cost one load per 64 SNs.
+ *
+ * Return: First matching SN in [@from, @to), or @to if there is none
+ */
+static uint32_t rlc_am_bitmap_find(const uint64_t *bitmap, uint32_t window, uint32_t from,
+                                   uint32_t to, int set) {
+    uint32_t sn = from;
+    while (sn != to) {
+        uint32_t idx = sn & (window - 1);
+        uint64_t word = bitmap[idx >> 6];
+        if (!set)
+            word = ~word;
+        word >>= idx & 63;
+        if (word) {
+            uint32_t found = sn + (uint32_t)__builtin_ctzll(word);
+            return (found - from < to - from) ? found : to;
+        }
+        uint32_t step = 64 - (idx & 63);
+        if (to - sn <= step)
+            return to;
+        sn += step;
+    }
+    return to;
+}
+
+/* Clears the bits of [from, to) as the receiving window moves past them. */
+static void rlc_am_bitmap_clear(uint64_t *bitmap, uint32_t window, uint32_t from, uint32_t to) {
+    while (from != to) {
+        uint32_t idx = from & (window - 1);
+        uint32_t bits = 64 - (idx & 63);
+        if (to - from < bits)
+            bits = to - from;
+        uint64_t mask = (bits == 64) ? ~0ULL : (((1ULL << bits) - 1) << (idx & 63));
+        bitmap[idx >> 6] &= ~mask;
+        from += bits;
+    }
+}
+
+/* --------------------------------------------------------------------------
+   State Allocation
+   -------------------------------------------------------------------------- */
+
+/*
+ * Drops every SDU held by the transmitting side and resets both sides.
+ * SDUs not sent yet wait in the entity's queue, flushed on its own.
+ */
+static void rlc_am_reset(rlc_am_t *am) {
+    for (uint32_t sn = am->tx_next_ack; sn != am->tx_next; sn++) {
+        pktbuf_free(am->tx_sdus[sn & (am->window - 1)]);
+        am->tx_sdus[sn & (am->window - 1)] = NULL;
+    }
+    memset(am->retx_pending, 0, am->window / 8);
+    memset(am->rx_bitmap, 0, am->window / 8);
+
+    am->tx_next_ack = am->tx_next = am->poll_sn = 0;
+    am->pdu_without_poll = am->byte_without_poll = 0;
+    am->poll_next = 0;
+    am->retx_head = am->retx_tail = 0;
+    am->retx_bytes = 0;
+    am->rx_next = am->rx_next_highest = am->rx_highest_status = am->rx_next_status_trigger = 0;
+    am->status_triggered = 0;
+    am->poll_pending = 0;
+    am->max_retx_hit = 0;
+}
+
+static void rlc_am_free(rlc_am_t *am) {
+    if (!am) return;
+    if (am->tx_sdus)
+        rlc_am_reset(am);
+    free(am->tx_sdus);
+    free(am->retx_count);
+    free(am->retx_pending);
+    free(am->retx_range);
+    free(am->retx_queue);
+    free(am->rx_bitmap);
+    free(am);
+}
+
+static rlc_am_t *rlc_am_alloc(const rlc_am_config_t *cfg) {
+    if (cfg->sn_bits != RLC_AM_SN_BITS_SHORT && cfg->sn_bits != RLC_AM_SN_BITS_LONG) return NULL;
+    if (cfg->max_retx == 0 || cfg->max_retx > 255) return NULL;
+
+    rlc_am_t *am = calloc(1, sizeof(rlc_am_t));
+    if (!am) return NULL;
+    am->cfg = *cfg;
+    am->sn_mod = (1u << cfg->sn_bits) - 1;
+    am->window = 1u << (cfg->sn_bits - 1);
+    am->tx_sdus = calloc(am->window, sizeof(pktbuf_t *));
+    am->retx_count = calloc(am->window, sizeof(uint16_t));
+    am->retx_pending = calloc(am->window / 64, sizeof(uint64_t));
+    am->retx_range = calloc(am->window, sizeof(rlc_byte_range_t));
+    am->retx_queue = calloc(am->window, sizeof(uint32_t));
+    am->rx_bitmap = calloc(am->window / 64, sizeof(uint64_t));
+    if (!am->tx_sdus || !am->retx_count || !am->retx_pending || !am->retx_range ||
+        !am->retx_queue || !am->rx_bitmap) {
+        rlc_am_free(am);
+        return NULL;
+    }
+    return am;
+}
+
+static void rlc_am_poll_retransmit_expired(timer_node_t *node);
+static void rlc_am_reassembly_expired(timer_node_t *node);
+static void rlc_am_status_prohibit_expired(timer_node_t *node);
+
+static void rlc_am_stop_timers(rlc_entity_t *entity) {
+    timer_cancel(&entity->t_reassembly);
+    timer_cancel(&entity->t_poll_retransmit);
+    timer_cancel(&entity->t_status_prohibit);
+}
+
+void rlc_am_establish(rlc_entity_t *entity) {
+    timer_init(&entity->t_reassembly, rlc_am_reassembly_expired);
+    timer_init(&entity->t_poll_retransmit, rlc_am_poll_retransmit_expired);
+    timer_init(&entity->t_status_prohibit, rlc_am_status_prohibit_expired);
+    entity->am = rlc_am_alloc(&rlc_am_default_config);
+    if (!entity->am)
+        printf("RLC AM: Failed to allocate entity state\n");
+}
+
+void rlc_am_reestablish(rlc_entity_t *entity) {
+    rlc_am_stop_timers(entity);
+    if (entity->am)
+        rlc_am_reset(entity->am);
+}
+
+void rlc_am_release(rlc_entity_t *entity) {
+    rlc_am_stop_timers(entity);
+    rlc_am_free(entity->am);
+    entity->am = NULL;
+}
+
+int rlc_am_configure(rlc_entity_t *entity, const rlc_am_config_t *cfg) {
+    if (!entity || !cfg || entity->mode != RLC_MODE_AM) return -1;
+    rlc_am_t *am = rlc_am_alloc(cfg);
+    if (!am) {
+        printf("RLC AM: Invalid configuration (SN %d bits, maxRetx %u)\n", cfg->sn_bits, cfg->max_retx);
+        return -1;
+    }
+    if (entity->am)
+        am->stats = entity->am->stats;
+    rlc_am_stop_timers(entity);
+    rlc_am_free(entity->am);
+    entity->am = am;
+    return 0;
+}
+
+/* --------------------------------------------------------------------------
+   Transmitting Side
+   -------------------------------------------------------------------------- */
+
+static inline uint32_t rlc_am_header_size(const rlc_am_t *am) {
+    return am->cfg.sn_bits == RLC_AM_SN_BITS_LONG ? 3 : 2;
+}
+
+static inline int rlc_am_window_stalled(const rlc_am_t *am) {
+    return am->tx_next - am->tx_next_ack >= am->window;
+}
+
+/* Peeks at the next SN to retransmit, dropping those acknowledged since they were NACKed. */
+static int rlc_am_retx_next(rlc_am_t *am, uint32_t *sn) {
+    while (am->retx_head != am->retx_tail) {
+        uint32_t s = am->retx_queue[am->retx_head & (am->window - 1)];
+        if (s - am->tx_next_ack < am->tx_next - am->tx_next_ack &&
+            rlc_am_bit_test(am->retx_pending, s & (am->window - 1))) {
+            *sn = s;
+            return 1;
+        }
+        am->retx_head++;
+    }
+    return 0;
+}
+
+/*
+ * Nothing left to send once the current PDU is out (TS 38.322 5.3.3.2).
+ * @sent is what this grant took off the queue, not yet subtracted from
+ * its byte count.
+ */
+static int rlc_am_tx_idle(rlc_entity_t *entity, rlc_am_t *am, size_t sent) {
+    uint32_t sn;
+    if (rlc_am_retx_next(am, &sn) || (entity->txq && entity->txq->cur)) return 0;
+    return rlc_am_window_stalled(am) || rlc_tx_queued_bytes(entity) == sent;
+}
+
+/* Payload of the PDU carrying [so, so + left) of an SDU within the budget, 0 if none fits. */
+static size_t rlc_am_fit(const rlc_am_t *am, size_t so, size_t left, size_t budget) {
+    size_t header = rlc_am_header_size(am) + (so ? 2 : 0);
+    size_t whole = header + left;
+    if (whole + mac_subheader_size(whole) <= budget)
+        return left;
+    return rlc_segment_fit(budget, header);
+}
+
+/**
+ * rlc_am_build_pdu - Build an AMD PDU or AMD PDU segment
+ * @am: AM state
+ * @sdu: SDU held for @sn
+ * @sn: Unwrapped SN of the SDU
+ * @so: Offset of the first byte carried
+ * @len: Bytes carried
+ *
+ * The PDU is a fresh header buffer chained to a reference on the held
+ * SDU, or a view of its bytes for a segment, so the SDU is never
+ * written and every retransmission sends the same bytes. The poll bit
+ * is left to rlc_am_set_poll().
+ *
+ * Return: PDU, or NULL on allocation failure
+ */
+static pktbuf_t *rlc_am_build_pdu(const rlc_am_t *am, pktbuf_t *sdu, uint32_t sn, size_t so, size_t len) {
+    uint8_t si = so == 0 ? (len == sdu->len ? 0 : RLC_AM_SI_FIRST)
+                         : (so + len == sdu->len ? RLC_AM_SI_LAST : RLC_AM_SI_MIDDLE);
+    size_t header_size = rlc_am_header_size(am) + (so ? 2 : 0);
+    pktbuf_t *payload = si == 0 ? pktbuf_ref(sdu) : pktbuf_view(sdu, so, len);
+    pktbuf_t *pdu = pktbuf_alloc(header_size);
+    if (!pdu || !payload) {
+        pktbuf_free(pdu);
+        pktbuf_free(payload);
+        return NULL;
+    }
+    uint8_t *header = pktbuf_append(pdu, header_size);
+    uint32_t wire_sn = sn & am->sn_mod;
+    /* D/C=1, SI */
+    header[0] = 0x80 | (uint8_t)(si << 4);
+    if (am->cfg.sn_bits == RLC_AM_SN_BITS_LONG) {
+        header[0] |= (wire_sn >> 16) & 0x03;
+        header[1] = (wire_sn >> 8) & 0xFF;
+        header[2] = wire_sn & 0xFF;
+    } else {
+        header[0] |= (wire_sn >> 8) & 0x0F;
+        header[1] = wire_sn & 0xFF;
+    }
+    if (so) {
+        header[header_size - 2] = (so >> 8) & 0xFF;
+        header[header_size - 1] = so & 0xFF;
+    }
+    pktbuf_chain(pdu, payload);
+    return pdu;
+}
+
+/**
+ * rlc_am_set_poll - Set the poll bit of an AMD PDU if one is due
+ * @entity: RLC entity
+ * @am: Its AM state
+ * @pdu: PDU just built, its bytes already taken off the buffers
+ * @new_bytes: SDU bytes it carries for the first time, 0 for a retransmission
+ * @sent: New SDU bytes taken off the queue in this grant, @pdu's included
+ *
+ * TS 38.322 5.3.3.2: pollPDU and pollByte count new data only; the
+ * PDU after which both buffers are empty, or no new SDU may go because
+ * the window stalled, polls too.
+ */
+static void rlc_am_set_poll(rlc_entity_t *entity, rlc_am_t *am, pktbuf_t *pdu, size_t new_bytes, size_t sent) {
+    int poll = am->poll_next;
+
+    if (new_bytes) {
+        am->pdu_without_poll++;
+        am->byte_without_poll += (uint32_t)new_bytes;
+        if ((am->cfg.poll_pdu && am->pdu_without_poll >= am->cfg.poll_pdu) ||
+            (am->cfg.poll_byte && am->byte_without_poll >= am->cfg.poll_byte))
+            poll = 1;
+    }
+    if (rlc_am_tx_idle(entity, am, sent) || (rlc_am_window_stalled(am) && !entity->txq->cur))
+        poll = 1;
+    if (!poll) return;
+
+    pdu->data[0] |= 0x40;
+    am->stats.polls++;
+    am->pdu_without_poll = 0;
+    am->byte_without_poll = 0;
+    am->poll_next = 0;
+    am->poll_sn = am->tx_next - 1;
+    timer_arm(timer_get_wheel(), &entity->t_poll_retransmit,
+              timer_ms(timer_get_wheel(), am->cfg.t_poll_retransmit));
+}
+
+static pktbuf_t *rlc_am_status_pdu(rlc_entity_t *entity, rlc_am_t *am, size_t max);
+
+size_t rlc_am_build_pdus(rlc_entity_t *entity, size_t grant, pktbuf_t **out, size_t max_pdus, size_t *sent) {
+    rlc_am_t *am = entity->am;
+    rlc_tx_queue_t *q = entity->txq;
+    size_t budget = grant, n = 0;
+    uint32_t sn;
+    if (!am || max_pdus == 0) return 0;
+
+    /* Control PDUs first, then retransmissions, then new data (TS 38.322 5.2.3.1.1) */
+    if (am->status_triggered && !timer_armed(&entity->t_status_prohibit)) {
+        size_t max = rlc_segment_fit(budget, 0);
+        if (max > RLC_AM_STATUS_MAX_SIZE)
+            max = RLC_AM_STATUS_MAX_SIZE;
+        pktbuf_t *pdu = max >= RLC_AM_STATUS_MIN_SIZE ? rlc_am_status_pdu(entity, am, max) : NULL;
+        if (pdu) {
+            am->status_triggered = 0;
+            am->stats.status_tx++;
+            am->stats.status_tx_bytes += pdu->len;
+            if (am->cfg.t_status_prohibit)
+                timer_arm(timer_get_wheel(), &entity->t_status_prohibit,
+                          timer_ms(timer_get_wheel(), am->cfg.t_status_prohibit));
+            budget -= pdu->len + mac_subheader_size(pdu->len);
+            out[n++] = pdu;
+        }
+    }
+
+    /* NACKed bytes, re-segmented to whatever the grant leaves */
+    while (n < max_pdus && rlc_am_retx_next(am, &sn)) {
+        uint32_t idx = sn & (am->window - 1);
+        rlc_byte_range_t *r = &am->retx_range[idx];
+        size_t len = rlc_am_fit(am, r->start, (size_t)(r->end - r->start), budget);
+        if (len == 0) break;
+        pktbuf_t *pdu = rlc_am_build_pdu(am, am->tx_sdus[idx], sn, r->start, len);
+        if (!pdu) break;
+        r->start += (uint16_t)len;
+        am->retx_bytes -= len;
+        if (r->start == r->end) {
+            rlc_am_bit_clear(am->retx_pending, idx);
+            am->retx_head++;
+        }
+        am->stats.retx_pdus++;
+        rlc_am_set_poll(entity, am, pdu, 0, *sent);
+        size_t pdu_len = pktbuf_pkt_len(pdu);
+        budget -= pdu_len + mac_subheader_size(pdu_len);
+        out[n++] = pdu;
+    }
+
+    /* New SDUs take their SN with their first byte; the one that does not fit is cut */
+    while (n < max_pdus) {
+        if (!q->cur) {
+            if (rlc_am_window_stalled(am) || rlc_segment_fit(budget, rlc_am_header_size(am)) == 0)
+                break;
+            pktbuf_t *sdu = spsc_ring_pop(&q->ring);
+            if (!sdu) break;
+            sn = am->tx_next++;
+            am->tx_sdus[sn & (am->window - 1)] = sdu;
+            am->retx_count[sn & (am->window - 1)] = 0;
+            /* The queue holds its own reference while it segments the SDU */
+            q->cur = pktbuf_ref(sdu);
+            q->so = 0;
+        }
+        size_t left = q->cur->len - q->so;
+        size_t len = rlc_am_fit(am, q->so, left, budget);
+        if (len == 0) break;
+        pktbuf_t *pdu = rlc_am_build_pdu(am, q->cur, am->tx_next - 1, q->so, len);
+        if (!pdu) break;
+        *sent += len;
+        if (len == left) {
+            pktbuf_free(q->cur);
+            q->cur = NULL;
+            q->so = 0;
+        } else {
+            q->so += len;
+        }
+        am->stats.tx_pdus++;
+        rlc_am_set_poll(entity, am, pdu, len, *sent);
+        size_t pdu_len = pktbuf_pkt_len(pdu);
+        budget -= pdu_len + mac_subheader_size(pdu_len);
+        out[n++] = pdu;
+    }
+    return n;
+}
+
+size_t rlc_am_pending_bytes(const rlc_entity_t *entity) {
+    const rlc_am_t *am = entity ? entity->am : NULL;
+    if (!am) return 0;
+    return am->retx_bytes +
+           (am->status_triggered && !timer_armed(&entity->t_status_prohibit) ? RLC_AM_STATUS_MIN_SIZE : 0);
+}
+
+/**
+ * rlc_am_queue_retx - Consider bytes of an SDU for retransmission
+ * @entity: RLC entity
+ * @am: Its AM state
+ * @sn: Unwrapped SN in [TX_Next_Ack, TX_Next)
+ * @start: First byte NACKed
+ * @end: End of the NACKed bytes (exclusive), clamped to the bytes sent
+ *
+ * Counts the retransmission and queues the SN unless it is already
+ * queued, in which case its pending range grows to cover the new one.
+ * RETX_COUNT is 0 for the first retransmission (TS 38.322 5.3.2), so
+ * maxRetxThreshold retransmissions go out before the next NACK of the
+ * SDU hits the threshold. That SDU is no longer retransmitted; it is
+ * recorded for rlc_am_indicate_max_retx().
+ */
+static void rlc_am_queue_retx(rlc_entity_t *entity, rlc_am_t *am, uint32_t sn, size_t start, size_t end) {
+    uint32_t idx = sn & (am->window - 1);
+    pktbuf_t *sdu = am->tx_sdus[idx];
+    if (!sdu) return;
+    /* The tail of the SDU being segmented has not been sent yet */
+    size_t limit = entity->txq && entity->txq->cur && sn == am->tx_next - 1 ? entity->txq->so : sdu->len;
+    if (end > limit)
+        end = limit;
+    if (start >= end) return;
+
+    rlc_byte_range_t *r = &am->retx_range[idx];
+    if (rlc_am_bit_test(am->retx_pending, idx)) {
+        size_t before = (size_t)(r->end - r->start);
+        if (start < r->start)
+            r->start = (uint16_t)start;
+        if (end > r->end)
+            r->end = (uint16_t)end;
+        am->retx_bytes += (size_t)(r->end - r->start) - before;
+        return;
+    }
+    if (am->retx_count[idx] > am->cfg.max_retx) return;
+    /* retx_count holds RETX_COUNT + 1, 0 until the SDU is first considered */
+    if (am->retx_count[idx]++ == am->cfg.max_retx) {
+        am->stats.max_retx_reached++;
+        if (!am->max_retx_hit) {
+            am->max_retx_hit = 1;
+            am->max_retx_sn = sn;
+        }
+        return;
+    }
+    rlc_am_bit_set(am->retx_pending, idx);
+    r->start = (uint16_t)start;
+    r->end = (uint16_t)end;
+    am->retx_bytes += end - start;
+    am->retx_queue[am->retx_tail++ & (am->window - 1)] = sn;
+}
+
+/**
+ * rlc_am_indicate_max_retx - Tell upper layers an SDU reached maxRetxThreshold
+ * @entity: RLC entity
+ * @am: Its AM state
+ *
+ * The SDU can never be acknowledged, so TX_Next_Ack and with it the
+ * transmitting window stay where they are until the entity is
+ * re-established. Run last by every path that may count
+ * retransmissions, so the handler is free to re-establish or release
+ * the entity; without a handler the entity re-establishes itself.
+ */
+static void rlc_am_indicate_max_retx(rlc_entity_t *entity, rlc_am_t *am) {
+    if (!am->max_retx_hit) return;
+    uint32_t sn = am->max_retx_sn & am->sn_mod;
+    am->max_retx_hit = 0;
+    printf("RLC AM: maxRetxThreshold reached for SN %u, radio link failure\n", sn);
+    if (rlc_am_max_retx_cb)
+        rlc_am_max_retx_cb(entity, sn);
+    else
+        rlc_entity_reestablish(entity);
+}
+
+void rlc_am_set_max_retx_callback(rlc_am_max_retx_cb_t cb) {
+    rlc_am_max_retx_cb = cb;
+}
+
+/**
+ * rlc_am_release_acked - Release SDUs positively acknowledged by a STATUS PDU
+ * @entity: RLC entity
+ * @am: Its AM state
+ * @from: First SN acknowledged
+ * @to: End of the acknowledged SNs (exclusive)
+ *
+ * Confirms the delivery of the SDUs to the bound PDCP entity, which
+ * then stops retaining their PDUs. SDUs from TX_Next_Ack on are
+ * confirmed in one pdcp_tx_confirm_upto() sweep up to the last one
+ * still held; SDUs acknowledged between NACKs one by one.
+ */
+static void rlc_am_release_acked(rlc_entity_t *entity, rlc_am_t *am, uint32_t from, uint32_t to) {
+    pdcp_entity_t *pdcp = entity->pdcp;
+    uint32_t count;
+    if (pdcp && from == am->tx_next_ack) {
+        for (uint32_t sn = to; sn != from; sn--) {
+            pktbuf_t *sdu = am->tx_sdus[(sn - 1) & (am->window - 1)];
+            if (!sdu) continue;
+            if (pdcp_tx_pdu_count(pdcp, sdu->data, sdu->len, &count) == 0)
+                pdcp_tx_confirm_upto(pdcp, count + 1);
+            break;
+        }
+        pdcp = NULL;
+    }
+    for (uint32_t sn = from; sn != to; sn++) {
+        uint32_t idx = sn & (am->window - 1);
+        pktbuf_t *sdu = am->tx_sdus[idx];
+        if (sdu && pdcp && pdcp_tx_pdu_count(pdcp, sdu->data, sdu->len, &count) == 0)
+            pdcp_tx_confirm(pdcp, count);
+        pktbuf_free(sdu);
+        am->tx_sdus[idx] = NULL;
+        if (rlc_am_bit_test(am->retx_pending, idx)) {
+            am->retx_bytes -= (size_t)(am->retx_range[idx].end - am->retx_range[idx].start);
+            rlc_am_bit_clear(am->retx_pending, idx);
+        }
+    }
+}
+
+/* --------------------------------------------------------------------------
+   STATUS PDUs
+   -------------------------------------------------------------------------- */
+
+/**
+ * rlc_am_parse_nack - Decode one NACK entry of a STATUS PDU
+ * @am: AM state (for the SN length)
+ * @p: Read position, advanced past the entry
+ * @end: End of the PDU
+ * @sn: Returns the NACK_SN
+ * @range: Returns the number of SNs covered (1 without NACK range)
+ * @so_start: Returns SOstart, 0 without E2
+ * @so_end: Returns SOend, RLC_AM_SO_END without E2
+ * @more: Returns E1, set if another entry follows
+ *
+ * Return: 0 on success, -1 if the PDU is truncated
+ */
+static int rlc_am_parse_nack(const rlc_am_t *am, const uint8_t **p, const uint8_t *end, uint32_t *sn,
+                             uint32_t *range, uint16_t *so_start, uint16_t *so_end, int *more) {
+    const uint8_t *q = *p;
+    uint8_t flags;
+    if (am->cfg.sn_bits == RLC_AM_SN_BITS_LONG) {
+        if (end - q < 3) return -1;
+        *sn = ((uint32_t)q[0] << 10) | ((uint32_t)q[1] << 2) | (q[2] >> 6);
+        flags = (uint8_t)(q[2] << 2);
+        q += 3;
+    } else {
+        if (end - q < 2) return -1;
+        *sn = ((uint32_t)q[0] << 4) | (q[1] >> 4);
+        flags = (uint8_t)(q[1] << 4);
+        q += 2;
+    }
+    /* flags: E1 E2 E3 in the top three bits */
+    *more = (flags & 0x80) != 0;
+    *so_start = 0;
+    *so_end = RLC_AM_SO_END;
+    if (flags & 0x40) {
+        if (end - q < 4) return -1;
+        *so_start = (uint16_t)((q[0] << 8) | q[1]);
+        *so_end = (uint16_t)((q[2] << 8) | q[3]);
+        q += 4;
+    }
+    *range = 1;
+    if (flags & 0x20) {
+        if (end - q < 1) return -1;
+        *range = q[0];
+        q += 1;
+    }
+    *p = q;
+    return 0;
+}
+
+/* Maps a received SN onto the unwrapped transmitting window. */
+static inline uint32_t rlc_am_tx_unwrap(const rlc_am_t *am, uint32_t wire_sn) {
+    return am->tx_next_ack + ((wire_sn - am->tx_next_ack) & am->sn_mod);
+}
+
+/**
+ * rlc_am_status_rx - Process a received STATUS PDU
+ * @entity: RLC entity
+ * @am: Its AM state
+ * @pdu: STATUS PDU
+ * @pdu_size: Size of @pdu in bytes
+ *
+ * The PDU is validated before any state changes, then SDUs between
+ * NACKs are released in bulk and the NACKed bytes queued for
+ * retransmission (TS 38.322 5.3.3.3): SOstart applies to the first SN
+ * of a NACK, SOend to the last, the SNs in between go whole. Several
+ * entries may NACK byte ranges of the same SN. t-PollRetransmit stops
+ * when ACK_SN passes POLL_SN or a NACK covers it.
+ */
+static void rlc_am_status_rx(rlc_entity_t *entity, rlc_am_t *am, const uint8_t *pdu, size_t pdu_size) {
+    const uint8_t *end = pdu + pdu_size;
+    const uint8_t *p;
+    uint32_t ack_sn, nack_sn, range;
+    uint16_t so_start, so_end;
+    int more;
+
+    if (am->cfg.sn_bits == RLC_AM_SN_BITS_LONG) {
+        if (pdu_size < 3) return;
+        ack_sn = ((uint32_t)(pdu[0] & 0x0F) << 14) | ((uint32_t)pdu[1] << 6) | (pdu[2] >> 2);
+        more = (pdu[2] & 0x02) != 0;
+        p = pdu + 3;
+    } else {
+        if (pdu_size < 3) return;
+        ack_sn = ((uint32_t)(pdu[0] & 0x0F) << 8) | pdu[1];
+        more = (pdu[2] & 0x80) != 0;
+        p = pdu + 3;
+    }
+    uint32_t ack = rlc_am_tx_unwrap(am, ack_sn);
+    if (ack - am->tx_next_ack > am->tx_next - am->tx_next_ack) {
+        printf("RLC AM: STATUS PDU with ACK_SN %u outside the window, ignored\n", ack_sn);
+        return;
+    }
+
+    /* Validate every NACK first, so a malformed PDU changes nothing */
+    const uint8_t *nacks = p;
+    uint32_t cursor = am->tx_next_ack;
+    for (int e1 = more; e1;) {
+        if (rlc_am_parse_nack(am, &p, end, &nack_sn, &range, &so_start, &so_end, &e1) < 0 || range == 0 ||
+            (range == 1 && so_start > so_end)) {
+            printf("RLC AM: Malformed STATUS PDU, ignored\n");
+            return;
+        }
+        uint32_t nack = rlc_am_tx_unwrap(am, nack_sn);
+        if (nack - am->tx_next_ack < cursor - am->tx_next_ack ||
+            nack + range - am->tx_next_ack > ack - am->tx_next_ack) {
+            printf("RLC AM: STATUS PDU with NACK_SN %u out of order, ignored\n", nack_sn);
+            return;
+        }
+        /* Another entry may NACK more bytes of an SN whose tail this one left out */
+        cursor = nack + range - (so_end != RLC_AM_SO_END ? 1 : 0);
+    }
+
+    am->stats.status_rx++;
+    p = nacks;
+    cursor = am->tx_next_ack;
+    uint32_t next_ack = ack;
+    /* The STATUS PDU covers POLL_SN, positively or negatively: the poll was answered */
+    int poll_answered = (int32_t)(ack - am->poll_sn) > 0;
+    for (int e1 = more; e1;) {
+        rlc_am_parse_nack(am, &p, end, &nack_sn, &range, &so_start, &so_end, &e1);
+        uint32_t nack = rlc_am_tx_unwrap(am, nack_sn);
+        if (next_ack == ack)
+            next_ack = nack;
+        if (am->poll_sn - nack < range)
+            poll_answered = 1;
+        if (nack - am->tx_next_ack >= cursor - am->tx_next_ack)
+            rlc_am_release_acked(entity, am, cursor, nack);
+        for (uint32_t i = 0; i < range; i++)
+            rlc_am_queue_retx(entity, am, nack + i, i == 0 ? so_start : 0,
+                              i == range - 1 && so_end != RLC_AM_SO_END ? (size_t)so_end + 1 : SIZE_MAX);
+        am->stats.nacks_rx += range;
+        cursor = nack + range;
+    }
+    rlc_am_release_acked(entity, am, cursor, ack);
+
+    if (poll_answered)
+        timer_cancel(&entity->t_poll_retransmit);
+    am->tx_next_ack = next_ack;
+    rlc_entity_sync_mac(entity);
+    rlc_am_indicate_max_retx(entity, am);
+}
+
+/* Reassembly slot with the lowest SN in [from, to), NULL if none. */
+static rlc_um_slot_t *rlc_am_rx_slot(const rlc_entity_t *entity, uint32_t from, uint32_t to) {
+    rlc_um_rx_t *rx = entity->um_rx;
+    rlc_um_slot_t *found = NULL;
+    if (!rx) return NULL;
+    for (int i = 0; i < rx->num_slots; i++) {
+        rlc_um_slot_t *slot = &rx->slots[i];
+        if (slot->in_use && slot->sn - from < to - from && (!found || slot->sn - from < found->sn - from))
+            found = slot;
+    }
+    return found;
+}
+
+/* Missing bytes of a partly received SDU as SOstart/SOend pairs; returns their number. */
+static int rlc_am_slot_holes(const rlc_um_slot_t *slot, uint16_t *so_start, uint16_t *so_end) {
+    uint32_t from = 0;
+    int n = 0;
+    for (int i = 0; i < slot->num_ranges; i++) {
+        if (slot->ranges[i].start > from) {
+            so_start[n] = (uint16_t)from;
+            so_end[n++] = slot->ranges[i].start - 1;
+        }
+        from = slot->ranges[i].end;
+    }
+    /* The tail runs to the last byte, whether or not the SDU size is known */
+    if (!slot->sdu_size || from < slot->sdu_size) {
+        so_start[n] = (uint16_t)from;
+        so_end[n++] = RLC_AM_SO_END;
+    }
+    return n;
+}
+
+/* Bytes of a NACK entry: NACK_SN and flags, SOstart/SOend, NACK range. */
+static inline size_t rlc_am_nack_size(const rlc_am_t *am, int so, uint32_t range) {
+    return (am->cfg.sn_bits == RLC_AM_SN_BITS_LONG ? 3 : 2) + (so ? 4 : 0) + (range > 1 ? 1 : 0);
+}
+
+/**
+ * rlc_am_put_nack - Write one NACK entry of a STATUS PDU
+ * @am: AM state (for the SN length)
+ * @e: Where the entry goes
+ * @last_e1: Flags byte of the previous entry, which gets E1; updated
+ * @sn: First SN missing
+ * @range: SNs missing from @sn on
+ * @so: Non-zero to add @so_start and @so_end
+ * @so_start: SOstart
+ * @so_end: SOend
+ *
+ * Return: Bytes written, rlc_am_nack_size()
+ */
+static size_t rlc_am_put_nack(const rlc_am_t *am, uint8_t *e, uint8_t **last_e1, uint32_t sn, uint32_t range,
+                              int so, uint16_t so_start, uint16_t so_end) {
+    int long_sn = am->cfg.sn_bits == RLC_AM_SN_BITS_LONG;
+    size_t len = long_sn ? 3 : 2;
+    uint32_t wire_sn = sn & am->sn_mod;
+    if (*last_e1)
+        **last_e1 |= long_sn ? 0x20 : 0x08;
+    if (long_sn) {
+        e[0] = (wire_sn >> 10) & 0xFF;
+        e[1] = (wire_sn >> 2) & 0xFF;
+        e[2] = (uint8_t)((wire_sn & 0x03) << 6) | (so ? 0x10 : 0x00) | (range > 1 ? 0x08 : 0x00);
+        *last_e1 = &e[2];
+    } else {
+        e[0] = (wire_sn >> 4) & 0xFF;
+        e[1] = (uint8_t)((wire_sn & 0x0F) << 4) | (so ? 0x04 : 0x00) | (range > 1 ? 0x02 : 0x00);
+        *last_e1 = &e[1];
+    }
+    if (so) {
+        e[len] = (so_start >> 8) & 0xFF;
+        e[len + 1] = so_start & 0xFF;
+        e[len + 2] = (so_end >> 8) & 0xFF;
+        e[len + 3] = so_end & 0xFF;
+        len += 4;
+    }
+    if (range > 1)
+        e[len++] = (uint8_t)range;
+    return len;
+}
+
+/**
+ * rlc_am_status_pdu - Build a STATUS PDU of at most a given size
+ * @entity: RLC entity
+ * @am: Its AM state
+ * @max: Largest PDU allowed, at least RLC_AM_STATUS_MIN_SIZE
+ *
+ * SNs missing outright are NACKed in ranges; an SDU partly received in
+ * a reassembly slot gets one SOstart/SOend entry per hole, all or none
+ * of them. What does not fit is left for the next report, ACK_SN
+ * stopping at the first SN not reported.
+ *
+ * Return: STATUS PDU, or NULL on allocation failure
+ */
+static pktbuf_t *rlc_am_status_pdu(rlc_entity_t *entity, rlc_am_t *am, size_t max) {
+    pktbuf_t *pdu = pktbuf_alloc(max);
+    if (!pdu) return NULL;
+    uint8_t *buf = pktbuf_append(pdu, max);
+
+    uint16_t so_start[RLC_UM_MAX_RANGES + 1], so_end[RLC_UM_MAX_RANGES + 1];
+    size_t len = RLC_AM_STATUS_MIN_SIZE;
+    uint8_t *last_e1 = NULL;
+    uint32_t ack = am->rx_highest_status;
+    uint32_t sn = am->rx_next;
+
+    while ((sn = rlc_am_bitmap_find(am->rx_bitmap, am->window, sn, am->rx_highest_status, 0)) !=
+           am->rx_highest_status) {
+        uint32_t run_end = rlc_am_bitmap_find(am->rx_bitmap, am->window, sn, am->rx_highest_status, 1);
+        while (sn != run_end) {
+            rlc_um_slot_t *slot = rlc_am_rx_slot(entity, sn, run_end);
+            uint32_t whole_end = slot ? slot->sn : run_end;
+            while (sn != whole_end) {
+                uint32_t range = whole_end - sn;
+                if (range > RLC_AM_NACK_RANGE_MAX)
+                    range = RLC_AM_NACK_RANGE_MAX;
+                if (len + rlc_am_nack_size(am, 0, range) > max) {
+                    /* Out of room: the next STATUS PDU reports the rest */
+                    ack = sn;
+                    goto done;
+                }
+                len += rlc_am_put_nack(am, buf + len, &last_e1, sn, range, 0, 0, 0);
+                sn += range;
+            }
+            if (!slot) break;
+            int holes = rlc_am_slot_holes(slot, so_start, so_end);
+            if (len + (size_t)holes * rlc_am_nack_size(am, 1, 1) > max) {
+                ack = sn;
+                goto done;
+            }
+            for (int i = 0; i < holes; i++)
+                len += rlc_am_put_nack(am, buf + len, &last_e1, sn, 1, 1, so_start[i], so_end[i]);
+            sn++;
+        }
+    }
+
+done:;
+    /* Header: D/C=0, CPT=000, ACK_SN, E1 (first NACK follows) */
+    uint32_t wire_ack = ack & am->sn_mod;
+    int has_nacks = len > RLC_AM_STATUS_MIN_SIZE;
+    if (am->cfg.sn_bits == RLC_AM_SN_BITS_LONG) {
+        buf[0] = (wire_ack >> 14) & 0x0F;
+        buf[1] = (wire_ack >> 6) & 0xFF;
+        buf[2] = (uint8_t)((wire_ack & 0x3F) << 2) | (has_nacks ? 0x02 : 0x00);
+    } else {
+        buf[0] = (wire_ack >> 8) & 0x0F;
+        buf[1] = wire_ack & 0xFF;
+        buf[2] = has_nacks ? 0x80 : 0x00;
+    }
+    pktbuf_trim(pdu, max - len);
+    return pdu;
+}
+
+pktbuf_t *rlc_am_build_status(rlc_entity_t *entity) {
+    rlc_am_t *am = entity ? entity->am : NULL;
+    if (!am) return NULL;
+    return rlc_am_status_pdu(entity, am, RLC_AM_STATUS_MAX_SIZE);
+}
+
+/* --------------------------------------------------------------------------
+   Receiving Side
+   -------------------------------------------------------------------------- */
+
+/* Bytes are missing before the last one received of the SDU with this SN. */
+static inline int rlc_am_rx_partial(const rlc_entity_t *entity, uint32_t sn) {
+    return rlc_am_rx_slot(entity, sn, sn + 1) != NULL;
+}
+
+/* Starts t-Reassembly while SNs or bytes are missing below RX_Next_Highest. */
+static void rlc_am_reassembly_update(rlc_entity_t *entity, rlc_am_t *am) {
+    if (timer_armed(&entity->t_reassembly)) {
+        uint32_t trigger = am->rx_next_status_trigger - am->rx_next;
+        /* Stop once RX_Next caught up, or the trigger fell out of the window */
+        if (trigger == 0 || trigger > am->window)
+            timer_cancel(&entity->t_reassembly);
+    }
+    if (!timer_armed(&entity->t_reassembly) &&
+        (am->rx_next_highest - am->rx_next > 1 ||
+         (am->rx_next_highest - am->rx_next == 1 && rlc_am_rx_partial(entity, am->rx_next)))) {
+        timer_arm(timer_get_wheel(), &entity->t_reassembly, timer_ms(timer_get_wheel(), am->cfg.t_reassembly));
+        am->rx_next_status_trigger = am->rx_next_highest;
+    }
+}
+
+/**
+ * rlc_am_data_rx - Process a received AMD PDU or AMD PDU segment
+ * @entity: RLC entity
+ * @am: Its AM state
+ * @pdu: AMD PDU
+ * @pdu_size: Size of @pdu in bytes
+ *
+ * Implements TS 38.322 5.2.3.2: a complete SDU goes to PDCP at once,
+ * a segment to the reassembly slot of its SN until its bytes cover
+ * the SDU. RX_Next and RX_Highest_Status skip runs of complete SDUs
+ * with word-wide bitmap scans, and a poll triggers a STATUS report as
+ * soon as RX_Highest_Status has passed it.
+ */
+static void rlc_am_data_rx(rlc_entity_t *entity, rlc_am_t *am, uint8_t *pdu, size_t pdu_size) {
+    size_t header_size = rlc_am_header_size(am);
+    if (pdu_size <= header_size) {
+        printf("RLC AM: PDU too short for header\n");
+        return;
+    }
+    int poll = (pdu[0] & 0x40) != 0;
+    uint8_t si = (pdu[0] >> 4) & 0x03;
+    uint32_t wire_sn = header_size == 3
+        ? ((uint32_t)(pdu[0] & 0x03) << 16) | ((uint32_t)pdu[1] << 8) | pdu[2]
+        : ((uint32_t)(pdu[0] & 0x0F) << 8) | pdu[1];
+    size_t so = 0;
+    if (si == RLC_AM_SI_LAST || si == RLC_AM_SI_MIDDLE) {
+        if (pdu_size <= header_size + 2) {
+            printf("RLC AM: PDU too short for header\n");
+            return;
+        }
+        so = ((size_t)pdu[header_size] << 8) | pdu[header_size + 1];
+        header_size += 2;
+    }
+    uint32_t x = am->rx_next + ((wire_sn - am->rx_next) & am->sn_mod);
+    uint32_t idx = x & (am->window - 1);
+
+    if (x - am->rx_next >= am->window || rlc_am_bit_test(am->rx_bitmap, idx)) {
+        /* Duplicate or outside the receiving window: a poll is still answered */
+        am->stats.rx_discarded++;
+        if (poll)
+            am->status_triggered = 1;
+        rlc_entity_sync_mac(entity);
+        return;
+    }
+
+    uint8_t *sdu = pdu + header_size;
+    size_t sdu_size = pdu_size - header_size;
+    rlc_um_slot_t *slot;
+    if (si != 0) {
+        am->stats.rx_segments++;
+        slot = rlc_rx_segment(entity, x, so, sdu, sdu_size, si == RLC_AM_SI_LAST);
+        sdu = slot ? slot->buf : NULL;
+        sdu_size = slot ? slot->sdu_size : 0;
+    } else {
+        /* A retransmission sent whole supersedes the segments received */
+        slot = rlc_am_rx_slot(entity, x, x + 1);
+    }
+
+    if (x - am->rx_next >= am->rx_next_highest - am->rx_next)
+        am->rx_next_highest = x + 1;
+    if (sdu) {
+        rlc_am_bit_set(am->rx_bitmap, idx);
+        am->stats.rx_pdus++;
+        if (entity->pdcp)
+            pdcp_rx_pdu_burst(entity->pdcp, &sdu, &sdu_size, 1);
+        if (slot)
+            slot->in_use = 0;
+        if (x == am->rx_highest_status)
+            am->rx_highest_status = rlc_am_bitmap_find(am->rx_bitmap, am->window, x + 1, am->rx_next_highest, 0);
+        if (x == am->rx_next) {
+            uint32_t rx_next = rlc_am_bitmap_find(am->rx_bitmap, am->window, x + 1, am->rx_next_highest, 0);
+            rlc_am_bitmap_clear(am->rx_bitmap, am->window, am->rx_next, rx_next);
+            am->rx_next = rx_next;
+        }
+    }
+    rlc_am_reassembly_update(entity, am);
+
+    if (poll && !am->poll_pending) {
+        am->poll_pending = 1;
+        am->poll_pending_sn = x;
+    }
+    /* A poll is answered once RX_Highest_Status has moved past it */
+    if (am->poll_pending && (int32_t)(am->rx_highest_status - am->poll_pending_sn) > 0) {
+        am->poll_pending = 0;
+        am->status_triggered = 1;
+    }
+    rlc_entity_sync_mac(entity);
+}
+
+void rlc_am_rx_data(rlc_entity_t *entity, uint8_t *pdu, size_t pdu_size) {
+    if (!entity || !pdu || pdu_size == 0) return;
+    rlc_am_t *am = entity->am;
+    if (!am) {
+        printf("RLC AM: Entity has no AM state, dropping PDU\n");
+        return;
+    }
+    if (pdu[0] & 0x80) {
+        rlc_am_data_rx(entity, am, pdu, pdu_size);
+    } else if (((pdu[0] >> 4) & 0x07) == RLC_AM_CPT_STATUS) {
+        rlc_am_status_rx(entity, am, pdu, pdu_size);
+    } else {
+        printf("RLC AM: Unknown control PDU type %d, discarded\n", (pdu[0] >> 4) & 0x07);
+    }
+}
+
+/* --------------------------------------------------------------------------
+   Timers
+   -------------------------------------------------------------------------- */
+
+/* TS 38.322 5.3.3.4: retransmit the last SDU sent to carry the poll. */
+static void rlc_am_poll_retransmit(rlc_entity_t *entity, rlc_am_t *am) {
+    if (rlc_am_tx_idle(entity, am, 0) && am->tx_next != am->tx_next_ack) {
+        uint32_t sn = am->tx_next - 1;
+        /* Already acknowledged between NACKs: any unacknowledged SDU will do */
+        if (!am->tx_sdus[sn & (am->window - 1)])
+            sn = am->tx_next_ack;
+        rlc_am_queue_retx(entity, am, sn, 0, SIZE_MAX);
+    }
+    am->poll_next = 1;
+    rlc_entity_sync_mac(entity);
+    rlc_am_indicate_max_retx(entity, am);
+}
+
+static void rlc_am_poll_retransmit_expired(timer_node_t *node) {
+    rlc_entity_t *entity = timer_entry(node, rlc_entity_t, t_poll_retransmit);
+    rlc_am_poll_retransmit(entity, entity->am);
+}
+
+/**
+ * rlc_am_tx_lost - Poll at once after HARQ gave up on AMD PDUs
+ * @entity: RLC entity in RLC_MODE_AM
+ *
+ * The TB may have carried the poll itself, so waiting would cost a
+ * full t-PollRetransmit. With every SN acknowledged the TB held only
+ * STATUS PDUs, which the peer's next poll asks for again.
+ */
+void rlc_am_tx_lost(rlc_entity_t *entity) {
+    rlc_am_t *am = entity->am;
+    am->stats.harq_losses++;
+    if (am->tx_next == am->tx_next_ack) return;
+    timer_cancel(&entity->t_poll_retransmit);
+    rlc_am_poll_retransmit(entity, am);
+}
+
+/* TS 38.322 5.2.3.2.4 */
+static void rlc_am_reassembly_expired(timer_node_t *node) {
+    rlc_entity_t *entity = timer_entry(node, rlc_entity_t, t_reassembly);
+    rlc_am_t *am = entity->am;
+    am->rx_highest_status = rlc_am_bitmap_find(am->rx_bitmap, am->window, am->rx_next_status_trigger,
+                                               am->rx_next_highest, 0);
+    if (am->rx_next_highest - am->rx_highest_status > 1 ||
+        (am->rx_next_highest - am->rx_highest_status == 1 && rlc_am_rx_partial(entity, am->rx_highest_status))) {
+        timer_arm(timer_get_wheel(), node, timer_ms(timer_get_wheel(), am->cfg.t_reassembly));
+        am->rx_next_status_trigger = am->rx_next_highest;
+    }
+    am->status_triggered = 1;
+    rlc_entity_sync_mac(entity);
+}
+
+/* Lets the STATUS report t-StatusProhibit held back count again in the buffer status. */
+static void rlc_am_status_prohibit_expired(timer_node_t *node) {
+    rlc_entity_t *entity = timer_entry(node, rlc_entity_t, t_status_prohibit);
+    rlc_entity_sync_mac(entity);
+}
@@ -0,0 +1,235 @@
+#include "rlc.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* UM header sizes: SN + SI, plus a 16-bit SO on segments after the first */
+#define RLC_UM_HEADER_SIZE     2
+#define RLC_UM_SO_HEADER_SIZE  4
+
+int rlc_tx_queue_init(rlc_entity_t *entity) {
+    /* Cache-line aligned so the producer and consumer fields never share a line */
+    rlc_tx_queue_t *q = aligned_alloc(RING_CACHE_LINE, sizeof(rlc_tx_queue_t));
+    if (!q) return -1;
+    memset(q, 0, sizeof(*q));
+    if (spsc_ring_init(&q->ring, RLC_TX_QUEUE_SIZE) < 0) {
+        free(q);
+        return -1;
+    }
+    entity->txq = q;
+    return 0;
+}
+
+void rlc_tx_queue_flush(rlc_entity_t *entity) {
+    rlc_tx_queue_t *q = entity->txq;
+    pktbuf_t *sdu;
+    if (!q) return;
+    pktbuf_free(q->cur);
+    q->cur = NULL;
+    q->so = 0;
+    while ((sdu = spsc_ring_pop(&q->ring)) != NULL)
+        pktbuf_free(sdu);
+    q->deq_bytes = q->enq_bytes;
+    rlc_entity_sync_mac(entity);
+}
+
+void rlc_tx_queue_free(rlc_entity_t *entity) {
+    if (!entity->txq) return;
+    rlc_tx_queue_flush(entity);
+    spsc_ring_free(&entity->txq->ring);
+    free(entity->txq);
+    entity->txq = NULL;
+}
+
+int rlc_tx_enqueue(rlc_entity_t *entity, pktbuf_t *sdu) {
+    rlc_tx_queue_t *q = entity ? entity->txq : NULL;
+    if (!q || !sdu) {
+        pktbuf_free(sdu);
+        return -1;
+    }
+    if (sdu->len > MAC_MAX_SDU_SIZE) {
+        q->oversized++;
+        pktbuf_free(sdu);
+        return -1;
+    }
+    /*
+     * Count the bytes before the SDU becomes visible, so a reader never
+     * sees the consumer's counter ahead of ours.
+     */
+    size_t len = sdu->len;
+    size_t bytes = q->enq_bytes + len;
+    __atomic_store_n(&q->enq_bytes, bytes, __ATOMIC_RELEASE);
+    if (spsc_ring_push(&q->ring, sdu) < 0) {
+        __atomic_store_n(&q->enq_bytes, bytes - len, __ATOMIC_RELEASE);
+        pktbuf_free(sdu);
+        return -1;
+    }
+    return 0;
+}
+
+pktbuf_t *rlc_tx_dequeue(rlc_entity_t *entity) {
+    rlc_tx_queue_t *q = entity ? entity->txq : NULL;
+    pktbuf_t *sdu;
+    if (!q || entity->mode == RLC_MODE_AM) return NULL;
+    if (q->cur) {
+        /* Rest of an SDU cut by rlc_build_pdus() */
+        sdu = q->so ? pktbuf_view(q->cur, q->so, q->cur->len - q->so) : q->cur;
+        if (!sdu) return NULL;
+        if (sdu != q->cur)
+            pktbuf_free(q->cur);
+        q->cur = NULL;
+        q->so = 0;
+    } else {
+        sdu = spsc_ring_pop(&q->ring);
+        if (!sdu) return NULL;
+    }
+    __atomic_store_n(&q->deq_bytes, q->deq_bytes + sdu->len, __ATOMIC_RELEASE);
+    rlc_entity_sync_mac(entity);
+    return sdu;
+}
+
+size_t rlc_tx_queued_bytes(const rlc_entity_t *entity) {
+    const rlc_tx_queue_t *q = entity ? entity->txq : NULL;
+    if (!q) return 0;
+    /* Consumer first: its count never passes the producer's seen afterwards */
+    size_t deq = __atomic_load_n(&q->deq_bytes, __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&q->enq_bytes, __ATOMIC_ACQUIRE) - deq;
+}
+
+size_t rlc_tx_discard(rlc_entity_t *entity, uint32_t count) {
+    rlc_tx_queue_t *q = entity ? entity->txq : NULL;
+    pktbuf_t *sdu;
+    uint32_t sdu_count;
+    size_t n = 0, bytes = 0;
+    if (!q || !entity->pdcp) return 0;
+    /* @cur has sent a segment already, so only the ring is looked at */
+    while ((sdu = spsc_ring_peek(&q->ring)) != NULL &&
+           pdcp_tx_pdu_count(entity->pdcp, sdu->data, sdu->len, &sdu_count) == 0 &&
+           (int32_t)(sdu_count - count) <= 0) {
+        spsc_ring_pop(&q->ring);
+        bytes += sdu->len;
+        pktbuf_free(sdu);
+        n++;
+    }
+    if (n == 0) return 0;
+    q->discarded += n;
+    __atomic_store_n(&q->deq_bytes, q->deq_bytes + bytes, __ATOMIC_RELEASE);
+    rlc_entity_sync_mac(entity);
+    return n;
+}
+
+size_t rlc_segment_fit(size_t budget, size_t header) {
+    size_t pdu;
+    if (budget <= 2 + header)
+        return 0;
+    if (budget - 2 <= 255)
+        pdu = budget - 2;
+    else if (budget - 3 >= 256)
+        pdu = budget - 3;
+    else
+        pdu = 255;
+    return pdu - header;
+}
+
+/* Builds an UM PDU carrying [so, so + len) of the SDU. */
+static pktbuf_t *rlc_um_build_pdu(rlc_entity_t *entity, pktbuf_t *sdu, size_t so, size_t len, uint8_t si) {
+    size_t header_size = so ? RLC_UM_SO_HEADER_SIZE : RLC_UM_HEADER_SIZE;
+    pktbuf_t *pdu;
+    uint8_t *header;
+
+    if (si == 0 && pktbuf_headroom(sdu) >= header_size) {
+        /* Whole SDU: prepend in place and hand over our reference */
+        pdu = sdu;
+        header = pktbuf_prepend(pdu, header_size);
+    } else {
+        pktbuf_t *payload = pktbuf_view(sdu, so, len);
+        pdu = pktbuf_alloc(header_size);
+        if (!pdu || !payload) {
+            pktbuf_free(pdu);
+            pktbuf_free(payload);
+            return NULL;
+        }
+        header = pktbuf_append(pdu, header_size);
+        pktbuf_chain(pdu, payload);
+        /* The view holds its own reference on the SDU bytes */
+        if (si == 0 || si == 3)
+            pktbuf_free(sdu);
+    }
+    header[0] = entity->tx_next;
+    header[1] = si;
+    if (so) {
+        header[2] = (so >> 8) & 0xFF;
+        header[3] = so & 0xFF;
+    }
+    return pdu;
+}
+
+/* TM and UM: whole SDUs in order, the one that does not fit cut (UM only). */
+static size_t rlc_tx_fill(rlc_entity_t *entity, size_t grant, pktbuf_t **out, size_t max_pdus, size_t *sent) {
+    rlc_tx_queue_t *q = entity->txq;
+    int segmenting = entity->mode == RLC_MODE_UM;
+    size_t budget = grant, n = 0;
+
+    while (n < max_pdus) {
+        if (!q->cur && !(q->cur = spsc_ring_pop(&q->ring)))
+            break;
+        pktbuf_t *sdu = q->cur;
+        size_t left = sdu->len - q->so;
+        size_t header = !segmenting ? 0 : q->so ? RLC_UM_SO_HEADER_SIZE : RLC_UM_HEADER_SIZE;
+        size_t whole = header + left;
+        size_t len = left;
+
+        if (whole + mac_subheader_size(whole) > budget) {
+            if (!segmenting) break;
+            len = rlc_segment_fit(budget, header);
+            if (len == 0) break;
+        }
+
+        pktbuf_t *pdu;
+        if (!segmenting) {
+            pdu = sdu;
+        } else {
+            /* SI: 0 whole SDU, 1 first, 2 middle, 3 last segment */
+            uint8_t si = (len == left) ? (q->so ? 3 : 0) : (q->so ? 2 : 1);
+            pdu = rlc_um_build_pdu(entity, sdu, q->so, len, si);
+            if (!pdu) break;
+        }
+
+        size_t pdu_len = header + len;
+        budget -= pdu_len + mac_subheader_size(pdu_len);
+        *sent += len;
+        out[n++] = pdu;
+        if (len == left) {
+            q->cur = NULL;
+            q->so = 0;
+            entity->tx_next++;
+        } else {
+            q->so += len;
+        }
+    }
+    return n;
+}
+
+size_t rlc_build_pdus(rlc_entity_t *entity, size_t grant, pktbuf_t **out, size_t max_pdus) {
+    if (!entity || !out || !entity->txq) return 0;
+    rlc_tx_queue_t *q = entity->txq;
+    size_t sent = 0;
+    size_t n = entity->mode == RLC_MODE_AM ? rlc_am_build_pdus(entity, grant, out, max_pdus, &sent)
+                                           : rlc_tx_fill(entity, grant, out, max_pdus, &sent);
+    /* One store per grant: the producer's side never touches this line */
+    if (sent)
+        __atomic_store_n(&q->deq_bytes, q->deq_bytes + sent, __ATOMIC_RELEASE);
+    rlc_entity_sync_mac(entity);
+    return n;
+}
+
+void rlc_tx_lost(rlc_entity_t *entity, size_t pdus, size_t bytes) {
+    if (!entity || pdus == 0) return;
+    if (entity->mode == RLC_MODE_AM) {
+        if (entity->am)
+            rlc_am_tx_lost(entity);
+        return;
+    }
+    if (!entity->txq) return;
+    entity->txq->lost_pdus += pdus;
+    entity->txq->lost_bytes += bytes;
+}
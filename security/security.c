@@ -0,0 +1,650 @@
+#include "security.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+#define SEC_HAVE_AESNI 1
+#endif
+
+/* --------------------------------------------------------------------------
+   AES-128 Tables (FIPS-197)
+   -------------------------------------------------------------------------- */
+static const uint8_t aes_sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static const uint32_t aes_te0[256] = {
+    0xc66363a5U, 0xf87c7c84U, 0xee777799U, 0xf67b7b8dU, 0xfff2f20dU, 0xd66b6bbdU,
+    0xde6f6fb1U, 0x91c5c554U, 0x60303050U, 0x02010103U, 0xce6767a9U, 0x562b2b7dU,
+    0xe7fefe19U, 0xb5d7d762U, 0x4dababe6U, 0xec76769aU, 0x8fcaca45U, 0x1f82829dU,
+    0x89c9c940U, 0xfa7d7d87U, 0xeffafa15U, 0xb25959ebU, 0x8e4747c9U, 0xfbf0f00bU,
+    0x41adadecU, 0xb3d4d467U, 0x5fa2a2fdU, 0x45afafeaU, 0x239c9cbfU, 0x53a4a4f7U,
+    0xe4727296U, 0x9bc0c05bU, 0x75b7b7c2U, 0xe1fdfd1cU, 0x3d9393aeU, 0x4c26266aU,
+    0x6c36365aU, 0x7e3f3f41U, 0xf5f7f702U, 0x83cccc4fU, 0x6834345cU, 0x51a5a5f4U,
+    0xd1e5e534U, 0xf9f1f108U, 0xe2717193U, 0xabd8d873U, 0x62313153U, 0x2a15153fU,
+    0x0804040cU, 0x95c7c752U, 0x46232365U, 0x9dc3c35eU, 0x30181828U, 0x379696a1U,
+    0x0a05050fU, 0x2f9a9ab5U, 0x0e070709U, 0x24121236U, 0x1b80809bU, 0xdfe2e23dU,
+    0xcdebeb26U, 0x4e272769U, 0x7fb2b2cdU, 0xea75759fU, 0x1209091bU, 0x1d83839eU,
+    0x582c2c74U, 0x341a1a2eU, 0x361b1b2dU, 0xdc6e6eb2U, 0xb45a5aeeU, 0x5ba0a0fbU,
+    0xa45252f6U, 0x763b3b4dU, 0xb7d6d661U, 0x7db3b3ceU, 0x5229297bU, 0xdde3e33eU,
+    0x5e2f2f71U, 0x13848497U, 0xa65353f5U, 0xb9d1d168U, 0x00000000U, 0xc1eded2cU,
+    0x40202060U, 0xe3fcfc1fU, 0x79b1b1c8U, 0xb65b5bedU, 0xd46a6abeU, 0x8dcbcb46U,
+    0x67bebed9U, 0x7239394bU, 0x944a4adeU, 0x984c4cd4U, 0xb05858e8U, 0x85cfcf4aU,
+    0xbbd0d06bU, 0xc5efef2aU, 0x4faaaae5U, 0xedfbfb16U, 0x864343c5U, 0x9a4d4dd7U,
+    0x66333355U, 0x11858594U, 0x8a4545cfU, 0xe9f9f910U, 0x04020206U, 0xfe7f7f81U,
+    0xa05050f0U, 0x783c3c44U, 0x259f9fbaU, 0x4ba8a8e3U, 0xa25151f3U, 0x5da3a3feU,
+    0x804040c0U, 0x058f8f8aU, 0x3f9292adU, 0x219d9dbcU, 0x70383848U, 0xf1f5f504U,
+    0x63bcbcdfU, 0x77b6b6c1U, 0xafdada75U, 0x42212163U, 0x20101030U, 0xe5ffff1aU,
+    0xfdf3f30eU, 0xbfd2d26dU, 0x81cdcd4cU, 0x180c0c14U, 0x26131335U, 0xc3ecec2fU,
+    0xbe5f5fe1U, 0x359797a2U, 0x884444ccU, 0x2e171739U, 0x93c4c457U, 0x55a7a7f2U,
+    0xfc7e7e82U, 0x7a3d3d47U, 0xc86464acU, 0xba5d5de7U, 0x3219192bU, 0xe6737395U,
+    0xc06060a0U, 0x19818198U, 0x9e4f4fd1U, 0xa3dcdc7fU, 0x44222266U, 0x542a2a7eU,
+    0x3b9090abU, 0x0b888883U, 0x8c4646caU, 0xc7eeee29U, 0x6bb8b8d3U, 0x2814143cU,
+    0xa7dede79U, 0xbc5e5ee2U, 0x160b0b1dU, 0xaddbdb76U, 0xdbe0e03bU, 0x64323256U,
+    0x743a3a4eU, 0x140a0a1eU, 0x924949dbU, 0x0c06060aU, 0x4824246cU, 0xb85c5ce4U,
+    0x9fc2c25dU, 0xbdd3d36eU, 0x43acacefU, 0xc46262a6U, 0x399191a8U, 0x319595a4U,
+    0xd3e4e437U, 0xf279798bU, 0xd5e7e732U, 0x8bc8c843U, 0x6e373759U, 0xda6d6db7U,
+    0x018d8d8cU, 0xb1d5d564U, 0x9c4e4ed2U, 0x49a9a9e0U, 0xd86c6cb4U, 0xac5656faU,
+    0xf3f4f407U, 0xcfeaea25U, 0xca6565afU, 0xf47a7a8eU, 0x47aeaee9U, 0x10080818U,
+    0x6fbabad5U, 0xf0787888U, 0x4a25256fU, 0x5c2e2e72U, 0x381c1c24U, 0x57a6a6f1U,
+    0x73b4b4c7U, 0x97c6c651U, 0xcbe8e823U, 0xa1dddd7cU, 0xe874749cU, 0x3e1f1f21U,
+    0x964b4bddU, 0x61bdbddcU, 0x0d8b8b86U, 0x0f8a8a85U, 0xe0707090U, 0x7c3e3e42U,
+    0x71b5b5c4U, 0xcc6666aaU, 0x904848d8U, 0x06030305U, 0xf7f6f601U, 0x1c0e0e12U,
+    0xc26161a3U, 0x6a35355fU, 0xae5757f9U, 0x69b9b9d0U, 0x17868691U, 0x99c1c158U,
+    0x3a1d1d27U, 0x279e9eb9U, 0xd9e1e138U, 0xebf8f813U, 0x2b9898b3U, 0x22111133U,
+    0xd26969bbU, 0xa9d9d970U, 0x078e8e89U, 0x339494a7U, 0x2d9b9bb6U, 0x3c1e1e22U,
+    0x15878792U, 0xc9e9e920U, 0x87cece49U, 0xaa5555ffU, 0x50282878U, 0xa5dfdf7aU,
+    0x038c8c8fU, 0x59a1a1f8U, 0x09898980U, 0x1a0d0d17U, 0x65bfbfdaU, 0xd7e6e631U,
+    0x844242c6U, 0xd06868b8U, 0x824141c3U, 0x299999b0U, 0x5a2d2d77U, 0x1e0f0f11U,
+    0x7bb0b0cbU, 0xa85454fcU, 0x6dbbbbd6U, 0x2c16163aU
+};
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define GETU32(p) (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | \
+                   ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+#define PUTU32(p, v) do { (p)[0] = (uint8_t)((v) >> 24); (p)[1] = (uint8_t)((v) >> 16); \
+                          (p)[2] = (uint8_t)((v) >> 8); (p)[3] = (uint8_t)(v); } while (0)
+
+/* --------------------------------------------------------------------------
+   Key Expansion
+   -------------------------------------------------------------------------- */
+void aes128_expand_key(aes128_key_t *ks, const uint8_t key[SEC_KEY_LEN]) {
+    static const uint8_t rcon[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+    uint8_t *rk = ks->rk;
+    memcpy(rk, key, SEC_KEY_LEN);
+    for (int i = 4; i < 44; i++) {
+        uint8_t t[4];
+        memcpy(t, rk + (i - 1) * 4, 4);
+        if (i % 4 == 0) {
+            /* RotWord, SubWord and round constant */
+            uint8_t t0 = t[0];
+            t[0] = aes_sbox[t[1]] ^ rcon[i / 4 - 1];
+            t[1] = aes_sbox[t[2]];
+            t[2] = aes_sbox[t[3]];
+            t[3] = aes_sbox[t0];
+        }
+        for (int j = 0; j < 4; j++)
+            rk[i * 4 + j] = rk[(i - 4) * 4 + j] ^ t[j];
+    }
+}
+
+/* --------------------------------------------------------------------------
+   Portable Implementation
+   -------------------------------------------------------------------------- */
+static void aes128_encrypt_portable(const aes128_key_t *ks, const uint8_t in[16], uint8_t out[16]) {
+    const uint8_t *rk = ks->rk;
+    uint32_t s0 = GETU32(in) ^ GETU32(rk);
+    uint32_t s1 = GETU32(in + 4) ^ GETU32(rk + 4);
+    uint32_t s2 = GETU32(in + 8) ^ GETU32(rk + 8);
+    uint32_t s3 = GETU32(in + 12) ^ GETU32(rk + 12);
+    uint32_t t0, t1, t2, t3;
+
+    for (int r = 1; r < 10; r++) {
+        rk += 16;
+        t0 = aes_te0[s0 >> 24] ^ ROR32(aes_te0[(s1 >> 16) & 0xff], 8) ^
+             ROR32(aes_te0[(s2 >> 8) & 0xff], 16) ^ ROR32(aes_te0[s3 & 0xff], 24) ^ GETU32(rk);
+        t1 = aes_te0[s1 >> 24] ^ ROR32(aes_te0[(s2 >> 16) & 0xff], 8) ^
+             ROR32(aes_te0[(s3 >> 8) & 0xff], 16) ^ ROR32(aes_te0[s0 & 0xff], 24) ^ GETU32(rk + 4);
+        t2 = aes_te0[s2 >> 24] ^ ROR32(aes_te0[(s3 >> 16) & 0xff], 8) ^
+             ROR32(aes_te0[(s0 >> 8) & 0xff], 16) ^ ROR32(aes_te0[s1 & 0xff], 24) ^ GETU32(rk + 8);
+        t3 = aes_te0[s3 >> 24] ^ ROR32(aes_te0[(s0 >> 16) & 0xff], 8) ^
+             ROR32(aes_te0[(s1 >> 8) & 0xff], 16) ^ ROR32(aes_te0[s2 & 0xff], 24) ^ GETU32(rk + 12);
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    /* Final round: SubBytes, ShiftRows, AddRoundKey (no MixColumns) */
+    rk += 16;
+    t0 = ((uint32_t)aes_sbox[s0 >> 24] << 24) | ((uint32_t)aes_sbox[(s1 >> 16) & 0xff] << 16) |
+         ((uint32_t)aes_sbox[(s2 >> 8) & 0xff] << 8) | aes_sbox[s3 & 0xff];
+    t1 = ((uint32_t)aes_sbox[s1 >> 24] << 24) | ((uint32_t)aes_sbox[(s2 >> 16) & 0xff] << 16) |
+         ((uint32_t)aes_sbox[(s3 >> 8) & 0xff] << 8) | aes_sbox[s0 & 0xff];
+    t2 = ((uint32_t)aes_sbox[s2 >> 24] << 24) | ((uint32_t)aes_sbox[(s3 >> 16) & 0xff] << 16) |
+         ((uint32_t)aes_sbox[(s0 >> 8) & 0xff] << 8) | aes_sbox[s1 & 0xff];
+    t3 = ((uint32_t)aes_sbox[s3 >> 24] << 24) | ((uint32_t)aes_sbox[(s0 >> 16) & 0xff] << 16) |
+         ((uint32_t)aes_sbox[(s1 >> 8) & 0xff] << 8) | aes_sbox[s2 & 0xff];
+    PUTU32(out, t0 ^ GETU32(rk));
+    PUTU32(out + 4, t1 ^ GETU32(rk + 4));
+    PUTU32(out + 8, t2 ^ GETU32(rk + 8));
+    PUTU32(out + 12, t3 ^ GETU32(rk + 12));
+}
+
+/* Builds the counter block COUNT | BEARER | DIRECTION | 0^26 | 0^64. */
+static void nea2_init_counter(uint8_t ctr[16], uint32_t count, uint8_t bearer, uint8_t direction) {
+    memset(ctr, 0, 16);
+    PUTU32(ctr, count);
+    ctr[4] = (uint8_t)(((bearer & 0x1f) << 3) | ((direction & 0x01) << 2));
+}
+
+static void nea2_crypt_portable(const aes128_key_t *ks, uint32_t count, uint8_t bearer,
+                                uint8_t direction, uint8_t *data, size_t len) {
+    uint8_t ctr[16], keystream[16];
+    nea2_init_counter(ctr, count, bearer, direction);
+    uint64_t block = 0;
+    while (len > 0) {
+        /* Only the low 64 bits carry the block counter */
+        for (int i = 0; i < 8; i++)
+            ctr[15 - i] = (uint8_t)(block >> (8 * i));
+        aes128_encrypt_portable(ks, ctr, keystream);
+        size_t n = len < 16 ? len : 16;
+        for (size_t i = 0; i < n; i++)
+            data[i] ^= keystream[i];
+        data += n;
+        len -= n;
+        block++;
+    }
+}
+
+static void nea2_crypt_burst_portable(const aes128_key_t *ks, const uint32_t *counts, uint8_t bearer,
+                                      uint8_t direction, uint8_t *const *data, const size_t *lens, size_t n) {
+    /* Table lookups gain nothing from interleaving PDUs */
+    for (size_t i = 0; i < n; i++)
+        nea2_crypt_portable(ks, counts[i], bearer, direction, data[i], lens[i]);
+}
+
+/* --------------------------------------------------------------------------
+   128-NIA2 (AES-CMAC) fused with 128-NEA2
+   -------------------------------------------------------------------------- */
+typedef void (*aes_block_fn)(const aes128_key_t *, const uint8_t *, uint8_t *);
+
+static inline void xor16(uint8_t *dst, const uint8_t *src) {
+    for (int i = 0; i < 16; i++)
+        dst[i] ^= src[i];
+}
+
+/* Counter block of keystream block @block: IV with the low 64 bits replaced. */
+static inline void nea2_counter_block(uint8_t ctr[16], const uint8_t iv[16], uint64_t block) {
+    memcpy(ctr, iv, 8);
+    for (int i = 0; i < 8; i++)
+        ctr[15 - i] = (uint8_t)(block >> (8 * i));
+}
+
+/* Final CMAC step over the last 1..32 message bytes (RFC 4493 2.4). */
+static void cmac_finish(aes_block_fn enc, const nia2_key_t *ik, uint8_t x[16],
+                        const uint8_t *last, size_t n) {
+    if (n > 16) {
+        xor16(x, last);
+        enc(&ik->ks, x, x);
+        last += 16;
+        n -= 16;
+    }
+    uint8_t m[16] = { 0 };
+    memcpy(m, last, n);
+    if (n == 16) {
+        xor16(m, ik->k1);
+    } else {
+        m[n] = 0x80;
+        xor16(m, ik->k2);
+    }
+    xor16(x, m);
+    enc(&ik->ks, x, x);
+}
+
+/*
+ * Completes a fused pass once the full 16-byte data blocks are done.
+ * @x: CMAC chaining value, @pend: full message block not yet absorbed
+ * (NULL if none), @stage: the @o message bytes that follow it, @tail:
+ * the last @rem data bytes followed by the 4-byte MAC-I, @block: index
+ * of the keystream block covering @tail.
+ */
+static int sec_fused_tail(aes_block_fn enc, const aes128_key_t *cks, const nia2_key_t *ik,
+                          const uint8_t iv[16], uint64_t block, uint8_t x[16], const uint8_t *pend,
+                          const uint8_t *stage, size_t o, uint8_t *tail, size_t rem, int rx) {
+    uint8_t ks[32], ctr[16], last[32], mac[16];
+    size_t span = rem + SEC_MAC_LEN;
+    if (cks) {
+        nea2_counter_block(ctr, iv, block);
+        enc(cks, ctr, ks);
+        if (span > 16) {
+            nea2_counter_block(ctr, iv, block + 1);
+            enc(cks, ctr, ks + 16);
+        }
+        if (rx)
+            for (size_t i = 0; i < span; i++)
+                tail[i] ^= ks[i];
+    }
+    if (pend) {
+        xor16(x, pend);
+        enc(&ik->ks, x, x);
+    }
+    memcpy(last, stage, o);
+    memcpy(last + o, tail, rem);
+    cmac_finish(enc, ik, x, last, o + rem);
+    memcpy(mac, x, SEC_MAC_LEN);
+
+    if (rx) {
+        uint8_t diff = 0;
+        for (size_t i = 0; i < SEC_MAC_LEN; i++)
+            diff |= (uint8_t)(mac[i] ^ tail[rem + i]);
+        return diff ? -1 : 0;
+    }
+    memcpy(tail + rem, mac, SEC_MAC_LEN);
+    if (cks)
+        for (size_t i = 0; i < span; i++)
+            tail[i] ^= ks[i];
+    return 0;
+}
+
+/*
+ * One pass over @data: each 16-byte block is read once, ciphered or
+ * deciphered, and its plaintext absorbed into the CMAC of
+ * COUNT | BEARER | DIRECTION | 0^26 || header || data. The CMAC block
+ * of iteration i ends o = 8 + hdr_len bytes into plaintext block i, so
+ * it is absorbed one iteration later, once that plaintext is known.
+ */
+static int sec_fused_portable(const aes128_key_t *cks, const nia2_key_t *ik, uint32_t count,
+                              uint8_t bearer, uint8_t direction, const uint8_t *hdr, size_t hdr_len,
+                              uint8_t *data, size_t len, int rx) {
+    uint8_t iv[16], ctr[16], ks[16], plain[16], x[16] = { 0 }, stage[16], pend[16];
+    int have_pend = 0;
+    size_t o = 8 + hdr_len;
+    nea2_init_counter(iv, count, bearer, direction);
+    memcpy(stage, iv, 8);
+    memcpy(stage + 8, hdr, hdr_len);
+
+    size_t nfull = len / 16;
+    for (size_t i = 0; i < nfull; i++) {
+        uint8_t *d = data + 16 * i;
+        if (have_pend) {
+            xor16(x, pend);
+            aes128_encrypt_portable(&ik->ks, x, x);
+        }
+        if (cks) {
+            nea2_counter_block(ctr, iv, i);
+            aes128_encrypt_portable(cks, ctr, ks);
+        }
+        if (rx) {
+            if (cks) xor16(d, ks);
+            memcpy(plain, d, 16);
+        } else {
+            memcpy(plain, d, 16);
+            if (cks) xor16(d, ks);
+        }
+        memcpy(pend, stage, o);
+        memcpy(pend + o, plain, 16 - o);
+        memcpy(stage, plain + 16 - o, o);
+        have_pend = 1;
+    }
+    return sec_fused_tail(aes128_encrypt_portable, cks, ik, iv, nfull, x, have_pend ? pend : NULL,
+                          stage, o, data + 16 * nfull, len - 16 * nfull, rx);
+}
+
+/* --------------------------------------------------------------------------
+   AES-NI Implementation
+   -------------------------------------------------------------------------- */
+#ifdef SEC_HAVE_AESNI
+#define AESNI_TARGET __attribute__((target("aes,sse2")))
+
+AESNI_TARGET
+static void aes128_encrypt_aesni(const aes128_key_t *ks, const uint8_t in[16], uint8_t out[16]) {
+    const __m128i *rk = (const __m128i *)ks->rk;
+    __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), _mm_load_si128(&rk[0]));
+    for (int r = 1; r < 10; r++)
+        b = _mm_aesenc_si128(b, _mm_load_si128(&rk[r]));
+    b = _mm_aesenclast_si128(b, _mm_load_si128(&rk[10]));
+    _mm_storeu_si128((__m128i *)out, b);
+}
+
+AESNI_TARGET
+static void nea2_crypt_aesni(const aes128_key_t *ks, uint32_t count, uint8_t bearer,
+                             uint8_t direction, uint8_t *data, size_t len) {
+    const __m128i *rkp = (const __m128i *)ks->rk;
+    __m128i rk[11];
+    for (int r = 0; r < 11; r++)
+        rk[r] = _mm_load_si128(&rkp[r]);
+
+    uint8_t iv[16];
+    uint64_t iv_hi;
+    nea2_init_counter(iv, count, bearer, direction);
+    memcpy(&iv_hi, iv, 8);
+    uint64_t block = 0;
+
+    /* Eight independent blocks keep the AES pipeline full */
+    while (len >= 8 * 16) {
+        __m128i b[8];
+        for (int i = 0; i < 8; i++)
+            b[i] = _mm_xor_si128(_mm_set_epi64x((long long)__builtin_bswap64(block + i),
+                                                (long long)iv_hi), rk[0]);
+        for (int r = 1; r < 10; r++)
+            for (int i = 0; i < 8; i++)
+                b[i] = _mm_aesenc_si128(b[i], rk[r]);
+        for (int i = 0; i < 8; i++) {
+            b[i] = _mm_aesenclast_si128(b[i], rk[10]);
+            __m128i d = _mm_loadu_si128((const __m128i *)(data + 16 * i));
+            _mm_storeu_si128((__m128i *)(data + 16 * i), _mm_xor_si128(d, b[i]));
+        }
+        data += 8 * 16;
+        len -= 8 * 16;
+        block += 8;
+    }
+
+    /* Remaining blocks, the last one possibly partial */
+    while (len > 0) {
+        __m128i b = _mm_xor_si128(_mm_set_epi64x((long long)__builtin_bswap64(block),
+                                                 (long long)iv_hi), rk[0]);
+        for (int r = 1; r < 10; r++)
+            b = _mm_aesenc_si128(b, rk[r]);
+        b = _mm_aesenclast_si128(b, rk[10]);
+        if (len >= 16) {
+            __m128i d = _mm_loadu_si128((const __m128i *)data);
+            _mm_storeu_si128((__m128i *)data, _mm_xor_si128(d, b));
+            data += 16;
+            len -= 16;
+        } else {
+            uint8_t keystream[16];
+            _mm_storeu_si128((__m128i *)keystream, b);
+            for (size_t i = 0; i < len; i++)
+                data[i] ^= keystream[i];
+            len = 0;
+        }
+        block++;
+    }
+}
+
+/*
+ * Keystream for several PDUs at once: the blocks of consecutive PDUs
+ * are dealt out eight at a time, so a burst of short PDUs keeps the
+ * AES pipeline as full as one long PDU does, instead of running the
+ * few blocks of each PDU back to back at full AESENC latency.
+ */
+AESNI_TARGET
+static void nea2_crypt_burst_aesni(const aes128_key_t *ks, const uint32_t *counts, uint8_t bearer,
+                                   uint8_t direction, uint8_t *const *data, const size_t *lens, size_t n) {
+    const __m128i *rkp = (const __m128i *)ks->rk;
+    __m128i rk[11];
+    for (int r = 0; r < 11; r++)
+        rk[r] = _mm_load_si128(&rkp[r]);
+
+    uint8_t iv[16];
+    uint64_t iv_hi = 0;
+    size_t p = 0, off = 0;
+    while (p < n && lens[p] == 0)
+        p++;
+    if (p < n) {
+        nea2_init_counter(iv, counts[p], bearer, direction);
+        memcpy(&iv_hi, iv, 8);
+    }
+    while (p < n) {
+        __m128i b[8];
+        uint8_t *dst[8];
+        size_t take[8];
+        int k = 0;
+        for (; k < 8 && p < n; k++) {
+            b[k] = _mm_xor_si128(_mm_set_epi64x((long long)__builtin_bswap64(off / 16), (long long)iv_hi),
+                                 rk[0]);
+            dst[k] = data[p] + off;
+            take[k] = lens[p] - off < 16 ? lens[p] - off : 16;
+            off += 16;
+            if (off >= lens[p]) {
+                off = 0;
+                while (++p < n && lens[p] == 0)
+                    ;
+                if (p < n) {
+                    nea2_init_counter(iv, counts[p], bearer, direction);
+                    memcpy(&iv_hi, iv, 8);
+                }
+            }
+        }
+        for (int r = 1; r < 10; r++)
+            for (int i = 0; i < k; i++)
+                b[i] = _mm_aesenc_si128(b[i], rk[r]);
+        for (int i = 0; i < k; i++) {
+            b[i] = _mm_aesenclast_si128(b[i], rk[10]);
+            if (take[i] == 16) {
+                __m128i d = _mm_loadu_si128((const __m128i *)dst[i]);
+                _mm_storeu_si128((__m128i *)dst[i], _mm_xor_si128(d, b[i]));
+            } else {
+                uint8_t keystream[16];
+                _mm_storeu_si128((__m128i *)keystream, b[i]);
+                for (size_t j = 0; j < take[i]; j++)
+                    dst[i][j] ^= keystream[j];
+            }
+        }
+    }
+}
+
+#define AESNI_SSSE3_TARGET __attribute__((target("aes,ssse3")))
+
+/*
+ * Same pass as sec_fused_portable() with the keystream block and the
+ * CMAC block of each iteration interleaved round by round, so the
+ * independent CTR block hides part of the serial CBC-MAC latency. The
+ * message bytes straddling two data blocks are merged with PSHUFB.
+ */
+AESNI_SSSE3_TARGET
+static int sec_fused_aesni(const aes128_key_t *cks, const nia2_key_t *ik, uint32_t count,
+                           uint8_t bearer, uint8_t direction, const uint8_t *hdr, size_t hdr_len,
+                           uint8_t *data, size_t len, int rx) {
+    const __m128i *ckp = (const __m128i *)(cks ? cks : &ik->ks);
+    const __m128i *ikp = (const __m128i *)ik->ks.rk;
+    __m128i rc[11], ri[11];
+    for (int r = 0; r < 11; r++) {
+        rc[r] = _mm_load_si128(&ckp[r]);
+        ri[r] = _mm_load_si128(&ikp[r]);
+    }
+
+    uint8_t iv[16], first[16] = { 0 }, lo_idx[16], hi_idx[16];
+    size_t o = 8 + hdr_len;
+    nea2_init_counter(iv, count, bearer, direction);
+    memcpy(first, iv, 8);
+    memcpy(first + 8, hdr, hdr_len);
+    /* hi_idx moves plaintext bytes 0..15-o up behind the staged bytes,
+       lo_idx moves bytes 16-o..15 down to start the next stage */
+    for (size_t j = 0; j < 16; j++) {
+        hi_idx[j] = j < o ? 0x80 : (uint8_t)(j - o);
+        lo_idx[j] = j < o ? (uint8_t)(j + 16 - o) : 0x80;
+    }
+    const __m128i hi_mask = _mm_loadu_si128((const __m128i *)hi_idx);
+    const __m128i lo_mask = _mm_loadu_si128((const __m128i *)lo_idx);
+    uint64_t iv_hi;
+    memcpy(&iv_hi, iv, 8);
+
+    __m128i x = _mm_setzero_si128(), stage = _mm_loadu_si128((const __m128i *)first), pend = x;
+    int have_pend = 0;
+    size_t nfull = len / 16;
+    for (size_t i = 0; i < nfull; i++) {
+        __m128i *d = (__m128i *)(data + 16 * i);
+        __m128i c = _mm_xor_si128(_mm_set_epi64x((long long)__builtin_bswap64(i), (long long)iv_hi), rc[0]);
+        __m128i m = _mm_xor_si128(_mm_xor_si128(x, pend), ri[0]);
+        if (cks && have_pend) {
+            for (int r = 1; r < 10; r++) {
+                c = _mm_aesenc_si128(c, rc[r]);
+                m = _mm_aesenc_si128(m, ri[r]);
+            }
+            c = _mm_aesenclast_si128(c, rc[10]);
+            x = _mm_aesenclast_si128(m, ri[10]);
+        } else if (cks) {
+            for (int r = 1; r < 10; r++)
+                c = _mm_aesenc_si128(c, rc[r]);
+            c = _mm_aesenclast_si128(c, rc[10]);
+        } else if (have_pend) {
+            for (int r = 1; r < 10; r++)
+                m = _mm_aesenc_si128(m, ri[r]);
+            x = _mm_aesenclast_si128(m, ri[10]);
+        }
+        __m128i plain = _mm_loadu_si128(d);
+        if (cks) {
+            __m128i out = _mm_xor_si128(plain, c);
+            _mm_storeu_si128(d, out);
+            if (rx) plain = out;
+        }
+        pend = _mm_or_si128(stage, _mm_shuffle_epi8(plain, hi_mask));
+        stage = _mm_shuffle_epi8(plain, lo_mask);
+        have_pend = 1;
+    }
+
+    uint8_t xb[16], pb[16], sb[16];
+    _mm_storeu_si128((__m128i *)xb, x);
+    _mm_storeu_si128((__m128i *)pb, pend);
+    _mm_storeu_si128((__m128i *)sb, stage);
+    return sec_fused_tail(aes128_encrypt_aesni, cks, ik, iv, nfull, xb, have_pend ? pb : NULL,
+                          sb, o, data + 16 * nfull, len - 16 * nfull, rx);
+}
+#endif /* SEC_HAVE_AESNI */
+
+/* --------------------------------------------------------------------------
+   Runtime Engine Selection
+   -------------------------------------------------------------------------- */
+typedef void (*nea2_fn)(const aes128_key_t *, uint32_t, uint8_t, uint8_t, uint8_t *, size_t);
+typedef void (*nea2_burst_fn)(const aes128_key_t *, const uint32_t *, uint8_t, uint8_t, uint8_t *const *,
+                              const size_t *, size_t);
+typedef int (*fused_fn)(const aes128_key_t *, const nia2_key_t *, uint32_t, uint8_t, uint8_t,
+                        const uint8_t *, size_t, uint8_t *, size_t, int);
+
+static struct {
+    int selected;
+    sec_engine_t engine;
+    aes_block_fn encrypt_block;
+    nea2_fn nea2;
+    nea2_burst_fn nea2_burst;
+    fused_fn fused;
+} sec_ops;
+
+static int sec_cpu_has_aesni(void) {
+#ifdef SEC_HAVE_AESNI
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("ssse3");
+#else
+    return 0;
+#endif
+}
+
+int sec_select_engine(sec_engine_t engine) {
+    if (engine == SEC_ENGINE_AESNI) {
+#ifdef SEC_HAVE_AESNI
+        if (!sec_cpu_has_aesni()) return -1;
+        sec_ops.encrypt_block = aes128_encrypt_aesni;
+        sec_ops.nea2 = nea2_crypt_aesni;
+        sec_ops.nea2_burst = nea2_crypt_burst_aesni;
+        sec_ops.fused = sec_fused_aesni;
+#else
+        return -1;
+#endif
+    } else {
+        sec_ops.encrypt_block = aes128_encrypt_portable;
+        sec_ops.nea2 = nea2_crypt_portable;
+        sec_ops.nea2_burst = nea2_crypt_burst_portable;
+        sec_ops.fused = sec_fused_portable;
+    }
+    sec_ops.engine = engine;
+    sec_ops.selected = 1;
+    return 0;
+}
+
+static inline void sec_ensure_selected(void) {
+    if (!sec_ops.selected) {
+        if (sec_select_engine(SEC_ENGINE_AESNI) < 0)
+            sec_select_engine(SEC_ENGINE_PORTABLE);
+    }
+}
+
+const char *sec_engine_name(void) {
+    sec_ensure_selected();
+    return sec_ops.engine == SEC_ENGINE_AESNI ? "AES-NI" : "portable";
+}
+
+void aes128_encrypt_block(const aes128_key_t *ks, const uint8_t in[16], uint8_t out[16]) {
+    sec_ensure_selected();
+    sec_ops.encrypt_block(ks, in, out);
+}
+
+void nea2_crypt(const aes128_key_t *ks, uint32_t count, uint8_t bearer, uint8_t direction,
+                uint8_t *data, size_t len) {
+    sec_ensure_selected();
+    sec_ops.nea2(ks, count, bearer, direction, data, len);
+}
+
+void nea2_crypt_burst(const aes128_key_t *ks, const uint32_t *counts, uint8_t bearer, uint8_t direction,
+                      uint8_t *const *data, const size_t *lens, size_t n) {
+    sec_ensure_selected();
+    sec_ops.nea2_burst(ks, counts, bearer, direction, data, lens, n);
+}
+
+/* Doubling in GF(2^128) for the CMAC subkeys (RFC 4493 2.3). */
+static void cmac_double(uint8_t out[16], const uint8_t in[16]) {
+    uint8_t carry = in[0] >> 7;
+    for (int i = 0; i < 15; i++)
+        out[i] = (uint8_t)((in[i] << 1) | (in[i + 1] >> 7));
+    out[15] = (uint8_t)((in[15] << 1) ^ (carry ? 0x87 : 0x00));
+}
+
+void nia2_expand_key(nia2_key_t *ik, const uint8_t key[SEC_KEY_LEN]) {
+    uint8_t l[16] = { 0 };
+    aes128_expand_key(&ik->ks, key);
+    aes128_encrypt_block(&ik->ks, l, l);
+    cmac_double(ik->k1, l);
+    cmac_double(ik->k2, ik->k1);
+}
+
+void nia2_mac(const nia2_key_t *ik, uint32_t count, uint8_t bearer, uint8_t direction,
+              const uint8_t *msg, size_t len, uint8_t mac[SEC_MAC_LEN]) {
+    sec_ensure_selected();
+    uint8_t iv[16], x[16] = { 0 }, last[32];
+    nea2_init_counter(iv, count, bearer, direction);
+
+    /* The 8-byte prefix and the first 8 message bytes form block one */
+    size_t n = len < 8 ? len : 8;
+    memcpy(last, iv, 8);
+    memcpy(last + 8, msg, n);
+    msg += n;
+    len -= n;
+    size_t fill = 8 + n;
+    while (len > 0) {
+        /* A full block is absorbed only once more data follows it */
+        xor16(x, last);
+        sec_ops.encrypt_block(&ik->ks, x, x);
+        n = len < 16 ? len : 16;
+        memcpy(last, msg, n);
+        msg += n;
+        len -= n;
+        fill = n;
+    }
+    cmac_finish(sec_ops.encrypt_block, ik, x, last, fill);
+    memcpy(mac, x, SEC_MAC_LEN);
+}
+
+void sec_protect(const aes128_key_t *cks, const nia2_key_t *ik, uint32_t count, uint8_t bearer,
+                 uint8_t direction, const uint8_t *hdr, size_t hdr_len, uint8_t *data, size_t len) {
+    sec_ensure_selected();
+    sec_ops.fused(cks, ik, count, bearer, direction, hdr, hdr_len, data, len, 0);
+}
+
+int sec_verify(const aes128_key_t *cks, const nia2_key_t *ik, uint32_t count, uint8_t bearer,
+               uint8_t direction, const uint8_t *hdr, size_t hdr_len, uint8_t *data, size_t len) {
+    sec_ensure_selected();
+    return sec_ops.fused(cks, ik, count, bearer, direction, hdr, hdr_len, data, len, 1);
+}
@@ -0,0 +1,176 @@
+#ifndef SECURITY_H
+#define SECURITY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * SEC_KEY_LEN - Length of 128-bit NR security keys in bytes
+ */
+#define SEC_KEY_LEN 16
+
+/**
+ * SEC_MAC_LEN - Length of the MAC-I appended by integrity protection
+ */
+#define SEC_MAC_LEN 4
+
+/**
+ * struct aes128_key_t - Expanded AES-128 key schedule
+ * @rk: Eleven 16-byte round keys in FIPS-197 byte order
+ *
+ * The same layout is consumed by the portable and the AES-NI
+ * implementations, so a key is expanded once per bearer and reused
+ * for every PDU.
+ */
+typedef struct {
+    uint8_t rk[11 * 16] __attribute__((aligned(16)));
+} aes128_key_t;
+
+/**
+ * struct nia2_key_t - Expanded 128-NIA2 (AES-CMAC) key
+ * @ks: AES key schedule of the integrity key
+ * @k1: CMAC subkey for a complete final block
+ * @k2: CMAC subkey for a padded final block
+ */
+typedef struct {
+    aes128_key_t ks;
+    uint8_t k1[16];
+    uint8_t k2[16];
+} nia2_key_t;
+
+/**
+ * enum sec_engine_t - AES implementations available at runtime
+ * @SEC_ENGINE_PORTABLE: Table-based C implementation
+ * @SEC_ENGINE_AESNI: x86 AES-NI implementation, 8 blocks in flight
+ */
+typedef enum {
+    SEC_ENGINE_PORTABLE,
+    SEC_ENGINE_AESNI
+} sec_engine_t;
+
+/**
+ * aes128_expand_key - Expand a 128-bit key into its round keys
+ * @ks: Key schedule to fill
+ * @key: 16-byte cipher key
+ */
+void aes128_expand_key(aes128_key_t *ks, const uint8_t key[SEC_KEY_LEN]);
+
+/**
+ * aes128_encrypt_block - Encrypt a single 16-byte block
+ * @ks: Expanded key schedule
+ * @in: Plaintext block
+ * @out: Ciphertext block (may alias @in)
+ */
+void aes128_encrypt_block(const aes128_key_t *ks, const uint8_t in[16], uint8_t out[16]);
+
+/**
+ * nea2_crypt - 128-NEA2 ciphering/deciphering in place
+ * @ks: Expanded cipher key
+ * @count: 32-bit COUNT of the PDU
+ * @bearer: 5-bit bearer identity
+ * @direction: 0 for uplink, 1 for downlink
+ * @data: Data to transform in place
+ * @len: Length of @data in bytes
+ *
+ * Generates the AES-CTR keystream of TS 33.501 / TS 33.401 Annex B.1.3
+ * with the initial counter block COUNT | BEARER | DIRECTION | 0...0
+ * and XORs it into @data. Encryption and decryption are identical.
+ */
+void nea2_crypt(const aes128_key_t *ks, uint32_t count, uint8_t bearer, uint8_t direction,
+                uint8_t *data, size_t len);
+
+/**
+ * nea2_crypt_burst - 128-NEA2 over several PDUs of one bearer
+ * @ks: Expanded cipher key
+ * @counts: COUNT of each PDU
+ * @bearer: 5-bit bearer identity
+ * @direction: 0 for uplink, 1 for downlink
+ * @data: Data of each PDU, transformed in place
+ * @lens: Length of each @data in bytes
+ * @n: Number of PDUs
+ *
+ * Same result as nea2_crypt() on each PDU in turn. The AES-NI engine
+ * generates the keystream blocks of consecutive PDUs together, so
+ * PDUs of a few blocks cost close to what the same bytes cost in one
+ * long PDU.
+ */
+void nea2_crypt_burst(const aes128_key_t *ks, const uint32_t *counts, uint8_t bearer, uint8_t direction,
+                      uint8_t *const *data, const size_t *lens, size_t n);
+
+/**
+ * nia2_expand_key - Expand a 128-bit integrity key
+ * @ik: Integrity key to fill (key schedule and CMAC subkeys)
+ * @key: 16-byte integrity key
+ */
+void nia2_expand_key(nia2_key_t *ik, const uint8_t key[SEC_KEY_LEN]);
+
+/**
+ * nia2_mac - Compute a 128-NIA2 MAC-I
+ * @ik: Expanded integrity key
+ * @count: 32-bit COUNT
+ * @bearer: 5-bit bearer identity
+ * @direction: 0 for uplink, 1 for downlink
+ * @msg: Message to protect
+ * @len: Length of @msg in bytes
+ * @mac: The 32 most significant bits of the AES-CMAC (TS 33.401 B.2.3)
+ */
+void nia2_mac(const nia2_key_t *ik, uint32_t count, uint8_t bearer, uint8_t direction,
+              const uint8_t *msg, size_t len, uint8_t mac[SEC_MAC_LEN]);
+
+/**
+ * sec_protect - Integrity-protect and cipher a PDU in one pass
+ * @cks: Expanded NEA2 key, or NULL to leave the data in clear
+ * @ik: Expanded NIA2 key
+ * @count: 32-bit COUNT
+ * @bearer: 5-bit bearer identity
+ * @direction: 0 for uplink, 1 for downlink
+ * @hdr: Header covered by the MAC-I but never ciphered (at most 7 bytes)
+ * @hdr_len: Length of @hdr
+ * @data: Data to protect, followed by SEC_MAC_LEN bytes of room
+ * @len: Length of @data without the MAC-I
+ *
+ * Computes the MAC-I over @hdr and @data, stores it after @data and
+ * ciphers @data and the MAC-I, reading each data block only once.
+ * Equivalent to nia2_mac() followed by nea2_crypt() over both.
+ */
+void sec_protect(const aes128_key_t *cks, const nia2_key_t *ik, uint32_t count, uint8_t bearer,
+                 uint8_t direction, const uint8_t *hdr, size_t hdr_len, uint8_t *data, size_t len);
+
+/**
+ * sec_verify - Decipher and verify a PDU in one pass
+ * @cks: Expanded NEA2 key, or NULL if the data is in clear
+ * @ik: Expanded NIA2 key
+ * @count: 32-bit COUNT
+ * @bearer: 5-bit bearer identity
+ * @direction: 0 for uplink, 1 for downlink
+ * @hdr: Header covered by the MAC-I (at most 7 bytes)
+ * @hdr_len: Length of @hdr
+ * @data: Received data followed by its SEC_MAC_LEN-byte MAC-I,
+ *        deciphered in place
+ * @len: Length of @data without the MAC-I
+ *
+ * Return: 0 if the MAC-I matches, -1 otherwise
+ */
+int sec_verify(const aes128_key_t *cks, const nia2_key_t *ik, uint32_t count, uint8_t bearer,
+               uint8_t direction, const uint8_t *hdr, size_t hdr_len, uint8_t *data, size_t len);
+
+/**
+ * sec_select_engine - Choose the AES implementation
+ * @engine: Requested implementation
+ *
+ * The engine is picked automatically on first use (AES-NI when the
+ * CPU supports it); this call overrides that choice, e.g. for
+ * benchmarking the fallback.
+ *
+ * Return: 0 on success, -1 if @engine is not supported by this CPU
+ */
+int sec_select_engine(sec_engine_t engine);
+
+/**
+ * sec_engine_name - Name of the AES implementation in use
+ *
+ * Return: Human-readable engine name
+ */
+const char *sec_engine_name(void);
+
+#endif /* SECURITY_H */
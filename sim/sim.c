@@ -0,0 +1,332 @@
+#define _GNU_SOURCE
+#include "sim.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include "../ipgen/ipgen.h"
+
+/* PDUs one UL grant can carry */
+#define SIM_MAX_PDUS 512
+
+/* Largest IP packet, within what UM reassembles */
+#define SIM_MAX_SDU 9000
+
+/* periodicBSR-Timer and retxBSR-Timer */
+#define SIM_BSR_PERIODIC_MS 10
+#define SIM_BSR_RETX_MS     80
+
+/* The PHY of the UE being served: one engine at a time owns the UL link */
+static sim_t *sim_active;
+
+static uint64_t sim_wall_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* xorshift32: cheap and repeatable */
+static uint32_t sim_rand(sim_t *sim) {
+    uint32_t x = sim->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim->rng = x;
+    return x;
+}
+
+/* Uniform over 1 .. 2 * mean - 1 ms, so the mean gap is @arrival_ms */
+static uint32_t sim_next_arrival(sim_t *sim) {
+    uint32_t ms = sim->cfg.arrival_ms > 1 ? 1 + sim_rand(sim) % (2 * sim->cfg.arrival_ms - 1) : 1;
+    return timer_ms(sim->wheel, ms);
+}
+
+/* The gNB sees the UE's buffer as its LCG counter, the figure its BSRs carry */
+static void sim_update_buffer(sim_t *sim, sim_ue_t *ue) {
+    mac_sched_update(&sim->sched, ue->id, ue->bsr.lcg_bytes[SIM_LCG], ue->bytes_per_prb);
+}
+
+/*
+ * Traffic arrival event: one IP packet through PDCP into the RLC
+ * queue, then the next arrival is drawn. Only the producer side of
+ * the queue is touched; MAC finds the data at the slot's buffer poll.
+ */
+static void sim_arrival(timer_node_t *node) {
+    static const uint8_t payload[SIM_MAX_SDU];
+    sim_ue_t *ue = timer_entry(node, sim_ue_t, arrival);
+    sim_t *sim = ue->sim;
+    pktbuf_t *pkt = generate_udp_packet(htonl(0x0a000000u + (uint32_t)ue->id), inet_addr("192.168.1.200"),
+                                        5000, 6000, payload, sim->cfg.sdu_size - 28);
+
+    sim->stats.arrivals++;
+    if (!pkt || pdcp_prepare_tx_pdu_burst(ue->pdcp, &pkt, &pkt, 1) == 0 || rlc_tx_enqueue(&ue->rlc, pkt) < 0)
+        sim->stats.dropped++;
+    timer_arm(sim->wheel, node, sim_next_arrival(sim));
+}
+
+/*
+ * MAC side of the slot: fold what each RLC queue gained into its LCG
+ * counter, raising an SR where that triggers a Regular BSR, and show
+ * the scheduler the buffers that changed.
+ */
+static void sim_poll_buffers(sim_t *sim) {
+    for (int i = 0; i < sim->cfg.num_ues; i++) {
+        sim_ue_t *ue = &sim->ues[i];
+        size_t before = ue->lch.buffer_size;
+        int sr = mac_handle_sr(&ue->bsr);
+        if (rlc_entity_sync_mac(&ue->rlc) == before) continue;
+        sim->stats.srs += !sr && mac_handle_sr(&ue->bsr);
+        sim_update_buffer(sim, ue);
+    }
+}
+
+/*
+ * UL PHY of the engine: the TB fails with probability bler_ppm and
+ * its feedback comes back harq_rtt slots later, when the process's
+ * HARQ RTT timer runs out.
+ */
+static void sim_phy_tx(harq_process_t *proc) {
+    sim_t *sim = sim_active;
+    harq_fb_push(&sim->feedback, proc, sim_rand(sim) * (1e6 / 4294967296.0) >= sim->cfg.bler_ppm);
+}
+
+/*
+ * HARQ gave the TB up: UM cannot get the RLC PDUs back, so they are
+ * counted as lost with RLC and the engine.
+ */
+static void sim_harq_fail(harq_process_t *proc) {
+    sim_t *sim = sim_active;
+    sim_ue_t *ue = (sim_ue_t *)((char *)proc->entity - offsetof(sim_ue_t, harq));
+    mac_subpdu_t views[SIM_MAX_PDUS];
+    int n = mac_parse_pdu(proc->tb->data, proc->tb->len, DIRECTION_UPLINK, views, SIM_MAX_PDUS);
+    size_t pdus = 0, bytes = 0;
+    for (int i = 0; i < n; i++) {
+        if (views[i].lcid != SIM_LCID) continue;
+        pdus++;
+        bytes += views[i].len;
+    }
+    rlc_tx_lost(&ue->rlc, pdus, bytes);
+    sim->stats.lost_pdus += pdus;
+    sim->stats.lost_bytes += bytes;
+}
+
+/*
+ * Builds the UE's TB for a grant on an idle process with mac_multiplex():
+ * RLC PDUs as MAC subPDUs, a triggered BSR in the room kept for it,
+ * else a Padding BSR if one fits, then padding. The process is told the RLC PDU bytes,
+ * which its ACK counts.
+ */
+static pktbuf_t *sim_build_tb(sim_t *sim, sim_ue_t *ue, harq_process_t *proc, uint32_t tbs) {
+    pktbuf_t *buf = pktbuf_alloc(tbs);
+    if (!buf) return NULL;
+    uint64_t bsrs = ue->bsr.reports, padding_bsrs = ue->bsr.padding_reports;
+    mac_multiplex(&ue->lcp, NULL, 0, pktbuf_append(buf, tbs), tbs, &proc->sdu_bytes);
+    sim->stats.bsrs += ue->bsr.reports - bsrs;
+    sim->stats.padding_bsrs += ue->bsr.padding_reports - padding_bsrs;
+    return buf;
+}
+
+static void sim_schedule(sim_t *sim) {
+    int n = mac_sched_run(&sim->sched, sim->grants);
+    sim->stats.grants += (uint64_t)n;
+    for (int g = 0; g < n; g++) {
+        sim_ue_t *ue = &sim->ues[sim->grants[g].ue];
+        harq_process_t *proc = harq_select(&ue->harq);
+        if (!proc) {
+            sim->stats.stalls++;
+        } else if (proc->state != HARQ_IDLE) {
+            harq_ul_retransmit(proc);
+            sim->stats.retx++;
+        } else {
+            pktbuf_t *tb = sim_build_tb(sim, ue, proc, sim->grants[g].tbs);
+            if (tb && harq_ul_start_tx(proc, tb) == 0)
+                sim->stats.new_tbs++;
+        }
+        /* The scheduler took the whole grant off its count; RLC knows what is left */
+        sim_update_buffer(sim, ue);
+    }
+}
+
+int sim_numerology(uint32_t scs_khz) {
+    for (int mu = 0; mu <= SIM_MAX_NUMEROLOGY; mu++)
+        if (scs_khz == 15u << mu) return mu;
+    return -1;
+}
+
+int sim_init(sim_t *sim, const sim_config_t *cfg) {
+    if (!sim || !cfg) return -1;
+    int mu = sim_numerology(cfg->scs_khz);
+    if (mu < 0 || cfg->num_ues < 0) return -1;
+    if (cfg->num_ues > 0 && (cfg->sdu_size <= 28 || cfg->sdu_size > SIM_MAX_SDU || cfg->arrival_ms == 0 ||
+                             cfg->harq_processes < 1 || cfg->harq_processes > HARQ_MAX_PROCESSES ||
+                             cfg->harq_rtt == 0 || cfg->harq_max_retx < 0 || cfg->bler_ppm > 1000000))
+        return -1;
+    memset(sim, 0, sizeof(*sim));
+    sim->cfg = *cfg;
+    sim->numerology = (unsigned)mu;
+    sim->wheel = timer_get_wheel();
+    sim->rng = cfg->seed ? cfg->seed : 1;
+    timer_wheel_init(sim->wheel, 0, 1u << mu);
+    if (cfg->num_ues == 0) return 0;
+
+    sim->ues = calloc((size_t)cfg->num_ues, sizeof(sim_ue_t));
+    sim->grants = calloc(cfg->max_grants ? cfg->max_grants : 1, sizeof(mac_grant_t));
+    /* At most one feedback in flight per process */
+    if (!sim->ues || !sim->grants ||
+        harq_fb_queue_init(&sim->feedback, (uint32_t)cfg->num_ues * (uint32_t)cfg->harq_processes,
+                           cfg->harq_rtt) < 0) {
+        free(sim->ues);
+        free(sim->grants);
+        return -1;
+    }
+    if (pdcp_table_init(&sim->pdcp, (uint32_t)cfg->num_ues) < 0) {
+        harq_fb_queue_free(&sim->feedback);
+        free(sim->ues);
+        free(sim->grants);
+        return -1;
+    }
+    if (mac_sched_init(&sim->sched, DIRECTION_UPLINK, MAC_SCHED_PF, cfg->num_ues, cfg->num_prbs,
+                       cfg->max_grants) < 0) {
+        pdcp_table_free(&sim->pdcp);
+        harq_fb_queue_free(&sim->feedback);
+        free(sim->ues);
+        free(sim->grants);
+        return -1;
+    }
+
+    for (int i = 0; i < cfg->num_ues; i++) {
+        sim_ue_t *ue = &sim->ues[i];
+        ue->sim = sim;
+        ue->id = mac_sched_add_ue(&sim->sched, 0);
+        /* MCS from cell edge to cell centre: 16 to 160 bytes per PRB */
+        ue->bytes_per_prb = 16 + sim_rand(sim) % 145;
+        ue->pdcp = pdcp_table_add(&sim->pdcp, (uint32_t)i, 1);
+        rlc_entity_establish(&ue->rlc, RLC_MODE_UM);
+        rlc_entity_bind_pdcp(&ue->rlc, ue->pdcp);
+        ue->lch = (logical_channel_t){
+            .channel_id = SIM_LCID,
+            .type = LC_TYPE_DTCH,
+            .priority = 1,
+            .pbr = MAC_PBR_INFINITY,
+            .lcg = SIM_LCG,
+        };
+        mac_lcp_init(&ue->lcp, &ue->lch, 1);
+        mac_bsr_init(&ue->bsr, &ue->lcp, SIM_BSR_PERIODIC_MS, SIM_BSR_RETX_MS);
+        rlc_entity_bind_mac(&ue->rlc, &ue->lcp, 0);
+        harq_entity_init(&ue->harq, cfg->harq_processes, cfg->harq_rtt);
+        ue->harq.max_retx = cfg->harq_max_retx;
+        timer_init(&ue->arrival, sim_arrival);
+        timer_arm(sim->wheel, &ue->arrival, sim_next_arrival(sim));
+    }
+    sim_active = sim;
+    harq_set_ul_tx_callback(sim_phy_tx);
+    harq_set_ul_fail_callback(sim_harq_fail);
+    return 0;
+}
+
+void sim_free(sim_t *sim) {
+    if (!sim || !sim->ues) return;
+    for (int i = 0; i < sim->cfg.num_ues; i++) {
+        sim_ue_t *ue = &sim->ues[i];
+        timer_cancel(&ue->arrival);
+        harq_entity_release(&ue->harq);
+        rlc_entity_release(&ue->rlc);
+        mac_bsr_release(&ue->bsr);
+    }
+    if (sim_active == sim) {
+        harq_set_ul_tx_callback(NULL);
+        harq_set_ul_fail_callback(NULL);
+        sim_active = NULL;
+    }
+    mac_sched_free(&sim->sched);
+    pdcp_table_free(&sim->pdcp);
+    harq_fb_queue_free(&sim->feedback);
+    free(sim->ues);
+    free(sim->grants);
+    sim->ues = NULL;
+    sim->grants = NULL;
+}
+
+static void sim_slot(sim_t *sim) {
+    /* Protocol timers and traffic arrivals */
+    timer_wheel_tick(sim->wheel);
+    if (sim->ues) {
+        sim_poll_buffers(sim);
+        harq_fb_drain(&sim->feedback, timer_now(sim->wheel));
+        sim_schedule(sim);
+    }
+    sim->slots++;
+}
+
+void sim_run(sim_t *sim, uint64_t slots) {
+    uint64_t t0 = sim_wall_ns();
+    for (uint64_t s = 0; s < slots; s++)
+        sim_slot(sim);
+    sim->stats.wall_ns += sim_wall_ns() - t0;
+}
+
+static void sim_hist_add(sim_hist_t *hist, uint64_t ns) {
+    uint64_t us = ns / 1000;
+    hist->buckets[us < SIM_HIST_BUCKETS ? us : SIM_HIST_BUCKETS - 1]++;
+    hist->count++;
+    hist->sum_ns += ns;
+    if (ns > hist->max_ns)
+        hist->max_ns = ns;
+}
+
+uint64_t sim_hist_percentile(const sim_hist_t *hist, double p) {
+    uint64_t target = (uint64_t)((double)hist->count * p), seen = 0;
+    for (uint32_t us = 0; us < SIM_HIST_BUCKETS - 1; us++) {
+        seen += hist->buckets[us];
+        if (seen > target) return (uint64_t)(us + 1) * 1000;
+    }
+    return hist->max_ns;
+}
+
+void sim_run_realtime(sim_t *sim, uint64_t slots, sim_pace_t pace) {
+    const uint64_t slot_ns = 1000000u >> sim->numerology;
+    uint64_t start = sim_wall_ns(), busy = 0;
+    for (uint64_t s = 0; s < slots; s++) {
+        uint64_t deadline = start + s * slot_ns;
+        uint64_t now = sim_wall_ns();
+        if (pace == SIM_PACE_POLL) {
+            while (now < deadline)
+                now = sim_wall_ns();
+        } else if (now < deadline) {
+            struct timespec ts = { (time_t)(deadline / 1000000000u), (long)(deadline % 1000000000u) };
+            int err;
+            while ((err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) == EINTR)
+                ;
+            now = sim_wall_ns();
+            if (err) {
+                /* The clock cannot be slept on: poll this slot and the rest */
+                printf("sim: clock_nanosleep failed (%s), polling instead\n", strerror(err));
+                pace = SIM_PACE_POLL;
+                while (now < deadline)
+                    now = sim_wall_ns();
+            }
+        }
+        sim_hist_add(&sim->rt.wakeup, now > deadline ? now - deadline : 0);
+
+        sim_slot(sim);
+        uint64_t end = sim_wall_ns();
+        sim_hist_add(&sim->rt.processing, end - now);
+        busy += end - now;
+        if (end > deadline + slot_ns)
+            sim->rt.overruns++;
+    }
+    /* Only the processing counts as L2 time; the rest was waiting */
+    sim->stats.wall_ns += busy;
+}
+
+int sim_pin_cpu(int cpu) {
+    cpu_set_t set;
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return -1;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+}
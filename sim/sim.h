@@ -0,0 +1,285 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../harq/harq.h"
+#include "../mac/mac.h"
+#include "../pdcp/pdcp.h"
+#include "../rlc/rlc.h"
+#include "../timer/timer.h"
+
+/**
+ * SIM_MAX_NUMEROLOGY - Highest numerology simulated (120 kHz SCS)
+ */
+#define SIM_MAX_NUMEROLOGY 3
+
+/**
+ * SIM_LCID - LCID of the DRB every simulated UE sends on
+ */
+#define SIM_LCID 4
+
+/**
+ * SIM_LCG - logicalChannelGroup of that DRB in BSRs
+ */
+#define SIM_LCG 1
+
+/**
+ * SIM_HIST_BUCKETS - Buckets of a slot timing histogram, 1 us each
+ *
+ * Covers 4 ms, eight 0.5 ms slots; longer samples land in the last
+ * bucket.
+ */
+#define SIM_HIST_BUCKETS 4096
+
+/**
+ * enum sim_pace_t - How sim_run_realtime() waits for a slot boundary
+ * @SIM_PACE_SLEEP: clock_nanosleep() to the absolute slot start
+ * @SIM_PACE_POLL: Spin on the clock, for a core of its own
+ */
+typedef enum {
+    SIM_PACE_SLEEP,
+    SIM_PACE_POLL
+} sim_pace_t;
+
+/**
+ * struct sim_hist_t - Histogram of per-slot durations
+ * @buckets: Samples per microsecond, the last one open ended
+ * @count: Samples
+ * @sum_ns: Sum of the samples
+ * @max_ns: Largest sample
+ */
+typedef struct {
+    uint64_t buckets[SIM_HIST_BUCKETS];
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+} sim_hist_t;
+
+/**
+ * struct sim_rt_stats_t - Slot pacing measurements
+ * @wakeup: Wake-up jitter: how late each slot started after its boundary
+ * @processing: L2 processing time of each slot
+ * @overruns: Slots whose processing ended past the next boundary
+ *
+ * An overrun slot is not dropped: the next one starts at once, late,
+ * as L2 must still process every slot.
+ */
+typedef struct {
+    sim_hist_t wakeup;
+    sim_hist_t processing;
+    uint64_t overruns;
+} sim_rt_stats_t;
+
+/**
+ * struct sim_config_t - Cell and load to simulate
+ * @scs_khz: Subcarrier spacing: 15, 30, 60 or 120 kHz
+ * @num_ues: UEs, each with one DRB (0 leaves only the slot clock)
+ * @num_prbs: UL carrier width in PRBs
+ * @max_grants: UL grants per slot
+ * @sdu_size: IP packet size in bytes
+ * @arrival_ms: Mean time between the packets of a UE, in ms
+ * @harq_processes: UL HARQ processes per UE
+ * @harq_rtt: Slots from a UL transmission to its HARQ feedback
+ * @harq_max_retx: Retransmissions before a TB is given up to RLC
+ * @bler_ppm: Chance that a transmission fails, per million
+ * @seed: Seed of the traffic, channel and CQI draws
+ */
+typedef struct {
+    uint32_t scs_khz;
+    int num_ues;
+    uint16_t num_prbs;
+    uint16_t max_grants;
+    uint32_t sdu_size;
+    uint32_t arrival_ms;
+    int harq_processes;
+    uint32_t harq_rtt;
+    int harq_max_retx;
+    uint32_t bler_ppm;
+    uint32_t seed;
+} sim_config_t;
+
+typedef struct sim sim_t;
+
+/**
+ * struct sim_ue_t - One simulated UE
+ * @sim: Engine running the UE
+ * @id: Index of the UE, also its scheduler ID
+ * @bytes_per_prb: Spectral efficiency, drawn once
+ * @pdcp: PDCP entity of the DRB
+ * @rlc: UM entity queueing the PDCP PDUs for UL grants
+ * @lch: MAC logical channel of the DRB, whose buffer is @rlc's queue
+ * @lcp: LCP state of the UE, holding @lch
+ * @bsr: Buffer status of the UE, fed by @rlc through @lcp
+ * @harq: UL HARQ processes
+ * @arrival: Event of the next packet arrival
+ */
+typedef struct {
+    sim_t *sim;
+    int id;
+    uint32_t bytes_per_prb;
+    pdcp_entity_t *pdcp;
+    rlc_entity_t rlc;
+    logical_channel_t lch;
+    mac_lcp_t lcp;
+    mac_bsr_t bsr;
+    harq_entity_t harq;
+    timer_node_t arrival;
+} sim_ue_t;
+
+/**
+ * struct sim_stats_t - Engine counters
+ * @arrivals: IP packets generated
+ * @dropped: Packets PDCP or the RLC queue dropped
+ * @grants: UL grants given
+ * @new_tbs: TBs sent for the first time
+ * @retx: Retransmissions
+ * @stalls: Grants lost because every HARQ process of the UE waited for feedback
+ * @srs: Scheduling requests, raised when new data folded into an LCG counter
+ *  triggers a Regular BSR
+ * @bsrs: Regular and Periodic BSRs sent
+ * @padding_bsrs: Padding BSRs sent
+ * @lost_pdus: RLC PDUs in TBs HARQ gave up on
+ * @lost_bytes: Their size in bytes
+ * @wall_ns: Wall-clock time spent processing slots
+ */
+typedef struct {
+    uint64_t arrivals;
+    uint64_t dropped;
+    uint64_t grants;
+    uint64_t new_tbs;
+    uint64_t retx;
+    uint64_t stalls;
+    uint64_t srs;
+    uint64_t bsrs;
+    uint64_t padding_bsrs;
+    uint64_t lost_pdus;
+    uint64_t lost_bytes;
+    uint64_t wall_ns;
+} sim_stats_t;
+
+/**
+ * struct sim - Discrete-event L2 engine on a virtual slot clock
+ * @cfg: Configuration
+ * @numerology: mu, with 2^mu slots per ms
+ * @wheel: Protocol timer wheel, ticked once per slot
+ * @slots: Slots simulated
+ * @pdcp: PDCP entities of the UEs
+ * @sched: UL scheduler
+ * @ues: UEs
+ * @grants: Grants of the current slot
+ * @feedback: HARQ feedback in flight, with its ACK and failure counters
+ * @rng: xorshift32 state
+ * @stats: Counters
+ * @rt: Slot pacing measurements of sim_run_realtime()
+ *
+ * Time only moves when the engine says so: sim_run() simulates a
+ * slot as soon as the previous one is done, sim_run_realtime() on
+ * the slot boundaries of the wall clock.
+ * Each slot fires, in order, the protocol timers and the traffic
+ * arrivals due (both events on the timer wheel), folds the RLC queues
+ * into the LCG counters, drains the HARQ feedback that has arrived,
+ * then runs the UL scheduler and puts the granted TBs on air.
+ */
+struct sim {
+    sim_config_t cfg;
+    unsigned numerology;
+    timer_wheel_t *wheel;
+    uint64_t slots;
+    pdcp_table_t pdcp;
+    mac_sched_t sched;
+    sim_ue_t *ues;
+    mac_grant_t *grants;
+    harq_fb_queue_t feedback;
+    uint32_t rng;
+    sim_stats_t stats;
+    sim_rt_stats_t rt;
+};
+
+/**
+ * sim_numerology - Numerology of a subcarrier spacing
+ * @scs_khz: Subcarrier spacing in kHz
+ *
+ * Return: mu (SCS = 15 kHz * 2^mu), or -1 above SIM_MAX_NUMEROLOGY or
+ * for a spacing that is not a power-of-two multiple of 15 kHz
+ */
+int sim_numerology(uint32_t scs_khz);
+
+/**
+ * sim_init - Set up an engine and its UEs
+ * @sim: Engine to initialize
+ * @cfg: Configuration (copied)
+ *
+ * Re-initializes the global timer wheel to the numerology's slot
+ * rate, so no timer may be armed on it yet. Every UE gets its first
+ * packet within its mean arrival time.
+ *
+ * Return: 0 on success, -1 for a bad configuration or on allocation
+ * failure
+ */
+int sim_init(sim_t *sim, const sim_config_t *cfg);
+
+/**
+ * sim_free - Release the UEs and storage of an engine
+ * @sim: Engine
+ */
+void sim_free(sim_t *sim);
+
+/**
+ * sim_run - Simulate slots back to back
+ * @sim: Engine
+ * @slots: Slots to simulate
+ */
+void sim_run(sim_t *sim, uint64_t slots);
+
+/**
+ * sim_run_realtime - Simulate slots on the real slot cadence
+ * @sim: Engine
+ * @slots: Slots to simulate
+ * @pace: How to wait for each slot boundary
+ *
+ * Slot k of the call starts at an absolute deadline k slot durations
+ * after the first, so waking late never shifts the slots after it.
+ * Wake-up jitter, processing time and overruns go to @sim->rt.
+ */
+void sim_run_realtime(sim_t *sim, uint64_t slots, sim_pace_t pace);
+
+/**
+ * sim_pin_cpu - Pin the calling thread to one CPU
+ * @cpu: CPU number
+ *
+ * Return: 0 on success, -1 on failure
+ */
+int sim_pin_cpu(int cpu);
+
+/**
+ * sim_hist_percentile - Sample below which a share of a histogram lies
+ * @hist: Histogram
+ * @p: Share, 0 to 1
+ *
+ * Return: Upper bound of the bucket holding the percentile, in ns
+ * (@hist->max_ns for the open-ended bucket)
+ */
+uint64_t sim_hist_percentile(const sim_hist_t *hist, double p);
+
+/**
+ * sim_slots_per_ms - Slot rate of an engine
+ * @sim: Engine
+ *
+ * Return: 2^mu
+ */
+static inline uint32_t sim_slots_per_ms(const sim_t *sim) {
+    return 1u << sim->numerology;
+}
+
+/**
+ * sim_seconds - Virtual time simulated so far
+ * @sim: Engine
+ *
+ * Return: Simulated seconds
+ */
+static inline double sim_seconds(const sim_t *sim) {
+    return (double)sim->slots / (1000.0 * sim_slots_per_ms(sim));
+}
+
+#endif /* SIM_H */
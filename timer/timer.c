@@ -0,0 +1,87 @@
+#include "timer.h"
+#include <string.h>
+
+/* Global wheel of the L2 stack, in 1 ms slots until re-initialized. */
+static timer_wheel_t global_wheel = { .ticks_per_ms = 1 };
+
+timer_wheel_t *timer_get_wheel(void) {
+    return &global_wheel;
+}
+
+void timer_wheel_init(timer_wheel_t *wheel, uint32_t now, uint32_t ticks_per_ms) {
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->now = now;
+    wheel->ticks_per_ms = ticks_per_ms ? ticks_per_ms : 1;
+}
+
+/* Links a timer into the slot of the lowest level that reaches its expiry. */
+static void timer_wheel_add(timer_wheel_t *wheel, timer_node_t *node) {
+    uint32_t delta = node->expiry - wheel->now;
+    unsigned level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1u << (TIMER_WHEEL_BITS * (level + 1))))
+        level++;
+    timer_node_t **slot =
+        &wheel->slots[level][(node->expiry >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+    node->next = *slot;
+    if (node->next)
+        node->next->pprev = &node->next;
+    node->pprev = slot;
+    *slot = node;
+}
+
+void timer_arm(timer_wheel_t *wheel, timer_node_t *node, uint32_t ticks) {
+    timer_cancel(node);
+    if (ticks == 0)
+        ticks = 1;
+    else if (ticks > TIMER_WHEEL_MAX)
+        ticks = TIMER_WHEEL_MAX;
+    node->expiry = wheel->now + ticks;
+    timer_wheel_add(wheel, node);
+}
+
+/* Spreads one slot of a higher level over the levels below. */
+static void timer_wheel_cascade(timer_wheel_t *wheel, unsigned level, unsigned index) {
+    timer_node_t *node = wheel->slots[level][index];
+    wheel->slots[level][index] = NULL;
+    while (node) {
+        timer_node_t *next = node->next;
+        timer_wheel_add(wheel, node);
+        node = next;
+    }
+}
+
+size_t timer_wheel_tick(timer_wheel_t *wheel) {
+    unsigned index = ++wheel->now & (TIMER_WHEEL_SLOTS - 1);
+    if (index == 0) {
+        for (unsigned level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+            unsigned i = (wheel->now >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1);
+            timer_wheel_cascade(wheel, level, i);
+            if (i != 0) break;
+        }
+    }
+
+    /*
+     * Detach the slot first: handlers may cancel timers of the same
+     * batch or re-arm their own, which always lands in a later slot.
+     */
+    timer_node_t *batch = wheel->slots[0][index];
+    size_t fired = 0;
+    if (!batch) return 0;
+    wheel->slots[0][index] = NULL;
+    batch->pprev = &batch;
+    while (batch) {
+        timer_node_t *node = batch;
+        timer_cancel(node);
+        node->cb(node);
+        fired++;
+    }
+    wheel->expired += fired;
+    return fired;
+}
+
+size_t timer_wheel_advance(timer_wheel_t *wheel, uint32_t now) {
+    size_t fired = 0;
+    while ((int32_t)(now - wheel->now) > 0)
+        fired += timer_wheel_tick(wheel);
+    return fired;
+}
@@ -0,0 +1,180 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * TIMER_WHEEL_BITS - log2 of the slots per wheel level
+ * TIMER_WHEEL_SLOTS - Slots per wheel level
+ * TIMER_WHEEL_LEVELS - Number of levels
+ *
+ * Level n holds timers due in less than 64^(n+1) ticks, so four
+ * levels reach 2^24 ticks: 4.6 hours of 1 ms slots, 17 minutes of
+ * 62.5 us slots. Longer timers are clamped to that horizon.
+ */
+#define TIMER_WHEEL_BITS   6
+#define TIMER_WHEEL_SLOTS  (1u << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_MAX    ((1u << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+typedef struct timer_node timer_node_t;
+
+/**
+ * timer_cb_t - Expiry handler
+ * @node: Expired timer, already disarmed (the handler may re-arm it)
+ *
+ * Handlers find their object with timer_entry().
+ */
+typedef void (*timer_cb_t)(timer_node_t *node);
+
+/**
+ * struct timer_node - Timer embedded in the object it times
+ * @next: Next timer in the same wheel slot
+ * @pprev: Link pointing at this timer, NULL while disarmed
+ * @expiry: Tick at which the timer fires
+ * @cb: Expiry handler
+ *
+ * Protocol entities embed one node per timer, so arming never
+ * allocates. The back link makes cancel O(1) without knowing which
+ * slot, level or wheel holds the node.
+ */
+struct timer_node {
+    timer_node_t *next;
+    timer_node_t **pprev;
+    uint32_t expiry;
+    timer_cb_t cb;
+};
+
+/**
+ * timer_entry - Object embedding a timer node
+ * @node: Timer node
+ * @type: Type of the embedding object
+ * @member: Name of the node within @type
+ */
+#define timer_entry(node, type, member) ((type *)((char *)(node) - offsetof(type, member)))
+
+/**
+ * struct timer_wheel_t - Hierarchical timing wheel driven by slot ticks
+ * @now: Last tick processed
+ * @ticks_per_ms: Slots per millisecond (2^numerology)
+ * @expired: Timers fired so far
+ * @slots: Timer lists, TIMER_WHEEL_SLOTS per level
+ *
+ * Level 0 holds the timers of the next 64 ticks, one slot per tick.
+ * Each higher level slot covers 64 slots of the level below and is
+ * spread over it when the lower level wraps around. Every tick then
+ * fires the whole level 0 slot as one batch. A wheel has no lock:
+ * its timers are armed, cancelled and fired on the thread ticking it.
+ */
+typedef struct {
+    uint32_t now;
+    uint32_t ticks_per_ms;
+    uint64_t expired;
+    timer_node_t *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} timer_wheel_t;
+
+/**
+ * timer_wheel_init - Set up an empty wheel
+ * @wheel: Wheel to initialize
+ * @now: Current tick
+ * @ticks_per_ms: Slots per millisecond, at least 1
+ *
+ * Timers still armed on a previous use of @wheel must have been
+ * cancelled.
+ */
+void timer_wheel_init(timer_wheel_t *wheel, uint32_t now, uint32_t ticks_per_ms);
+
+/**
+ * timer_get_wheel - Access the wheel shared by all L2 protocol timers
+ *
+ * Counts 1 ms slots (numerology 0) unless re-initialized.
+ *
+ * Return: Pointer to the global wheel
+ */
+timer_wheel_t *timer_get_wheel(void);
+
+/**
+ * timer_wheel_tick - Advance the wheel by one slot
+ * @wheel: Wheel
+ *
+ * Fires every timer due at the new tick, in one batch.
+ *
+ * Return: Number of timers fired
+ */
+size_t timer_wheel_tick(timer_wheel_t *wheel);
+
+/**
+ * timer_wheel_advance - Advance the wheel up to a tick
+ * @wheel: Wheel
+ * @now: Tick to reach (ignored if not ahead of the wheel)
+ *
+ * Return: Number of timers fired
+ */
+size_t timer_wheel_advance(timer_wheel_t *wheel, uint32_t now);
+
+/**
+ * timer_init - Prepare an embedded timer
+ * @node: Timer node
+ * @cb: Expiry handler
+ */
+static inline void timer_init(timer_node_t *node, timer_cb_t cb) {
+    node->next = NULL;
+    node->pprev = NULL;
+    node->expiry = 0;
+    node->cb = cb;
+}
+
+/**
+ * timer_armed - Check whether a timer is running
+ * @node: Timer node
+ *
+ * Return: Non-zero while armed
+ */
+static inline int timer_armed(const timer_node_t *node) {
+    return node->pprev != NULL;
+}
+
+/**
+ * timer_cancel - Stop a timer
+ * @node: Timer node (disarmed timers are left alone)
+ */
+static inline void timer_cancel(timer_node_t *node) {
+    if (!node->pprev) return;
+    *node->pprev = node->next;
+    if (node->next)
+        node->next->pprev = node->pprev;
+    node->next = NULL;
+    node->pprev = NULL;
+}
+
+/**
+ * timer_arm - Start or restart a timer
+ * @wheel: Wheel
+ * @node: Timer node (cancelled first if armed)
+ * @ticks: Ticks until expiry; 0 fires on the next tick
+ */
+void timer_arm(timer_wheel_t *wheel, timer_node_t *node, uint32_t ticks);
+
+/**
+ * timer_ms - Convert a protocol timer duration to ticks
+ * @wheel: Wheel
+ * @ms: Duration in ms
+ *
+ * Return: Number of slots in @ms
+ */
+static inline uint32_t timer_ms(const timer_wheel_t *wheel, uint32_t ms) {
+    return ms * wheel->ticks_per_ms;
+}
+
+/**
+ * timer_now - Current tick of a wheel
+ * @wheel: Wheel
+ *
+ * Return: Last tick processed
+ */
+static inline uint32_t timer_now(const timer_wheel_t *wheel) {
+    return wheel->now;
+}
+
+#endif /* TIMER_H */